@@ -104,6 +104,9 @@ namespace NativeJIT
         Not,
         Or,
         Pop,
+        Popcnt,
+        PrefetchNta,    // Memory operand only. The size is ignored.
+        PrefetchT0,     // Memory operand only. The size is ignored.
         Push,
         Rep,
         Ret,
@@ -419,6 +422,12 @@ namespace NativeJIT
                          Register<SIZE, false> dest,
                          Register<SIZE, false> bit);
 
+        // Emits 0F 18 /hint, where hint 0 is prefetchnta and hint 1 is
+        // prefetcht0.
+        void Prefetch(uint8_t hint,
+                      Register<8u, false> base,
+                      int32_t offset);
+
 
         // Methods for emitting the 0x66 operand size override prefix if
         // size of either operand is 16-bit. Note: for indirect addressing, the
@@ -2011,7 +2020,16 @@ namespace NativeJIT
                                        Register<SIZE, false> bit)
     {
         EmitOpSizeOverride(Register<SIZE, false>(0));
-        if (opcode == 0xbc || opcode == 0xbd)
+        if (opcode == 0xb8)
+        {
+            // Popcnt requires the F3 prefix, which must precede REX.
+            Emit8(0xf3);
+            EmitRex<SIZE, false>(dest, bit);
+            Emit8(0x0f);
+            Emit8(opcode);
+            EmitModRM(dest, bit);
+        }
+        else if (opcode == 0xbc || opcode == 0xbd)
         {
             EmitRex<SIZE, false>(dest, bit);
             Emit8(0x0f);
@@ -2271,6 +2289,18 @@ namespace NativeJIT
     }
 
 
+    template <>
+    template <>
+    template <unsigned SIZE>
+    void X64CodeGenerator::Helper<OpCode::Popcnt>::ArgTypes1<false>::Emit(
+        X64CodeGenerator& code,
+        Register<SIZE, false> dest,
+        Register<SIZE, false> src)
+    {
+        code.GroupBitOps(0xb8, dest, src);
+    }
+
+
     template <>
     template <>
     template <unsigned SIZE>
@@ -2423,6 +2453,36 @@ namespace NativeJIT
     }
 
 
+    //
+    // PrefetchNta
+    //
+
+    template <>
+    template <unsigned SIZE>
+    void X64CodeGenerator::Helper<OpCode::PrefetchNta>::ArgTypes0::Emit(
+        X64CodeGenerator& code,
+        Register<8u, false> base,
+        int32_t offset)
+    {
+        code.Prefetch(0, base, offset);
+    }
+
+
+    //
+    // PrefetchT0
+    //
+
+    template <>
+    template <unsigned SIZE>
+    void X64CodeGenerator::Helper<OpCode::PrefetchT0>::ArgTypes0::Emit(
+        X64CodeGenerator& code,
+        Register<8u, false> base,
+        int32_t offset)
+    {
+        code.Prefetch(1, base, offset);
+    }
+
+
     //
     // Lea
     //
@@ -148,6 +148,9 @@ namespace NativeJIT
             "not",
             "or",
             "pop",
+            "popcnt",
+            "prefetchnta",
+            "prefetcht0",
             "push",
             "rep",
             "ret",
@@ -248,6 +251,21 @@ namespace NativeJIT
     }
 
 
+    void X64CodeGenerator::Prefetch(uint8_t hint,
+                                    Register<8u, false> base,
+                                    int32_t offset)
+    {
+        // Prefetches have no operand size, so only REX.B may be needed.
+        if (base.IsExtended())
+        {
+            Emit8(0x41);
+        }
+        Emit8(0x0f);
+        Emit8(0x18);
+        EmitModRMOffset(Register<8u, false>(hint), base, offset);
+    }
+
+
     void X64CodeGenerator::Ret()
     {
         Emit8(0xc3);
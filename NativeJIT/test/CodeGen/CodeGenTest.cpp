@@ -71,6 +71,12 @@ namespace NativeJIT
             buffer.Emit<OpCode::Btc>(bx, dx);
             buffer.Emit<OpCode::Btr>(esi, edi);
             buffer.Emit<OpCode::Bts>(r8d, r12d);
+            buffer.Emit<OpCode::Popcnt>(rax, r14);
+            buffer.Emit<OpCode::Popcnt>(r13d, ecx);
+
+            // Prefetch
+            buffer.Emit<OpCode::PrefetchT0, 8>(rax, 0x40);
+            buffer.Emit<OpCode::PrefetchNta, 8>(r12, 0x1234);
 
             // rep stosq
             buffer.Emit<OpCode::Rep>();
@@ -749,6 +755,13 @@ namespace NativeJIT
                 " 00000057  66| 0F BB D3         btc bx, dx                                                         \n"
                 " 0000005B  0F B3 FE             btr esi, edi                                                       \n"
                 " 0000005E  45/ 0F AB E0         bts r8d, r12d                                                      \n"
+                " 00000062  F3/ 49/ 0F B8 C6     popcnt rax, r14                                                    \n"
+                " 00000067  F3/ 44/ 0F B8 E9     popcnt r13d, ecx                                                   \n"
+
+                // Prefetch
+                " 0000006C  0F 18 48 40          prefetcht0 byte ptr [rax + 40h]                                    \n"
+                " 00000070  41/ 0F 18 84 24      prefetchnta byte ptr [r12 + 1234h]                                 \n"
+                "           00001234                                                                                \n"
 
                 // Rep Stosq
                 " 0000004C  F3/ 48/ AB           rep stosq                                                          \n"
@@ -109,13 +109,16 @@ namespace BitFunnel
         // by a shard number.  The returned FileDescriptor1 objects provide
         // methods to generate the file names and open the files.
         virtual FileDescriptor1 Chunk(size_t number) = 0;
+        virtual FileDescriptor1 CoOccurrenceTable(size_t shard) = 0;
         virtual FileDescriptor1 Correlate(size_t shard) = 0;
         virtual FileDescriptor1 CumulativeTermCounts(size_t shard) = 0;
         virtual FileDescriptor1 DocFreqTable(size_t shard) = 0;
+        virtual FileDescriptor1 DocFreqTableBounds(size_t shard) = 0;
         virtual FileDescriptor1 IndexedIdfTable(size_t shard) = 0;
         //virtual FileDescriptor1 DocTable(size_t shard) = 0;
         //virtual FileDescriptor1 ScoreTable(size_t shard) = 0;
         virtual FileDescriptor1 RowDensities(size_t shard) = 0;
+        virtual FileDescriptor1 RowDensityTable(size_t shard) = 0;
         virtual FileDescriptor1 TermTable(size_t shard) = 0;
         virtual FileDescriptor1 TermTableStatistics(size_t shard) = 0;
 
@@ -34,6 +34,7 @@
 namespace BitFunnel
 {
     class IChunkManifestIngestor;
+    class ICoOccurrenceTable;
     class IConfiguration;
     class IDocument;
     class IDocumentDataSchema;
@@ -44,7 +45,9 @@ namespace BitFunnel
     class IFileSystem;
     class IIndexedIdfTable;
     class IIngestor;
+    class IQueryShardCostFunction;
     class IRecycler;
+    class IRowDensityTable;
     class IShardCostFunction;
     class IShardDefinition;
     class ISimpleIndex;
@@ -61,11 +64,21 @@ namespace BitFunnel
     namespace Factories
     {
         void AnalyzeRowTables(ISimpleIndex const & index,
-                              char const * outDir);
+                              char const * outDir,
+                              size_t threadCount);
 
+        // Loads sketches previously written by ICoOccurrenceTable::Write().
+        std::unique_ptr<ICoOccurrenceTable>
+            CreateCoOccurrenceTable(std::istream& input);
+
+        // Writes the terms that share more than one row in each shard. If
+        // topPairCount is not zero, writes only the topPairCount pairs that
+        // share the most rows.
         void CreateCorrelate(ISimpleIndex const & index,
                              char const * outDir,
-                             std::vector<std::string> const & terms);
+                             std::vector<std::string> const & terms,
+                             size_t threadCount,
+                             size_t topPairCount);
 
         std::unique_ptr<IConfiguration>
             CreateConfiguration(size_t maxGramSize,
@@ -75,6 +88,8 @@ namespace BitFunnel
 
         std::unique_ptr<IDocumentDataSchema> CreateDocumentDataSchema();
 
+        std::unique_ptr<IDocumentFrequencyTable>
+            CreateDocumentFrequencyTable();
         std::unique_ptr<IDocumentFrequencyTable>
             CreateDocumentFrequencyTable(std::istream& input);
 
@@ -93,21 +108,57 @@ namespace BitFunnel
             CreateIndexedIdfTable(std::istream& input,
                                   Term::IdfX10 defaultIdf);
 
+        // A statisticsOnly IIngestor gathers corpus statistics without
+        // setting row bits. It adds only the documents whose DocId hashes
+        // into the first sampleFraction of the hash range.
+        // expectedTermCounts holds the expected number of distinct terms in
+        // each shard, which sizes the shard's term presence filter. Shards
+        // without an entry, or with an entry of zero, use a default size.
+        // If collectCoOccurrences is true, the statistics include the
+        // term co-occurrence sketches used by the TermTableBuilder.
         std::unique_ptr<IIngestor>
             CreateIngestor(IDocumentDataSchema const & docDataSchema,
                            IRecycler& recycler,
                            ITermTableCollection const & termTables,
                            IShardDefinition const & shardDefinition,
-                           ISliceBufferAllocator& sliceBufferAllocator);
+                           ISliceBufferAllocator& sliceBufferAllocator,
+                           bool statisticsOnly = false,
+                           double sampleFraction = 1.0,
+                           std::vector<size_t> const & expectedTermCounts =
+                               std::vector<size_t>(),
+                           bool collectCoOccurrences = false);
 
         std::unique_ptr<IRecycler> CreateRecycler();
 
+        // Measures the density of every row in every shard of an index.
+        std::unique_ptr<IRowDensityTable>
+            CreateRowDensityTable(ISimpleIndex const & index);
+
+        // Loads densities previously written by IRowDensityTable::Write().
+        std::unique_ptr<IRowDensityTable>
+            CreateRowDensityTable(IFileManager & fileManager,
+                                  ShardId shardCount);
+
         std::unique_ptr<IShardCostFunction>
             CreateShardCostFunction(IDocumentHistogram const & histogram,
                                     double shardOverhead,
                                     size_t minShardCapacity,
                                     Rank maxRankInUse);
 
+        // Returns a cost function that models the bits scanned by queries
+        // that look up each term in queryTerms as often as its frequency.
+        // Term densities in each shard are estimated from their corpus
+        // frequencies in terms.
+        std::unique_ptr<IQueryShardCostFunction>
+            CreateQueryShardCostFunction(IDocumentHistogram const & histogram,
+                                         IDocumentFrequencyTable const & terms,
+                                         IDocumentFrequencyTable const & queryTerms,
+                                         double density,
+                                         double snr,
+                                         double shardOverhead,
+                                         size_t minShardCapacity,
+                                         Rank maxRankInUse);
+
         std::unique_ptr<ISimpleIndex> CreateSimpleIndex(IFileSystem& fileSystem);
 
         std::unique_ptr<ISliceBufferAllocator>
@@ -124,6 +175,20 @@ namespace BitFunnel
                                    IFactSet const & facts,
                                    ITermTable & termTable);
 
+        // When coOccurrences is not nullptr, the builder avoids packing
+        // terms that often appear in the same documents into the same
+        // shared row. When explicitTerms is not nullptr, its terms are
+        // given explicit rows even if they are rarer than adhocFrequency.
+        std::unique_ptr<ITermTableBuilder>
+            CreateTermTableBuilder(double density,
+                                   double adhocFrequency,
+                                   ITermTreatment const & treatment,
+                                   IDocumentFrequencyTable const & terms,
+                                   IFactSet const & facts,
+                                   ITermTable & termTable,
+                                   ICoOccurrenceTable const * coOccurrences,
+                                   IDocumentFrequencyTable const * explicitTerms = nullptr);
+
         std::unique_ptr<ITermTableCollection>
             CreateTermTableCollection();
         std::unique_ptr<ITermTableCollection>
@@ -0,0 +1,63 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <iosfwd>                       // std::ostream parameter.
+
+#include "BitFunnel/IInterface.h"       // Base class.
+#include "BitFunnel/Term.h"             // Term::Hash parameter.
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // ICoOccurrenceTable
+    //
+    // Abstract base class or interface for classes that estimate how often
+    // pairs of terms appear in the same document. Each term is summarized
+    // by a small MinHash sketch of the documents that contain it, so joint
+    // frequencies are estimates. The estimates are most accurate for terms
+    // with similar frequencies.
+    //
+    //*************************************************************************
+    class ICoOccurrenceTable : public IInterface
+    {
+    public:
+        // Returns true if the table has a sketch for the term.
+        virtual bool Contains(Term::Hash term) const = 0;
+
+        // Returns the fraction of documents that contain the term, or 0.0
+        // if the table has no sketch for the term.
+        virtual double GetFrequency(Term::Hash term) const = 0;
+
+        // Returns the estimated fraction of documents that contain both
+        // terms, or 0.0 if the table has no sketch for either term.
+        virtual double GetJointFrequency(Term::Hash a,
+                                         Term::Hash b) const = 0;
+
+        // Writes the table in the binary format read by
+        // Factories::CreateCoOccurrenceTable().
+        virtual void Write(std::ostream& output) const = 0;
+    };
+}
@@ -76,6 +76,7 @@ namespace BitFunnel
         //      CumulativeTermCountd
         //      DocumentFrequencyTable (with term text if termToText provided)
         //      IndexedIdfTable
+        //      CoOccurrenceTable
         virtual void WriteStatistics(IFileManager & fileManager,
                                      ITermToText const * termToText) const = 0;
 
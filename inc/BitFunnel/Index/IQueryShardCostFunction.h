@@ -0,0 +1,54 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#pragma once
+
+#include "BitFunnel/Index/IShardCostFunction.h"     // Base class.
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // IQueryShardCostFunction is an abstract base class or interface for
+    // IShardCostFunctions whose cost combines the expected number of bits
+    // a query scans in a shard with the shard's row table memory. GetCost()
+    // returns GetScanCost() + weight * GetMemoryCost(), where the weight is
+    // set with SetMemoryWeight(). ShardDefinitionBuilder adjusts the weight
+    // to find the shards that scan the fewest bits within a memory budget.
+    //
+    //*************************************************************************
+    class IQueryShardCostFunction : public IShardCostFunction
+    {
+    public:
+        // Sets the weight of a byte of row table memory relative to a bit
+        // scanned per query.
+        virtual void SetMemoryWeight(double weight) = 0;
+
+        // Returns the expected number of bits a query scans in the shard
+        // specified by StartAt() and Extend().
+        virtual double GetScanCost() const = 0;
+
+        // Returns the number of bytes of row table memory used by the shard
+        // specified by StartAt() and Extend().
+        virtual double GetMemoryCost() const = 0;
+    };
+}
@@ -0,0 +1,59 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include "BitFunnel/BitFunnelTypes.h"   // ShardId parameter.
+#include "BitFunnel/IInterface.h"       // Base class.
+#include "BitFunnel/Index/RowId.h"      // RowId parameter.
+
+
+namespace BitFunnel
+{
+    class IFileManager;
+
+    //*************************************************************************
+    //
+    // IRowDensityTable
+    //
+    // Records, for each shard, the fraction of active documents that have
+    // their bit set in each row. The query planner uses these densities to
+    // evaluate the most selective rows first.
+    //
+    // Densities are measured from an index with ingested documents and
+    // persisted with one RowDensityTable file per shard. A serving index
+    // loads these files at startup.
+    //
+    //*************************************************************************
+    class IRowDensityTable : public IInterface
+    {
+    public:
+        // Writes one RowDensityTable file for each shard.
+        virtual void Write(IFileManager & fileManager) const = 0;
+
+        virtual ShardId GetShardCount() const = 0;
+
+        // Returns the density of a row in a shard. Returns 1.0 for rows
+        // beyond the range of the table, which have not been measured.
+        virtual double GetDensity(ShardId shard, RowId row) const = 0;
+    };
+}
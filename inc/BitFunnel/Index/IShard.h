@@ -34,6 +34,7 @@ namespace BitFunnel
 {
     class IFileManager;
     class ITermToText;
+    class Term;
 
     class IShard : public IInterface
     {
@@ -56,6 +57,15 @@ namespace BitFunnel
         // Returns the offset of the row in the slice buffer in a shard.
         virtual ptrdiff_t GetRowOffset(RowId rowId) const = 0;
 
+        // Returns the offset of the row's summary quadword in the slice
+        // buffer in a shard. See Row::GetSummaryBlockShift().
+        virtual ptrdiff_t GetRowSummaryOffset(RowId rowId) const = 0;
+
+        // Returns false if no document in the shard contains term. May
+        // return true for terms that are absent. Used by the query planner
+        // to skip shards that cannot match.
+        virtual bool MayContainTerm(Term const & term) const = 0;
+
         virtual void TemporaryWriteDocumentFrequencyTable(
             std::ostream& out,
             ITermToText const * termToText) const = 0;
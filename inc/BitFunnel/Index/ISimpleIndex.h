@@ -38,6 +38,7 @@ namespace BitFunnel
     class IIndexedIdfTable;
     class IIngestor;
     class IRecycler;
+    class IRowDensityTable;
     class IShardDefinition;
     class ISliceBufferAllocator;
     class ITermTable;
@@ -91,9 +92,22 @@ namespace BitFunnel
         virtual void SetTermTableCollection(
             std::unique_ptr<ITermTableCollection> termTables) = 0;
 
+        // Unlike the other setters, SetRowDensityTable() may be called after
+        // StartIndex(), since densities are typically measured from an index
+        // that already contains documents. It must not be called while
+        // queries are being processed.
+        virtual void SetRowDensityTable(
+            std::unique_ptr<IRowDensityTable> densities) = 0;
+
+        // Configures an index that gathers corpus statistics without setting
+        // row bits. Only the documents whose DocId hashes into the first
+        // sampleFraction of the hash range are ingested. Term co-occurrence
+        // sketches are only gathered if collectCoOccurrences is true.
         virtual void ConfigureForStatistics(char const * directory,
                                             size_t gramSize,
-                                            bool generateTermToText) = 0;
+                                            bool generateTermToText,
+                                            double sampleFraction = 1.0,
+                                            bool collectCoOccurrences = false) = 0;
 
         virtual void ConfigureForServing(char const * directory,
                                          size_t gramSize,
@@ -137,5 +151,8 @@ namespace BitFunnel
         // system.
         virtual ITermTable const & GetTermTable0() const = 0;
         virtual ITermTable const & GetTermTable(ShardId shardId) const = 0;
+
+        // Returns nullptr if row densities are not available.
+        virtual IRowDensityTable const * GetRowDensityTable() const = 0;
     };
 }
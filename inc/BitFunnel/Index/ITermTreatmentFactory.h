@@ -31,6 +31,7 @@
 
 namespace BitFunnel
 {
+    class IDocumentFrequencyTable;
     class ITermTreatment;
 
     //*************************************************************************
@@ -51,5 +52,16 @@ namespace BitFunnel
             CreateTreatment(char const * name,
                             double density,
                             double snr) const = 0;
+
+        // Creates a treatment that may also take into account how often
+        // terms appear in queries. The frequency of each entry in queryTerms
+        // is the fraction of queries containing the term. Treatments that
+        // require query term frequencies throw a RecoverableError if
+        // queryTerms is nullptr. Other treatments ignore it.
+        virtual std::unique_ptr<ITermTreatment>
+            CreateTreatment(char const * name,
+                            double density,
+                            double snr,
+                            IDocumentFrequencyTable const * queryTerms) const = 0;
     };
 }
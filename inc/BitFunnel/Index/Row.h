@@ -69,6 +69,19 @@ namespace BitFunnel
         static DocIndex DocumentsInRank0Row(DocIndex documentCount,
                                             Rank maxRank);
 
+        // Each row in a slice has a summary quadword. Bit b of the summary is
+        // set when some document in the b-th block of consecutive documents
+        // may have a bit set in the row. The block size is the smallest
+        // power of two that lets 64 blocks cover the slice capacity. This
+        // method returns log2 of the number of documents in a block.
+        static unsigned GetSummaryBlockShift(DocIndex capacity);
+
+        // Returns the summary bits for the blocks that overlap the range of
+        // 2^log2DocumentCount documents starting at firstDocument.
+        static uint64_t GetSummaryMask(DocIndex firstDocument,
+                                       unsigned log2DocumentCount,
+                                       unsigned blockShift);
+
     private:
         // Pointer to the actual row data.
         uint64_t const * m_data;
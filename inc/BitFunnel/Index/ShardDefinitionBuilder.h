@@ -27,6 +27,7 @@
 namespace BitFunnel
 {
     class IDocumentHistogram;
+    class IQueryShardCostFunction;
     class IShardCostFunction;
     class IShardDefinition;
 
@@ -47,5 +48,23 @@ namespace BitFunnel
         std::unique_ptr<IShardDefinition const> CreateShardDefinition(
             IShardCostFunction& costFunction,
             size_t maxShardCount);
+
+        //*********************************************************************
+        //
+        // Constructs the shard definition that minimizes the scan cost of an
+        // IQueryShardCostFunction, subject to the total memory cost of the
+        // shards being at most memoryBudget bytes.
+        //
+        // The budget is enforced by Lagrangian relaxation. The shards that
+        // minimize scan cost plus weight times memory cost are found for a
+        // sequence of memory weights, searching for the smallest weight whose
+        // shards fit in the budget. Throws RecoverableError if no weight
+        // yields shards that fit.
+        //
+        //*********************************************************************
+        std::unique_ptr<IShardDefinition const> CreateShardDefinition(
+            IQueryShardCostFunction& costFunction,
+            size_t maxShardCount,
+            double memoryBudget);
     };
 }
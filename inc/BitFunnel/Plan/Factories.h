@@ -32,7 +32,9 @@
 namespace BitFunnel
 {
     class IAllocator;
+    class IConfiguration;
     class IDiagnosticStream;
+    class IDocumentFrequencyTable;
     class IInputStream;
     class IMatchVerifier;
     class IPlanRows;
@@ -48,6 +50,14 @@ namespace BitFunnel
     {
         std::unique_ptr<IMatchVerifier> CreateMatchVerifier(std::string query);
 
+        // Returns a table whose entries give the fraction of queries that
+        // look up each term. Throws QueryParser::ParseError if a query
+        // cannot be parsed.
+        std::unique_ptr<IDocumentFrequencyTable>
+            CreateQueryTermFrequencyTable(
+                IConfiguration const & configuration,
+                std::vector<std::string> const & queries);
+
         IPlanRows& CreatePlanRows(IInputStream& input,
                                   const ISimpleIndex& index,
                                   IAllocator& allocator);
@@ -22,9 +22,11 @@
 
 #pragma once
 
-#include <ostream>                          // std::ostream methods inlined.
+#include <ostream>                                  // std::ostream methods inlined.
+#include <string.h>                                 // memcpy() inlined.
 
-#include "BitFunnel/Utilities/Stopwatch.h"  // Stopwatch embedded.
+#include "BitFunnel/Utilities/HardwareCounters.h"   // HardwareCounters::Values embedded.
+#include "BitFunnel/Utilities/Stopwatch.h"          // Stopwatch embedded.
 
 
 namespace CsvTsv
@@ -40,6 +42,30 @@ namespace BitFunnel
     public:
         class Data;
 
+        // Phases of query processing to which hardware counter events are
+        // attributed. Compile covers code generation, and is only separated
+        // from Plan when StartCompiling() is called.
+        enum Phase
+        {
+            Parse,
+            Plan,
+            Compile,
+            Match,
+            PhaseCount
+        };
+
+        inline QueryInstrumentation()
+          : m_counters(nullptr),
+            m_isCompiling(false),
+            m_matchingFinished(0.0)
+        {
+        }
+
+        // Attributes the events counted by counters, which must be open on
+        // the calling thread, to the phases of this query. Should be called
+        // before parsing starts.
+        void EnableHardwareCounters(HardwareCounters const & counters);
+
         inline void SetMatchCount(size_t matchCount)
         {
             m_data.m_matchCount = matchCount;
@@ -65,19 +91,69 @@ namespace BitFunnel
             m_data.m_cacheLineCount += amount;
         }
 
+        // Records that matching stopped early because the query was
+        // cancelled or ran past its deadline, so the match count only
+        // covers part of the index.
+        inline void SetTruncated()
+        {
+            m_data.m_truncated = true;
+        }
+
+        // Records the time the query spent in an admission queue before
+        // parsing started. It is reported separately from, and not included
+        // in, the parsing, planning and matching times.
+        inline void SetQueueTime(double queueTime)
+        {
+            m_data.m_queueTime = queueTime;
+        }
+
         inline void FinishParsing()
         {
             m_data.m_parsingTime = m_stopwatch.ElapsedTime();
+            if (m_counters != nullptr)
+            {
+                RecordCounters(Parse);
+            }
+        }
+
+        // Marks the end of the Plan phase and the start of the Compile
+        // phase for hardware counters. The planning time still includes
+        // compilation.
+        inline void StartCompiling()
+        {
+            if (m_counters != nullptr)
+            {
+                RecordCounters(Plan);
+            }
+            m_isCompiling = true;
         }
 
         inline void FinishPlanning()
         {
             m_data.m_planningTime = m_stopwatch.ElapsedTime() - m_data.m_parsingTime;
+            if (m_counters != nullptr)
+            {
+                RecordCounters(m_isCompiling ? Compile : Plan);
+            }
         }
 
         inline void FinishMatching()
         {
-            m_data.m_matchingTime = m_stopwatch.ElapsedTime() - m_data.m_planningTime;
+            m_matchingFinished = m_stopwatch.ElapsedTime();
+            m_data.m_matchingTime = m_matchingFinished - m_data.m_planningTime;
+            if (m_counters != nullptr)
+            {
+                RecordCounters(Match);
+            }
+        }
+
+        // Records the time spent after FinishMatching() estimating the cache
+        // lines accessed by native code. It is not included in the matching
+        // time.
+        inline void FinishEstimatingCacheLines()
+        {
+            m_data.m_cacheLineEstimationTime =
+                m_stopwatch.ElapsedTime() - m_matchingFinished;
         }
 
         inline Data & GetData()
@@ -93,10 +169,14 @@ namespace BitFunnel
                 m_matchCount(0ull),
                 m_quadwordCount(0ull),
                 m_cacheLineCount(0ll),
+                m_queueTime(0.0),
                 m_parsingTime(0.0),
                 m_planningTime(0.0),
-                m_matchingTime(0.0)
+                m_matchingTime(0.0),
+                m_cacheLineEstimationTime(0.0),
+                m_truncated(false)
             {
+                memset(m_hardwareCounts, 0, sizeof(m_hardwareCounts));
             }
 
             Data & operator=(Data const & other)
@@ -105,9 +185,15 @@ namespace BitFunnel
                 m_matchCount = other.m_matchCount;
                 m_quadwordCount = other.m_quadwordCount;
                 m_cacheLineCount = other.m_cacheLineCount;
+                m_queueTime = other.m_queueTime;
                 m_parsingTime = other.m_parsingTime;
                 m_planningTime = other.m_planningTime;
                 m_matchingTime = other.m_matchingTime;
+                m_cacheLineEstimationTime = other.m_cacheLineEstimationTime;
+                m_truncated = other.m_truncated;
+                memcpy(m_hardwareCounts,
+                       other.m_hardwareCounts,
+                       sizeof(m_hardwareCounts));
                 return *this;
             }
 
@@ -131,6 +217,11 @@ namespace BitFunnel
                 return m_cacheLineCount;
             }
 
+            inline double GetQueueTime()
+            {
+                return m_queueTime;
+            }
+
             inline double GetParsingTime()
             {
                 return m_parsingTime;
@@ -146,8 +237,31 @@ namespace BitFunnel
                 return m_matchingTime;
             }
 
-            static void FormatHeader(CsvTsv::CsvTableFormatter & formatter);
-            void Format(CsvTsv::CsvTableFormatter & formatter) const;
+            inline double GetCacheLineEstimationTime()
+            {
+                return m_cacheLineEstimationTime;
+            }
+
+            inline bool IsTruncated()
+            {
+                return m_truncated;
+            }
+
+            // Returns the number of times the event occurred during the
+            // phase, or zero if hardware counters were not enabled.
+            inline uint64_t GetHardwareCount(Phase phase,
+                                             HardwareCounters::Event event)
+            {
+                return m_hardwareCounts[phase][event];
+            }
+
+            // The <phase>_<event> hardware counter columns are only written
+            // if hardwareCounts is true, which it should be when
+            // EnableHardwareCounters() was called.
+            static void FormatHeader(CsvTsv::CsvTableFormatter & formatter,
+                                     bool hardwareCounts = false);
+            void Format(CsvTsv::CsvTableFormatter & formatter,
+                        bool hardwareCounts = false) const;
 
         private:
             friend class QueryInstrumentation;
@@ -156,13 +270,25 @@ namespace BitFunnel
             size_t m_matchCount;
             size_t m_quadwordCount;
             size_t m_cacheLineCount;
+            double m_queueTime;
             double m_parsingTime;
             double m_planningTime;
             double m_matchingTime;
+            double m_cacheLineEstimationTime;
+            bool m_truncated;
+            HardwareCounters::Values m_hardwareCounts[PhaseCount];
         };
 
     private:
+        // Adds the events counted since the last call to the phase.
+        void RecordCounters(Phase phase);
+
         Stopwatch m_stopwatch;
         Data m_data;
+
+        HardwareCounters const * m_counters;
+        HardwareCounters::Sample m_lastSample;
+        bool m_isCompiling;
+        double m_matchingFinished;
     };
 }
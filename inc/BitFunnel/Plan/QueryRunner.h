@@ -22,8 +22,13 @@
 
 #pragma once
 
+#include <iosfwd>       // std::ostream parameter.
+#include <string>       // std::string template parameter.
 #include <vector>       // std::vector parameter
 
+#include "BitFunnel/Plan/QueryInstrumentation.h"    // QueryInstrumentation::Data return value.
+#include "BitFunnel/Utilities/LatencyHistogram.h"   // LatencyHistogram member.
+
 
 namespace BitFunnel
 {
@@ -38,11 +43,14 @@ namespace BitFunnel
             Statistics(size_t threadCount,
                        size_t uniqueQueryCount,
                        size_t processedCount,
+                       size_t truncatedCount,
                        size_t matchCount,
                        double elapsedTime,
                        double parsingTime,
                        double planningTime,
-                       double matchingTime);
+                       double matchingTime,
+                       double queueingTime,
+                       LatencyHistogram const & latencies);
 
             void Print(std::ostream& out) const;
 
@@ -50,19 +58,79 @@ namespace BitFunnel
             const size_t m_threadCount;
             const size_t m_uniqueQueryCount;
             size_t m_processedCount;
+            size_t m_truncatedCount;
             size_t m_matchCount;
             double m_elapsedTime;
             double m_parsingLatency;
             double m_planningLatency;
             double m_matchingLatency;
+            double m_queueingLatency;
+
+            // End-to-end latencies of the queries processed, and the counts
+            // of queries rejected or shed.
+            LatencyHistogram m_latencies;
+        };
+
+
+        // Controls how Run() admits queries to its threads. The defaults
+        // submit every query, in order, as fast as threads become available:
+        // each query is submitted once a thread is free to run it.
+        class SchedulerOptions
+        {
+        public:
+            SchedulerOptions();
+
+            // Maximum number of queries waiting for a thread. Zero means
+            // that the queue is unbounded. Only limits open-loop arrivals,
+            // since closed-loop submission never queues more queries than
+            // there are threads.
+            size_t m_queueCapacity;
+
+            // Queries outside priority class 0 that wait longer than this
+            // many seconds for a thread are shed. Zero disables shedding.
+            double m_targetQueueDelay;
+
+            // Seconds that each query may run, from the start of planning,
+            // before it stops matching and reports the matches found so far
+            // as truncated. Zero disables the deadline.
+            double m_deadline;
+
+            // Queries per second at which queries are submitted. When zero,
+            // and m_arrivalTimes is empty, queries are submitted closed loop,
+            // as threads become free. Otherwise queries are submitted on an
+            // open-loop schedule, and rejected if the queue is full when
+            // they arrive.
+            double m_arrivalRate;
+
+            // When true, the intervals between arrivals are exponentially
+            // distributed with mean 1 / m_arrivalRate, rather than fixed.
+            bool m_poissonArrivals;
+
+            // Seed for the Poisson arrival process.
+            unsigned m_seed;
+
+            // Recorded arrival time, in seconds, of each query. Either
+            // empty or one entry per query, in nondecreasing order. The
+            // recording is replayed once per iteration. If m_arrivalRate is
+            // non-zero, the recording is stretched or compressed to that
+            // average rate.
+            std::vector<double> m_arrivalTimes;
+
+            // Priority class of each query, with 0 being the highest. Either
+            // empty, which puts every query in class 0, or one entry per
+            // query.
+            std::vector<unsigned> m_priorities;
         };
 
 
+        // Cache lines are counted in every cacheLineSamplePeriod-th slice,
+        // and scaled up to estimate the total. Zero disables counting.
         static QueryInstrumentation::Data Run(
             char const * query,
             ISimpleIndex const & index,
             bool useNativeCode,
-            bool countCacheLines);
+            size_t cacheLineSamplePeriod,
+            bool countHardwareEvents = false);
 
         static Statistics Run(ISimpleIndex const & index,
                               char const * outputDir,
@@ -70,6 +138,25 @@ namespace BitFunnel
                               std::vector<std::string> const & queries,
                               size_t iterations,
                               bool useNativeCode,
-                              bool countCacheLines);
+                              size_t cacheLineSamplePeriod,
+                              bool countHardwareEvents = false,
+                              SchedulerOptions const & options = SchedulerOptions());
+
+        // Matches each query repetitions times on the calling thread with
+        // each of QueryPlanner's matchers (the ByteCodeInterpreter, native
+        // code, and native code with PrecompiledKernels) and writes one CSV
+        // row per query and matcher to out, with the match count and the
+        // mean planning and matching times. Planning time includes native
+        // code generation, so the rows show whether a matcher's compile
+        // cost is repaid by its matching time.
+        //
+        // If sweepLoopOptions is true, the rows are instead native code
+        // with each combination of prefetch distance and prefetch hint, for
+        // tuning QueryResources on a given machine.
+        static void CompareMatchers(ISimpleIndex const & index,
+                                    std::vector<std::string> const & queries,
+                                    size_t repetitions,
+                                    bool sweepLoopOptions,
+                                    std::ostream & out);
     };
 }
@@ -0,0 +1,122 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>                 // uint64_t parameter.
+
+#include "BitFunnel/NonCopyable.h"  // Inherits from NonCopyable.
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // HardwareCounters
+    //
+    // Reads CPU performance monitoring counters for the calling thread. On
+    // Linux, the counters are opened with perf_event_open() as a single
+    // group, so they are scheduled onto the PMU together and read with one
+    // system call. When the kernel multiplexes the group with other events,
+    // the counts are scaled by the fraction of time the group was running.
+    // To measure an interval, take a Sample at each end and pass both to
+    // Difference(), which scales the interval's own counts by the fraction
+    // of the interval the group was running.
+    // Events that the platform, kernel or perf_event_paranoid setting do
+    // not allow are left out of the group and read as zero.
+    //
+    // The counters count events on the thread that called Open(). Like the
+    // thread itself, a HardwareCounters is not threadsafe.
+    //
+    //*************************************************************************
+    class HardwareCounters : NonCopyable
+    {
+    public:
+        enum Event
+        {
+            Instructions,
+            Cycles,
+            BranchMisses,
+            LLCMisses,
+            DTLBMisses,
+            EventCount
+        };
+
+        typedef uint64_t Values[EventCount];
+
+        // Unscaled counts, and the total time the group had been enabled
+        // and running in nanoseconds, as of one read of the group.
+        class Sample
+        {
+        public:
+            Values m_counts;
+            uint64_t m_timeEnabled;
+            uint64_t m_timeRunning;
+        };
+
+        HardwareCounters();
+        ~HardwareCounters();
+
+        // Opens and starts the counters for the calling thread. Returns
+        // false, and leaves the counters closed, if no event is available.
+        // Has no effect if the counters are already open.
+        bool Open();
+
+        // Returns true if Open() succeeded.
+        bool IsOpen() const;
+
+        bool IsAvailable(Event event) const;
+
+        // Stores the current value of each counter in values, scaled for
+        // multiplexing. Unavailable events, and all events if the counters
+        // are not open, are reported as zero.
+        void Read(Values & values) const;
+
+        // Stores the current unscaled value of each counter, and the group's
+        // times, in sample. Unavailable events, and everything if the
+        // counters are not open, are reported as zero.
+        void Read(Sample & sample) const;
+
+        // Stores in values the events counted between two samples, scaled
+        // by the fraction of the interval the group was running. A count
+        // that did not advance, or an interval in which the group never
+        // ran, is reported as zero.
+        static void Difference(Sample const & start,
+                               Sample const & end,
+                               Values & values);
+
+        // Returns a short lowercase name for the event, suitable for a
+        // column header.
+        static char const * GetName(Event event);
+
+    private:
+        // File descriptor of each event, or -1 if it is unavailable. The
+        // first available event is the group leader.
+        int m_files[EventCount];
+
+        // Position of each available event in the values read from the
+        // group leader.
+        unsigned m_groupIndex[EventCount];
+
+        unsigned m_groupSize;
+    };
+}
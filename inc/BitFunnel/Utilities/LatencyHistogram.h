@@ -0,0 +1,94 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <stddef.h>     // size_t return value.
+#include <stdint.h>     // uint64_t parameter.
+#include <vector>       // std::vector embedded.
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // LatencyHistogram
+    //
+    // Records durations in a log-bucketed histogram in the style of
+    // HdrHistogram. Durations are rounded to whole nanoseconds. Each power
+    // of two is divided into 2^subBucketBits linear sub-buckets, so the
+    // percentiles returned by GetPercentile() are within a relative error
+    // of 2^-subBucketBits of the exact value, while memory use is fixed
+    // and independent of the number or range of values recorded.
+    //
+    // LatencyHistogram is not threadsafe. Threads should record into their
+    // own histograms and Merge() them afterwards.
+    //
+    //*************************************************************************
+    class LatencyHistogram
+    {
+    public:
+        LatencyHistogram(unsigned subBucketBits = 7);
+
+        // Records a duration, in seconds. Negative durations are recorded
+        // as zero.
+        void Record(double seconds);
+
+        // Counts requests that were rejected on arrival or shed before
+        // they ran, and so have no duration. They are counted separately
+        // from the recorded durations, which alone determine the
+        // percentiles.
+        void RecordRejected(size_t count = 1);
+        void RecordShed(size_t count = 1);
+
+        // Adds the values and counts recorded in other, which must have the
+        // same number of sub-bucket bits.
+        void Merge(LatencyHistogram const & other);
+
+        // Returns the number of durations recorded.
+        size_t GetCount() const;
+
+        size_t GetRejectedCount() const;
+        size_t GetShedCount() const;
+
+        // Returns the largest value recorded, in seconds.
+        double GetMax() const;
+
+        // Returns a value, in seconds, that is greater than or equal to the
+        // specified percentage of the recorded values, which must be between
+        // 0 and 100. Returns 0 if no values have been recorded.
+        double GetPercentile(double percentile) const;
+
+    private:
+        size_t GetBucket(uint64_t nanoseconds) const;
+
+        // Returns the largest value that maps to the specified bucket.
+        uint64_t GetUpperBound(size_t bucket) const;
+
+        const unsigned m_subBucketBits;
+        std::vector<size_t> m_counts;
+        size_t m_count;
+        size_t m_rejectedCount;
+        size_t m_shedCount;
+        uint64_t m_max;
+    };
+}
@@ -62,6 +62,10 @@ namespace BitFunnel
                                      statisticsDirectory,
                                      "ColumnDensitySummary",
                                      ".txt")),
+          m_coOccurrenceTable(new ParameterizedFile1(fileSystem,
+                                                     statisticsDirectory,
+                                                     "CoOccurrenceTable",
+                                                     ".bin")),
           m_correlate(new ParameterizedFile1(fileSystem,
                                              statisticsDirectory,
                                              "Correlate",
@@ -73,6 +77,10 @@ namespace BitFunnel
           m_docFreqTable(new ParameterizedFile1(fileSystem,
                                                 statisticsDirectory,
                                                 "DocFreqTable", ".csv")),
+          m_docFreqTableBounds(new ParameterizedFile1(fileSystem,
+                                                      statisticsDirectory,
+                                                      "DocFreqTableBounds",
+                                                      ".csv")),
           m_documentHistogram(new ParameterizedFile0(fileSystem,
                                                      statisticsDirectory,
                                                      "DocumentHistogram",
@@ -103,6 +111,11 @@ namespace BitFunnel
                                      statisticsDirectory,
                                      "RowDensities",
                                      ".csv")),
+          m_rowDensityTable(
+              new ParameterizedFile1(fileSystem,
+                                     indexDirectory,
+                                     "RowDensityTable",
+                                     ".bin")),
           m_shardDefinition(
               new ParameterizedFile0(fileSystem,
                                      statisticsDirectory,
@@ -202,6 +215,12 @@ namespace BitFunnel
     }
 
 
+    FileDescriptor1 FileManager::CoOccurrenceTable(size_t shard)
+    {
+        return FileDescriptor1(*m_coOccurrenceTable, shard);
+    }
+
+
     FileDescriptor1 FileManager::Correlate(size_t shard)
     {
         return FileDescriptor1(*m_correlate, shard);
@@ -220,6 +239,12 @@ namespace BitFunnel
     }
 
 
+    FileDescriptor1 FileManager::DocFreqTableBounds(size_t shard)
+    {
+        return FileDescriptor1(*m_docFreqTableBounds, shard);
+    }
+
+
     FileDescriptor1 FileManager::IndexedIdfTable(size_t shard)
     {
         return FileDescriptor1(*m_indexedIdfTable, shard);
@@ -232,6 +257,12 @@ namespace BitFunnel
     }
 
 
+    FileDescriptor1 FileManager::RowDensityTable(size_t shard)
+    {
+        return FileDescriptor1(*m_rowDensityTable, shard);
+    }
+
+
     FileDescriptor1 FileManager::TermTable(size_t shard)
     {
         return FileDescriptor1(*m_termTable, shard);
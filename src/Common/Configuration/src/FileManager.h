@@ -75,13 +75,16 @@ namespace BitFunnel
         virtual FileDescriptor0 VerificationResults() override;
 
         virtual FileDescriptor1 Chunk(size_t number) override;
+        virtual FileDescriptor1 CoOccurrenceTable(size_t shard) override;
         virtual FileDescriptor1 Correlate(size_t shard) override;
         virtual FileDescriptor1 CumulativeTermCounts(size_t shard) override;
         virtual FileDescriptor1 DocFreqTable(size_t shard) override;
+        virtual FileDescriptor1 DocFreqTableBounds(size_t shard) override;
         virtual FileDescriptor1 IndexedIdfTable(size_t shard) override;
         //virtual FileDescriptor1 DocTable(size_t shard) override;
         //virtual FileDescriptor1 ScoreTable(size_t shard) override;
         virtual FileDescriptor1 RowDensities(size_t shard) override;
+        virtual FileDescriptor1 RowDensityTable(size_t shard) override;
         virtual FileDescriptor1 TermTable(size_t shard) override;
         virtual FileDescriptor1 TermTableStatistics(size_t shard) override;
 
@@ -91,9 +94,11 @@ namespace BitFunnel
         std::unique_ptr<IParameterizedFile1> m_chunk;
         std::unique_ptr<IParameterizedFile0> m_columnDensities;
         std::unique_ptr<IParameterizedFile0> m_columnDensitySummary;
+        std::unique_ptr<IParameterizedFile1> m_coOccurrenceTable;
         std::unique_ptr<IParameterizedFile1> m_correlate;
         std::unique_ptr<IParameterizedFile1> m_cumulativeTermCounts;
         std::unique_ptr<IParameterizedFile1> m_docFreqTable;
+        std::unique_ptr<IParameterizedFile1> m_docFreqTableBounds;
         std::unique_ptr<IParameterizedFile0> m_documentHistogram;
         std::unique_ptr<IParameterizedFile1> m_indexedIdfTable;
         std::unique_ptr<IParameterizedFile2> m_indexSlice;
@@ -102,6 +107,7 @@ namespace BitFunnel
         std::unique_ptr<IParameterizedFile0> m_queryPipelineStatistics;
         std::unique_ptr<IParameterizedFile0> m_querySummaryStatistics;
         std::unique_ptr<IParameterizedFile1> m_rowDensities;
+        std::unique_ptr<IParameterizedFile1> m_rowDensityTable;
         std::unique_ptr<IParameterizedFile0> m_shardDefinition;
         std::unique_ptr<IParameterizedFile1> m_termTable;
         std::unique_ptr<IParameterizedFile1> m_termTableStatistics;
@@ -0,0 +1,273 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+#include "BitFunnel/Exceptions.h"
+#include "BitFunnel/Utilities/HardwareCounters.h"
+
+
+namespace BitFunnel
+{
+#ifdef __linux__
+    // Opens an event for the calling thread, as a new group leader if
+    // groupFile is -1, or as a member of groupFile's group otherwise.
+    static int OpenEvent(uint32_t type, uint64_t config, int groupFile)
+    {
+        perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.type = type;
+        attributes.size = sizeof(attributes);
+        attributes.config = config;
+        attributes.read_format = PERF_FORMAT_GROUP |
+                                 PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                 PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // The leader starts disabled so that every member of the group
+        // starts counting at the same time.
+        attributes.disabled = (groupFile == -1) ? 1 : 0;
+
+        // Only count user-mode events, which unprivileged processes are
+        // allowed to do under the default perf_event_paranoid setting.
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        // Count events on the calling thread, on any CPU.
+        return static_cast<int>(
+            syscall(__NR_perf_event_open, &attributes, 0, -1, groupFile, 0));
+    }
+
+
+    static uint64_t CacheMissConfig(uint64_t cache)
+    {
+        return cache |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+#endif
+
+
+    HardwareCounters::HardwareCounters()
+      : m_groupSize(0)
+    {
+        for (unsigned i = 0; i < EventCount; ++i)
+        {
+            m_files[i] = -1;
+            m_groupIndex[i] = 0;
+        }
+    }
+
+
+    HardwareCounters::~HardwareCounters()
+    {
+#ifdef __linux__
+        for (unsigned i = 0; i < EventCount; ++i)
+        {
+            if (m_files[i] >= 0)
+            {
+                close(m_files[i]);
+            }
+        }
+#endif
+    }
+
+
+    bool HardwareCounters::Open()
+    {
+#ifdef __linux__
+        if (m_groupSize == 0)
+        {
+            const struct
+            {
+                uint32_t m_type;
+                uint64_t m_config;
+            } events[EventCount] = {
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+                { PERF_TYPE_HW_CACHE, CacheMissConfig(PERF_COUNT_HW_CACHE_LL) },
+                { PERF_TYPE_HW_CACHE, CacheMissConfig(PERF_COUNT_HW_CACHE_DTLB) }
+            };
+
+            int leader = -1;
+            for (unsigned i = 0; i < EventCount; ++i)
+            {
+                m_files[i] = OpenEvent(events[i].m_type, events[i].m_config, leader);
+                if (m_files[i] >= 0)
+                {
+                    if (leader == -1)
+                    {
+                        leader = m_files[i];
+                    }
+                    m_groupIndex[i] = m_groupSize++;
+                }
+            }
+
+            if (leader >= 0)
+            {
+                ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+        }
+#endif
+
+        return IsOpen();
+    }
+
+
+    bool HardwareCounters::IsOpen() const
+    {
+        return m_groupSize > 0;
+    }
+
+
+    bool HardwareCounters::IsAvailable(Event event) const
+    {
+        return m_files[event] >= 0;
+    }
+
+
+    void HardwareCounters::Read(Values & values) const
+    {
+        Sample start;
+        memset(&start, 0, sizeof(start));
+
+        Sample end;
+        Read(end);
+
+        Difference(start, end, values);
+    }
+
+
+    void HardwareCounters::Read(Sample & sample) const
+    {
+        memset(&sample, 0, sizeof(sample));
+
+#ifdef __linux__
+        if (!IsOpen())
+        {
+            return;
+        }
+
+        // Layout of a PERF_FORMAT_GROUP read with both total times.
+        struct
+        {
+            uint64_t m_count;
+            uint64_t m_timeEnabled;
+            uint64_t m_timeRunning;
+            uint64_t m_values[EventCount];
+        } group;
+
+        int leader = -1;
+        for (unsigned i = 0; i < EventCount && leader == -1; ++i)
+        {
+            leader = m_files[i];
+        }
+
+        const ssize_t expected =
+            static_cast<ssize_t>((3 + m_groupSize) * sizeof(uint64_t));
+        if (read(leader, &group, sizeof(group)) != expected)
+        {
+            return;
+        }
+
+        sample.m_timeEnabled = group.m_timeEnabled;
+        sample.m_timeRunning = group.m_timeRunning;
+        for (unsigned i = 0; i < EventCount; ++i)
+        {
+            if (m_files[i] >= 0)
+            {
+                sample.m_counts[i] = group.m_values[m_groupIndex[i]];
+            }
+        }
+#endif
+    }
+
+
+    // static
+    void HardwareCounters::Difference(Sample const & start,
+                                      Sample const & end,
+                                      Values & values)
+    {
+        const uint64_t enabled =
+            (end.m_timeEnabled > start.m_timeEnabled) ?
+            end.m_timeEnabled - start.m_timeEnabled : 0;
+        const uint64_t running =
+            (end.m_timeRunning > start.m_timeRunning) ?
+            end.m_timeRunning - start.m_timeRunning : 0;
+
+        // Extrapolate to the whole interval the group was enabled if it only
+        // ran for part of it.
+        const double scale = (running == 0) ?
+            0.0 :
+            static_cast<double>(enabled) / static_cast<double>(running);
+
+        for (unsigned i = 0; i < EventCount; ++i)
+        {
+            const uint64_t count =
+                (end.m_counts[i] > start.m_counts[i]) ?
+                end.m_counts[i] - start.m_counts[i] : 0;
+
+            if (running == 0)
+            {
+                values[i] = 0;
+            }
+            else if (running == enabled)
+            {
+                values[i] = count;
+            }
+            else
+            {
+                values[i] =
+                    static_cast<uint64_t>(static_cast<double>(count) * scale);
+            }
+        }
+    }
+
+
+    // static
+    char const * HardwareCounters::GetName(Event event)
+    {
+        switch (event)
+        {
+        case Instructions:
+            return "instructions";
+        case Cycles:
+            return "cycles";
+        case BranchMisses:
+            return "branchmisses";
+        case LLCMisses:
+            return "llcmisses";
+        case DTLBMisses:
+            return "dtlbmisses";
+        default:
+            throw FatalError("HardwareCounters::GetName: unknown event.");
+        }
+    }
+}
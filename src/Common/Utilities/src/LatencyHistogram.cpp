@@ -0,0 +1,184 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+
+#include "BitFunnel/Utilities/LatencyHistogram.h"
+#include "LoggerInterfaces/Check.h"
+
+
+namespace BitFunnel
+{
+    // Returns the position of the most significant bit in value, which must
+    // not be zero.
+    static unsigned HighestBit(uint64_t value)
+    {
+        unsigned bit = 0;
+        while (value >>= 1)
+        {
+            ++bit;
+        }
+        return bit;
+    }
+
+
+    LatencyHistogram::LatencyHistogram(unsigned subBucketBits)
+      : m_subBucketBits(subBucketBits),
+        m_count(0),
+        m_rejectedCount(0),
+        m_shedCount(0),
+        m_max(0)
+    {
+        CHECK_LE(subBucketBits, 16u)
+            << "Too many sub-bucket bits.";
+
+        // Values below 2^subBucketBits each have their own bucket. Each
+        // larger power of two up to 2^63 has 2^subBucketBits buckets.
+        m_counts.resize((64 - subBucketBits + 1) << subBucketBits, 0);
+    }
+
+
+    void LatencyHistogram::Record(double seconds)
+    {
+        const uint64_t nanoseconds = (seconds > 0.0) ?
+            static_cast<uint64_t>(std::llround(seconds * 1e9)) :
+            0;
+        ++m_counts[GetBucket(nanoseconds)];
+        ++m_count;
+        m_max = (std::max)(m_max, nanoseconds);
+    }
+
+
+    void LatencyHistogram::RecordRejected(size_t count)
+    {
+        m_rejectedCount += count;
+    }
+
+
+    void LatencyHistogram::RecordShed(size_t count)
+    {
+        m_shedCount += count;
+    }
+
+
+    void LatencyHistogram::Merge(LatencyHistogram const & other)
+    {
+        CHECK_EQ(m_subBucketBits, other.m_subBucketBits)
+            << "Histograms must have the same precision.";
+
+        for (size_t i = 0; i < m_counts.size(); ++i)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_count += other.m_count;
+        m_rejectedCount += other.m_rejectedCount;
+        m_shedCount += other.m_shedCount;
+        m_max = (std::max)(m_max, other.m_max);
+    }
+
+
+    size_t LatencyHistogram::GetCount() const
+    {
+        return m_count;
+    }
+
+
+    size_t LatencyHistogram::GetRejectedCount() const
+    {
+        return m_rejectedCount;
+    }
+
+
+    size_t LatencyHistogram::GetShedCount() const
+    {
+        return m_shedCount;
+    }
+
+
+    double LatencyHistogram::GetMax() const
+    {
+        return static_cast<double>(m_max) * 1e-9;
+    }
+
+
+    double LatencyHistogram::GetPercentile(double percentile) const
+    {
+        CHECK_GE(percentile, 0.0);
+        CHECK_LE(percentile, 100.0);
+
+        if (m_count == 0)
+        {
+            return 0.0;
+        }
+
+        // Number of values that must be less than or equal to the result.
+        const size_t rank = (std::max)(
+            static_cast<size_t>(1),
+            static_cast<size_t>(std::ceil(percentile / 100.0 * m_count)));
+
+        size_t seen = 0;
+        for (size_t bucket = 0; bucket < m_counts.size(); ++bucket)
+        {
+            seen += m_counts[bucket];
+            if (seen >= rank)
+            {
+                const uint64_t value = (std::min)(GetUpperBound(bucket), m_max);
+                return static_cast<double>(value) * 1e-9;
+            }
+        }
+
+        return GetMax();
+    }
+
+
+    size_t LatencyHistogram::GetBucket(uint64_t nanoseconds) const
+    {
+        const uint64_t subBucketCount = 1ull << m_subBucketBits;
+        if (nanoseconds < subBucketCount)
+        {
+            return static_cast<size_t>(nanoseconds);
+        }
+
+        // Keep the top m_subBucketBits + 1 bits of the value. The leading
+        // one selects the power of two and the rest select the sub-bucket.
+        const unsigned shift = HighestBit(nanoseconds) - m_subBucketBits;
+        const uint64_t mantissa = nanoseconds >> shift;
+        return static_cast<size_t>(((shift + 1) << m_subBucketBits) +
+                                   (mantissa - subBucketCount));
+    }
+
+
+    uint64_t LatencyHistogram::GetUpperBound(size_t bucket) const
+    {
+        const uint64_t subBucketCount = 1ull << m_subBucketBits;
+        if (bucket < subBucketCount)
+        {
+            return bucket;
+        }
+
+        const unsigned shift =
+            static_cast<unsigned>(bucket >> m_subBucketBits) - 1;
+        const uint64_t mantissa = subBucketCount + (bucket & (subBucketCount - 1));
+        return ((mantissa + 1) << shift) - 1;
+    }
+}
@@ -82,4 +82,36 @@ namespace BitFunnel
 
         return RoundUp<size_t>(documentCount, rowQuanta);
     }
+
+
+    unsigned Row::GetSummaryBlockShift(DocIndex capacity)
+    {
+        // Blocks are never smaller than a quadword.
+        unsigned shift = 6;
+        while ((capacity + (1ull << shift) - 1) >> shift > 64)
+        {
+            ++shift;
+        }
+        return shift;
+    }
+
+
+    uint64_t Row::GetSummaryMask(DocIndex firstDocument,
+                                 unsigned log2DocumentCount,
+                                 unsigned blockShift)
+    {
+        const size_t firstBlock = firstDocument >> blockShift;
+        if (log2DocumentCount <= blockShift)
+        {
+            // The range lies within a single block.
+            return 1ull << firstBlock;
+        }
+
+        const unsigned blockCount = 1u << (log2DocumentCount - blockShift);
+        if (blockCount >= 64)
+        {
+            return ~0ull;
+        }
+        return ((1ull << blockCount) - 1) << firstBlock;
+    }
 }
@@ -0,0 +1,141 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Utilities/HardwareCounters.h"
+
+
+namespace BitFunnel
+{
+    namespace HardwareCountersTest
+    {
+        TEST(HardwareCounters, Names)
+        {
+            EXPECT_EQ(std::string("instructions"),
+                      HardwareCounters::GetName(HardwareCounters::Instructions));
+            EXPECT_EQ(std::string("llcmisses"),
+                      HardwareCounters::GetName(HardwareCounters::LLCMisses));
+        }
+
+
+        // Counters may be unavailable on this machine, in which case Open()
+        // must fail and every event must read as zero.
+        TEST(HardwareCounters, Read)
+        {
+            HardwareCounters counters;
+            EXPECT_FALSE(counters.IsOpen());
+            const bool isOpen = counters.Open();
+            EXPECT_EQ(isOpen, counters.IsOpen());
+
+            bool anyAvailable = false;
+            for (unsigned i = 0; i < HardwareCounters::EventCount; ++i)
+            {
+                anyAvailable |=
+                    counters.IsAvailable(static_cast<HardwareCounters::Event>(i));
+            }
+            EXPECT_EQ(isOpen, anyAvailable);
+
+            HardwareCounters::Values before;
+            counters.Read(before);
+
+            volatile uint64_t sum = 0;
+            for (uint64_t i = 0; i < 100000; ++i)
+            {
+                sum = sum + i;
+            }
+
+            HardwareCounters::Values after;
+            counters.Read(after);
+
+            for (unsigned i = 0; i < HardwareCounters::EventCount; ++i)
+            {
+                auto event = static_cast<HardwareCounters::Event>(i);
+                if (counters.IsAvailable(event))
+                {
+                    EXPECT_GE(after[i], before[i]);
+                }
+                else
+                {
+                    EXPECT_EQ(0u, before[i]);
+                    EXPECT_EQ(0u, after[i]);
+                }
+            }
+
+            if (counters.IsAvailable(HardwareCounters::Instructions))
+            {
+                EXPECT_GT(after[HardwareCounters::Instructions],
+                          before[HardwareCounters::Instructions] + 100000);
+            }
+        }
+
+
+        // Each interval is scaled by its own fraction of running time, and
+        // a count that went backwards, which scaling cumulative counts can
+        // produce, is reported as zero rather than wrapping around.
+        TEST(HardwareCounters, Difference)
+        {
+            HardwareCounters::Sample start;
+            HardwareCounters::Sample end;
+            for (unsigned i = 0; i < HardwareCounters::EventCount; ++i)
+            {
+                start.m_counts[i] = 1000;
+                end.m_counts[i] = 1000 + 100 * i;
+            }
+            end.m_counts[HardwareCounters::Instructions] = 999;
+
+            // The group ran for the whole interval.
+            start.m_timeEnabled = 100;
+            start.m_timeRunning = 50;
+            end.m_timeEnabled = 200;
+            end.m_timeRunning = 150;
+
+            HardwareCounters::Values values;
+            HardwareCounters::Difference(start, end, values);
+            EXPECT_EQ(0u, values[HardwareCounters::Instructions]);
+            for (unsigned i = 1; i < HardwareCounters::EventCount; ++i)
+            {
+                EXPECT_EQ(100u * i, values[i]);
+            }
+
+            // The group ran for a quarter of the interval.
+            end.m_timeEnabled = 500;
+            end.m_timeRunning = 150;
+            HardwareCounters::Difference(start, end, values);
+            EXPECT_EQ(0u, values[HardwareCounters::Instructions]);
+            for (unsigned i = 1; i < HardwareCounters::EventCount; ++i)
+            {
+                EXPECT_EQ(400u * i, values[i]);
+            }
+
+            // The group never ran.
+            end.m_timeRunning = 50;
+            HardwareCounters::Difference(start, end, values);
+            for (unsigned i = 0; i < HardwareCounters::EventCount; ++i)
+            {
+                EXPECT_EQ(0u, values[i]);
+            }
+        }
+    }
+}
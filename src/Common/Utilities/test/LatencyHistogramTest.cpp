@@ -0,0 +1,134 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Utilities/LatencyHistogram.h"
+
+
+namespace BitFunnel
+{
+    namespace LatencyHistogramTest
+    {
+        TEST(LatencyHistogram, Empty)
+        {
+            LatencyHistogram histogram;
+            EXPECT_EQ(0u, histogram.GetCount());
+            EXPECT_EQ(0.0, histogram.GetMax());
+            EXPECT_EQ(0.0, histogram.GetPercentile(50.0));
+            EXPECT_EQ(0u, histogram.GetRejectedCount());
+            EXPECT_EQ(0u, histogram.GetShedCount());
+        }
+
+
+        TEST(LatencyHistogram, SmallValuesAreExact)
+        {
+            LatencyHistogram histogram(7);
+            for (unsigned ns = 1; ns <= 100; ++ns)
+            {
+                histogram.Record(ns * 1e-9);
+            }
+
+            EXPECT_EQ(100u, histogram.GetCount());
+            EXPECT_DOUBLE_EQ(50e-9, histogram.GetPercentile(50.0));
+            EXPECT_DOUBLE_EQ(99e-9, histogram.GetPercentile(99.0));
+            EXPECT_DOUBLE_EQ(100e-9, histogram.GetPercentile(100.0));
+            EXPECT_DOUBLE_EQ(1e-9, histogram.GetPercentile(0.0));
+        }
+
+
+        TEST(LatencyHistogram, RelativePrecision)
+        {
+            const unsigned subBucketBits = 7;
+            const double tolerance = 1.0 / (1u << subBucketBits);
+
+            // Values from 1us to 10s, spread logarithmically.
+            LatencyHistogram histogram(subBucketBits);
+            std::vector<double> values;
+            for (double value = 1e-6; value < 10.0; value *= 1.01)
+            {
+                values.push_back(value);
+                histogram.Record(value);
+            }
+            EXPECT_EQ(values.size(), histogram.GetCount());
+            EXPECT_NEAR(values.back(), histogram.GetMax(), 1e-9);
+
+            for (double percentile : { 10.0, 50.0, 90.0, 99.0, 99.9, 100.0 })
+            {
+                const size_t rank = static_cast<size_t>(
+                    std::ceil(percentile / 100.0 * values.size()));
+                const double exact = values[rank - 1];
+                const double estimate = histogram.GetPercentile(percentile);
+                EXPECT_GE(estimate, exact * (1.0 - 1e-9)) << percentile;
+                EXPECT_LE(estimate, exact * (1.0 + tolerance)) << percentile;
+            }
+        }
+
+
+        TEST(LatencyHistogram, Merge)
+        {
+            LatencyHistogram a;
+            LatencyHistogram b;
+            for (unsigned i = 0; i < 90; ++i)
+            {
+                a.Record(0.001);
+            }
+            for (unsigned i = 0; i < 10; ++i)
+            {
+                b.Record(1.0);
+            }
+            b.Record(-1.0);
+
+            a.Merge(b);
+            EXPECT_EQ(101u, a.GetCount());
+            EXPECT_NEAR(0.001, a.GetPercentile(50.0), 0.001 / 128);
+            EXPECT_NEAR(1.0, a.GetPercentile(99.0), 1.0 / 128);
+            EXPECT_DOUBLE_EQ(1.0, a.GetMax());
+        }
+
+
+        // Rejected and shed requests are counted, merged, and kept out of
+        // the percentiles.
+        TEST(LatencyHistogram, RejectedAndShed)
+        {
+            LatencyHistogram a;
+            LatencyHistogram b;
+            for (unsigned i = 0; i < 10; ++i)
+            {
+                a.Record(0.001);
+            }
+            a.RecordRejected();
+            a.RecordShed(2);
+            b.RecordRejected(3);
+            b.RecordShed();
+
+            a.Merge(b);
+            EXPECT_EQ(10u, a.GetCount());
+            EXPECT_EQ(4u, a.GetRejectedCount());
+            EXPECT_EQ(3u, a.GetShedCount());
+            EXPECT_NEAR(0.001, a.GetPercentile(100.0), 0.001 / 128);
+        }
+    }
+}
@@ -0,0 +1,255 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>                                // std::lower_bound().
+#include <istream>
+#include <ostream>
+
+#include "BitFunnel/Exceptions.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Utilities/StreamUtilities.h"
+#include "CoOccurrenceTable.h"
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // Factory methods.
+    //
+    //*************************************************************************
+    std::unique_ptr<ICoOccurrenceTable>
+        Factories::CreateCoOccurrenceTable(std::istream& input)
+    {
+        return std::unique_ptr<ICoOccurrenceTable>(
+            new CoOccurrenceTable(input));
+    }
+
+
+    //*************************************************************************
+    //
+    // CoOccurrenceTable::Sketch
+    //
+    //*************************************************************************
+    CoOccurrenceTable::Sketch::Sketch()
+      : m_size(0)
+    {
+    }
+
+
+    void CoOccurrenceTable::Sketch::Add(uint64_t documentHash)
+    {
+        if (m_size == c_sketchSize && documentHash >= m_hashes[m_size - 1])
+        {
+            return;
+        }
+
+        uint64_t * end = m_hashes + m_size;
+        uint64_t * it = std::lower_bound(m_hashes, end, documentHash);
+        if (it != end && *it == documentHash)
+        {
+            return;
+        }
+
+        // A full sketch drops its largest hash to make room.
+        if (m_size < c_sketchSize)
+        {
+            ++m_size;
+        }
+        else
+        {
+            --end;
+        }
+        std::copy_backward(it, end, end + 1);
+        *it = documentHash;
+    }
+
+
+    size_t CoOccurrenceTable::Sketch::size() const
+    {
+        return m_size;
+    }
+
+
+    uint64_t CoOccurrenceTable::Sketch::operator[](size_t index) const
+    {
+        return m_hashes[index];
+    }
+
+
+    bool CoOccurrenceTable::Sketch::operator==(Sketch const & other) const
+    {
+        return m_size == other.m_size &&
+            std::equal(m_hashes, m_hashes + m_size, other.m_hashes);
+    }
+
+
+    //*************************************************************************
+    //
+    // CoOccurrenceTable
+    //
+    //*************************************************************************
+    const size_t CoOccurrenceTable::c_sketchSize;
+
+
+    CoOccurrenceTable::CoOccurrenceTable()
+    {
+    }
+
+
+    CoOccurrenceTable::CoOccurrenceTable(std::istream& input)
+    {
+        // TODO: Use FileHeader and version.
+        const size_t count = StreamUtilities::ReadField<size_t>(input);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Term::Hash hash(StreamUtilities::ReadField<Term::Hash>(input));
+            const double frequency(StreamUtilities::ReadField<double>(input));
+
+            const size_t size = StreamUtilities::ReadField<size_t>(input);
+            if (size > c_sketchSize)
+            {
+                RecoverableError error("CoOccurrenceTable: sketch too large.");
+                throw error;
+            }
+
+            Sketch sketch;
+            for (size_t j = 0; j < size; ++j)
+            {
+                sketch.Add(StreamUtilities::ReadField<uint64_t>(input));
+            }
+            AddTerm(hash, frequency, sketch);
+        }
+    }
+
+
+    uint64_t CoOccurrenceTable::HashDocument(DocId id)
+    {
+        // DocIds are often sequential, so they are mixed with the SplitMix64
+        // finalizer to make the smallest hashes a uniform sample.
+        uint64_t h = id;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+
+
+    void CoOccurrenceTable::AddTerm(Term::Hash term,
+                                    double frequency,
+                                    Sketch const & sketch)
+    {
+        m_terms[term] = std::make_pair(frequency, sketch);
+    }
+
+
+    bool CoOccurrenceTable::Contains(Term::Hash term) const
+    {
+        return m_terms.find(term) != m_terms.end();
+    }
+
+
+    double CoOccurrenceTable::GetFrequency(Term::Hash term) const
+    {
+        auto it = m_terms.find(term);
+        return (it == m_terms.end()) ? 0.0 : it->second.first;
+    }
+
+
+    double CoOccurrenceTable::GetJointFrequency(Term::Hash a,
+                                                Term::Hash b) const
+    {
+        auto itA = m_terms.find(a);
+        auto itB = m_terms.find(b);
+        if (itA == m_terms.end() || itB == m_terms.end())
+        {
+            return 0.0;
+        }
+
+        const double fa = itA->second.first;
+        const double fb = itB->second.first;
+        if (a == b)
+        {
+            return fa;
+        }
+
+        // The c_sketchSize smallest hashes of the merged sketches are the
+        // sketch of the union of the two document sets. A hash in the
+        // union's sketch is in both sets exactly when it is in both
+        // sketches, so the fraction of such hashes estimates the Jaccard
+        // index of the two sets.
+        Sketch const & x = itA->second.second;
+        Sketch const & y = itB->second.second;
+        size_t i = 0;
+        size_t j = 0;
+        size_t unionCount = 0;
+        size_t intersectionCount = 0;
+        while (unionCount < c_sketchSize && (i < x.size() || j < y.size()))
+        {
+            if (j == y.size() || (i < x.size() && x[i] < y[j]))
+            {
+                ++i;
+            }
+            else if (i == x.size() || y[j] < x[i])
+            {
+                ++j;
+            }
+            else
+            {
+                ++intersectionCount;
+                ++i;
+                ++j;
+            }
+            ++unionCount;
+        }
+
+        if (intersectionCount == 0)
+        {
+            return 0.0;
+        }
+
+        // |A & B| = J * |A | B| = J * (|A| + |B|) / (1 + J).
+        const double jaccard =
+            static_cast<double>(intersectionCount) / unionCount;
+        const double joint = jaccard * (fa + fb) / (1.0 + jaccard);
+        return (std::min)(joint, (std::min)(fa, fb));
+    }
+
+
+    void CoOccurrenceTable::Write(std::ostream& output) const
+    {
+        // TODO: Use FileHeader and version.
+        StreamUtilities::WriteField<size_t>(output, m_terms.size());
+        for (auto const & term : m_terms)
+        {
+            StreamUtilities::WriteField<Term::Hash>(output, term.first);
+            StreamUtilities::WriteField<double>(output, term.second.first);
+
+            Sketch const & sketch = term.second.second;
+            StreamUtilities::WriteField<size_t>(output, sketch.size());
+            for (size_t i = 0; i < sketch.size(); ++i)
+            {
+                StreamUtilities::WriteField<uint64_t>(output, sketch[i]);
+            }
+        }
+    }
+}
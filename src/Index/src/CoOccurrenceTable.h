@@ -0,0 +1,103 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <iosfwd>                                   // std::istream parameter.
+#include <stdint.h>                                 // uint64_t template parameter.
+#include <unordered_map>                            // std::unordered_map member.
+#include <utility>                                  // std::pair member.
+
+#include "BitFunnel/BitFunnelTypes.h"               // DocId parameter.
+#include "BitFunnel/Index/ICoOccurrenceTable.h"     // Base class.
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // CoOccurrenceTable
+    //
+    // Summarizes the documents containing each term with a bottom-k MinHash
+    // sketch, the c_sketchSize smallest hashes of the DocIds of documents
+    // that contain the term. A term in fewer than c_sketchSize documents
+    // keeps all of its hashes, so joint frequencies of rare terms are exact.
+    //
+    // Sketches are gathered by DocumentFrequencyTableBuilder during the
+    // statistics pass and are used by TermTableBuilder to avoid packing
+    // correlated terms into the same shared row.
+    //
+    //*************************************************************************
+    class CoOccurrenceTable : public ICoOccurrenceTable
+    {
+    public:
+        static const size_t c_sketchSize = 32;
+
+        // Up to c_sketchSize document hashes in increasing order. The hashes
+        // are stored inline, so a sketch needs no allocation of its own.
+        class Sketch
+        {
+        public:
+            Sketch();
+
+            // Adds a document hash, keeping only the c_sketchSize smallest
+            // hashes.
+            void Add(uint64_t documentHash);
+
+            size_t size() const;
+            uint64_t operator[](size_t index) const;
+
+            bool operator==(Sketch const & other) const;
+
+        private:
+            uint64_t m_hashes[c_sketchSize];
+            size_t m_size;
+        };
+
+        // Constructs an empty CoOccurrenceTable.
+        CoOccurrenceTable();
+
+        // Constructs a CoOccurrenceTable from data previously persisted to a
+        // stream by Write().
+        CoOccurrenceTable(std::istream& input);
+
+        // Returns the hash used to represent a document in sketches.
+        static uint64_t HashDocument(DocId id);
+
+        // Records the frequency and sketch of a term. Does not guard against
+        // duplicate Term::Hash values.
+        void AddTerm(Term::Hash term, double frequency, Sketch const & sketch);
+
+        //
+        // ICoOccurrenceTable methods.
+        //
+        virtual bool Contains(Term::Hash term) const override;
+        virtual double GetFrequency(Term::Hash term) const override;
+        virtual double GetJointFrequency(Term::Hash a,
+                                         Term::Hash b) const override;
+        virtual void Write(std::ostream& output) const override;
+
+    private:
+        // Frequency and sketch for each term.
+        std::unordered_map<Term::Hash, std::pair<double, Sketch>> m_terms;
+    };
+}
@@ -20,30 +20,30 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
-
+#include <algorithm>                            // std::sort(), std::push_heap().
+#include <condition_variable>                   // std::condition_variable.
+#include <memory>                               // std::unique_ptr.
+#include <mutex>                                // std::lock_guard.
 #include <ostream>
-#include <unordered_map>                        // TODO: consider changing.
+#include <sstream>                              // std::stringstream.
+#include <unordered_map>
+#include <unordered_set>
 
 #include "BitFunnel/Configuration/Factories.h"
 #include "BitFunnel/Configuration/IFileSystem.h"
-#include "BitFunnel/Index/DocumentHandle.h"
+#include "BitFunnel/IFileManager.h"
 #include "BitFunnel/Index/Factories.h"
-#include "BitFunnel/Index/IDocument.h"
-#include "BitFunnel/Index/IDocumentCache.h"
-#include "BitFunnel/Index/IDocumentFrequencyTable.h"
 #include "BitFunnel/Index/IIngestor.h"
 #include "BitFunnel/Index/ISimpleIndex.h"
 #include "BitFunnel/Index/RowIdSequence.h"
-#include "BitFunnel/Index/Token.h"
+#include "BitFunnel/Term.h"
+#include "BitFunnel/Utilities/Factories.h"
+#include "BitFunnel/Utilities/ITaskDistributor.h"
+#include "BitFunnel/Utilities/ITaskProcessor.h"
 #include "Correlate.h"
 #include "CsvTsv/Csv.h"
-#include "DocumentHandleInternal.h"
 #include "LoggerInterfaces/Check.h"
 #include "NativeJIT/TypeConverter.h"
-#include "RowTableAnalyzer.h"
-#include "RowTableDescriptor.h"
-#include "Shard.h"
-#include "TermToText.h"
 
 
 // Define hash of RowId to allow use of map/set.
@@ -56,7 +56,9 @@ namespace std
         std::size_t operator()(BitFunnel::RowId const & row) const
         {
             // TODO: do we need to hash this?
-            return NativeJIT::convertType<BitFunnel::RowId, size_t>(row);
+            // RowId is 32 bits. Converting directly to size_t would pick up
+            // uninitialized bytes.
+            return NativeJIT::convertType<BitFunnel::RowId, uint32_t>(row);
         }
     };
 }
@@ -66,104 +68,548 @@ namespace BitFunnel
 {
     void Factories::CreateCorrelate(ISimpleIndex const & index,
                                     char const * outDir,
-                                    std::vector<std::string> const & terms)
+                                    std::vector<std::string> const & terms,
+                                    size_t threadCount,
+                                    size_t topPairCount)
     {
         char const end = '\0';     // TODO: Workaround for issue #386.
         CHECK_NE(*outDir, end)
             << "Output directory not set. ";
 
         Correlate correlate(index, terms);
-        correlate.CorrelateRows(outDir);
+        correlate.CorrelateRows(outDir, threadCount, topPairCount);
     }
 
 
-    Correlate::Correlate(ISimpleIndex const & index,
-                         std::vector<std::string> const & terms)
-        : m_index(index),
-          m_terms(terms)
+    //*************************************************************************
+    //
+    // CorrelateShard
+    //
+    // The rows of each distinct term in one shard, and the terms in each
+    // row. Terms are identified by their position in the list of distinct
+    // terms.
+    //
+    //*************************************************************************
+    class CorrelateShard
     {
-    }
+    public:
+        CorrelateShard(ISimpleIndex const & index,
+                       ShardId shard,
+                       std::vector<std::string> const & terms)
+        {
+            const Term::StreamId c_TODOStreamId = 0;
+
+            std::unordered_set<Term::Hash> hashes;
+            for (auto const & text : terms)
+            {
+                Term term(text.c_str(), c_TODOStreamId, index.GetConfiguration());
+                if (!hashes.insert(term.GetRawHash()).second)
+                {
+                    // Duplicate terms would collide with themselves.
+                    continue;
+                }
+
+                const uint32_t id = static_cast<uint32_t>(m_text.size());
+                m_text.push_back(&text);
+                m_termRows.push_back(std::vector<RowId>());
+
+                RowIdSequence rows(term, index.GetTermTable(shard));
+                for (RowId row : rows)
+                {
+                    m_termRows.back().push_back(row);
+                    m_rowTerms[row].push_back(id);
+                }
+            }
+        }
+
+
+        size_t GetTermCount() const
+        {
+            return m_text.size();
+        }
+
+
+        std::string const & GetText(uint32_t term) const
+        {
+            return *m_text[term];
+        }
+
+
+        // Adds the number of rows the term shares with each other term to
+        // counts, and appends each term that shares a row to partners. The
+        // caller must zero the entries of counts listed in partners before
+        // the next call.
+        void CountCollisions(uint32_t term,
+                             std::vector<uint32_t> & counts,
+                             std::vector<uint32_t> & partners) const
+        {
+            for (RowId row : m_termRows[term])
+            {
+                for (uint32_t other : m_rowTerms.find(row)->second)
+                {
+                    if (other != term && counts[other]++ == 0)
+                    {
+                        partners.push_back(other);
+                    }
+                }
+            }
+        }
+
+    private:
+        std::vector<std::string const *> m_text;
+        std::vector<std::vector<RowId>> m_termRows;
+        std::unordered_map<RowId, std::vector<uint32_t>> m_rowTerms;
+    };
+
+
+    //*************************************************************************
+    //
+    // CorrelateShardProcessor
+    //
+    // Builds the CorrelateShard for the shard with the same number as the
+    // task.
+    //
+    //*************************************************************************
+    class CorrelateShardProcessor : public ITaskProcessor
+    {
+    public:
+        CorrelateShardProcessor(ISimpleIndex const & index,
+                                std::vector<std::string> const & terms,
+                                std::vector<std::unique_ptr<CorrelateShard>> & shards)
+          : m_index(index),
+            m_terms(terms),
+            m_shards(shards)
+        {
+        }
+
+        //
+        // ITaskProcessor methods
+        //
+
+        virtual void ProcessTask(size_t taskId) override
+        {
+            m_shards[taskId].reset(
+                new CorrelateShard(m_index,
+                                   static_cast<ShardId>(taskId),
+                                   m_terms));
+        }
+
+        virtual void Finished() override
+        {
+        }
+
+    private:
+        ISimpleIndex const & m_index;
+        std::vector<std::string> const & m_terms;
+        std::vector<std::unique_ptr<CorrelateShard>> & m_shards;
+    };
 
 
-    void Correlate::CorrelateRows(char const * outDir) const
+    //*************************************************************************
+    //
+    // PartitionWriter
+    //
+    // Writes the output of one shard's partitions in partition order,
+    // whatever order the partitions finish in. Partitions are contiguous
+    // ranges of terms, so the output is in term order for any number of
+    // threads. Output for a partition that finishes early is held until
+    // the partitions before it have been written. At most window partitions
+    // are held at once, provided that each partition waits for its turn
+    // before it starts.
+    //
+    //*************************************************************************
+    class PartitionWriter
     {
-        auto & ingestor = m_index.GetIngestor();
+    public:
+        PartitionWriter(std::ostream& output,
+                        size_t partitionCount,
+                        size_t window)
+          : m_output(output),
+            m_window(window),
+            m_pending(partitionCount),
+            m_finished(partitionCount, false),
+            m_next(0)
+        {
+        }
+
+
+        // Blocks until partition is less than window partitions after the
+        // next partition to be written. Partitions must be started in order,
+        // so that the next partition to be written is always running.
+        void WaitForTurn(size_t partition)
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_turnCond.wait(lock, [&] {
+                return partition < m_next + m_window;
+            });
+        }
+
 
-        auto & fileManager = m_index.GetFileManager();
-        TermToText termToText(*fileManager.TermToText().OpenForRead());
-        for (ShardId shardId = 0; shardId < ingestor.GetShardCount(); ++shardId)
+        void Write(size_t partition, std::string const & text)
         {
-            auto fileSystem = Factories::CreateFileSystem();
-            auto outFileManager =
-                Factories::CreateFileManager(outDir,
-                                             outDir,
-                                             outDir,
-                                             *fileSystem);
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_pending[partition] = text;
+            m_finished[partition] = true;
+
+            const size_t next = m_next;
+            while (m_next < m_finished.size() && m_finished[m_next])
+            {
+                m_output << m_pending[m_next];
+                m_pending[m_next].clear();
+                m_pending[m_next].shrink_to_fit();
+                ++m_next;
+            }
 
-            CorrelateShard(shardId,
-                           termToText,
-                           *outFileManager->Correlate(shardId).OpenForWrite());
+            if (m_next != next)
+            {
+                m_turnCond.notify_all();
+            }
         }
-    }
+
+    private:
+        std::mutex m_lock;
+        std::condition_variable m_turnCond;
+        std::ostream& m_output;
+        const size_t m_window;
+        std::vector<std::string> m_pending;
+        std::vector<bool> m_finished;
+        size_t m_next;
+    };
 
 
-    void Correlate::CorrelateShard(ShardId const & shardId,
-                                   ITermToText const & termToText,
-                                   std::ostream& out) const
+    //*************************************************************************
+    //
+    // CorrelatePartitionProcessor
+    //
+    // Counts collisions for one partition of one shard's terms per task.
+    // Each partition covers termsPerPartition terms, and the tasks cover
+    // the partitions of shard 0, then shard 1, and so on, where shard s's
+    // first task is firstTasks[s]. Each partition's lines are passed to its
+    // shard's PartitionWriter when the partition is finished. In top pairs
+    // mode, each task keeps its own top pairs and merges them into its
+    // shard's top pairs when done.
+    //
+    //*************************************************************************
+    class CorrelatePartitionProcessor : public ITaskProcessor
     {
-        const Term::StreamId c_TODOStreamId = 0;
-        // TODO: this should be a vector instead of a set. That change shouldn't
-        // really affect running time much, though, since we that should be
-        // dominated by the later phases.
-        std::unordered_map<RowId, std::vector<Term::Hash>> rowIdToHash;
+    public:
+        // Two terms, with the lower numbered term first, and the number of
+        // rows they share.
+        struct Pair
+        {
+            uint32_t m_term;
+            uint32_t m_partner;
+            uint32_t m_sharedRows;
+        };
 
-        // auto & fileManager = m_index.GetFileManager();
-        for (auto const & termText : m_terms)
+        // Orders pairs by decreasing number of shared rows, then by term
+        // number. This is a total order, so the top pairs do not depend on
+        // the order in which they were found.
+        static bool IsBetter(Pair const & a, Pair const & b)
         {
-            Term term(termText.c_str(), c_TODOStreamId, m_index.GetConfiguration());
-            RowIdSequence rows(term, m_index.GetTermTable(shardId));
-            for (RowId row : rows)
+            if (a.m_sharedRows != b.m_sharedRows)
+            {
+                return a.m_sharedRows > b.m_sharedRows;
+            }
+            if (a.m_term != b.m_term)
             {
-                rowIdToHash[row].push_back(term.GetRawHash());
+                return a.m_term < b.m_term;
             }
+            return a.m_partner < b.m_partner;
         }
 
+        CorrelatePartitionProcessor(
+            std::vector<std::unique_ptr<CorrelateShard>> const & shards,
+            std::vector<size_t> const & firstTasks,
+            size_t termsPerPartition,
+            size_t topPairCount,
+            std::vector<std::unique_ptr<PartitionWriter>> & writers,
+            std::vector<std::vector<Pair>> & topPairs,
+            std::vector<std::mutex> & locks)
+          : m_shards(shards),
+            m_firstTasks(firstTasks),
+            m_termsPerPartition(termsPerPartition),
+            m_topPairCount(topPairCount),
+            m_writers(writers),
+            m_topPairs(topPairs),
+            m_locks(locks)
+        {
+        }
 
-        std::unordered_map<Term::Hash,
-                           std::unordered_map<Term::Hash, uint8_t>> collisions;
-        for (auto const & item : rowIdToHash)
+        //
+        // ITaskProcessor methods
+        //
+
+        virtual void ProcessTask(size_t taskId) override
         {
-            auto const & rowId = item.first;
-            auto const & hashes = rowIdToHash[rowId];
-            for (auto const & leftHash : hashes)
+            const size_t shard = static_cast<size_t>(
+                std::upper_bound(m_firstTasks.begin(), m_firstTasks.end(), taskId) -
+                m_firstTasks.begin() - 1);
+            const size_t partition = taskId - m_firstTasks[shard];
+
+            CorrelateShard const & terms = *m_shards[shard];
+            const size_t termCount = terms.GetTermCount();
+            const uint32_t start =
+                static_cast<uint32_t>(partition * m_termsPerPartition);
+            const uint32_t end = static_cast<uint32_t>(
+                (std::min)(termCount, (partition + 1) * m_termsPerPartition));
+
+            if (m_topPairCount == 0)
+            {
+                m_writers[shard]->WaitForTurn(partition);
+            }
+
+            // counts is sized for the largest shard seen by this thread and
+            // is left zeroed after each term.
+            if (m_counts.size() < termCount)
+            {
+                m_counts.resize(termCount, 0);
+            }
+
+            std::stringstream lines;
+            std::vector<Pair> topPairs;
+            for (uint32_t term = start; term < end; ++term)
             {
-                for (auto const & rightHash : hashes)
+                terms.CountCollisions(term, m_counts, m_partners);
+
+                if (m_partners.size() > 0)
                 {
-                    if (leftHash != rightHash)
+                    if (m_topPairCount == 0)
+                    {
+                        WriteTerm(terms, term, lines);
+                    }
+                    else
                     {
-                        ++collisions[leftHash][rightHash];
+                        AddTopPairs(term, topPairs);
                     }
                 }
+
+                for (auto partner : m_partners)
+                {
+                    m_counts[partner] = 0;
+                }
+                m_partners.clear();
+            }
+
+            if (m_topPairCount == 0)
+            {
+                m_writers[shard]->Write(partition, lines.str());
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(m_locks[shard]);
+                auto & shardPairs = m_topPairs[shard];
+                for (auto const & pair : topPairs)
+                {
+                    AddTopPair(pair, shardPairs);
+                }
             }
         }
 
-        CsvTsv::CsvTableFormatter formatter(out);
-        for (auto const & item : collisions)
+        virtual void Finished() override
+        {
+        }
+
+    private:
+        // Partners are listed in term order.
+        void WriteTerm(CorrelateShard const & terms,
+                       uint32_t term,
+                       std::ostream& output)
         {
-            auto const & leftHash = item.first;
-            // TODO: consider only writing out terms with collisions.
-            formatter.WriteField(termToText.Lookup(leftHash));
-            for (auto const & innerItem : item.second)
+            std::sort(m_partners.begin(), m_partners.end());
+
+            CsvTsv::CsvTableFormatter formatter(output);
+            formatter.WriteField(terms.GetText(term));
+            for (auto partner : m_partners)
             {
-                auto const & rightHash = innerItem.first;
-                const uint8_t numCollisions = innerItem.second;
-                if (numCollisions > 1)
+                // Every term is assigned more than one row, so sharing a
+                // single row is expected.
+                const uint32_t sharedRows = m_counts[partner];
+                if (sharedRows > 1)
                 {
-                    formatter.WriteField(termToText.Lookup(rightHash));
-                    formatter.WriteField(numCollisions);
+                    formatter.WriteField(terms.GetText(partner));
+                    formatter.WriteField(sharedRows);
                 }
             }
             formatter.WriteRowEnd();
         }
+
+
+        void AddTopPairs(uint32_t term, std::vector<Pair> & topPairs) const
+        {
+            for (auto partner : m_partners)
+            {
+                // Each pair is counted once, from its lower numbered term.
+                const uint32_t sharedRows = m_counts[partner];
+                if (partner > term && sharedRows > 1)
+                {
+                    AddTopPair(Pair { term, partner, sharedRows }, topPairs);
+                }
+            }
+        }
+
+
+        // topPairs is a heap with the worst pair at the front.
+        void AddTopPair(Pair const & pair, std::vector<Pair> & topPairs) const
+        {
+            if (topPairs.size() < m_topPairCount)
+            {
+                topPairs.push_back(pair);
+                std::push_heap(topPairs.begin(), topPairs.end(), IsBetter);
+            }
+            else if (IsBetter(pair, topPairs.front()))
+            {
+                std::pop_heap(topPairs.begin(), topPairs.end(), IsBetter);
+                topPairs.back() = pair;
+                std::push_heap(topPairs.begin(), topPairs.end(), IsBetter);
+            }
+        }
+
+
+        std::vector<std::unique_ptr<CorrelateShard>> const & m_shards;
+        std::vector<size_t> const & m_firstTasks;
+        const size_t m_termsPerPartition;
+        const size_t m_topPairCount;
+        std::vector<std::unique_ptr<PartitionWriter>> & m_writers;
+        std::vector<std::vector<Pair>> & m_topPairs;
+        std::vector<std::mutex> & m_locks;
+
+        // Per-thread scratch space for CorrelateShard::CountCollisions().
+        std::vector<uint32_t> m_counts;
+        std::vector<uint32_t> m_partners;
+    };
+
+
+    //*************************************************************************
+    //
+    // Correlate
+    //
+    //*************************************************************************
+    const size_t Correlate::c_defaultTermsPerPartition;
+
+
+    Correlate::Correlate(ISimpleIndex const & index,
+                         std::vector<std::string> const & terms,
+                         size_t termsPerPartition)
+        : m_index(index),
+          m_terms(terms),
+          m_termsPerPartition(termsPerPartition)
+    {
+        CHECK_GT(termsPerPartition, 0u)
+            << "Partitions must have at least one term.";
+    }
+
+
+    void Correlate::CorrelateRows(char const * outDir,
+                                  size_t threadCount,
+                                  size_t topPairCount) const
+    {
+        auto fileSystem = Factories::CreateFileSystem();
+        auto outFileManager =
+            Factories::CreateFileManager(outDir,
+                                         outDir,
+                                         outDir,
+                                         *fileSystem);
+
+        CorrelateRows(*outFileManager, threadCount, topPairCount);
+    }
+
+
+    void Correlate::CorrelateRows(IFileManager & fileManager,
+                                  size_t threadCount,
+                                  size_t topPairCount) const
+    {
+        // Finished partitions may be held for up to this many partitions
+        // per thread while an earlier partition is still running, which
+        // keeps threads busy when partitions take different amounts of time
+        // without letting the held output grow with the number of terms.
+        const size_t c_windowPerThread = 4;
+
+        threadCount = (std::max)(threadCount, static_cast<size_t>(1));
+        const size_t shardCount = m_index.GetIngestor().GetShardCount();
+
+        std::vector<std::unique_ptr<CorrelateShard>> shards(shardCount);
+        {
+            std::vector<std::unique_ptr<ITaskProcessor>> processors;
+            for (size_t i = 0; i < (std::min)(threadCount, shardCount); ++i)
+            {
+                processors.push_back(
+                    std::unique_ptr<ITaskProcessor>(
+                        new CorrelateShardProcessor(m_index, m_terms, shards)));
+            }
+
+            auto distributor =
+                Factories::CreateTaskDistributor(processors, shardCount);
+            distributor->WaitForCompletion();
+        }
+
+        std::vector<size_t> firstTasks(1, 0);
+        std::vector<std::unique_ptr<std::ostream>> outputs;
+        std::vector<std::unique_ptr<PartitionWriter>> writers;
+        for (ShardId shardId = 0; shardId < shardCount; ++shardId)
+        {
+            const size_t partitionCount =
+                (shards[shardId]->GetTermCount() + m_termsPerPartition - 1) /
+                m_termsPerPartition;
+            firstTasks.push_back(firstTasks.back() + partitionCount);
+
+            outputs.push_back(fileManager.Correlate(shardId).OpenForWrite());
+            writers.push_back(
+                std::unique_ptr<PartitionWriter>(
+                    new PartitionWriter(*outputs.back(),
+                                        partitionCount,
+                                        threadCount * c_windowPerThread)));
+        }
+        const size_t taskCount = firstTasks.back();
+        firstTasks.pop_back();
+
+        std::vector<std::vector<CorrelatePartitionProcessor::Pair>>
+            topPairs(shardCount);
+        std::vector<std::mutex> locks(shardCount);
+        {
+            std::vector<std::unique_ptr<ITaskProcessor>> processors;
+            for (size_t i = 0; i < threadCount; ++i)
+            {
+                processors.push_back(
+                    std::unique_ptr<ITaskProcessor>(
+                        new CorrelatePartitionProcessor(shards,
+                                                        firstTasks,
+                                                        m_termsPerPartition,
+                                                        topPairCount,
+                                                        writers,
+                                                        topPairs,
+                                                        locks)));
+            }
+
+            auto distributor =
+                Factories::CreateTaskDistributor(processors, taskCount);
+            distributor->WaitForCompletion();
+        }
+
+        if (topPairCount > 0)
+        {
+            for (ShardId shardId = 0; shardId < shardCount; ++shardId)
+            {
+                auto & pairs = topPairs[shardId];
+                std::sort(pairs.begin(),
+                          pairs.end(),
+                          CorrelatePartitionProcessor::IsBetter);
+
+                // The header distinguishes these files from the per-term
+                // files, whose lines have the same form.
+                CsvTsv::CsvTableFormatter formatter(*outputs[shardId]);
+                formatter.WriteField("term");
+                formatter.WriteField("partner");
+                formatter.WriteField("rows");
+                formatter.WriteRowEnd();
+                for (auto const & pair : pairs)
+                {
+                    formatter.WriteField(shards[shardId]->GetText(pair.m_term));
+                    formatter.WriteField(shards[shardId]->GetText(pair.m_partner));
+                    formatter.WriteField(pair.m_sharedRows);
+                    formatter.WriteRowEnd();
+                }
+            }
+        }
     }
 }
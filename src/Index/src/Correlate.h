@@ -22,34 +22,68 @@
 
 #pragma once
 
-#include <array>                                // std::arrray embedded.
-#include <iosfwd>                               // std::ostream paramter.
-#include <vector>                               // std::vector embedded.
-
-#include "BitFunnel/BitFunnelTypes.h"           // DocId embedded.
-#include "BitFunnel/Utilities/Accumulator.h"    // Accumulator embedded.
+#include <stddef.h>                             // size_t parameter.
+#include <string>                               // std::string template parameter.
+#include <vector>                               // std::vector member.
 
 
 namespace BitFunnel
 {
     class IFileManager;
     class ISimpleIndex;
-    class ITermToText;
 
+    //*************************************************************************
+    //
+    // Correlate
+    //
+    // Finds pairs of terms that share more than one row in a shard. Since
+    // each term is configured with several rows, a pair that shares more
+    // than one of them produces correlated false positives.
+    //
+    // Collisions are counted one term at a time, so memory grows with the
+    // number of terms and their rows rather than with the number of
+    // colliding pairs. Each shard's terms are split into partitions of a
+    // fixed number of terms that are processed in parallel, and results are
+    // streamed to one file per shard as partitions finish. A partition is
+    // not started until it is within a few partitions per thread of the
+    // next one to be written, so the output held in memory does not grow
+    // with the number of terms. Output does not depend on the number of
+    // threads or the partition size.
+    //
+    //*************************************************************************
     class Correlate
     {
     public:
+        static const size_t c_defaultTermsPerPartition = 4096;
+
         Correlate (ISimpleIndex const & index,
-                   std::vector<std::string> const & terms);
-        void CorrelateRows(char const * outDir) const;
+                   std::vector<std::string> const & terms,
+                   size_t termsPerPartition = c_defaultTermsPerPartition);
 
-    private:
-        void CorrelateShard(
-            ShardId const & shardId,
-            ITermToText const & termToText,
-            std::ostream& out) const;
+        // Writes the collisions in each shard to outDir using threadCount
+        // threads. Terms are numbered in the order of their first
+        // appearance in the term list.
+        //
+        // If topPairCount is zero, writes one line for each term that
+        // shares a row with another term, in term order. Each line lists
+        // the term, then each term that shares more than one of its rows,
+        // in term order, along with the number of shared rows.
+        //
+        // Otherwise writes a "term,partner,rows" header, then the
+        // topPairCount pairs that share the most rows, one pair per line,
+        // by decreasing shared rows. Ties are listed in term order.
+        void CorrelateRows(char const * outDir,
+                           size_t threadCount,
+                           size_t topPairCount) const;
 
+        // Same as above, but writes to the Correlate files of fileManager.
+        void CorrelateRows(IFileManager & fileManager,
+                           size_t threadCount,
+                           size_t topPairCount) const;
+
+    private:
         ISimpleIndex const & m_index;
         std::vector<std::string> const & m_terms;
+        const size_t m_termsPerPartition;
     };
 }
@@ -38,6 +38,15 @@ namespace BitFunnel
     // Factory methods
     //
     //*************************************************************************
+    std::unique_ptr<IDocumentFrequencyTable>
+        Factories::CreateDocumentFrequencyTable()
+    {
+        return
+            std::unique_ptr<IDocumentFrequencyTable>(
+                new DocumentFrequencyTable());
+    }
+
+
     std::unique_ptr<IDocumentFrequencyTable>
         Factories::CreateDocumentFrequencyTable(std::istream& input)
     {
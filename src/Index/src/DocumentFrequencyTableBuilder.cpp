@@ -21,9 +21,13 @@
 // THE SOFTWARE.
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <vector>
 
+#include "BitFunnel/Exceptions.h"
+#include "CsvTsv/Csv.h"
 #include "DocumentFrequencyTable.h"
 #include "DocumentFrequencyTableBuilder.h"
 #include "IndexedIdfTable.h"
@@ -31,6 +35,38 @@
 
 namespace BitFunnel
 {
+    // Normal quantile for a two sided 95% confidence interval.
+    static const double c_z95 = 1.96;
+
+
+    // Returns the number of independent samples equivalent to a sample of
+    // documentCount documents drawn without replacement from a
+    // sampleFraction of the corpus.
+    static double GetEffectiveSampleSize(size_t documentCount,
+                                         double sampleFraction)
+    {
+        if (sampleFraction <= 0.0 || sampleFraction > 1.0)
+        {
+            RecoverableError error("DocumentFrequencyTableBuilder: sampleFraction must be in (0, 1].");
+            throw error;
+        }
+
+        if (sampleFraction == 1.0)
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+
+        return documentCount / (1.0 - sampleFraction);
+    }
+
+
+    DocumentFrequencyTableBuilder::DocumentFrequencyTableBuilder(
+        bool collectCoOccurrences)
+      : m_collectCoOccurrences(collectCoOccurrences)
+    {
+    }
+
+
     void DocumentFrequencyTableBuilder::OnDocumentEnter()
     {
         std::lock_guard<std::mutex> lock(m_lock);
@@ -38,10 +74,18 @@ namespace BitFunnel
     }
 
 
-    void DocumentFrequencyTableBuilder::OnTerm(Term t)
+    void DocumentFrequencyTableBuilder::OnTerm(Term t, DocId id)
     {
+        // The hash is computed before taking the lock.
+        const uint64_t documentHash =
+            m_collectCoOccurrences ? CoOccurrenceTable::HashDocument(id) : 0;
+
         std::lock_guard<std::mutex> lock(m_lock);
         ++m_termCounts[t];
+        if (m_collectCoOccurrences)
+        {
+            m_sketches[t].Add(documentHash);
+        }
     }
 
 
@@ -115,4 +159,169 @@ namespace BitFunnel
             output << i << "," << m_cumulativeTermCounts[i] << std::endl;
         }
     }
+
+
+    void DocumentFrequencyTableBuilder::WriteCoOccurrenceTable(
+        std::ostream& output,
+        double truncateBelowFrequency) const
+    {
+        if (!m_collectCoOccurrences)
+        {
+            RecoverableError error("DocumentFrequencyTableBuilder: co-occurrences were not collected.");
+            throw error;
+        }
+
+        CoOccurrenceTable table;
+
+        for (auto const & entry : m_sketches)
+        {
+            double frequency = static_cast<double>(m_termCounts.at(entry.first)) / m_cumulativeTermCounts.size();
+            if (frequency >= truncateBelowFrequency)
+            {
+                table.AddTerm(entry.first.GetRawHash(),
+                              frequency,
+                              entry.second);
+            }
+        }
+
+        table.Write(output);
+    }
+
+
+    void DocumentFrequencyTableBuilder::WriteFrequencyBounds(
+        std::ostream& output,
+        double truncateBelowFrequency,
+        double sampleFraction) const
+    {
+        const size_t documentCount = m_cumulativeTermCounts.size();
+
+        std::vector<std::pair<Term::Hash, size_t>> entries;
+        for (auto const & entry : m_termCounts)
+        {
+            double frequency = static_cast<double>(entry.second) / documentCount;
+            if (frequency >= truncateBelowFrequency)
+            {
+                entries.push_back(std::make_pair(entry.first.GetRawHash(),
+                                                 entry.second));
+            }
+        }
+
+        // Sort by decreasing count, then by hash so the file does not depend
+        // on the order of m_termCounts.
+        std::sort(entries.begin(),
+                  entries.end(),
+                  [](std::pair<Term::Hash, size_t> const & a,
+                     std::pair<Term::Hash, size_t> const & b)
+                  {
+                      return (a.second != b.second) ?
+                          a.second > b.second : a.first < b.first;
+                  });
+
+        CsvTsv::CsvTableFormatter formatter(output);
+        CsvTsv::TableWriter writer(formatter);
+
+        CsvTsv::OutputColumn<Term::Hash> hash(
+            "hash",
+            "Term's raw hash.");
+        hash.SetHexMode(true);
+
+        CsvTsv::OutputColumn<double> frequency(
+            "frequency",
+            "Term's frequency in the sample.");
+
+        CsvTsv::OutputColumn<double> lower(
+            "lower",
+            "Lower bound of the 95% confidence interval.");
+
+        CsvTsv::OutputColumn<double> upper(
+            "upper",
+            "Upper bound of the 95% confidence interval.");
+
+        writer.DefineColumn(hash);
+        writer.DefineColumn(frequency);
+        writer.DefineColumn(lower);
+        writer.DefineColumn(upper);
+
+        writer.WritePrologue();
+
+        for (auto const & entry : entries)
+        {
+            double l;
+            double u;
+            GetFrequencyBounds(entry.second,
+                               documentCount,
+                               sampleFraction,
+                               l,
+                               u);
+
+            hash = entry.first;
+            frequency = static_cast<double>(entry.second) / documentCount;
+            lower = l;
+            upper = u;
+
+            writer.WriteDataRow();
+        }
+
+        writer.WriteEpilogue();
+
+        std::cout << "Frequency bounds count: "
+                  << entries.size()
+                  << std::endl
+                  << "Frequencies within 10% at 95% confidence: >= "
+                  << GetMinAccurateFrequency(documentCount, sampleFraction, 0.1)
+                  << std::endl;
+    }
+
+
+    void DocumentFrequencyTableBuilder::GetFrequencyBounds(
+        size_t count,
+        size_t documentCount,
+        double sampleFraction,
+        double& lower,
+        double& upper)
+    {
+        if (documentCount == 0)
+        {
+            lower = 0.0;
+            upper = 1.0;
+            return;
+        }
+
+        const double p = static_cast<double>(count) / documentCount;
+        const double n = GetEffectiveSampleSize(documentCount, sampleFraction);
+
+        if (std::isinf(n))
+        {
+            lower = p;
+            upper = p;
+            return;
+        }
+
+        const double z2 = c_z95 * c_z95;
+        const double denominator = 1.0 + z2 / n;
+        const double center = (p + z2 / (2.0 * n)) / denominator;
+        const double halfWidth =
+            c_z95 * std::sqrt(p * (1.0 - p) / n + z2 / (4.0 * n * n)) / denominator;
+
+        lower = (std::max)(0.0, center - halfWidth);
+        upper = (std::min)(1.0, center + halfWidth);
+    }
+
+
+    double DocumentFrequencyTableBuilder::GetMinAccurateFrequency(
+        size_t documentCount,
+        double sampleFraction,
+        double relativeError)
+    {
+        const double n = GetEffectiveSampleSize(documentCount, sampleFraction);
+        if (std::isinf(n))
+        {
+            return 0.0;
+        }
+
+        // The normal approximation's relative half width,
+        // z * sqrt((1 - f) / (f * n)), equals relativeError at this f.
+        const double z2 = c_z95 * c_z95;
+        return z2 / (relativeError * relativeError * n + z2);
+    }
 }
@@ -22,12 +22,14 @@
 
 #pragma once
 
-#include <iosfwd>           // std::ostream parameter.
-#include <mutex>            // std::mutex embedded.
-#include <unordered_map>    // std::unordered_map member.
-#include <vector>           // std::vector member.
+#include <iosfwd>                       // std::ostream parameter.
+#include <mutex>                        // std::mutex embedded.
+#include <unordered_map>                // std::unordered_map member.
+#include <vector>                       // std::vector member.
 
-#include "BitFunnel/Term.h" // Term and Term::Hasher template parameters.
+#include "BitFunnel/BitFunnelTypes.h"   // DocId parameter.
+#include "BitFunnel/Term.h"             // Term and Term::Hasher template parameters.
+#include "CoOccurrenceTable.h"          // CoOccurrenceTable::Sketch template parameter.
 
 
 namespace BitFunnel
@@ -48,6 +50,11 @@ namespace BitFunnel
     // number of unique terms in the Document Frequency Table as a function of
     // the number of documents processed so far.
     //
+    // The optional third statistic is a CoOccurrenceTable which keeps a
+    // MinHash sketch of the DocIds of the documents containing each term.
+    // Sketches cost an update per posting, so they are only gathered when
+    // the builder is constructed with collectCoOccurrences.
+    //
     // Information about the corpus is supplied to the
     // DocumentFrequencyTableBuilder through a sequence of calls to
     // OnDocumentEnter() and OnTerm().
@@ -61,13 +68,15 @@ namespace BitFunnel
     class DocumentFrequencyTableBuilder
     {
     public:
+        explicit DocumentFrequencyTableBuilder(bool collectCoOccurrences = false);
+
         // This method is threadsafe in the presense of multiple writers
         // (ie. callers to OnDocumentEnter() and OnTerm()).
         void OnDocumentEnter();
 
         // This method is threadsafe in the presense of multiple writers
         // (ie. callers to OnDocumentEnter() and OnTerm()).
-        void OnTerm(Term t);
+        void OnTerm(Term t, DocId id);
 
         // Writes the Document Frequency Table to a stream. The file format is
         // a sequence of entries, one per line. Each entry consists of the
@@ -106,9 +115,56 @@ namespace BitFunnel
         // (ie. callers to OnDocumentEnter() and OnTerm()).
         void WriteCumulativeTermCounts(std::ostream& output) const;
 
+        // Writes the sketches of terms with frequency at least
+        // truncateBelowFrequency in the binary format used by the
+        // CoOccurrenceTable constructor. Throws if the builder was not
+        // constructed with collectCoOccurrences.
+        //
+        // This method is not threadsafe in the presense of writers.
+        // (ie. callers to OnDocumentEnter() and OnTerm()).
+        void WriteCoOccurrenceTable(std::ostream& output,
+                                    double truncateBelowFrequency) const;
+
+        // Writes 95% confidence bounds on the corpus frequency of each term
+        // with frequency at least truncateBelowFrequency, for statistics
+        // gathered from a sampleFraction of the corpus. The file format is a
+        // CSV table with columns hash, frequency, lower, and upper, ordered
+        // by decreasing frequency. Also prints the frequency above which
+        // the estimates are within 10% of the corpus frequency.
+        //
+        // This method is not threadsafe in the presense of writers.
+        // (ie. callers to OnDocumentEnter() and OnTerm()).
+        void WriteFrequencyBounds(std::ostream& output,
+                                  double truncateBelowFrequency,
+                                  double sampleFraction) const;
+
+        // Computes the Wilson score interval for the frequency of a term that
+        // appears in count of the documentCount documents sampled from a
+        // sampleFraction of the corpus. The sample size is adjusted by the
+        // finite population correction, so the interval narrows to
+        // count / documentCount as sampleFraction approaches 1.
+        static void GetFrequencyBounds(size_t count,
+                                       size_t documentCount,
+                                       double sampleFraction,
+                                       double& lower,
+                                       double& upper);
+
+        // Returns the smallest frequency whose estimate is within
+        // relativeError of the corpus frequency at 95% confidence.
+        static double GetMinAccurateFrequency(size_t documentCount,
+                                              double sampleFraction,
+                                              double relativeError);
+
     private:
+        const bool m_collectCoOccurrences;
+
         std::mutex m_lock;
         std::vector<size_t> m_cumulativeTermCounts;
         std::unordered_map<Term, size_t, Term::Hasher> m_termCounts;
+
+        // Empty unless m_collectCoOccurrences.
+        std::unordered_map<Term,
+                           CoOccurrenceTable::Sketch,
+                           Term::Hasher> m_sketches;
     };
 }
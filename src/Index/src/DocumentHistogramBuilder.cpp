@@ -21,6 +21,8 @@
 // THE SOFTWARE.
 
 
+#include <cmath>
+
 #include "CsvTsv/Csv.h"
 #include "DocumentHistogramBuilder.h"
 
@@ -64,7 +66,8 @@ namespace BitFunnel
     }
 
 
-    void DocumentHistogramBuilder::Write(std::ostream& output) const
+    void DocumentHistogramBuilder::Write(std::ostream& output,
+                                         double scale) const
     {
         CsvTsv::CsvTableFormatter formatter(output);
         CsvTsv::TableWriter writer(formatter);
@@ -86,7 +89,7 @@ namespace BitFunnel
         for (const auto & kvPairs : m_hist)
         {
             postingCount = kvPairs.first;
-            numDocs = kvPairs.second;
+            numDocs = static_cast<uint64_t>(std::llround(kvPairs.second * scale));
             writer.WriteDataRow();
         }
 
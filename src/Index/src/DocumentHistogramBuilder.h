@@ -49,8 +49,11 @@ namespace BitFunnel
         // GetValue is thread safe with multiple readers and writers.
         size_t GetValue(size_t postingCount) const;
 
-        // Persists the contents of the histogram to a stream, not thread-safe
-        void Write(std::ostream& output) const;
+        // Persists the contents of the histogram to a stream, not thread-safe.
+        // Each document count is multiplied by scale and rounded, so that a
+        // histogram of a sample of the corpus can estimate the histogram of
+        // the whole corpus.
+        void Write(std::ostream& output, double scale = 1.0) const;
 
 
     private:
@@ -21,6 +21,7 @@
 // THE SOFTWARE.
 
 #include <iostream>  // TODO: remove.
+#include <limits>
 
 #include "BitFunnel/Configuration/IShardDefinition.h"
 #include "BitFunnel/Exceptions.h"
@@ -31,6 +32,7 @@
 #include "BitFunnel/Index/ISliceBufferAllocator.h"
 #include "BitFunnel/Index/ITermTableCollection.h"
 #include "BitFunnel/Utilities/Factories.h"
+#include "CoOccurrenceTable.h"
 #include "DocumentHandleInternal.h"
 #include "Ingestor.h"
 #include "LoggerInterfaces/Logging.h"
@@ -39,18 +41,48 @@
 
 namespace BitFunnel
 {
+    // Returns the largest document hash that is in a sample of sampleFraction
+    // of the hash range.
+    static uint64_t GetSampleThreshold(double sampleFraction)
+    {
+        if (!(sampleFraction > 0.0 && sampleFraction <= 1.0))
+        {
+            RecoverableError error("Ingestor: sampleFraction must be in (0, 1].");
+            throw error;
+        }
+
+        // 2^64 as a double.
+        const double range = 18446744073709551616.0;
+        const double threshold = sampleFraction * range;
+        if (threshold >= range)
+        {
+            return std::numeric_limits<uint64_t>::max();
+        }
+
+        return static_cast<uint64_t>(threshold);
+    }
+
+
     std::unique_ptr<IIngestor>
     Factories::CreateIngestor(IDocumentDataSchema const & docDataSchema,
                               IRecycler& recycler,
                               ITermTableCollection const & termTables,
                               IShardDefinition const & shardDefinition,
-                              ISliceBufferAllocator& sliceBufferAllocator)
+                              ISliceBufferAllocator& sliceBufferAllocator,
+                              bool statisticsOnly,
+                              double sampleFraction,
+                              std::vector<size_t> const & expectedTermCounts,
+                              bool collectCoOccurrences)
     {
         return std::unique_ptr<IIngestor>(new Ingestor(docDataSchema,
                                                        recycler,
                                                        termTables,
                                                        shardDefinition,
-                                                       sliceBufferAllocator));
+                                                       sliceBufferAllocator,
+                                                       statisticsOnly,
+                                                       sampleFraction,
+                                                       expectedTermCounts,
+                                                       collectCoOccurrences));
     }
 
 
@@ -58,7 +90,11 @@ namespace BitFunnel
                        IRecycler& recycler,
                        ITermTableCollection const & termTables,
                        IShardDefinition const & shardDefinition,
-                       ISliceBufferAllocator& sliceBufferAllocator)
+                       ISliceBufferAllocator& sliceBufferAllocator,
+                       bool statisticsOnly,
+                       double sampleFraction,
+                       std::vector<size_t> const & expectedTermCounts,
+                       bool collectCoOccurrences)
         : m_recycler(recycler),
           m_shardDefinition(shardDefinition),
           // TODO: This member is now redundant (with m_documentMap).
@@ -66,6 +102,10 @@ namespace BitFunnel
           // always equal to m_documentMap.size().
           m_documentCount(0),
           m_totalSourceByteSize(0),
+          m_sampleFraction(sampleFraction),
+          m_sampleThreshold(GetSampleThreshold(sampleFraction)),
+          m_collectCoOccurrences(collectCoOccurrences),
+          m_skippedDocumentCount(0),
           m_documentMap(new DocumentMap()),
           m_documentCache(new DocumentCache()),
           m_tokenManager(Factories::CreateTokenManager()),
@@ -93,7 +133,11 @@ namespace BitFunnel
                               termTables.GetTermTable(shardId),
                               docDataSchema,
                               m_sliceBufferAllocator,
-                              m_sliceBufferAllocator.GetSliceBufferSize())));
+                              m_sliceBufferAllocator.GetSliceBufferSize(),
+                              statisticsOnly,
+                              (shardId < expectedTermCounts.size()) ?
+                                  expectedTermCounts[shardId] : 0,
+                              collectCoOccurrences)));
         }
     }
 
@@ -115,6 +159,13 @@ namespace BitFunnel
             << "Total bytes read: " << m_totalSourceByteSize << std::endl
             << "Posting count: " << m_histogram.GetPostingCount() << std::endl;
 
+        if (m_sampleFraction < 1.0)
+        {
+            out << "Sample fraction: " << m_sampleFraction << std::endl
+                << "Documents skipped by sampling: "
+                << m_skippedDocumentCount << std::endl;
+        }
+
         if (time > 0)
         {
             out << "Total ingestion time: " << time << std::endl;
@@ -138,7 +189,9 @@ namespace BitFunnel
 
         {
             auto out = fileManager.DocumentHistogram().OpenForWrite();
-            m_histogram.Write(*out);
+            // Each sampled document stands for 1 / m_sampleFraction
+            // documents in the corpus. Term frequencies need no scaling.
+            m_histogram.Write(*out, 1.0 / m_sampleFraction);
         }
 
         for (size_t shard = 0; shard < m_shards.size(); ++shard)
@@ -155,6 +208,17 @@ namespace BitFunnel
                 auto out = fileManager.IndexedIdfTable(shard).OpenForWrite();
                 m_shards[shard]->TemporaryWriteIndexedIdfTable(*out);
             }
+            if (m_collectCoOccurrences)
+            {
+                auto out = fileManager.CoOccurrenceTable(shard).OpenForWrite();
+                m_shards[shard]->TemporaryWriteCoOccurrenceTable(*out);
+            }
+            if (m_sampleFraction < 1.0)
+            {
+                auto out = fileManager.DocFreqTableBounds(shard).OpenForWrite();
+                m_shards[shard]->TemporaryWriteDocumentFrequencyBounds(*out,
+                                                                        m_sampleFraction);
+            }
         }
     }
 
@@ -176,6 +240,12 @@ namespace BitFunnel
 
     void Ingestor::Add(DocId id, IDocument const & document)
     {
+        if (CoOccurrenceTable::HashDocument(id) > m_sampleThreshold)
+        {
+            ++m_skippedDocumentCount;
+            return;
+        }
+
         ++m_documentCount;
         m_totalSourceByteSize += document.GetSourceByteSize();
 
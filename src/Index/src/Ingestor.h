@@ -26,6 +26,7 @@
 #include <memory>                           // std::unique_ptr embedded.
 #include <mutex>                            // std::mutex member.
 #include <stddef.h>                         // size_t template parameter.
+#include <stdint.h>                         // uint64_t member.
 #include <vector>                           // std::vector embedded.
 
 #include "BitFunnel/BitFunnelTypes.h"       // DocId parameter.
@@ -53,7 +54,11 @@ namespace BitFunnel
                  IRecycler& recycle,
                  ITermTableCollection const & termTables,
                  IShardDefinition const & shardDefinition,
-                 ISliceBufferAllocator& sliceBufferAllocator);
+                 ISliceBufferAllocator& sliceBufferAllocator,
+                 bool statisticsOnly,
+                 double sampleFraction,
+                 std::vector<size_t> const & expectedTermCounts,
+                 bool collectCoOccurrences);
 
         virtual ~Ingestor();
 
@@ -70,6 +75,11 @@ namespace BitFunnel
         //      CumulativeTermCountd
         //      DocumentFrequencyTable (with term text if termToText provided)
         //      IndexedIdfTable
+        //      CoOccurrenceTable
+        //      DocFreqTableBounds (only when sampling)
+        //
+        // When sampling, the DocumentHistogram counts are scaled up to
+        // estimate the whole corpus.
         virtual void WriteStatistics(IFileManager & fileManager,
                                      ITermToText const * termToText) const override;
 
@@ -80,7 +90,8 @@ namespace BitFunnel
         virtual IDocumentCache & GetDocumentCache() const override;
 
 
-        // Adds a document to the index. Throws if there is no space to add the
+        // Adds a document to the index. Documents outside of the sample are
+        // ignored. Throws if there is no space to add the
         // document which means the system is running at its maximum capacity.
         // The IDocument must implement the Place method which should call
         // IIndex::AllocateDocument, passing the ddrCandidateCount parameter.
@@ -174,6 +185,17 @@ namespace BitFunnel
         std::atomic<size_t> m_documentCount;
         std::atomic<size_t> m_totalSourceByteSize;
 
+        // Documents are sampled by DocId hash, so the same documents are
+        // chosen on every run. Add() ignores documents whose hash exceeds
+        // m_sampleThreshold.
+        const double m_sampleFraction;
+        const uint64_t m_sampleThreshold;
+
+        // When set, shards gather the sketches written to the
+        // CoOccurrenceTable files.
+        const bool m_collectCoOccurrences;
+        std::atomic<size_t> m_skippedDocumentCount;
+
         std::unique_ptr<DocumentMap> m_documentMap;
 
         std::unique_ptr<DocumentCache> m_documentCache;
@@ -0,0 +1,279 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <algorithm>    // std::min() or std::max()
+#include <cmath>        // std::ceil(), std::exp(), std::log().
+#include <limits>       // std::numeric_limits<float>::infinity().
+#include <unordered_map>
+#include <utility>      // std::pair.
+#include <vector>
+
+#include "BitFunnel/Configuration/IShardDefinition.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IDocumentFrequencyTable.h"
+#include "BitFunnel/Index/IDocumentHistogram.h"
+#include "BitFunnel/Index/Row.h"
+#include "LoggerInterfaces/Check.h"
+#include "QueryShardCostFunction.h"
+
+
+namespace BitFunnel
+{
+    std::unique_ptr<IQueryShardCostFunction>
+        Factories::CreateQueryShardCostFunction(
+            IDocumentHistogram const & histogram,
+            IDocumentFrequencyTable const & terms,
+            IDocumentFrequencyTable const & queryTerms,
+            double density,
+            double snr,
+            double shardOverhead,
+            size_t minShardCapacity,
+            Rank maxRankInUse)
+    {
+        return std::unique_ptr<IQueryShardCostFunction>(
+            new QueryShardCostFunction(histogram,
+                                       terms,
+                                       queryTerms,
+                                       density,
+                                       snr,
+                                       shardOverhead,
+                                       minShardCapacity,
+                                       maxRankInUse));
+    }
+
+
+    //*************************************************************************
+    //
+    // QueryShardCostFunction
+    //
+    //*************************************************************************
+    QueryShardCostFunction::QueryShardCostFunction(
+        IDocumentHistogram const & histogram,
+        IDocumentFrequencyTable const & terms,
+        IDocumentFrequencyTable const & queryTerms,
+        double density,
+        double snr,
+        double shardOverhead,
+        size_t minShardCapacity,
+        Rank maxRankInUse)
+      : m_histogram(histogram),
+        m_density(density),
+        m_snr(snr),
+        m_shardOverhead(shardOverhead),
+        m_minShardCapacity(minShardCapacity),
+        m_maxRankInUse(maxRankInUse),
+        m_memoryWeight(0.0)
+    {
+        CHECK_GT(m_histogram.GetEntryCount(), 0u)
+            << "Histogram must have at least one entry.";
+        CHECK_GT(m_density, 0.0)
+            << "Density must be between 0 and 1.";
+        CHECK_LT(m_density, 1.0)
+            << "Density must be between 0 and 1.";
+        CHECK_GT(m_snr, 0.0)
+            << "SNR must be positive.";
+
+        //
+        // Gather the corpus mean and range of posting counts.
+        //
+        double postingCountSum = 0.0;
+        size_t minPostingCount = std::numeric_limits<size_t>::max();
+        size_t maxPostingCount = 0;
+        for (size_t i = 0; i < m_histogram.GetEntryCount(); ++i)
+        {
+            const size_t postingCount = m_histogram.GetPostingCount(i);
+            postingCountSum += postingCount * m_histogram.GetDocumentCount(i);
+            minPostingCount = (std::min)(minPostingCount, postingCount);
+            maxPostingCount = (std::max)(maxPostingCount, postingCount);
+        }
+        m_meanPostingCount =
+            (std::max)(postingCountSum / m_histogram.GetTotalDocumentCount(),
+                       1.0);
+        m_minPostingCount =
+            static_cast<double>((std::max)(minPostingCount, size_t(1)));
+        const double maxGridPostingCount =
+            static_cast<double>((std::max)(maxPostingCount, size_t(1)));
+        m_gridStep = std::log(maxGridPostingCount / m_minPostingCount) / (c_gridSize - 1);
+
+        //
+        // Look up the corpus frequency of each query term.
+        //
+        std::unordered_map<Term::Hash, double> frequencies;
+        double minFrequency = 1.0;
+        for (auto const & entry : terms)
+        {
+            frequencies[entry.GetTerm().GetRawHash()] = entry.GetFrequency();
+            if (entry.GetFrequency() > 0.0)
+            {
+                minFrequency = (std::min)(minFrequency, entry.GetFrequency());
+            }
+        }
+
+        std::vector<std::pair<double, double>> queryFrequencies;
+        for (auto const & entry : queryTerms)
+        {
+            auto it = frequencies.find(entry.GetTerm().GetRawHash());
+            const double frequency =
+                (it == frequencies.end() || it->second <= 0.0) ?
+                minFrequency : it->second;
+            queryFrequencies.push_back(
+                std::make_pair(entry.GetFrequency(), frequency));
+        }
+
+        //
+        // Tabulate the expected number of rows scanned per query.
+        //
+        m_rowsPerQuery.resize(c_gridSize);
+        for (size_t i = 0; i < c_gridSize; ++i)
+        {
+            const double scale =
+                m_minPostingCount * std::exp(i * m_gridStep) /
+                m_meanPostingCount;
+
+            double rows = 0.0;
+            for (auto const & query : queryFrequencies)
+            {
+                rows += query.first *
+                    GetRowCount((std::min)(query.second * scale, 1.0));
+            }
+            m_rowsPerQuery[i] = rows;
+        }
+
+        StartAt(0);
+    }
+
+
+    void QueryShardCostFunction::StartAt(size_t vertex)
+    {
+        m_fromVertex = vertex;
+        m_toVertex = vertex;
+        m_documentCount = 0;
+        m_postingCountSum = 0;
+        m_maxPostingCount = 0;
+    }
+
+
+    void QueryShardCostFunction::Extend()
+    {
+        const double documentCount = m_histogram.GetDocumentCount(m_toVertex);
+        m_documentCount += documentCount;
+
+        const size_t postingCount = m_histogram.GetPostingCount(m_toVertex);
+        m_postingCountSum += postingCount * documentCount;
+        m_maxPostingCount = (std::max)(postingCount, m_maxPostingCount);
+
+        m_toVertex++;
+    }
+
+
+    float QueryShardCostFunction::GetCost() const
+    {
+        if (m_documentCount == 0 || GetColumnCount() < m_minShardCapacity)
+        {
+            // Don't allow a shard which has a capacity less than
+            // m_minShardCapacity.
+            return std::numeric_limits<float>::infinity();
+        }
+
+        return static_cast<float>(GetScanCost() +
+                                  m_memoryWeight * GetMemoryCost());
+    }
+
+
+    size_t QueryShardCostFunction::GetVertexCount() const
+    {
+        return m_histogram.GetEntryCount() + 1;
+    }
+
+
+    void QueryShardCostFunction::AddShard(IShardDefinition& shardDefinition) const
+    {
+        // IShardDefinition identifies shards by their smallest posting
+        // count, and the first shard must start at zero.
+        const size_t minPostingCount =
+            (m_fromVertex == 0) ? 0 : m_histogram.GetPostingCount(m_fromVertex);
+        shardDefinition.AddShard(minPostingCount, m_density);
+    }
+
+
+    void QueryShardCostFunction::SetMemoryWeight(double weight)
+    {
+        m_memoryWeight = weight;
+    }
+
+
+    double QueryShardCostFunction::GetScanCost() const
+    {
+        if (m_documentCount == 0)
+        {
+            return 0.0;
+        }
+
+        return GetColumnCount() *
+               GetRowsPerQuery(m_postingCountSum / m_documentCount) +
+               m_shardOverhead;
+    }
+
+
+    double QueryShardCostFunction::GetMemoryCost() const
+    {
+        const double rowCount = std::ceil(m_maxPostingCount / m_density);
+        return GetColumnCount() * rowCount / 8.0;
+    }
+
+
+    double QueryShardCostFunction::GetColumnCount() const
+    {
+        return static_cast<double>(
+            Row::DocumentsInRank0Row(static_cast<DocIndex>(m_documentCount),
+                                     m_maxRankInUse));
+    }
+
+
+    double QueryShardCostFunction::GetRowsPerQuery(double meanPostingCount) const
+    {
+        size_t i = 0;
+        if (m_gridStep > 0.0 && meanPostingCount > m_minPostingCount)
+        {
+            const double position =
+                std::log(meanPostingCount / m_minPostingCount) / m_gridStep;
+            i = (std::min)(static_cast<size_t>(position + 0.5),
+                           c_gridSize - 1);
+        }
+        return m_rowsPerQuery[i];
+    }
+
+
+    double QueryShardCostFunction::GetRowCount(double termDensity) const
+    {
+        if (termDensity >= m_density)
+        {
+            // Dense terms get a single private row.
+            return 1.0;
+        }
+
+        // Rarer terms need enough shared rows to bring the noise below
+        // termDensity / snr.
+        const double rows =
+            std::ceil(std::log(termDensity / m_snr) / std::log(m_density));
+        return (std::max)(rows, 1.0);
+    }
+}
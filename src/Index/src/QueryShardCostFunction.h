@@ -0,0 +1,149 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#pragma once
+
+#include <vector>                                       // std::vector member.
+
+#include "BitFunnel/Index/IQueryShardCostFunction.h"    // Base class.
+#include "BitFunnel/NonCopyable.h"                      // Base class.
+
+
+namespace BitFunnel
+{
+    class IDocumentFrequencyTable;
+    class IDocumentHistogram;
+
+    //*************************************************************************
+    //
+    // QueryShardCostFunction is an implementation of IQueryShardCostFunction
+    // that estimates the cost of replaying a query log against each
+    // candidate shard.
+    //
+    // A term with corpus frequency f is assumed to appear in a shard's
+    // documents with density f * m / M, where m is the mean posting count
+    // of the shard's documents and M is the mean posting count of the
+    // corpus. A term at least as dense as the target row density gets one
+    // private row. A rarer term with density d gets the k shared rows that
+    // bring the noise down to d / snr, i.e. density^k <= d / snr. A query
+    // scans every row of each of its terms, so the scan cost of a shard is
+    // its column count times the expected number of rows per query, plus a
+    // fixed overhead per shard.
+    //
+    // The memory cost of a shard is its column count times the number of
+    // rows needed to hold its longest document's postings at the target
+    // density.
+    //
+    // The expected number of rows per query only depends on m, so it is
+    // tabulated once at construction on a logarithmic grid of posting
+    // counts rather than summed over the query terms for every edge.
+    //
+    //*************************************************************************
+    class QueryShardCostFunction : public IQueryShardCostFunction, NonCopyable
+    {
+    public:
+        // queryTerms holds the fraction of queries that look up each term.
+        // Query terms missing from terms are assumed to be as rare as the
+        // rarest term in terms.
+        QueryShardCostFunction(IDocumentHistogram const & histogram,
+                               IDocumentFrequencyTable const & terms,
+                               IDocumentFrequencyTable const & queryTerms,
+                               double density,
+                               double snr,
+                               double shardOverhead,
+                               size_t minShardCapacity,
+                               Rank maxRankInUse);
+
+        //
+        // ICostFunction methods.
+        //
+
+        virtual void StartAt(size_t vertex) override;
+        virtual void Extend() override;
+        virtual float GetCost() const override;
+        virtual size_t GetVertexCount() const override;
+
+        //
+        // IShardCostFunction methods.
+        //
+
+        virtual void AddShard(IShardDefinition& shardDefinition) const override;
+
+        //
+        // IQueryShardCostFunction methods.
+        //
+
+        virtual void SetMemoryWeight(double weight) override;
+        virtual double GetScanCost() const override;
+        virtual double GetMemoryCost() const override;
+
+    private:
+        // Returns the number of columns in the current shard's row tables.
+        double GetColumnCount() const;
+
+        // Returns the expected number of rows a query scans in a shard whose
+        // documents have the given mean posting count.
+        double GetRowsPerQuery(double meanPostingCount) const;
+
+        // Returns the number of rows a term with the given density needs.
+        double GetRowCount(double termDensity) const;
+
+        // Number of points in the m_rowsPerQuery grid.
+        static const size_t c_gridSize = 1024;
+
+        //
+        // Constructor parameters.
+        //
+
+        IDocumentHistogram const & m_histogram;
+        const double m_density;
+        const double m_snr;
+        const double m_shardOverhead;
+        const size_t m_minShardCapacity;
+        const Rank m_maxRankInUse;
+
+        //
+        // Other members.
+        //
+
+        double m_memoryWeight;
+
+        // Mean posting count over the corpus.
+        double m_meanPostingCount;
+
+        // Expected rows per query at posting counts
+        // m_minPostingCount * exp(i * m_gridStep).
+        std::vector<double> m_rowsPerQuery;
+        double m_minPostingCount;
+        double m_gridStep;
+
+        // Total number of documents and postings in the histogram slots
+        // from m_fromVertex up to, but not including, m_toVertex.
+        double m_documentCount;
+        double m_postingCountSum;
+
+        // Largest posting count in the above histogram slots.
+        size_t m_maxPostingCount;
+
+        size_t m_fromVertex;
+        size_t m_toVertex;
+    };
+}
@@ -0,0 +1,128 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <istream>
+#include <ostream>
+
+#include "BitFunnel/IFileManager.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IIngestor.h"
+#include "BitFunnel/Index/IShard.h"
+#include "BitFunnel/Index/ISimpleIndex.h"
+#include "BitFunnel/Utilities/StreamUtilities.h"
+#include "LoggerInterfaces/Check.h"
+#include "RowDensityTable.h"
+
+
+namespace BitFunnel
+{
+    std::unique_ptr<IRowDensityTable>
+        Factories::CreateRowDensityTable(ISimpleIndex const & index)
+    {
+        return std::unique_ptr<IRowDensityTable>(new RowDensityTable(index));
+    }
+
+
+    std::unique_ptr<IRowDensityTable>
+        Factories::CreateRowDensityTable(IFileManager & fileManager,
+                                         ShardId shardCount)
+    {
+        return std::unique_ptr<IRowDensityTable>(
+            new RowDensityTable(fileManager, shardCount));
+    }
+
+
+    RowDensityTable::RowDensityTable(ISimpleIndex const & index)
+        : m_shards(index.GetIngestor().GetShardCount())
+    {
+        for (ShardId shardId = 0; shardId < m_shards.size(); ++shardId)
+        {
+            auto & shard = index.GetIngestor().GetShard(shardId);
+            for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+            {
+                m_shards[shardId][rank] = shard.GetDensities(rank);
+            }
+        }
+    }
+
+
+    RowDensityTable::RowDensityTable(IFileManager & fileManager,
+                                     ShardId shardCount)
+        : m_shards(shardCount)
+    {
+        for (ShardId shardId = 0; shardId < shardCount; ++shardId)
+        {
+            auto input = fileManager.RowDensityTable(shardId).OpenForRead();
+            for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+            {
+                // DESIGN NOTE: not using StreamUtilities::ReadVector() because
+                // ranks without rows have empty vectors, and ReadArray()
+                // asserts on a null buffer.
+                auto & densities = m_shards[shardId][rank];
+                densities.resize(StreamUtilities::ReadField<size_t>(*input));
+                if (!densities.empty())
+                {
+                    StreamUtilities::ReadArray(*input,
+                                               densities.data(),
+                                               densities.size());
+                }
+            }
+        }
+    }
+
+
+    void RowDensityTable::Write(IFileManager & fileManager) const
+    {
+        for (ShardId shardId = 0; shardId < m_shards.size(); ++shardId)
+        {
+            auto output = fileManager.RowDensityTable(shardId).OpenForWrite();
+            for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+            {
+                auto const & densities = m_shards[shardId][rank];
+                StreamUtilities::WriteField<size_t>(*output, densities.size());
+                if (!densities.empty())
+                {
+                    StreamUtilities::WriteArray(*output,
+                                                densities.data(),
+                                                densities.size());
+                }
+            }
+        }
+    }
+
+
+    ShardId RowDensityTable::GetShardCount() const
+    {
+        return m_shards.size();
+    }
+
+
+    double RowDensityTable::GetDensity(ShardId shard, RowId row) const
+    {
+        CHECK_LT(shard, m_shards.size())
+            << "ShardId out of range.";
+
+        auto const & densities = m_shards[shard][row.GetRank()];
+        return (row.GetIndex() < densities.size()) ?
+            densities[row.GetIndex()] : 1.0;
+    }
+}
@@ -0,0 +1,62 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <array>                                // std::array embedded.
+#include <iosfwd>                               // std::istream parameter.
+#include <vector>                               // std::vector embedded.
+
+#include "BitFunnel/Index/IRowDensityTable.h"   // Base class.
+#include "BitFunnel/NonCopyable.h"              // Base class.
+
+
+namespace BitFunnel
+{
+    class ISimpleIndex;
+
+    class RowDensityTable : public IRowDensityTable, NonCopyable
+    {
+    public:
+        // Measures the densities of all rows in all shards of index.
+        RowDensityTable(ISimpleIndex const & index);
+
+        // Loads one RowDensityTable file for each shard.
+        RowDensityTable(IFileManager & fileManager, ShardId shardCount);
+
+        //
+        // IRowDensityTable methods.
+        //
+
+        virtual void Write(IFileManager & fileManager) const override;
+
+        virtual ShardId GetShardCount() const override;
+
+        virtual double GetDensity(ShardId shard, RowId row) const override;
+
+    private:
+        // Densities for each row in a shard, organized by rank.
+        typedef std::array<std::vector<double>, c_maxRankValue + 1> ShardDensities;
+
+        std::vector<ShardDensities> m_shards;
+    };
+}
@@ -21,8 +21,11 @@
 // THE SOFTWARE.
 
 
+#include <algorithm>
+#include <memory>
 #include <ostream>
 #include <stack>
+#include <unordered_map>
 
 #include "BitFunnel/Configuration/Factories.h"
 #include "BitFunnel/Configuration/IFileSystem.h"
@@ -32,28 +35,34 @@
 #include "BitFunnel/Index/IDocumentCache.h"
 #include "BitFunnel/Index/IDocumentFrequencyTable.h"
 #include "BitFunnel/Index/IIngestor.h"
+#include "BitFunnel/Index/IRowDensityTable.h"
 #include "BitFunnel/Index/ISimpleIndex.h"
 #include "BitFunnel/Index/RowIdSequence.h"
+#include "BitFunnel/Utilities/Factories.h"
+#include "BitFunnel/Utilities/ITaskDistributor.h"
+#include "BitFunnel/Utilities/ITaskProcessor.h"
 #include "CsvTsv/Csv.h"
 #include "DocumentHandleInternal.h"
 #include "LoggerInterfaces/Check.h"
 #include "RowTableAnalyzer.h"
 #include "RowTableDescriptor.h"
 #include "Shard.h"
+#include "Slice.h"
 #include "TermToText.h"
 
 
 namespace BitFunnel
 {
     void Factories::AnalyzeRowTables(ISimpleIndex const & index,
-                                     char const * outDir)
+                                     char const * outDir,
+                                     size_t threadCount)
     {
         char const end = '\0';     // TODO: Workaround for issue #386.
         CHECK_NE(*outDir, end)
           << "Output directory not set. ";
 
         RowTableAnalyzer statistics(index);
-        statistics.AnalyzeColumns(outDir);
+        statistics.AnalyzeColumns(outDir, threadCount);
         statistics.AnalyzeRows(outDir);
     }
 
@@ -81,42 +90,40 @@ namespace BitFunnel
         // TODO: Create with factory?
         TermToText termToText(*fileManager.TermToText().OpenForRead());
 
-        for (ShardId shardId = 0; shardId < ingestor.GetShardCount(); ++shardId)
-        {
-            auto terms(Factories::CreateDocumentFrequencyTable(
-                *fileManager.DocFreqTable(shardId).OpenForRead()));
+        auto fileSystem = Factories::CreateFileSystem();
+        auto outFileManager =
+            Factories::CreateFileManager(outDir,
+                                         outDir,
+                                         outDir,
+                                         *fileSystem);
 
-            auto fileSystem = Factories::CreateFileSystem();
-            auto outFileManager =
-                Factories::CreateFileManager(outDir,
-                                             outDir,
-                                             outDir,
-                                             *fileSystem);
+        // Measure densities once and use them both for the human readable
+        // RowDensities files and for the binary RowDensityTable files that
+        // are loaded by a serving index.
+        auto densities = Factories::CreateRowDensityTable(m_index);
 
+        for (ShardId shardId = 0; shardId < ingestor.GetShardCount(); ++shardId)
+        {
             AnalyzeRowsInOneShard(shardId,
                                   termToText,
+                                  *densities,
                                   *outFileManager->RowDensities(shardId).OpenForWrite());
         }
+
+        densities->Write(*outFileManager);
     }
 
 
     void RowTableAnalyzer::AnalyzeRowsInOneShard(
         ShardId const & shardId,
         ITermToText const & termToText,
+        IRowDensityTable const & densities,
         std::ostream& out) const
     {
         auto & fileManager = m_index.GetFileManager();
         auto terms(Factories::CreateDocumentFrequencyTable(
             *fileManager.DocFreqTable(shardId).OpenForRead()));
 
-        std::array<std::vector<double>, c_maxRankValue> densities;
-
-        for (Rank rank = 0; rank < c_maxRankValue; ++rank)
-        {
-            auto & shard = m_index.GetIngestor().GetShard(shardId);
-            densities[rank] = shard.GetDensities(rank);
-        }
-
         // Use CsvTableFormatter to escape terms that contain commas and quotes.
         CsvTsv::CsvTableFormatter formatter(out);
 
@@ -140,7 +147,7 @@ namespace BitFunnel
                 formatter.WriteField("r");
                 out << row.GetRank();
                 formatter.WriteField(row.GetIndex());
-                formatter.WriteField(densities[row.GetRank()][row.GetIndex()]);
+                formatter.WriteField(densities.GetDensity(shardId, row));
 
                 rowsReversed.pop();
             }
@@ -149,16 +156,208 @@ namespace BitFunnel
     }
 
 
+    //*************************************************************************
+    //
+    // ColumnCountProcessor
+    //
+    // Counts the bits set in each column of each rank for the slice with the
+    // same number as the task.
+    //
+    // Rows are scanned a quadword at a time. Each quadword is added to a
+    // bank of bit-sliced counters, where plane i holds bit i of the count
+    // for each of the quadword's 64 columns. The planes are flushed into
+    // the per-column counts before they can overflow. The inner loops run
+    // across whole rows with no branches, so the compiler can vectorize
+    // them.
+    //
+    // At rank r, a quadword holds bits for 64 << r columns, so counts are
+    // kept at rank resolution as described for RowTableAnalyzer::ColumnCounts.
+    //
+    //*************************************************************************
+    class ColumnCountProcessor : public ITaskProcessor
+    {
+    public:
+        typedef RowTableAnalyzer::ColumnCounts Counts;
+
+        ColumnCountProcessor(std::vector<Slice const *> const & slices,
+                             std::vector<Counts> & counts)
+          : m_slices(slices),
+            m_counts(counts)
+        {
+        }
+
+        //
+        // ITaskProcessor methods
+        //
+
+        virtual void ProcessTask(size_t taskId) override
+        {
+            Slice const & slice = *m_slices[taskId];
+            const DocIndex capacity = slice.GetShard().GetSliceCapacity();
+
+            for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+            {
+                CountRank(slice.GetRowTable(rank),
+                          slice.GetSliceBuffer(),
+                          capacity,
+                          rank,
+                          m_counts[taskId][rank]);
+            }
+        }
+
+        virtual void Finished() override
+        {
+        }
+
+    private:
+        void CountRank(RowTableDescriptor const & rowTable,
+                       void const * buffer,
+                       DocIndex capacity,
+                       Rank rank,
+                       std::vector<uint32_t> & counts)
+        {
+            const size_t qwordCount =
+                (capacity == 0) ? 0 : ((capacity - 1) >> (6 + rank)) + 1;
+
+            counts.assign(qwordCount << 6, 0);
+            m_planes.assign(c_planeCount * qwordCount, 0);
+            m_carries.resize(qwordCount);
+
+            size_t pendingRows = 0;
+            const RowIndex rowCount = rowTable.GetRowCount();
+            for (RowIndex row = 0; row < rowCount; ++row)
+            {
+                uint64_t const * rowData =
+                    reinterpret_cast<uint64_t const *>(
+                        static_cast<char const *>(buffer) +
+                        rowTable.GetRowOffset(row));
+
+                for (size_t q = 0; q < qwordCount; ++q)
+                {
+                    m_carries[q] = rowData[q];
+                }
+
+                // Ripple carry add of one row into the counter planes.
+                for (size_t i = 0; i < c_planeCount; ++i)
+                {
+                    uint64_t * plane = m_planes.data() + i * qwordCount;
+                    for (size_t q = 0; q < qwordCount; ++q)
+                    {
+                        const uint64_t carry = plane[q] & m_carries[q];
+                        plane[q] ^= m_carries[q];
+                        m_carries[q] = carry;
+                    }
+                }
+
+                if (++pendingRows == c_maxPendingRows)
+                {
+                    Flush(qwordCount, counts);
+                    pendingRows = 0;
+                }
+            }
+
+            if (pendingRows > 0)
+            {
+                Flush(qwordCount, counts);
+            }
+        }
+
+
+        // Transposes the counter planes into per-column counts and clears
+        // the planes.
+        void Flush(size_t qwordCount, std::vector<uint32_t> & counts)
+        {
+            for (size_t i = 0; i < c_planeCount; ++i)
+            {
+                uint64_t * plane = m_planes.data() + i * qwordCount;
+                for (size_t q = 0; q < qwordCount; ++q)
+                {
+                    const uint64_t bits = plane[q];
+                    uint32_t * column = counts.data() + (q << 6);
+                    for (unsigned b = 0; b < 64; ++b)
+                    {
+                        column[b] +=
+                            static_cast<uint32_t>((bits >> b) & 1) << i;
+                    }
+                    plane[q] = 0;
+                }
+            }
+        }
+
+        // Number of bits in each bit-sliced counter. The planes are flushed
+        // after c_maxPendingRows rows, which is the largest count they hold.
+        static const size_t c_planeCount = 8;
+        static const size_t c_maxPendingRows = (1ull << c_planeCount) - 1;
+
+        std::vector<Slice const *> const & m_slices;
+        std::vector<Counts> & m_counts;
+
+        // Scratch space reused across tasks. Plane i of quadword q is at
+        // m_planes[i * qwordCount + q].
+        std::vector<uint64_t> m_planes;
+        std::vector<uint64_t> m_carries;
+    };
+
+
     //*************************************************************************
     //
     // Analyze columns
     //
     //*************************************************************************
-    void RowTableAnalyzer::AnalyzeColumns(char const * outDir) const
+    std::vector<RowTableAnalyzer::ColumnCounts>
+        RowTableAnalyzer::CountColumns(std::vector<Slice const *> const & slices,
+                                       size_t threadCount)
+    {
+        std::vector<ColumnCounts> counts(slices.size());
+        if (!slices.empty())
+        {
+            threadCount = (std::max)(threadCount, static_cast<size_t>(1));
+
+            std::vector<std::unique_ptr<ITaskProcessor>> processors;
+            for (size_t i = 0; i < (std::min)(threadCount, slices.size()); ++i)
+            {
+                processors.push_back(
+                    std::unique_ptr<ITaskProcessor>(
+                        new ColumnCountProcessor(slices, counts)));
+            }
+
+            auto distributor =
+                Factories::CreateTaskDistributor(processors, slices.size());
+            distributor->WaitForCompletion();
+        }
+
+        return counts;
+    }
+
+
+    void RowTableAnalyzer::AnalyzeColumns(char const * outDir,
+                                          size_t threadCount) const
     {
         auto & ingestor = m_index.GetIngestor();
         auto & cache = ingestor.GetDocumentCache();
 
+        //
+        // Find the slices holding cached documents.
+        //
+        std::vector<Slice const *> slices;
+        std::unordered_map<Slice const *, size_t> sliceNumbers;
+        for (auto doc : cache)
+        {
+            const DocumentHandleInternal
+                handle(ingestor.GetHandle(doc.second));
+            Slice const * slice = &handle.GetSlice();
+            if (sliceNumbers.find(slice) == sliceNumbers.end())
+            {
+                sliceNumbers[slice] = slices.size();
+                slices.push_back(slice);
+            }
+        }
+
+        //
+        // Count the bits in every column of every slice.
+        //
+        auto counts = CountColumns(slices, threadCount);
+
         std::vector<Column> columns;
 
         for (auto doc : cache)
@@ -173,25 +372,17 @@ namespace BitFunnel
                                  shard,
                                  doc.first.GetPostingCount());
 
-            void const * buffer = slice.GetSliceBuffer();
+            auto const & sliceCounts = counts[sliceNumbers[&slice]];
             const DocIndex column = handle.GetIndex();
 
             for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
             {
-                RowTableDescriptor rowTable = slice.GetRowTable(rank);
-
-                size_t bitCount = 0;
-                const size_t rowCount = rowTable.GetRowCount();
-                for (RowIndex row = 0; row < rowCount; ++row)
-                {
-                    if (rowTable.GetBit(buffer, row, column) != 0)
-                    {
-                        ++bitCount;
-                    }
-                }
+                const size_t bitCount =
+                    sliceCounts[rank][((column >> (6 + rank)) << 6) | (column & 63)];
 
                 columns.back().SetCount(rank, bitCount);
 
+                const size_t rowCount = slice.GetRowTable(rank).GetRowCount();
                 double density =
                     (rowCount == 0) ? 0.0 : static_cast<double>(bitCount) / rowCount;
                 columns.back().SetDensity(rank, density);
@@ -33,8 +33,10 @@
 namespace BitFunnel
 {
     class IFileManager;
+    class IRowDensityTable;
     class ISimpleIndex;
     class ITermToText;
+    class Slice;
 
     class RowTableAnalyzer
     {
@@ -42,12 +44,26 @@ namespace BitFunnel
         RowTableAnalyzer(ISimpleIndex const & index);
 
         void AnalyzeRows(char const * outDir) const;
-        void AnalyzeColumns(char const * outDir) const;
+        // Counts the bits in each cached document's column with one task
+        // per slice, spread over threadCount threads.
+        void AnalyzeColumns(char const * outDir, size_t threadCount) const;
+
+        // Bit counts for one slice, by rank. At rank r, entry (q << 6) | b
+        // counts the rows with bit b of quadword q set. That bit is shared
+        // by every column c with (c >> (6 + r)) == q and (c & 63) == b.
+        typedef std::array<std::vector<uint32_t>, c_maxRankValue + 1> ColumnCounts;
+
+        // Counts the bits in each column of each slice with one task per
+        // slice, spread over threadCount threads.
+        static std::vector<ColumnCounts>
+            CountColumns(std::vector<Slice const *> const & slices,
+                         size_t threadCount);
 
     private:
         void AnalyzeRowsInOneShard(
             ShardId const & shardId,
             ITermToText const & termToText,
+            IRowDensityTable const & densities,
             std::ostream& out) const;
 
 
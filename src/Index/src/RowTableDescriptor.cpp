@@ -46,7 +46,8 @@ namespace BitFunnel
           m_rank(rank),
           m_maxRank(maxRank),
           m_bufferOffset(rowTableBufferOffset),
-          m_bytesPerRow(Row::BytesInRow(capacity, rank, maxRank))
+          m_bytesPerRow(Row::BytesInRow(capacity, rank, maxRank)),
+          m_summaryBlockShift(Row::GetSummaryBlockShift(capacity))
     {
         // Make sure capacity is properly rounded already.
         // TODO: fix.
@@ -65,7 +66,8 @@ namespace BitFunnel
           m_rank(other.m_rank),
           m_maxRank(other.m_maxRank),
           m_bufferOffset(other.m_bufferOffset),
-          m_bytesPerRow(other.m_bytesPerRow)
+          m_bytesPerRow(other.m_bytesPerRow),
+          m_summaryBlockShift(other.m_summaryBlockShift)
     {
     }
 
@@ -105,6 +107,9 @@ namespace BitFunnel
             // Fill up the match-all row with all ones.
             uint64_t * rowData = GetRowData(sliceBuffer, row.GetIndex());
             memset(rowData, 0xFF, m_bytesPerRow);
+
+            // The match-all row is never empty.
+            *GetRowSummaryData(sliceBuffer, row.GetIndex()) = ~0ull;
         }
     }
 
@@ -145,14 +150,25 @@ namespace BitFunnel
         uint64_t bitPos = docIndex & 0x3F;
 
 
+        uint64_t* const summary = GetRowSummaryData(sliceBuffer, rowIndex);
+        uint64_t blockPos = docIndex >> m_summaryBlockShift;
+
 #ifdef _MSC_VER
         _interlockedbittestandset64(reinterpret_cast<long long *>(row + offset), bitPos);
+        _interlockedbittestandset64(reinterpret_cast<long long *>(summary), blockPos);
 #else
         // TODO: figure out if this should really be +m.
         asm("lock btsq %1, %0" : "+m" (*(row + offset)) : "r" (bitPos));
         // uint64_t bitMask = 1ull << bitPos;
         // uint64_t newVal = *(row + offset) | bitMask;
         // *(row + offset) = newVal;
+
+        // Most documents land in blocks that are already marked, so test
+        // before paying for another locked instruction.
+        if ((*summary & (1ull << blockPos)) == 0)
+        {
+            asm("lock btsq %1, %0" : "+m" (*summary) : "r" (blockPos));
+        }
 #endif
     }
 
@@ -184,6 +200,23 @@ namespace BitFunnel
     }
 
 
+    ptrdiff_t RowTableDescriptor::GetRowSummaryOffset(RowIndex rowIndex) const
+    {
+        return m_bufferOffset
+            + static_cast<ptrdiff_t>(m_rowCount * m_bytesPerRow
+                                     + rowIndex * sizeof(uint64_t));
+    }
+
+
+    uint64_t RowTableDescriptor::GetRowSummary(void const * sliceBuffer,
+                                               RowIndex rowIndex) const
+    {
+        return *reinterpret_cast<uint64_t const *>(
+            reinterpret_cast<char const *>(sliceBuffer) +
+            GetRowSummaryOffset(rowIndex));
+    }
+
+
     /* static */
     size_t RowTableDescriptor::GetBufferSize(DocIndex capacity,
                                              RowIndex rowCount,
@@ -195,8 +228,10 @@ namespace BitFunnel
         // LogAssertB(capacity == Row::DocumentsInRank0Row(capacity),
         //            "capacity not evenly rounded.");
 
+        // Rows are followed by one summary quadword per row.
         return static_cast<unsigned>(
-            Row::BytesInRow(capacity, rank, maxRank) * rowCount);
+            (Row::BytesInRow(capacity, rank, maxRank) + sizeof(uint64_t))
+            * rowCount);
     }
 
 
@@ -221,6 +256,15 @@ namespace BitFunnel
     }
 
 
+    uint64_t* RowTableDescriptor::GetRowSummaryData(void* sliceBuffer,
+                                                    RowIndex rowIndex) const
+    {
+        return reinterpret_cast<uint64_t*>(
+            reinterpret_cast<char*>(sliceBuffer) +
+            GetRowSummaryOffset(rowIndex));
+    }
+
+
     size_t RowTableDescriptor::QwordPositionFromDocIndex(DocIndex docIndex) const
     {
         LogAssertB(docIndex < m_capacity, "docIndex out of range");
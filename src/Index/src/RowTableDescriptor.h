@@ -42,6 +42,11 @@ namespace BitFunnel
     // and is able to perform bit operations over that data.
     // See Slice.h for more info about the layout of the data buffer.
     //
+    // The rows are followed by one summary quadword per row. SetBit() sets
+    // the summary bit for the block of documents that contains the column,
+    // so that the matcher can skip slices and blocks where a row is empty.
+    // ClearBit() leaves the summary unchanged, so summaries are conservative.
+    //
     // All methods except Initialize are thread safe. Initialize method is not
     // thread-safe with respect to calling *Bit methods at the same time.
     //
@@ -80,7 +85,8 @@ namespace BitFunnel
                         RowIndex rowIndex,
                         DocIndex docIndex) const;
 
-        // Sets a bit in the given row and column.
+        // Sets a bit in the given row and column, along with the row's
+        // summary bit for the block containing the column.
         void SetBit(void* sliceBuffer,
                     RowIndex rowIndex,
                     DocIndex docIndex) const;
@@ -94,6 +100,15 @@ namespace BitFunnel
         // start of the sliceBuffer.
         ptrdiff_t GetRowOffset(RowIndex rowIndex) const;
 
+        // Returns the offset of the summary quadword for the row with the
+        // given index, relative to the start of the sliceBuffer. See
+        // Row::GetSummaryBlockShift() for the meaning of the summary bits.
+        ptrdiff_t GetRowSummaryOffset(RowIndex rowIndex) const;
+
+        // Returns the summary quadword for the row with the given index.
+        uint64_t GetRowSummary(void const * sliceBuffer,
+                               RowIndex rowIndex) const;
+
         // Returns true if the given RowTableDescriptor is data-compatible with
         // this instance. Used when loading Slices from the stream.
         bool IsCompatibleWith(RowTableDescriptor const & other) const;
@@ -123,6 +138,11 @@ namespace BitFunnel
         uint64_t const * GetRowData(void const * sliceBuffer,
                                     RowIndex rowIndex) const;
 
+        // Helper method to seek to the summary for the row with the given
+        // RowIndex.
+        uint64_t* GetRowSummaryData(void* sliceBuffer,
+                                    RowIndex rowIndex) const;
+
         // Returns the QWORD number for the given DocIndex.
         size_t QwordPositionFromDocIndex(DocIndex docIndex) const;
 
@@ -140,5 +160,8 @@ namespace BitFunnel
 
         // Cached value of the number of bytes per single row.
         const size_t m_bytesPerRow;
+
+        // Cached value of Row::GetSummaryBlockShift(m_capacity).
+        const unsigned m_summaryBlockShift;
     };
 }
@@ -76,7 +76,10 @@ namespace BitFunnel
                  ITermTable const & termTable,
                  IDocumentDataSchema const & docDataSchema,
                  ISliceBufferAllocator& sliceBufferAllocator,
-                 size_t sliceBufferSize)
+                 size_t sliceBufferSize,
+                 bool statisticsOnly,
+                 size_t expectedTermCount,
+                 bool collectCoOccurrences)
         : m_shardId(id),
           m_recycler(recycler),
           m_tokenManager(tokenManager),
@@ -89,8 +92,11 @@ namespace BitFunnel
                                                  docDataSchema,
                                                  termTable)),
           m_sliceBufferSize(sliceBufferSize),
+          m_statisticsOnly(statisticsOnly),
+          m_termFilter(expectedTermCount),
           // TODO: will need one global, not one per shard.
-          m_docFrequencyTableBuilder(new DocumentFrequencyTableBuilder())
+          m_docFrequencyTableBuilder(
+              new DocumentFrequencyTableBuilder(collectCoOccurrences))
     {
         const size_t bufferSize =
             InitializeDescriptors(this,
@@ -140,6 +146,9 @@ namespace BitFunnel
 
         // TODO: verify compatibility of DocTableDescriptor, RowTableDescriptor with the stream's data.
 
+        // The stream doesn't record which terms were posted to the slice.
+        m_termFilter.Disable();
+
         void* buffer = m_sliceBufferAllocator.Allocate(m_sliceBufferSize);
 
         try
@@ -234,6 +243,12 @@ namespace BitFunnel
     }
 
 
+    ptrdiff_t Shard::GetRowSummaryOffset(RowId rowId) const
+    {
+        return GetRowTable(rowId.GetRank()).GetRowSummaryOffset(rowId.GetIndex());
+    }
+
+
     RowTableDescriptor const & Shard::GetRowTable(Rank rank) const
     {
         return m_rowTables.at(rank);
@@ -402,9 +417,17 @@ namespace BitFunnel
 
         if (m_docFrequencyTableBuilder.get() != nullptr)
         {
-            m_docFrequencyTableBuilder->OnTerm(term);
+            m_docFrequencyTableBuilder->OnTerm(term,
+                                               m_docTable->GetDocId(sliceBuffer,
+                                                                    index));
         }
 
+        if (m_statisticsOnly)
+        {
+            return;
+        }
+
+        m_termFilter.Add(term);
 
         RowIdSequence rows(term, m_termTable);
 
@@ -457,6 +480,12 @@ namespace BitFunnel
     }
 
 
+    bool Shard::MayContainTerm(Term const & term) const
+    {
+        return m_termFilter.MayContain(term);
+    }
+
+
     void Shard::TemporaryRecordDocument()
     {
         if (m_docFrequencyTableBuilder.get() != nullptr)
@@ -496,6 +525,33 @@ namespace BitFunnel
     }
 
 
+    void Shard::TemporaryWriteDocumentFrequencyBounds(std::ostream& out,
+                                                      double sampleFraction) const
+    {
+        if (m_docFrequencyTableBuilder.get() != nullptr)
+        {
+            m_docFrequencyTableBuilder->WriteFrequencyBounds(out,
+                                                             0.0,
+                                                             sampleFraction);
+        }
+    }
+
+
+    void Shard::TemporaryWriteCoOccurrenceTable(std::ostream& out) const
+    {
+        // Sketches are only useful for terms frequent enough to be packed
+        // into explicit rows. Truncating rarer terms keeps the file small.
+        // TODO: This truncation frequency shouldn't be fixed.
+        const double c_truncateBelowFrequency = 1e-4;
+        if (m_docFrequencyTableBuilder.get() != nullptr)
+        {
+            m_docFrequencyTableBuilder->WriteCoOccurrenceTable(
+                out,
+                c_truncateBelowFrequency);
+        }
+    }
+
+
     void Shard::TemporaryWriteAllSlices(IFileManager& fileManager) const
     {
         auto token = m_tokenManager.RequestToken();
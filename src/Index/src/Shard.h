@@ -23,6 +23,7 @@
 #pragma once
 
 
+#include <atomic>                           // std::atomic member.
 #include <memory>                           // std::unique_ptr member.
 #include <ostream>                          // TODO: Remove this temporary include.
 #include <vector>
@@ -36,6 +37,7 @@
 #include "DocumentHandleInternal.h"         // Return value.
 #include "RowTableDescriptor.h"             // Required for embedded std::vector.
 #include "Slice.h"                          // std::unique_ptr template parameter.
+#include "TermPresenceFilter.h"             // TermPresenceFilter embedded.
 
 
 namespace BitFunnel
@@ -68,13 +70,23 @@ namespace BitFunnel
         // Constructs an empty Shard with no slices. sliceBufferSize must be
         // sufficient to hold the minimum capacity Slice. The minimum capacity
         // is determined by a value returned by Row::DocumentsInRank0Row(1).
+        // A statisticsOnly Shard only records corpus statistics. AddPosting()
+        // does not set row bits or add to the term presence filter, so the
+        // Shard cannot be queried. The term presence filter is sized for
+        // expectedTermCount distinct terms, or for a default count if
+        // expectedTermCount is zero. A Shard constructed with
+        // collectCoOccurrences also keeps the sketches written by
+        // TemporaryWriteCoOccurrenceTable().
         Shard(ShardId id,
               IRecycler& recycler,
               ITokenManager& tokenManager,
               ITermTable const & termTable,
               IDocumentDataSchema const & docDataSchema,
               ISliceBufferAllocator& sliceBufferAllocator,
-              size_t sliceBufferSize);
+              size_t sliceBufferSize,
+              bool statisticsOnly,
+              size_t expectedTermCount,
+              bool collectCoOccurrences = false);
 
         virtual ~Shard();
 
@@ -84,6 +96,9 @@ namespace BitFunnel
         void TemporaryRecordDocument();
         void TemporaryWriteIndexedIdfTable(std::ostream& out) const;
         void TemporaryWriteCumulativeTermCounts(std::ostream& out) const;
+        void TemporaryWriteCoOccurrenceTable(std::ostream& out) const;
+        void TemporaryWriteDocumentFrequencyBounds(std::ostream& out,
+                                                   double sampleFraction) const;
 
 
         //
@@ -108,6 +123,15 @@ namespace BitFunnel
         // Returns the offset of the row in the slice buffer in a shard.
         virtual ptrdiff_t GetRowOffset(RowId rowId) const override;
 
+        // Returns the offset of the row's summary quadword in the slice
+        // buffer in a shard.
+        virtual ptrdiff_t GetRowSummaryOffset(RowId rowId) const override;
+
+        // Returns true if term may have been posted to this shard. Returns
+        // true for all terms once a slice has been loaded from a stream,
+        // since the filter doesn't know the terms in loaded slices.
+        virtual bool MayContainTerm(Term const & term) const override;
+
         virtual void TemporaryWriteDocumentFrequencyTable(
             std::ostream& out,
             ITermToText const * termToText) const override;
@@ -315,12 +339,18 @@ namespace BitFunnel
         //    in future.
         const size_t m_sliceBufferSize;
 
+        const bool m_statisticsOnly;
+
         // Descriptors for RowTables and DocTable.
         // DESIGN NOTE: using pointers, rather than embedded instances to avoid
         // initializer order dependencies in constructor list.
         std::unique_ptr<DocTableDescriptor> m_docTable;
         std::vector<RowTableDescriptor> m_rowTables;
 
+        // Records the terms posted to this shard. Disabled when a slice is
+        // loaded from a stream without its terms.
+        TermPresenceFilter m_termFilter;
+
         std::unique_ptr<DocumentFrequencyTableBuilder> m_docFrequencyTableBuilder;
         std::mutex m_temporaryFrequencyTableMutex;
     };
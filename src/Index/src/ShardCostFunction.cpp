@@ -141,6 +141,10 @@ namespace BitFunnel
         // TODO: Issue #396. Is there some way to provider a density
         // other than the default?
         const double defaultDensity = 0.15;
-        shardDefinition.AddShard(m_maxPostingCount, defaultDensity);
+        // IShardDefinition identifies shards by their smallest posting
+        // count, and the first shard must start at zero.
+        const size_t minPostingCount =
+            (m_fromVertex == 0) ? 0 : m_histogram.GetPostingCount(m_fromVertex);
+        shardDefinition.AddShard(minPostingCount, defaultDensity);
     }
 }
@@ -23,6 +23,8 @@
 #include <memory>
 
 #include "BitFunnel/Configuration/Factories.h"
+#include "BitFunnel/Exceptions.h"
+#include "BitFunnel/Index/IQueryShardCostFunction.h"
 #include "BitFunnel/Index/IShardCostFunction.h"
 #include "BitFunnel/Index/ShardDefinitionBuilder.h"
 #include "SingleSourceShortestPath.h"
@@ -30,6 +32,55 @@
 
 namespace BitFunnel
 {
+    // Converts a path returned by SingleSourceShortestPath::FindPath() into a
+    // ShardDefinition.
+    static std::unique_ptr<IShardDefinition const>
+        CreateFromPath(IShardCostFunction& costFunction,
+                       std::vector<size_t> const & path)
+    {
+        auto shardDefinition =
+            Factories::CreateShardDefinition();
+
+        size_t index = 0;
+        costFunction.StartAt(index);
+        for (unsigned i = 1 ; i < path.size(); ++i)
+        {
+            while (index < path[i])
+            {
+                ++index;
+                costFunction.Extend();
+            }
+            costFunction.AddShard(*shardDefinition);
+            costFunction.StartAt(index);
+        }
+
+        return std::move(shardDefinition);
+    }
+
+
+    // Returns the total memory cost of the shards along a path.
+    static double GetMemoryCost(IQueryShardCostFunction& costFunction,
+                                std::vector<size_t> const & path)
+    {
+        double memory = 0.0;
+
+        size_t index = 0;
+        costFunction.StartAt(index);
+        for (unsigned i = 1 ; i < path.size(); ++i)
+        {
+            while (index < path[i])
+            {
+                ++index;
+                costFunction.Extend();
+            }
+            memory += costFunction.GetMemoryCost();
+            costFunction.StartAt(index);
+        }
+
+        return memory;
+    }
+
+
     //*********************************************************************
     //
     // CreateShardDefinition() constructs an optimal shard definition based
@@ -53,25 +104,78 @@ namespace BitFunnel
         std::vector<size_t> path;
         SingleSourceShortestPath::FindPath(costFunction, maxShardCount, path);
 
-        //
-        // Convert the path into a ShardDefinition.
-        //
-        auto shardDefinition =
-            Factories::CreateShardDefinition();
+        return CreateFromPath(costFunction, path);
+    }
 
-        size_t index = 0;
-        costFunction.StartAt(index);
-        for (unsigned i = 1 ; i < path.size(); ++i)
+
+    std::unique_ptr<IShardDefinition const>
+    ShardDefinitionBuilder::CreateShardDefinition(IQueryShardCostFunction& costFunction,
+                                                  size_t maxShardCount,
+                                                  double memoryBudget)
+    {
+        // Initial weight tried once the scan cost alone gives shards that
+        // exceed the budget, and the number of times it may be quadrupled.
+        const double c_initialMemoryWeight = 1.0 / 1024;
+        const unsigned c_maxWeightIncreases = 40;
+
+        // Number of bisection steps between the largest weight known to
+        // exceed the budget and the smallest weight known to fit.
+        const unsigned c_bisectionCount = 32;
+
+        std::vector<size_t> path;
+        costFunction.SetMemoryWeight(0.0);
+        SingleSourceShortestPath::FindPath(costFunction, maxShardCount, path);
+
+        if (GetMemoryCost(costFunction, path) > memoryBudget)
         {
-            while (index < path[i])
+            double low = 0.0;
+            double high = c_initialMemoryWeight;
+            std::vector<size_t> highPath;
+            for (unsigned i = 0; ; ++i)
             {
-                ++index;
-                costFunction.Extend();
+                if (i == c_maxWeightIncreases)
+                {
+                    RecoverableError
+                        error("ShardDefinitionBuilder: memory budget is too small.");
+                    throw error;
+                }
+
+                highPath.clear();
+                costFunction.SetMemoryWeight(high);
+                SingleSourceShortestPath::FindPath(costFunction,
+                                                   maxShardCount,
+                                                   highPath);
+                if (GetMemoryCost(costFunction, highPath) <= memoryBudget)
+                {
+                    break;
+                }
+                low = high;
+                high *= 4;
             }
-            costFunction.AddShard(*shardDefinition);
-            costFunction.StartAt(index);
+
+            for (unsigned i = 0; i < c_bisectionCount; ++i)
+            {
+                const double middle = (low + high) / 2;
+
+                path.clear();
+                costFunction.SetMemoryWeight(middle);
+                SingleSourceShortestPath::FindPath(costFunction,
+                                                   maxShardCount,
+                                                   path);
+                if (GetMemoryCost(costFunction, path) <= memoryBudget)
+                {
+                    high = middle;
+                    highPath.swap(path);
+                }
+                else
+                {
+                    low = middle;
+                }
+            }
+
+            path.swap(highPath);
         }
 
-        return std::move(shardDefinition);
+        return CreateFromPath(costFunction, path);
     }
 }
@@ -21,6 +21,10 @@
 // THE SOFTWARE.
 
 
+#include <algorithm>
+#include <istream>
+#include <string>
+
 #include "BitFunnel/Configuration/Factories.h"
 #include "BitFunnel/Index/Factories.h"
 #include "BitFunnel/Index/Helpers.h"
@@ -45,6 +49,38 @@ namespace BitFunnel
     }
 
 
+    // Returns the number of distinct terms in the shard at the end of the
+    // statistics run, which is the unique term count on the last line of
+    // its CumulativeTermCounts file. Returns zero if the file is missing.
+    static size_t ReadDistinctTermCount(IFileManager & fileManager,
+                                        ShardId shard)
+    {
+        if (!fileManager.CumulativeTermCounts(shard).Exists())
+        {
+            return 0;
+        }
+
+        auto input = fileManager.CumulativeTermCounts(shard).OpenForRead();
+        std::string line;
+        std::string last;
+        while (std::getline(*input, line))
+        {
+            if (!line.empty())
+            {
+                last = line;
+            }
+        }
+
+        const size_t comma = last.find(',');
+        if (comma == std::string::npos)
+        {
+            return 0;
+        }
+
+        return std::stoull(last.substr(comma + 1));
+    }
+
+
     //*************************************************************************
     //
     // SimpleIndex
@@ -54,6 +90,9 @@ namespace BitFunnel
     SimpleIndex::SimpleIndex(IFileSystem& fileSystem)
         : m_fileSystem(fileSystem),
           m_isStarted(false),
+          m_statisticsOnly(false),
+          m_sampleFraction(1.0),
+          m_collectCoOccurrences(false),
           m_blockAllocatorBufferSize(0)
     {
     }
@@ -165,16 +204,29 @@ namespace BitFunnel
     }
 
 
+    void SimpleIndex::SetRowDensityTable(
+        std::unique_ptr<IRowDensityTable> densities)
+    {
+        m_rowDensities = std::move(densities);
+    }
+
+
     //
     // Configuration methods.
     //
 
     void SimpleIndex::ConfigureForStatistics(char const * directory,
                                              size_t gramSize,
-                                             bool generateTermToText)
+                                             bool generateTermToText,
+                                             double sampleFraction,
+                                             bool collectCoOccurrences)
     {
         EnsureStarted(false);
 
+        m_statisticsOnly = true;
+        m_sampleFraction = sampleFraction;
+        m_collectCoOccurrences = collectCoOccurrences;
+
         //if (m_fileSystem.get() == nullptr)
         //{
         //    m_fileSystem = Factories::CreateFileSystem();
@@ -279,6 +331,28 @@ namespace BitFunnel
                     m_shardDefinition->GetShardCount());
         }
 
+        // Row densities are optional. Without them, the query planner falls
+        // back to ordering rows by rank alone.
+        if (m_rowDensities.get() == nullptr &&
+            m_fileManager->RowDensityTable(0).Exists())
+        {
+            m_rowDensities =
+                Factories::CreateRowDensityTable(
+                    *m_fileManager,
+                    m_shardDefinition->GetShardCount());
+        }
+
+        // Size each shard's term presence filter for the distinct terms
+        // seen in that shard by the statistics builder.
+        if (m_expectedTermCounts.empty())
+        {
+            for (ShardId shard = 0; shard < m_shardDefinition->GetShardCount(); ++shard)
+            {
+                m_expectedTermCounts.push_back(
+                    ReadDistinctTermCount(*m_fileManager, shard));
+            }
+        }
+
         if (m_idfTable == nullptr)
         {
             auto input = m_fileManager->IndexedIdfTable(0).OpenForRead();
@@ -356,9 +430,18 @@ namespace BitFunnel
 
         if (m_sliceAllocator.get() == nullptr)
         {
-            const ShardId tempId = 0;
-            const size_t m_blockSize =
-                32 * GetReasonableBlockSize(*m_schema, m_termTables->GetTermTable(tempId));
+            // Every shard allocates its slices from the same allocator, so
+            // blocks must be large enough for the shard with the most rows.
+            size_t reasonableBlockSize = 0;
+            for (ShardId shard = 0; shard < m_termTables->size(); ++shard)
+            {
+                reasonableBlockSize =
+                    (std::max)(reasonableBlockSize,
+                               GetReasonableBlockSize(
+                                   *m_schema,
+                                   m_termTables->GetTermTable(shard)));
+            }
+            const size_t m_blockSize = 32 * reasonableBlockSize;
                 // std::cout << "Blocksize: " << blockSize << std::endl;
 
 
@@ -389,7 +472,11 @@ namespace BitFunnel
                                                *m_recycler,
                                                *m_termTables,
                                                *m_shardDefinition,
-                                               *m_sliceAllocator);
+                                               *m_sliceAllocator,
+                                               m_statisticsOnly,
+                                               m_sampleFraction,
+                                               m_expectedTermCounts,
+                                               m_collectCoOccurrences);
 
         m_isStarted = true;
     }
@@ -461,6 +548,12 @@ namespace BitFunnel
     }
 
 
+    IRowDensityTable const * SimpleIndex::GetRowDensityTable() const
+    {
+        return m_rowDensities.get();
+    }
+
+
     void SimpleIndex::EnsureStarted(bool started) const
     {
         CHECK_EQ(started, m_isStarted)
@@ -24,6 +24,7 @@
 
 #include <memory>                                   // std::unique_ptr embedded.
 #include <thread>                                   // std::thread embedded.
+#include <vector>                                   // std::vector embedded.
 
 #include "BitFunnel/Configuration/IFileSystem.h"    // Parameterizes std::unique_ptr.
 #include "BitFunnel/Configuration/IShardDefinition.h"  // Parameterizes std::unique_ptr.
@@ -33,6 +34,7 @@
 #include "BitFunnel/Index/IIndexedIdfTable.h"       // Parameterizes std::unique_ptr.
 #include "BitFunnel/Index/IIngestor.h"              // Parameterizes std::unique_ptr.
 #include "BitFunnel/Index/IRecycler.h"              // Parameterizes std::unique_ptr.
+#include "BitFunnel/Index/IRowDensityTable.h"       // Parameterizes std::unique_ptr.
 #include "BitFunnel/Index/ISliceBufferAllocator.h"  // Parameterizes std::unique_ptr.
 #include "BitFunnel/Index/ISimpleIndex.h"           // Parameterizes std::unique_ptr.
 #include "BitFunnel/Index/ITermTable.h"             // Parameterizes std::unique_ptr.
@@ -77,10 +79,15 @@ namespace BitFunnel
         virtual void SetTermTableCollection(
             std::unique_ptr<ITermTableCollection> termTables) override;
 
+        virtual void SetRowDensityTable(
+            std::unique_ptr<IRowDensityTable> densities) override;
+
 
         virtual void ConfigureForStatistics(char const * directory,
                                             size_t gramSize,
-                                            bool generateTermToText) override;
+                                            bool generateTermToText,
+                                            double sampleFraction,
+                                            bool collectCoOccurrences) override;
 
         virtual void ConfigureForServing(char const * directory,
                                          size_t gramSize,
@@ -100,6 +107,7 @@ namespace BitFunnel
         virtual IRecycler & GetRecycler() const override;
         virtual ITermTable const & GetTermTable0() const override;
         virtual ITermTable const & GetTermTable(ShardId shardId) const override;
+        virtual IRowDensityTable const * GetRowDensityTable() const override;
 
     private:
         void EnsureStarted(bool started) const;
@@ -115,6 +123,14 @@ namespace BitFunnel
 
         bool m_isStarted;
 
+        // Set by ConfigureForStatistics().
+        bool m_statisticsOnly;
+        double m_sampleFraction;
+        bool m_collectCoOccurrences;
+
+        // Distinct terms per shard, read by ConfigureForServing().
+        std::vector<size_t> m_expectedTermCounts;
+
         //
         // Members initialized by StartIndex().
         //
@@ -128,6 +144,7 @@ namespace BitFunnel
 
         // Following members may become per-shard.
         std::unique_ptr<ITermTableCollection> m_termTables;
+        std::unique_ptr<IRowDensityTable> m_rowDensities;
         std::unique_ptr<IIndexedIdfTable> m_idfTable;
         std::unique_ptr<IConfiguration> m_configuration;
 
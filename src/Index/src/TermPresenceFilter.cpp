@@ -0,0 +1,163 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "BitFunnel/Term.h"
+#include "TermPresenceFilter.h"
+
+
+namespace BitFunnel
+{
+    // Returns the log2 of the bit count for a filter that holds termCount
+    // terms.
+    static unsigned GetLog2BitCount(size_t termCount,
+                                    size_t bitsPerTerm,
+                                    unsigned minLog2BitCount,
+                                    unsigned maxLog2BitCount)
+    {
+        const uint64_t bitCount = static_cast<uint64_t>(termCount) * bitsPerTerm;
+        unsigned log2BitCount = minLog2BitCount;
+        while (log2BitCount < maxLog2BitCount &&
+               (1ull << log2BitCount) < bitCount)
+        {
+            ++log2BitCount;
+        }
+        return log2BitCount;
+    }
+
+
+    const size_t TermPresenceFilter::c_defaultTermCount;
+
+
+    TermPresenceFilter::TermPresenceFilter(size_t expectedTermCount)
+      : m_log2BitCount(GetLog2BitCount((expectedTermCount == 0) ?
+                                           c_defaultTermCount :
+                                           expectedTermCount,
+                                       c_bitsPerTerm,
+                                       c_minLog2BitCount,
+                                       c_maxLog2BitCount)),
+        m_wordCount((1ull << m_log2BitCount) / 64),
+        m_bits(new std::atomic<uint64_t>[m_wordCount]),
+        m_setBitCount(0),
+        m_enabled(true)
+    {
+        for (size_t i = 0; i < m_wordCount; ++i)
+        {
+            m_bits[i] = 0;
+        }
+    }
+
+
+    void TermPresenceFilter::Add(Term const & term)
+    {
+        if (!m_enabled.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        const uint64_t hash = GetHash(term);
+        for (unsigned probe = 0; probe < c_probeCount; ++probe)
+        {
+            const size_t bit = GetBitPosition(hash, probe);
+            const uint64_t mask = 1ull << (bit & 63);
+            std::atomic<uint64_t> & word = m_bits[bit >> 6];
+
+            // Most postings are for terms that are already present, so test
+            // before paying for a locked instruction.
+            if ((word.load(std::memory_order_relaxed) & mask) == 0 &&
+                (word.fetch_or(mask, std::memory_order_relaxed) & mask) == 0)
+            {
+                // Saturated. The filter would rule out few terms.
+                if (++m_setBitCount > GetBitCount() / 2)
+                {
+                    Disable();
+                }
+            }
+        }
+    }
+
+
+    bool TermPresenceFilter::MayContain(Term const & term) const
+    {
+        if (!m_enabled)
+        {
+            return true;
+        }
+
+        const uint64_t hash = GetHash(term);
+        for (unsigned probe = 0; probe < c_probeCount; ++probe)
+        {
+            const size_t bit = GetBitPosition(hash, probe);
+            if ((m_bits[bit >> 6].load(std::memory_order_relaxed) &
+                 (1ull << (bit & 63))) == 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    void TermPresenceFilter::Disable()
+    {
+        m_enabled = false;
+    }
+
+
+    bool TermPresenceFilter::IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+
+    size_t TermPresenceFilter::GetBitCount() const
+    {
+        return m_wordCount * 64;
+    }
+
+
+    double TermPresenceFilter::GetLoadFactor() const
+    {
+        return static_cast<double>(m_setBitCount) / GetBitCount();
+    }
+
+
+    uint64_t TermPresenceFilter::GetHash(Term const & term)
+    {
+        // Term::GetGeneralHash() adds the StreamId to the raw hash, which
+        // makes adjacent raw hashes in different streams collide.
+        return term.GetRawHash() ^
+            (static_cast<uint64_t>(term.GetStream()) * 0xc2b2ae3d27d4eb4full);
+    }
+
+
+    size_t TermPresenceFilter::GetBitPosition(uint64_t hash,
+                                              unsigned probe) const
+    {
+        // Double hashing with the two halves of a remixed hash. Term hashes
+        // of similar text can share low-order bits, so mix them first.
+        uint64_t h = hash * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 32;
+        const uint64_t h1 = h;
+        const uint64_t h2 = (h >> 32) | 1;
+        return static_cast<size_t>((h1 + probe * h2) & ((1ull << m_log2BitCount) - 1));
+    }
+}
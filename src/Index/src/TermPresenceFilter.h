@@ -0,0 +1,104 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <atomic>                       // std::atomic embedded.
+#include <memory>                       // std::unique_ptr embedded.
+#include <stdint.h>                     // uint64_t embedded.
+
+#include "BitFunnel/NonCopyable.h"      // Base class.
+
+
+namespace BitFunnel
+{
+    class Term;
+
+    //*************************************************************************
+    //
+    // TermPresenceFilter is a Bloom filter over the terms posted to a Shard.
+    // MayContain() never returns false for a term that was added, so the
+    // query planner can safely skip a shard when one of the terms that every
+    // match requires is absent.
+    //
+    // The filter disables itself once half of its bits are set, since it
+    // would then rarely rule out a term. A disabled filter ignores Add()
+    // and MayContain() always returns true.
+    //
+    // Add() is thread safe with respect to Add(), Disable() and
+    // MayContain().
+    //
+    //*************************************************************************
+    class TermPresenceFilter : NonCopyable
+    {
+    public:
+        // Constructs a filter sized for expectedTermCount distinct terms,
+        // or for c_defaultTermCount terms if expectedTermCount is zero.
+        TermPresenceFilter(size_t expectedTermCount);
+
+        // Records the presence of term.
+        void Add(Term const & term);
+
+        // Returns false if term was never added. May return true for terms
+        // that were never added.
+        bool MayContain(Term const & term) const;
+
+        // Stops recording terms. Used when terms are added to the shard
+        // without passing through Add(), e.g. when loading slices.
+        void Disable();
+
+        bool IsEnabled() const;
+
+        size_t GetBitCount() const;
+
+        // Returns the fraction of bits that are set. The false positive rate
+        // is approximately this value raised to the power c_probeCount.
+        double GetLoadFactor() const;
+
+        // Expected distinct term count used when none is known.
+        static const size_t c_defaultTermCount = 1ull << 16;
+
+    private:
+        // With at least 12 bits per expected term and 4 probes, the false
+        // positive rate is at most (1 - e^(-4/12))^4, about 0.65%, until
+        // the shard holds the expected number of distinct terms. It rises
+        // to (1/2)^4, about 6%, when the filter disables itself.
+        static const size_t c_bitsPerTerm = 12;
+        static const unsigned c_probeCount = 4;
+        static const unsigned c_minLog2BitCount = 12;
+        static const unsigned c_maxLog2BitCount = 32;
+
+        // Returns a hash of the term's text and stream.
+        static uint64_t GetHash(Term const & term);
+
+        // Returns the bit position for the specified probe of a term.
+        size_t GetBitPosition(uint64_t hash, unsigned probe) const;
+
+        // The filter has 2^m_log2BitCount bits.
+        const unsigned m_log2BitCount;
+        const size_t m_wordCount;
+        std::unique_ptr<std::atomic<uint64_t>[]> m_bits;
+
+        std::atomic<size_t> m_setBitCount;
+        std::atomic<bool> m_enabled;
+    };
+}
@@ -23,10 +23,15 @@
 #include <algorithm>
 #include <iostream>     // TODO: Remove this temporary include.
 #include <math.h>
+#include <thread>
+#include <unordered_set>
 
 #include "BitFunnel/BitFunnelTypes.h"
 #include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/ICoOccurrenceTable.h"
 #include "BitFunnel/Index/ITermTable.h"
+#include "BitFunnel/Utilities/Factories.h"
+#include "BitFunnel/Utilities/ITaskProcessor.h"
 #include "BitFunnel/Utilities/Stopwatch.h"
 #include "DocumentFrequencyTable.h"
 #include "LoggerInterfaces/Check.h"
@@ -47,6 +52,27 @@ namespace BitFunnel
                                           IDocumentFrequencyTable const & terms,
                                           IFactSet const & facts,
                                           ITermTable & termTable)
+    {
+        return CreateTermTableBuilder(density,
+                                      adhocFrequency,
+                                      treatment,
+                                      terms,
+                                      facts,
+                                      termTable,
+                                      nullptr,
+                                      nullptr);
+    }
+
+
+    std::unique_ptr<ITermTableBuilder>
+        Factories::CreateTermTableBuilder(double density,
+                                          double adhocFrequency,
+                                          ITermTreatment const & treatment,
+                                          IDocumentFrequencyTable const & terms,
+                                          IFactSet const & facts,
+                                          ITermTable & termTable,
+                                          ICoOccurrenceTable const * coOccurrences,
+                                          IDocumentFrequencyTable const * explicitTerms)
     {
         // TODO: make skipDistance (currently c_explicitRowRandomizaitonLimit) a parameter.
         return
@@ -56,10 +82,47 @@ namespace BitFunnel
                                                                     terms,
                                                                     facts,
                                                                     termTable,
-                                                                    c_explicitRowRandomizationLimit));
+                                                                    c_explicitRowRandomizationLimit,
+                                                                    coOccurrences,
+                                                                    explicitTerms));
     }
 
 
+    //*************************************************************************
+    //
+    // RowAssignerProcessor
+    //
+    // Runs RowAssigner::AssignExplicit() for the rank with the same number as
+    // the task.
+    //
+    //*************************************************************************
+    template <typename ASSIGNER>
+    class RowAssignerProcessor : public ITaskProcessor
+    {
+    public:
+        RowAssignerProcessor(std::vector<std::unique_ptr<ASSIGNER>> const & assigners)
+          : m_assigners(assigners)
+        {
+        }
+
+        //
+        // ITaskProcessor methods
+        //
+
+        virtual void ProcessTask(size_t taskId) override
+        {
+            m_assigners[taskId]->AssignExplicit();
+        }
+
+        virtual void Finished() override
+        {
+        }
+
+    private:
+        std::vector<std::unique_ptr<ASSIGNER>> const & m_assigners;
+    };
+
+
     //*************************************************************************
     //
     // TermTableBuilder
@@ -71,13 +134,11 @@ namespace BitFunnel
                                        IDocumentFrequencyTable const & terms,
                                        IFactSet const & facts,
                                        ITermTable & termTable,
-                                       unsigned randomSkipDistance)
+                                       unsigned randomSkipDistance,
+                                       ICoOccurrenceTable const * coOccurrences,
+                                       IDocumentFrequencyTable const * explicitTerms)
         : m_termTable(termTable),
-          m_buildTime(0.0),
-          // seed, min value, max value.
-          m_random(std::make_unique<RandomInt<unsigned>>(0,
-                                                         0,
-                                                         randomSkipDistance))
+          m_buildTime(0.0)
     {
         Stopwatch stopwatch;
 
@@ -89,9 +150,24 @@ namespace BitFunnel
                     new RowAssigner(rank,
                                     density,
                                     termTable,
-                                    *m_random)));
+                                    randomSkipDistance,
+                                    coOccurrences)));
         }
 
+        // Hash and number of configuration entries of each explicit term,
+        // and the rank of each entry, in the order the requests were made.
+        std::vector<std::pair<Term::Hash, size_t>> explicitRequests;
+        std::vector<Rank> requestRanks;
+
+        // Terms that get explicit rows regardless of their frequency.
+        std::unordered_set<Term::Hash> forcedExplicit;
+        if (explicitTerms != nullptr)
+        {
+            for (auto const & entry : *explicitTerms)
+            {
+                forcedExplicit.insert(entry.GetTerm().GetRawHash());
+            }
+        }
 
         // For each entry in the document frequency table.
         // (note that the entries are sorted in order of decreasing frequency).
@@ -106,7 +182,9 @@ namespace BitFunnel
             // Get the term's RowConfiguration.
             auto configuration = treatment.GetTreatment(dfEntry.GetTerm());
 
-            if (dfEntry.GetFrequency() < adhocFrequency)
+            if (dfEntry.GetFrequency() < adhocFrequency &&
+                forcedExplicit.find(dfEntry.GetTerm().GetRawHash()) ==
+                    forcedExplicit.end())
             {
                 // For each rank entry in the RowConfiguration.
                 for (auto rcEntry : configuration)
@@ -119,24 +197,61 @@ namespace BitFunnel
             }
             else
             {
-                m_termTable.OpenTerm();
                 //std::cout << "  Configuration: ";
                 //configuration.Write(std::cout);
                 //std::cout << std::endl;
 
                 // For each rank entry in the RowConfiguration.
+                size_t entryCount = 0;
                 for (auto rcEntry : configuration)
                 {
-                    // Assign the appropriate rows.
+                    // Request the appropriate rows.
                     m_rowAssigners[rcEntry.GetRank()]->
-                        AssignExplicit(dfEntry.GetFrequency(),
-                                       rcEntry.GetRowCount());
+                        RequestExplicit(dfEntry.GetFrequency(),
+                                        rcEntry.GetRowCount(),
+                                        dfEntry.GetTerm().GetRawHash());
+                    requestRanks.push_back(rcEntry.GetRank());
+                    ++entryCount;
                 }
 
-                m_termTable.CloseTerm(dfEntry.GetTerm().GetRawHash());
+                explicitRequests.push_back(
+                    std::make_pair(dfEntry.GetTerm().GetRawHash(), entryCount));
             }
         }
 
+        // Bin pack each rank on its own thread.
+        {
+            const size_t threadCount =
+                (std::min)(static_cast<size_t>(c_maxRankValue + 1),
+                           static_cast<size_t>(
+                               (std::max)(1u, std::thread::hardware_concurrency())));
+
+            std::vector<std::unique_ptr<ITaskProcessor>> processors;
+            for (size_t i = 0; i < threadCount; ++i)
+            {
+                processors.push_back(
+                    std::unique_ptr<ITaskProcessor>(
+                        new RowAssignerProcessor<RowAssigner>(m_rowAssigners)));
+            }
+
+            auto distributor =
+                Factories::CreateTaskDistributor(processors,
+                                                 m_rowAssigners.size());
+            distributor->WaitForCompletion();
+        }
+
+        // Add the explicit terms to the TermTable, in their original order.
+        size_t request = 0;
+        for (auto const & term : explicitRequests)
+        {
+            m_termTable.OpenTerm();
+            for (size_t i = 0; i < term.second; ++i)
+            {
+                m_rowAssigners[requestRanks[request++]]->AddNextRowIds();
+            }
+            m_termTable.CloseTerm(term.first);
+        }
+
         // TODO: make entries for facts.
 
         // For each (IdfX10, GramSize) pair.
@@ -249,21 +364,33 @@ namespace BitFunnel
     // TermTableBuilder::RowAssigner
     //
     //*************************************************************************
+    const double TermTableBuilder::RowAssigner::c_correlatedContainment = 0.5;
+    const size_t TermTableBuilder::RowAssigner::c_maxCorrelatedSkips;
+    const size_t TermTableBuilder::RowAssigner::c_maxCorrelationChecks;
+
+
     TermTableBuilder::RowAssigner::RowAssigner(
         Rank rank,
         double density,
         ITermTable & termTable,
-        RandomInt<unsigned>& random)
+        unsigned randomSkipDistance,
+        ICoOccurrenceTable const * coOccurrences)
         : m_rank(rank),
           m_density(density),
           m_termTable(termTable),
+          m_coOccurrences(coOccurrences),
           m_adhocTotal(0),
           m_currentRow(0),
+          m_nextRequest(0),
+          m_nextRow(0),
+          m_correlatedSkipCount(0),
+          m_correlatedShareCount(0),
           m_privateExplicitTermCount(0),
           m_sharedAdhocTermCount(0),
           m_sharedExplicitTermCount(0),
           m_privateExplicitRowCount(0),
-          m_random(random)
+          // seed, min value, max value.
+          m_random(rank, 0, randomSkipDistance)
     {
         // TODO: Is there a way to reduce this coupling between RowAssigner
         // and the internals of TermTable?
@@ -276,12 +403,51 @@ namespace BitFunnel
     }
 
 
-    void TermTableBuilder::RowAssigner::AssignExplicit(double frequency,
-                                                       RowIndex count)
+    void TermTableBuilder::RowAssigner::RequestExplicit(double frequency,
+                                                        RowIndex count,
+                                                        Term::Hash hash)
     {
         // Compute the frequency at rank.
-        double f = Term::FrequencyAtRank(frequency, m_rank);
+        m_requests.push_back(
+            std::make_pair(Term::FrequencyAtRank(frequency, m_rank), count));
+        m_requestHashes.push_back(hash);
+    }
+
 
+    void TermTableBuilder::RowAssigner::AssignExplicit()
+    {
+        for (size_t i = 0; i < m_requests.size(); ++i)
+        {
+            const size_t start = m_assignedRows.size();
+            AssignExplicit(m_requests[i].first,
+                           m_requests[i].second,
+                           m_requestHashes[i]);
+            m_assignedCounts.push_back(
+                static_cast<RowIndex>(m_assignedRows.size() - start));
+        }
+
+        // Free the requests and row terms, which are no longer needed.
+        std::vector<std::pair<double, RowIndex>>().swap(m_requests);
+        std::vector<Term::Hash>().swap(m_requestHashes);
+        std::vector<std::vector<Term::Hash>>().swap(m_rowTerms);
+    }
+
+
+    void TermTableBuilder::RowAssigner::AddNextRowIds()
+    {
+        const RowIndex count = m_assignedCounts[m_nextRequest++];
+        for (RowIndex i = 0; i < count; ++i)
+        {
+            // TODO: figure out ShardId value here.
+            m_termTable.AddRowId(RowId(m_rank, m_assignedRows[m_nextRow++]));
+        }
+    }
+
+
+    void TermTableBuilder::RowAssigner::AssignExplicit(double f,
+                                                       RowIndex count,
+                                                       Term::Hash hash)
+    {
         if (f >= m_density)
         {
             // A private row was requested or this term was found to have
@@ -292,9 +458,9 @@ namespace BitFunnel
             ++m_privateExplicitTermCount;
             ++m_privateExplicitRowCount;
 
-            // Just reserve the RowIndex and then add the appropriate RowID to
-            // the TermTableBuilder.
-            m_termTable.AddRowId(RowId(m_rank, m_currentRow++));
+            // Just reserve the RowIndex. AddNextRowIds() will add the
+            // appropriate RowId to the TermTable.
+            m_assignedRows.push_back(m_currentRow++);
         }
         else
         {
@@ -309,6 +475,9 @@ namespace BitFunnel
             std::vector<Bin> currentBins;
             std::vector<Bin> skippedBins;
 
+            const bool isCorrelationTracked =
+                m_coOccurrences != nullptr && m_coOccurrences->Contains(hash);
+
             for (RowIndex i = 0; i < count; ++i)
             {
                 // Look for an existing bin with enough space.
@@ -333,6 +502,47 @@ namespace BitFunnel
                     --skipDistance;
                 }
 
+                if (it != m_bins.end() && isCorrelationTracked)
+                {
+                    // Bins after it have more space, so any of them can
+                    // hold the term. If the term is correlated with a term
+                    // in it, take the first uncorrelated bin among the next
+                    // few, or else the least correlated one. Correlation
+                    // never costs extra rows.
+                    auto best = it;
+                    double bestCorrelation = GetCorrelation(it->GetIndex(), hash);
+                    auto candidate = it;
+                    for (size_t skip = 0;
+                         skip < c_maxCorrelatedSkips &&
+                         bestCorrelation >= c_correlatedContainment;
+                         ++skip)
+                    {
+                        if (++candidate == m_bins.end())
+                        {
+                            break;
+                        }
+
+                        const double correlation =
+                            GetCorrelation(candidate->GetIndex(), hash);
+                        if (correlation < bestCorrelation)
+                        {
+                            best = candidate;
+                            bestCorrelation = correlation;
+                        }
+                    }
+
+                    if (best != it)
+                    {
+                        ++m_correlatedSkipCount;
+                        it = best;
+                    }
+
+                    if (bestCorrelation >= c_correlatedContainment)
+                    {
+                        ++m_correlatedShareCount;
+                    }
+                }
+
                 if (it == m_bins.end())
                 {
                     // No existing bin has enough space. Start a new bin.
@@ -366,11 +576,19 @@ namespace BitFunnel
 
             // All of the bins for this term have been identified.
 
-            // Now add the appropriate RowIds to the TermTable.
+            // Now record the appropriate rows for AddNextRowIds().
             for (auto b : currentBins)
             {
-                // TODO: figure out ShardId value here.
-                m_termTable.AddRowId(RowId(m_rank, b.GetIndex()));
+                m_assignedRows.push_back(b.GetIndex());
+
+                if (isCorrelationTracked)
+                {
+                    if (b.GetIndex() >= m_rowTerms.size())
+                    {
+                        m_rowTerms.resize(b.GetIndex() + 1);
+                    }
+                    m_rowTerms[b.GetIndex()].push_back(hash);
+                }
             }
 
             // Reinsert the bins into m_bins.
@@ -379,6 +597,40 @@ namespace BitFunnel
     }
 
 
+    double TermTableBuilder::RowAssigner::GetCorrelation(RowIndex row,
+                                                         Term::Hash hash) const
+    {
+        if (row >= m_rowTerms.size())
+        {
+            return 0.0;
+        }
+
+        const double frequency = m_coOccurrences->GetFrequency(hash);
+        double correlation = 0.0;
+
+        // Terms are packed in order of decreasing frequency, so the most
+        // recently packed terms have frequencies closest to this term's.
+        // These are the pairs whose MinHash estimates are most accurate.
+        auto const & terms = m_rowTerms[row];
+        size_t checks = 0;
+        for (auto it = terms.rbegin();
+             it != terms.rend() && checks < c_maxCorrelationChecks;
+             ++it, ++checks)
+        {
+            const double smaller =
+                (std::min)(frequency, m_coOccurrences->GetFrequency(*it));
+            if (smaller > 0.0)
+            {
+                correlation =
+                    (std::max)(correlation,
+                               m_coOccurrences->GetJointFrequency(hash, *it) / smaller);
+            }
+        }
+
+        return correlation;
+    }
+
+
     void TermTableBuilder::RowAssigner::AssignAdhoc(double frequency,
                                                     RowIndex count)
     {
@@ -449,6 +701,16 @@ namespace BitFunnel
             output << "    Explicit: " << GetExplicitRowCount() << std::endl;
             output << std::endl;
 
+            if (m_coOccurrences != nullptr)
+            {
+                output << "  Correlated terms" << std::endl;
+                output << "    Moved from best fit row: "
+                       << m_correlatedSkipCount << std::endl;
+                output << "    Sharing a row: "
+                       << m_correlatedShareCount << std::endl;
+                output << std::endl;
+            }
+
             output << "  Bytes per document: "
                    << m_termTable.GetBytesPerDocument(m_rank) << std::endl;
 
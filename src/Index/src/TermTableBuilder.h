@@ -27,6 +27,7 @@
 #include <map>                                  // std::map member.
 #include <memory>                               // std::unique_ptr member.
 #include <set>                                  // std::set member.
+#include <utility>                              // std::pair member.
 #include <vector>                               // std::vector member.
 
 #include "BitFunnel/BitFunnelTypes.h"           // Rank parameter.
@@ -40,10 +41,31 @@
 namespace BitFunnel
 {
     class DocumentFrequencyTable;   // TODO: IDocumentFrequencyTable
+    class ICoOccurrenceTable;
     class IFactSet;
     class ITermTreatment;
     class ITermTable;
 
+    //*************************************************************************
+    //
+    // TermTableBuilder
+    //
+    // Assigns rows to the terms in an IDocumentFrequencyTable. Each rank has
+    // its own RowAssigner. The builder first queues each term's explicit
+    // row requests with the RowAssigners, then bin packs each rank on its
+    // own thread, and finally adds the assigned rows to the ITermTable in
+    // term order. Each RowAssigner has its own random number generator,
+    // seeded by rank, so the TermTable does not depend on thread timing.
+    //
+    // When given an ICoOccurrenceTable, the RowAssigners avoid packing terms
+    // that often appear in the same documents into the same shared row.
+    // Such terms tend to appear in the same queries, where a shared row
+    // filters once instead of twice.
+    //
+    // Terms in explicitTerms are given explicit rows even when they are
+    // rare enough for adhoc rows.
+    //
+    //*************************************************************************
     class TermTableBuilder : public ITermTableBuilder
     {
     public:
@@ -53,7 +75,9 @@ namespace BitFunnel
                          IDocumentFrequencyTable const & terms,
                          IFactSet const & facts,
                          ITermTable & termTable,
-                         unsigned randomSkipDistance);
+                         unsigned randomSkipDistance,
+                         ICoOccurrenceTable const * coOccurrences = nullptr,
+                         IDocumentFrequencyTable const * explicitTerms = nullptr);
 
         virtual void Print(std::ostream& output) const override;
 
@@ -87,9 +111,6 @@ namespace BitFunnel
 
         double m_buildTime;
 
-        // Random number generator.
-        std::unique_ptr<RandomInt<unsigned>> m_random;
-
         class RowAssignment
         {
         public:
@@ -121,9 +142,24 @@ namespace BitFunnel
             RowAssigner(Rank rank,
                         double density,
                         ITermTable & termTable,
-                        RandomInt<unsigned>& random);
+                        unsigned randomSkipDistance,
+                        ICoOccurrenceTable const * coOccurrences);
+
+            // Queues a request for count rows for an explicit term. Requests
+            // are assigned rows by AssignExplicit().
+            void RequestExplicit(double frequency,
+                                 RowIndex count,
+                                 Term::Hash hash);
+
+            // Assigns rows to the queued explicit requests, in the order
+            // they were made. Does not modify the ITermTable, so
+            // RowAssigners for different ranks may run on different threads.
+            void AssignExplicit();
+
+            // Adds the rows assigned to the next explicit request to the
+            // ITermTable's open term.
+            void AddNextRowIds();
 
-            void AssignExplicit(double frequency, RowIndex count);
             void AssignAdhoc(double frequency, RowIndex count);
 
             RowIndex GetExplicitRowCount() const;
@@ -132,10 +168,32 @@ namespace BitFunnel
             void Print(std::ostream& output) const;
 
         private:
+            // Assigns rows for one explicit request, with f being the
+            // frequency at m_rank.
+            void AssignExplicit(double f, RowIndex count, Term::Hash hash);
+
+            // Returns the largest fraction of documents containing the
+            // rarer term that also contain the other, over pairs of the
+            // term and terms already packed into the shared row.
+            double GetCorrelation(RowIndex row, Term::Hash hash) const;
+
+            // A term is correlated with a row when GetCorrelation() is at
+            // least c_correlatedContainment.
+            static const double c_correlatedContainment;
+
+            // Number of bins after the best fit bin that are considered
+            // for a term correlated with the best fit bin.
+            static const size_t c_maxCorrelatedSkips = 8;
+
+            // GetCorrelation() only checks the most recently packed terms,
+            // which are the ones with the most similar frequencies.
+            static const size_t c_maxCorrelationChecks = 32;
+
             // Constructor parameters.
             Rank m_rank;
             double m_density;
             ITermTable & m_termTable;
+            ICoOccurrenceTable const * m_coOccurrences;
 
             // Sum of frequencies of all adhoc terms. Used to compute the
             // number of adhoc rows.
@@ -143,9 +201,34 @@ namespace BitFunnel
 
             RowIndex m_currentRow;
 
+            // Frequency at rank and row count of each explicit request, and
+            // the hash of the requesting term.
+            std::vector<std::pair<double, RowIndex>> m_requests;
+            std::vector<Term::Hash> m_requestHashes;
+
+            // Rows assigned to each request, in request order, and the
+            // number assigned to each request.
+            std::vector<RowIndex> m_assignedRows;
+            std::vector<RowIndex> m_assignedCounts;
+
+            // Position of the next request in m_assignedCounts and of its
+            // first row in m_assignedRows. Used by AddNextRowIds().
+            size_t m_nextRequest;
+            size_t m_nextRow;
+
             class Bin;
             std::set<Bin> m_bins;
 
+            // Terms in m_coOccurrences packed into each shared row, in
+            // packing order. Indexed by RowIndex.
+            std::vector<std::vector<Term::Hash>> m_rowTerms;
+
+            // Number of terms moved from their best fit row to avoid a
+            // correlated term, and number of terms that share a row with a
+            // correlated term because no nearby row was uncorrelated.
+            size_t m_correlatedSkipCount;
+            size_t m_correlatedShareCount;
+
             // If any termCount is > 0, then we consider this rank "in use" and
             // set the row count to be at least some minimum value..
             //
@@ -158,7 +241,7 @@ namespace BitFunnel
 
             size_t m_privateExplicitRowCount;
 
-            RandomInt<unsigned>& m_random;
+            RandomInt<unsigned> m_random;
 
 
             class Bin
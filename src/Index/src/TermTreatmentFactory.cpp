@@ -29,6 +29,7 @@
 #include "TreatmentPrivateSharedRank0.h"
 #include "TreatmentPrivateSharedRank0And3.h"
 #include "TreatmentPrivateSharedRank0ToN.h"
+#include "TreatmentQueryAware.h"
 
 
 namespace BitFunnel
@@ -52,6 +53,7 @@ namespace BitFunnel
         AddTreatment<TreatmentPrivateSharedRank0ToN>();
         AddTreatment<TreatmentOptimal>();
         AddTreatment<TreatmentClassicBitsliced>();
+        AddQueryTermTreatment<TreatmentQueryAware>();
     }
 
 
@@ -73,13 +75,24 @@ namespace BitFunnel
         TermTreatmentFactory::CreateTreatment(char const * name,
                                               double density,
                                               double snr) const
+    {
+        return CreateTreatment(name, density, snr, nullptr);
+    }
+
+
+    std::unique_ptr<ITermTreatment>
+        TermTreatmentFactory::CreateTreatment(
+            char const * name,
+            double density,
+            double snr,
+            IDocumentFrequencyTable const * queryTerms) const
     {
         size_t i = 0;
         for (i = 0; i < m_names.size(); ++i)
         {
             if (m_names[i] == name)
             {
-                return m_creators[i](density, snr);
+                return m_creators[i](density, snr, queryTerms);
             }
         }
 
@@ -25,6 +25,7 @@
 #include <string>   // std::string embedded.
 #include <vector>   // std::vector embedded.
 
+#include "BitFunnel/Exceptions.h"                   // RecoverableError thrown.
 #include "BitFunnel/Index/ITermTreatmentFactory.h"  // Base class.
 #include "LoggerInterfaces/Check.h"
 
@@ -52,23 +53,67 @@ namespace BitFunnel
                             double density,
                             double snr) const override;
 
+        virtual std::unique_ptr<ITermTreatment>
+            CreateTreatment(char const * name,
+                            double density,
+                            double snr,
+                            IDocumentFrequencyTable const * queryTerms) const override;
+
     private:
         typedef std::unique_ptr<ITermTreatment>(*Creator)(
             double density,
-            double snr);
+            double snr,
+            IDocumentFrequencyTable const * queryTerms);
 
         template <class TREATMENT>
-        static std::unique_ptr<ITermTreatment> Create(double density,
-                                                      double snr)
+        static std::unique_ptr<ITermTreatment> Create(
+            double density,
+            double snr,
+            IDocumentFrequencyTable const * /*queryTerms*/)
         {
             return std::unique_ptr<ITermTreatment>
                 (new TREATMENT(density, snr));
         }
 
+        // Creator for treatments whose constructors also take the query
+        // term frequency table.
+        template <class TREATMENT>
+        static std::unique_ptr<ITermTreatment> CreateWithQueryTerms(
+            double density,
+            double snr,
+            IDocumentFrequencyTable const * queryTerms)
+        {
+            if (queryTerms == nullptr)
+            {
+                throw RecoverableError(
+                    std::string("ITermTreatment ") + TREATMENT::GetName() +
+                    " requires query term frequencies.");
+            }
+
+            return std::unique_ptr<ITermTreatment>
+                (new TREATMENT(density, snr, *queryTerms));
+        }
+
         template <class TREATMENT>
         void AddTreatment()
         {
-            auto name = TREATMENT::GetName();
+            AddCreator(TREATMENT::GetName(),
+                       TREATMENT::GetDescription(),
+                       Create<TREATMENT>);
+        }
+
+        template <class TREATMENT>
+        void AddQueryTermTreatment()
+        {
+            AddCreator(TREATMENT::GetName(),
+                       TREATMENT::GetDescription(),
+                       CreateWithQueryTerms<TREATMENT>);
+        }
+
+        void AddCreator(char const * name,
+                        char const * description,
+                        Creator creator)
+        {
             for (auto & treatment : m_names)
             {
                 CHECK_NE(treatment, name)
@@ -76,8 +121,8 @@ namespace BitFunnel
             }
 
             m_names.push_back(name);
-            m_descriptions.push_back(TREATMENT::GetDescription());
-            m_creators.push_back(Create<TREATMENT>);
+            m_descriptions.push_back(description);
+            m_creators.push_back(creator);
         }
 
         std::vector<std::string> m_names;
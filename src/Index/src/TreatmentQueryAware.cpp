@@ -0,0 +1,167 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+
+#include "BitFunnel/Index/IDocumentFrequencyTable.h"
+#include "BitFunnel/Term.h"
+#include "TreatmentQueryAware.h"
+
+
+namespace BitFunnel
+{
+    const double TreatmentQueryAware::c_hotQueryFrequency = 0.01;
+
+
+    static RowIndex ClampRowCount(int rowCount)
+    {
+        const int c_maxRowCount =
+            static_cast<int>(RowConfiguration::Entry::c_maxRowCount);
+        return static_cast<RowIndex>((std::max)(1, (std::min)(rowCount, c_maxRowCount)));
+    }
+
+
+    //*************************************************************************
+    //
+    // TreatmentQueryAware
+    //
+    // Spends rows where queries land. Terms that appear in at least
+    // c_hotQueryFrequency of the queries get the PrivateSharedRank0ToN
+    // layout, plus the extra rows needed for a ten times higher
+    // signal-to-noise ratio. The extra rows go to the top rank, unless the
+    // term is dense enough there to fill a private row, which has no noise.
+    // Then they go to rank 0.
+    //
+    // Terms that never appear in the query log only get enough shared rank 0
+    // rows to keep noise below their own signal. Other queried terms and
+    // adhoc terms are treated as PrivateSharedRank0ToN.
+    //
+    // Adhoc rows are configured by IdfX10 alone, so queried terms must be
+    // given explicit rows by the TermTableBuilder. Terms that are not
+    // queried keep the usual adhoc threshold.
+    //
+    //*************************************************************************
+    TreatmentQueryAware::TreatmentQueryAware(
+        double density,
+        double snr,
+        IDocumentFrequencyTable const & queryTerms)
+      : m_warm(density, snr)
+    {
+        const double c_hotSnrMultiplier = 10.0;
+        const double c_coldSnr = 1.0;
+
+        for (auto const & entry : queryTerms)
+        {
+            m_queryFrequencies[entry.GetTerm().GetRawHash()] =
+                entry.GetFrequency();
+        }
+
+        for (Term::IdfX10 idf = 0; idf <= Term::c_maxIdfX10Value; ++idf)
+        {
+            RowConfiguration cold;
+            RowConfiguration hot;
+
+            const double frequency = Term::IdfX10ToFrequency(idf);
+            if (frequency >= density)
+            {
+                // This term is so common that it must be assigned a private row.
+                cold.push_front(RowConfiguration::Entry(0, 1));
+                hot.push_front(RowConfiguration::Entry(0, 1));
+            }
+            else
+            {
+                cold.push_front(
+                    RowConfiguration::Entry(
+                        0,
+                        ClampRowCount(Term::ComputeRowCount(frequency,
+                                                            density,
+                                                            c_coldSnr))));
+
+                // Same ranks as PrivateSharedRank0ToN, whose top row is
+                // private once the term is dense enough at that rank.
+                const double c_maxDensity = 0.15;
+                const Rank maxRank =
+                    (std::min)(Term::ComputeMaxRank(frequency, c_maxDensity),
+                               static_cast<Rank>(6u));
+
+                const int baseRows =
+                    Term::ComputeRowCount(frequency, density, snr);
+                const int hotRows =
+                    Term::ComputeRowCount(frequency,
+                                          density,
+                                          snr * c_hotSnrMultiplier);
+
+                int rank0Rows = 2;
+                int topRows = hotRows - 2 - (static_cast<int>(maxRank) - 1);
+                if (Term::FrequencyAtRank(frequency, maxRank) >= density)
+                {
+                    // The top row is private, so one is enough. The extra
+                    // rows go to rank 0 instead.
+                    rank0Rows += (std::max)(0, hotRows - baseRows);
+                    topRows = 1;
+                }
+
+                hot.push_front(RowConfiguration::Entry(0, ClampRowCount(rank0Rows)));
+                for (Rank rank = 1; rank < maxRank; ++rank)
+                {
+                    hot.push_front(RowConfiguration::Entry(rank, 1));
+                }
+                hot.push_front(RowConfiguration::Entry(maxRank, ClampRowCount(topRows)));
+            }
+
+            m_cold.push_back(cold);
+            m_hot.push_back(hot);
+        }
+    }
+
+
+    RowConfiguration TreatmentQueryAware::GetTreatment(Term term) const
+    {
+        // The TermTableBuilder asks for the configuration of adhoc terms
+        // using prototypes with a raw hash of zero. Any term may land in
+        // adhoc rows at query time, so they keep the warm configuration.
+        if (term.GetRawHash() == 0ull)
+        {
+            return m_warm.GetTreatment(term);
+        }
+
+        // DESIGN NOTE: we can't c_maxIdfX10Value directly to min because min
+        // takes a reference and the compiler has already turned it into a
+        // constant, which we can't take a reference to.
+        auto local = Term::c_maxIdfX10Value;
+        Term::IdfX10 idf = std::min(term.GetIdfSum(), local);
+
+        auto it = m_queryFrequencies.find(term.GetRawHash());
+        if (it == m_queryFrequencies.end())
+        {
+            return m_cold[idf];
+        }
+        else if (it->second >= c_hotQueryFrequency)
+        {
+            return m_hot[idf];
+        }
+        else
+        {
+            return m_warm.GetTreatment(term);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <unordered_map>                    // std::unordered_map member.
+#include <vector>                           // std::vector member.
+
+#include "BitFunnel/Index/ITermTreatment.h" // Base class.
+#include "TreatmentPrivateSharedRank0ToN.h" // Embedded member.
+
+
+namespace BitFunnel
+{
+    class IDocumentFrequencyTable;
+
+    class TreatmentQueryAware : public ITermTreatment
+    {
+    public:
+        // The frequency of each entry in queryTerms is the fraction of
+        // queries that contain the term.
+        TreatmentQueryAware(double density,
+                            double snr,
+                            IDocumentFrequencyTable const & queryTerms);
+
+        //
+        // ITermTreatment methods.
+        //
+
+        virtual RowConfiguration GetTreatment(Term term) const override;
+
+
+        //
+        // Static methods used by ITermTreatmentFactory
+        //
+        static char const * GetName()
+        {
+            return "QueryAware";
+        }
+
+
+        static char const * GetDescription()
+        {
+            return "Terms frequent in queries get PrivateSharedRank0ToN rows plus extra rows for a higher signal-to-noise ratio, terms absent from queries get a few shared rank 0 rows, and the rest are treated as PrivateSharedRank0ToN. Requires a query log.";
+        }
+
+        // Terms in at least this fraction of queries are treated as hot.
+        static const double c_hotQueryFrequency;
+
+    private:
+        // Configurations for unqueried and hot terms, indexed by IdfX10.
+        std::vector<RowConfiguration> m_cold;
+        std::vector<RowConfiguration> m_hot;
+
+        // Configuration for terms that are queried, but not hot, and for
+        // adhoc terms.
+        TreatmentPrivateSharedRank0ToN m_warm;
+
+        // Query frequency of each term, indexed by raw hash.
+        std::unordered_map<Term::Hash, double> m_queryFrequencies;
+    };
+}
@@ -0,0 +1,134 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "CoOccurrenceTable.h"
+
+
+namespace BitFunnel
+{
+    namespace CoOccurrenceTableTest
+    {
+        // Returns the sketch for a term in documents [start, end).
+        static CoOccurrenceTable::Sketch MakeSketch(DocId start, DocId end)
+        {
+            CoOccurrenceTable::Sketch sketch;
+            for (DocId id = start; id < end; ++id)
+            {
+                sketch.Add(CoOccurrenceTable::HashDocument(id));
+            }
+            return sketch;
+        }
+
+
+        TEST(CoOccurrenceTable, SketchSize)
+        {
+            auto sketch = MakeSketch(0, 1000);
+            ASSERT_EQ(CoOccurrenceTable::c_sketchSize, sketch.size());
+
+            // Sketches hold the smallest hashes in increasing order.
+            std::vector<uint64_t> hashes;
+            for (DocId id = 0; id < 1000; ++id)
+            {
+                hashes.push_back(CoOccurrenceTable::HashDocument(id));
+            }
+            std::sort(hashes.begin(), hashes.end());
+            for (size_t i = 0; i < sketch.size(); ++i)
+            {
+                EXPECT_EQ(hashes[i], sketch[i]);
+            }
+
+            // Adding a document twice does not change the sketch.
+            auto repeated = sketch;
+            repeated.Add(sketch[0]);
+            EXPECT_EQ(sketch, repeated);
+        }
+
+
+        // Terms in fewer than c_sketchSize documents have exact joint
+        // frequencies.
+        TEST(CoOccurrenceTable, SmallTermsAreExact)
+        {
+            const double documentCount = 100.0;
+
+            CoOccurrenceTable table;
+            table.AddTerm(1ull, 10 / documentCount, MakeSketch(0, 10));
+            table.AddTerm(2ull, 10 / documentCount, MakeSketch(5, 15));
+            table.AddTerm(3ull, 10 / documentCount, MakeSketch(20, 30));
+
+            EXPECT_TRUE(table.Contains(1ull));
+            EXPECT_FALSE(table.Contains(4ull));
+
+            EXPECT_DOUBLE_EQ(0.1, table.GetFrequency(1ull));
+            EXPECT_EQ(0.0, table.GetFrequency(4ull));
+
+            EXPECT_DOUBLE_EQ(0.05, table.GetJointFrequency(1ull, 2ull));
+            EXPECT_DOUBLE_EQ(0.05, table.GetJointFrequency(2ull, 1ull));
+            EXPECT_DOUBLE_EQ(0.1, table.GetJointFrequency(1ull, 1ull));
+            EXPECT_EQ(0.0, table.GetJointFrequency(1ull, 3ull));
+            EXPECT_EQ(0.0, table.GetJointFrequency(1ull, 4ull));
+        }
+
+
+        TEST(CoOccurrenceTable, LargeTermsAreEstimated)
+        {
+            const double documentCount = 10000.0;
+
+            CoOccurrenceTable table;
+            table.AddTerm(1ull, 1000 / documentCount, MakeSketch(0, 1000));
+            table.AddTerm(2ull, 500 / documentCount, MakeSketch(0, 500));
+            table.AddTerm(3ull, 1000 / documentCount, MakeSketch(5000, 6000));
+
+            // Term 2 is contained in term 1.
+            EXPECT_NEAR(0.05, table.GetJointFrequency(1ull, 2ull), 0.02);
+            EXPECT_LE(table.GetJointFrequency(1ull, 2ull), 0.05);
+
+            // Terms 1 and 3 are disjoint.
+            EXPECT_EQ(0.0, table.GetJointFrequency(1ull, 3ull));
+        }
+
+
+        TEST(CoOccurrenceTable, RoundTrip)
+        {
+            CoOccurrenceTable table;
+            table.AddTerm(1ull, 0.1, MakeSketch(0, 100));
+            table.AddTerm(2ull, 0.05, MakeSketch(50, 100));
+
+            std::stringstream stream;
+            table.Write(stream);
+
+            CoOccurrenceTable table2(stream);
+
+            EXPECT_TRUE(table2.Contains(1ull));
+            EXPECT_TRUE(table2.Contains(2ull));
+            EXPECT_EQ(table.GetFrequency(1ull), table2.GetFrequency(1ull));
+            EXPECT_EQ(table.GetFrequency(2ull), table2.GetFrequency(2ull));
+            EXPECT_EQ(table.GetJointFrequency(1ull, 2ull),
+                      table2.GetJointFrequency(1ull, 2ull));
+        }
+    }
+}
@@ -0,0 +1,343 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Configuration/Factories.h"
+#include "BitFunnel/Configuration/IFileSystem.h"
+#include "BitFunnel/Configuration/IShardDefinition.h"
+#include "BitFunnel/IFileManager.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IIngestor.h"
+#include "BitFunnel/Index/ISimpleIndex.h"
+#include "BitFunnel/Index/ITermTable.h"
+#include "BitFunnel/Index/ITermTableCollection.h"
+#include "BitFunnel/Index/RowIdSequence.h"
+#include "BitFunnel/Term.h"
+#include "Correlate.h"
+
+
+namespace BitFunnel
+{
+    namespace CorrelateTest
+    {
+        static const Term::StreamId c_streamId = 0;
+        static const ShardId c_shardCount = 2;
+        static const size_t c_termCount = 40;
+        static const RowIndex c_rowPoolSize = 16;
+
+
+        static std::string GetText(size_t term)
+        {
+            return "t" + std::to_string(term);
+        }
+
+
+        // Each term gets up to three rank 0 rows from a small pool, so many
+        // terms share more than one row. The rows differ by shard.
+        static std::unique_ptr<ITermTable> CreateTermTable(ShardId shard)
+        {
+            const RowIndex firstRow = ITermTable::SystemTerm::Count;
+            const RowIndex adhocRowCount = 1;
+
+            auto termTable = Factories::CreateTermTable();
+            for (size_t term = 0; term < c_termCount; ++term)
+            {
+                std::vector<RowIndex> rows;
+                for (size_t i = 0; i < 3; ++i)
+                {
+                    const RowIndex row = static_cast<RowIndex>(
+                        (term * (i + 2) + i * 5 + shard * 3) % c_rowPoolSize);
+                    if (std::find(rows.begin(), rows.end(), row) == rows.end())
+                    {
+                        rows.push_back(row);
+                    }
+                }
+
+                termTable->OpenTerm();
+                for (auto row : rows)
+                {
+                    termTable->AddRowId(RowId(0, firstRow + row));
+                }
+                termTable->CloseTerm(Term::ComputeRawHash(GetText(term).c_str()));
+            }
+            termTable->SetRowCounts(0, firstRow + c_rowPoolSize, adhocRowCount);
+            termTable->Seal();
+
+            return termTable;
+        }
+
+
+        static std::unique_ptr<ISimpleIndex> CreateIndex(IFileSystem & fileSystem)
+        {
+            auto termTables = Factories::CreateTermTableCollection();
+            auto shardDefinition = Factories::CreateShardDefinition();
+            for (ShardId shard = 0; shard < c_shardCount; ++shard)
+            {
+                termTables->AddTermTable(CreateTermTable(shard));
+                shardDefinition->AddShard(shard * 100, 0.15);
+            }
+
+            auto index = Factories::CreateSimpleIndex(fileSystem);
+            index->SetTermTableCollection(std::move(termTables));
+            index->SetShardDefinition(std::move(shardDefinition));
+            index->ConfigureAsMock(1, false);
+            index->StartIndex();
+
+            return index;
+        }
+
+
+        // Terms are listed in an order that differs from their numbering,
+        // with one duplicate.
+        static std::vector<std::string> GetTerms()
+        {
+            std::vector<std::string> terms;
+            for (size_t term = 0; term < c_termCount; ++term)
+            {
+                terms.push_back(GetText((term * 7) % c_termCount));
+            }
+            terms.push_back(terms[3]);
+            return terms;
+        }
+
+
+        static std::string Read(IFileManager & fileManager, ShardId shard)
+        {
+            auto input = fileManager.Correlate(shard).OpenForRead();
+            std::stringstream text;
+            text << input->rdbuf();
+            return text.str();
+        }
+
+
+        static std::vector<std::string> RunCorrelate(ISimpleIndex const & index,
+                                                     IFileSystem & fileSystem,
+                                                     char const * outDir,
+                                                     size_t threadCount,
+                                                     size_t topPairCount,
+                                                     size_t termsPerPartition =
+                                                         Correlate::c_defaultTermsPerPartition)
+        {
+            auto fileManager = Factories::CreateFileManager(outDir,
+                                                            outDir,
+                                                            outDir,
+                                                            fileSystem);
+
+            auto terms = GetTerms();
+            Correlate correlate(index, terms, termsPerPartition);
+            correlate.CorrelateRows(*fileManager, threadCount, topPairCount);
+
+            std::vector<std::string> output;
+            for (ShardId shard = 0; shard < c_shardCount; ++shard)
+            {
+                output.push_back(Read(*fileManager, shard));
+            }
+            return output;
+        }
+
+
+        static std::vector<RowId> GetRows(ISimpleIndex const & index,
+                                          ShardId shard,
+                                          std::string const & text)
+        {
+            Term term(text.c_str(), c_streamId, index.GetConfiguration());
+            RowIdSequence rows(term, index.GetTermTable(shard));
+            return std::vector<RowId>(rows.begin(), rows.end());
+        }
+
+
+        static uint32_t CountSharedRows(std::vector<RowId> const & a,
+                                        std::vector<RowId> const & b)
+        {
+            uint32_t count = 0;
+            for (auto row : a)
+            {
+                if (std::find(b.begin(), b.end(), row) != b.end())
+                {
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+
+        TEST(Correlate, ThreadCountDoesNotChangeOutput)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = CreateIndex(*fileSystem);
+
+            for (size_t topPairCount : { 0, 10 })
+            {
+                auto expected = RunCorrelate(*index, *fileSystem, "one", 1, topPairCount);
+                for (ShardId shard = 0; shard < c_shardCount; ++shard)
+                {
+                    EXPECT_FALSE(expected[shard].empty());
+                }
+
+                for (size_t threadCount : { 2, 3, 8 })
+                {
+                    auto observed = RunCorrelate(*index,
+                                        *fileSystem,
+                                        "many",
+                                        threadCount,
+                                        topPairCount);
+                    EXPECT_EQ(expected, observed);
+                }
+            }
+        }
+
+
+        // Partitions of a few terms each, with many threads, exercise the
+        // limit on how far ahead of the output a partition may start.
+        TEST(Correlate, PartitionSizeDoesNotChangeOutput)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = CreateIndex(*fileSystem);
+
+            for (size_t topPairCount : { 0, 10 })
+            {
+                auto expected = RunCorrelate(*index, *fileSystem, "one", 1, topPairCount);
+                for (size_t termsPerPartition : { 1, 3, 7 })
+                {
+                    for (size_t threadCount : { 1, 3, 8 })
+                    {
+                        auto observed = RunCorrelate(*index,
+                                            *fileSystem,
+                                            "many",
+                                            threadCount,
+                                            topPairCount,
+                                            termsPerPartition);
+                        EXPECT_EQ(expected, observed)
+                            << termsPerPartition << " terms per partition, "
+                            << threadCount << " threads";
+                    }
+                }
+            }
+        }
+
+
+        TEST(Correlate, TermsAndPartnersInTermOrder)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = CreateIndex(*fileSystem);
+            auto terms = GetTerms();
+            terms.pop_back();
+
+            auto output = RunCorrelate(*index, *fileSystem, "out", 3, 0);
+
+            for (ShardId shard = 0; shard < c_shardCount; ++shard)
+            {
+                std::vector<std::vector<RowId>> rows;
+                for (auto const & term : terms)
+                {
+                    rows.push_back(GetRows(*index, shard, term));
+                }
+
+                std::stringstream expected;
+                for (size_t term = 0; term < terms.size(); ++term)
+                {
+                    std::stringstream line;
+                    bool sharesRow = false;
+                    for (size_t partner = 0; partner < terms.size(); ++partner)
+                    {
+                        if (partner != term)
+                        {
+                            const uint32_t shared =
+                                CountSharedRows(rows[term], rows[partner]);
+                            sharesRow |= (shared > 0);
+                            if (shared > 1)
+                            {
+                                line << "," << terms[partner] << "," << shared;
+                            }
+                        }
+                    }
+                    if (sharesRow)
+                    {
+                        expected << terms[term] << line.str() << "\n";
+                    }
+                }
+
+                EXPECT_EQ(expected.str(), output[shard]);
+            }
+        }
+
+
+        TEST(Correlate, TopPairs)
+        {
+            const size_t c_topPairCount = 7;
+
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = CreateIndex(*fileSystem);
+            auto terms = GetTerms();
+            terms.pop_back();
+
+            auto output = RunCorrelate(*index, *fileSystem, "out", 3, c_topPairCount);
+
+            for (ShardId shard = 0; shard < c_shardCount; ++shard)
+            {
+                std::vector<std::vector<RowId>> rows;
+                for (auto const & term : terms)
+                {
+                    rows.push_back(GetRows(*index, shard, term));
+                }
+
+                // Decreasing shared rows, then term order.
+                std::vector<std::tuple<int, size_t, size_t>> pairs;
+                for (size_t term = 0; term < terms.size(); ++term)
+                {
+                    for (size_t partner = term + 1; partner < terms.size(); ++partner)
+                    {
+                        const uint32_t shared =
+                            CountSharedRows(rows[term], rows[partner]);
+                        if (shared > 1)
+                        {
+                            pairs.push_back(std::make_tuple(-static_cast<int>(shared),
+                                                            term,
+                                                            partner));
+                        }
+                    }
+                }
+                std::sort(pairs.begin(), pairs.end());
+                ASSERT_GT(pairs.size(), c_topPairCount);
+                pairs.resize(c_topPairCount);
+
+                std::stringstream expected;
+                expected << "term,partner,rows\n";
+                for (auto const & pair : pairs)
+                {
+                    expected << terms[std::get<1>(pair)] << ","
+                             << terms[std::get<2>(pair)] << ","
+                             << -std::get<0>(pair) << "\n";
+                }
+
+                EXPECT_EQ(expected.str(), output[shard]);
+            }
+        }
+    }
+}
@@ -24,7 +24,10 @@
 
 #include "gtest/gtest.h"
 
+#include "BitFunnel/Exceptions.h"
+#include "CoOccurrenceTable.h"
 #include "DocumentFrequencyTable.h"
+#include "DocumentFrequencyTableBuilder.h"
 #include "TermToText.h"
 
 
@@ -135,5 +138,83 @@ namespace BitFunnel
                 EXPECT_EQ(observed, expected);
             }
         }
+
+
+        // Bounds on frequencies estimated from a sample of the corpus.
+        TEST(DocumentFrequencyTable, FrequencyBounds)
+        {
+            double lower;
+            double upper;
+
+            // The whole corpus has no sampling error.
+            DocumentFrequencyTableBuilder::GetFrequencyBounds(25, 100, 1.0, lower, upper);
+            EXPECT_EQ(0.25, lower);
+            EXPECT_EQ(0.25, upper);
+            EXPECT_EQ(0.0, DocumentFrequencyTableBuilder::GetMinAccurateFrequency(100, 1.0, 0.1));
+
+            // Wilson interval for 25 of 100 documents, with the sample size
+            // corrected to 100 / (1 - 0.5) = 200.
+            DocumentFrequencyTableBuilder::GetFrequencyBounds(25, 100, 0.5, lower, upper);
+            EXPECT_NEAR(0.1951, lower, 1e-4);
+            EXPECT_NEAR(0.3143, upper, 1e-4);
+
+            // Smaller samples give wider intervals.
+            double smallLower;
+            double smallUpper;
+            DocumentFrequencyTableBuilder::GetFrequencyBounds(25, 100, 0.01, smallLower, smallUpper);
+            EXPECT_LT(smallLower, lower);
+            EXPECT_GT(smallUpper, upper);
+
+            // Terms not seen in the sample may still be in the corpus.
+            DocumentFrequencyTableBuilder::GetFrequencyBounds(0, 100, 0.5, lower, upper);
+            EXPECT_EQ(0.0, lower);
+            EXPECT_GT(upper, 0.0);
+
+            // At the minimum accurate frequency, the interval is about
+            // 10% of the frequency on either side.
+            const double f = DocumentFrequencyTableBuilder::GetMinAccurateFrequency(10000, 0.1, 0.1);
+            const size_t count = static_cast<size_t>(f * 10000);
+            DocumentFrequencyTableBuilder::GetFrequencyBounds(count, 10000, 0.1, lower, upper);
+            EXPECT_NEAR(0.1, (upper - lower) / 2 / f, 0.01);
+        }
+
+
+        // Co-occurrence sketches are only gathered on request. The written
+        // table estimates the joint frequency of two terms that share half
+        // of their documents.
+        TEST(DocumentFrequencyTable, CoOccurrences)
+        {
+            const Term a(1000ull, 0, 0, 1);
+            const Term b(1001ull, 0, 0, 1);
+
+            DocumentFrequencyTableBuilder plain;
+            DocumentFrequencyTableBuilder sketched(true);
+            for (DocId id = 0; id < 20; ++id)
+            {
+                plain.OnDocumentEnter();
+                sketched.OnDocumentEnter();
+                if (id < 10)
+                {
+                    plain.OnTerm(a, id);
+                    sketched.OnTerm(a, id);
+                }
+                if (id >= 5 && id < 15)
+                {
+                    plain.OnTerm(b, id);
+                    sketched.OnTerm(b, id);
+                }
+            }
+
+            std::stringstream stream;
+            EXPECT_THROW(plain.WriteCoOccurrenceTable(stream, 0.0),
+                         RecoverableError);
+
+            sketched.WriteCoOccurrenceTable(stream, 0.0);
+            CoOccurrenceTable table(stream);
+            EXPECT_DOUBLE_EQ(0.5, table.GetFrequency(a.GetRawHash()));
+            EXPECT_DOUBLE_EQ(0.5, table.GetFrequency(b.GetRawHash()));
+            EXPECT_DOUBLE_EQ(0.25, table.GetJointFrequency(a.GetRawHash(),
+                                                           b.GetRawHash()));
+        }
     }
 }
@@ -0,0 +1,166 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <limits>
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Configuration/IShardDefinition.h"
+#include "BitFunnel/Exceptions.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IDocumentFrequencyTable.h"
+#include "BitFunnel/Index/IDocumentHistogram.h"
+#include "BitFunnel/Index/IQueryShardCostFunction.h"
+#include "BitFunnel/Index/Row.h"
+#include "BitFunnel/Index/ShardDefinitionBuilder.h"
+#include "BitFunnel/Term.h"
+
+
+namespace BitFunnel
+{
+    namespace QueryShardCostFunctionTest
+    {
+        // 1000 short documents and 1000 long documents.
+        static std::unique_ptr<IDocumentHistogram> CreateHistogram()
+        {
+            std::stringstream input;
+            input << "Postings,Count" << std::endl
+                  << "10,1000" << std::endl
+                  << "1000,1000" << std::endl;
+            return Factories::CreateDocumentHistogram(input);
+        }
+
+
+        // Returns a cost function for queries that all look up one term in
+        // 2% of the corpus.
+        static std::unique_ptr<IQueryShardCostFunction>
+            CreateCostFunction(IDocumentHistogram const & histogram,
+                               IDocumentFrequencyTable & terms,
+                               IDocumentFrequencyTable & queryTerms)
+        {
+            const Term::Hash hash = 123;
+            terms.AddEntry(IDocumentFrequencyTable::Entry(Term(hash, 0, 0), 0.02));
+            queryTerms.AddEntry(IDocumentFrequencyTable::Entry(Term(hash, 0, 0), 1.0));
+
+            return Factories::CreateQueryShardCostFunction(histogram,
+                                                           terms,
+                                                           queryTerms,
+                                                           0.1,
+                                                           10.0,
+                                                           1.0,
+                                                           1,
+                                                           0);
+        }
+
+
+        static double GetMemoryCost(IQueryShardCostFunction& costFunction,
+                                    size_t from,
+                                    size_t to)
+        {
+            costFunction.StartAt(from);
+            for (size_t i = from; i < to; ++i)
+            {
+                costFunction.Extend();
+            }
+            return costFunction.GetMemoryCost();
+        }
+
+
+        TEST(QueryShardCostFunction, Costs)
+        {
+            auto histogram = CreateHistogram();
+            auto terms = Factories::CreateDocumentFrequencyTable();
+            auto queryTerms = Factories::CreateDocumentFrequencyTable();
+            auto costFunction = CreateCostFunction(*histogram, *terms, *queryTerms);
+
+            EXPECT_EQ(costFunction->GetVertexCount(), 3u);
+
+            const double allColumns =
+                static_cast<double>(Row::DocumentsInRank0Row(2000, 0));
+            const double halfColumns =
+                static_cast<double>(Row::DocumentsInRank0Row(1000, 0));
+
+            // Empty shards are not allowed.
+            costFunction->StartAt(0);
+            EXPECT_EQ(costFunction->GetCost(),
+                      std::numeric_limits<float>::infinity());
+
+            // The mean posting count of the corpus is 505. Over the whole
+            // corpus the term has density 0.02 and needs 3 rows to get noise
+            // below 0.002.
+            costFunction->Extend();
+            costFunction->Extend();
+            EXPECT_EQ(costFunction->GetScanCost(), allColumns * 3 + 1.0);
+            EXPECT_EQ(costFunction->GetMemoryCost(), allColumns * 10000 / 8);
+
+            // In the short documents the term has density 0.0004 and needs
+            // 5 rows.
+            costFunction->StartAt(0);
+            costFunction->Extend();
+            EXPECT_EQ(costFunction->GetScanCost(), halfColumns * 5 + 1.0);
+            EXPECT_EQ(costFunction->GetMemoryCost(), halfColumns * 100 / 8);
+
+            // In the long documents the term has density 0.04 and needs 3
+            // rows.
+            costFunction->StartAt(1);
+            costFunction->Extend();
+            EXPECT_EQ(costFunction->GetScanCost(), halfColumns * 3 + 1.0);
+            EXPECT_EQ(costFunction->GetMemoryCost(), halfColumns * 10000 / 8);
+
+            costFunction->SetMemoryWeight(2.0);
+            EXPECT_FLOAT_EQ(costFunction->GetCost(),
+                            static_cast<float>(
+                                costFunction->GetScanCost() +
+                                2.0 * costFunction->GetMemoryCost()));
+        }
+
+
+        TEST(QueryShardCostFunction, MemoryBudget)
+        {
+            auto histogram = CreateHistogram();
+            auto terms = Factories::CreateDocumentFrequencyTable();
+            auto queryTerms = Factories::CreateDocumentFrequencyTable();
+            auto costFunction = CreateCostFunction(*histogram, *terms, *queryTerms);
+
+            // Splitting off the short documents saves memory, because their
+            // rows only need to hold 10 postings.
+            const double oneShard = GetMemoryCost(*costFunction, 0, 2);
+            const double twoShards =
+                GetMemoryCost(*costFunction, 0, 1) +
+                GetMemoryCost(*costFunction, 1, 2);
+            EXPECT_LT(twoShards, oneShard);
+
+            auto definition =
+                ShardDefinitionBuilder::CreateShardDefinition(*costFunction,
+                                                              2,
+                                                              twoShards);
+            EXPECT_EQ(definition->GetShardCount(), 2u);
+            EXPECT_EQ(definition->GetMinPostingCount(1), 1000u);
+
+            EXPECT_THROW(
+                ShardDefinitionBuilder::CreateShardDefinition(*costFunction,
+                                                              2,
+                                                              twoShards / 2),
+                RecoverableError);
+        }
+    }
+}
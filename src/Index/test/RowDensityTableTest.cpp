@@ -0,0 +1,117 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Configuration/Factories.h"
+#include "BitFunnel/Configuration/IFileSystem.h"
+#include "BitFunnel/IFileManager.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IIngestor.h"
+#include "BitFunnel/Index/IRowDensityTable.h"
+#include "BitFunnel/Index/IShard.h"
+#include "BitFunnel/Index/ISimpleIndex.h"
+#include "BitFunnel/Index/RowIdSequence.h"
+#include "BitFunnel/Mocks/Factories.h"
+#include "BitFunnel/Term.h"
+
+
+namespace BitFunnel
+{
+    namespace RowDensityTableTest
+    {
+        static const Term::StreamId c_streamId = 0;
+        static const DocId c_maxDocId = 1000;
+
+        static RowId GetRow(ISimpleIndex const & index,
+                            ShardId shard,
+                            char const * text)
+        {
+            Term term(text, c_streamId, index.GetConfiguration());
+            RowIdSequence rows(term, index.GetTermTable(shard));
+            return *rows.begin();
+        }
+
+
+        // In the PrimeFactors index, about half of the documents contain the
+        // term "2" and about one seventh contain the term "7".
+        TEST(RowDensityTable, Measure)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            1);
+
+            auto densities = Factories::CreateRowDensityTable(*index);
+            ASSERT_EQ(densities->GetShardCount(), 1u);
+
+            const double density2 = densities->GetDensity(0, GetRow(*index, 0, "2"));
+            const double density7 = densities->GetDensity(0, GetRow(*index, 0, "7"));
+
+            EXPECT_NEAR(density2, 1.0 / 2, 0.01);
+            EXPECT_NEAR(density7, 1.0 / 7, 0.01);
+
+            // Rows outside of the table are treated as fully dense.
+            EXPECT_EQ(densities->GetDensity(0, RowId(0, c_maxRowIndexValue)), 1.0);
+        }
+
+
+        TEST(RowDensityTable, RoundTrip)
+        {
+            const ShardId c_shardCount = 2;
+
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            c_shardCount);
+
+            auto fileManager = Factories::CreateFileManager("config",
+                                                            "statistics",
+                                                            "index",
+                                                            *fileSystem);
+
+            auto original = Factories::CreateRowDensityTable(*index);
+            original->Write(*fileManager);
+
+            auto loaded = Factories::CreateRowDensityTable(*fileManager,
+                                                           c_shardCount);
+            ASSERT_EQ(loaded->GetShardCount(), c_shardCount);
+
+            for (ShardId shard = 0; shard < c_shardCount; ++shard)
+            {
+                for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+                {
+                    auto rowCount =
+                        index->GetIngestor().GetShard(shard).GetDensities(rank).size();
+                    for (RowIndex row = 0; row < rowCount; ++row)
+                    {
+                        RowId rowId(rank, row);
+                        EXPECT_EQ(original->GetDensity(shard, rowId),
+                                  loaded->GetDensity(shard, rowId));
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,180 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <future>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/Helpers.h"
+#include "BitFunnel/Index/IRecycler.h"
+#include "BitFunnel/Index/ITermTable.h"
+#include "BitFunnel/Index/Token.h"
+#include "BitFunnel/Utilities/Factories.h"
+#include "DocumentDataSchema.h"
+#include "DocumentHandleInternal.h"
+#include "RowTableAnalyzer.h"
+#include "RowTableDescriptor.h"
+#include "Shard.h"
+#include "Slice.h"
+#include "TrackingSliceBufferAllocator.h"
+
+
+namespace BitFunnel
+{
+    namespace RowTableAnalyzerTest
+    {
+        // More rows than the bit-sliced counters hold between flushes.
+        static const RowIndex c_rank0RowCount = 600;
+        static const RowIndex c_rank3RowCount = 300;
+
+
+        static std::unique_ptr<ITermTable> CreateTermTable()
+        {
+            const RowIndex adhocRowCount = 1;
+            const RowIndex firstRow = ITermTable::SystemTerm::Count;
+
+            auto termTable = Factories::CreateTermTable();
+            Term::Hash hash = 0;
+            for (RowIndex row = 0; row < c_rank0RowCount; ++row)
+            {
+                termTable->OpenTerm();
+                termTable->AddRowId(RowId(0, firstRow + row));
+                termTable->CloseTerm(++hash);
+            }
+            for (RowIndex row = 0; row < c_rank3RowCount; ++row)
+            {
+                termTable->OpenTerm();
+                termTable->AddRowId(RowId(3, row));
+                termTable->CloseTerm(++hash);
+            }
+            termTable->SetRowCounts(0, firstRow + c_rank0RowCount, adhocRowCount);
+            termTable->SetRowCounts(3, c_rank3RowCount, adhocRowCount);
+            termTable->Seal();
+
+            return termTable;
+        }
+
+
+        // Compares the bit-sliced counts with a scalar loop over GetBit()
+        // for five slices counted on two threads.
+        TEST(RowTableAnalyzer, CountColumns)
+        {
+            const size_t c_sliceCount = 5;
+            const size_t c_threadCount = 2;
+
+            auto recycler = Factories::CreateRecycler();
+            auto background = std::async(std::launch::async, &IRecycler::Run, recycler.get());
+            auto tokenManager = Factories::CreateTokenManager();
+
+            auto termTable = CreateTermTable();
+            DocumentDataSchema docDataSchema;
+            const size_t blockSize =
+                GetMinimumBlockSize(docDataSchema, *termTable);
+            TrackingSliceBufferAllocator allocator(blockSize);
+
+            {
+                Shard shard(0,
+                            *recycler,
+                            *tokenManager,
+                            *termTable,
+                            docDataSchema,
+                            allocator,
+                            blockSize,
+                            false,
+                            0);
+
+                const DocIndex capacity = shard.GetSliceCapacity();
+                std::vector<Slice const *> slices;
+                for (DocId id = 0; id < capacity * c_sliceCount; ++id)
+                {
+                    const DocumentHandleInternal handle = shard.AllocateDocument(id);
+                    if (id % capacity == 0)
+                    {
+                        slices.push_back(&handle.GetSlice());
+                    }
+                }
+                ASSERT_EQ(slices.size(), c_sliceCount);
+
+                // Each slice gets a different density, some dense enough
+                // that most columns count more than 255 bits.
+                std::mt19937 random(1234);
+                for (size_t s = 0; s < slices.size(); ++s)
+                {
+                    std::bernoulli_distribution isSet(0.1 + 0.2 * s);
+                    void * buffer = slices[s]->GetSliceBuffer();
+                    for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+                    {
+                        RowTableDescriptor const & rowTable =
+                            slices[s]->GetRowTable(rank);
+                        for (RowIndex row = 0; row < rowTable.GetRowCount(); ++row)
+                        {
+                            for (DocIndex column = 0; column < capacity; column += (1u << rank))
+                            {
+                                if (isSet(random))
+                                {
+                                    rowTable.SetBit(buffer, row, column);
+                                }
+                            }
+                        }
+                    }
+                }
+
+                auto counts =
+                    RowTableAnalyzer::CountColumns(slices, c_threadCount);
+                ASSERT_EQ(counts.size(), c_sliceCount);
+
+                for (size_t s = 0; s < slices.size(); ++s)
+                {
+                    void const * buffer = slices[s]->GetSliceBuffer();
+                    for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+                    {
+                        RowTableDescriptor const & rowTable =
+                            slices[s]->GetRowTable(rank);
+                        for (DocIndex column = 0; column < capacity; ++column)
+                        {
+                            uint32_t expected = 0;
+                            for (RowIndex row = 0; row < rowTable.GetRowCount(); ++row)
+                            {
+                                if (rowTable.GetBit(buffer, row, column) != 0)
+                                {
+                                    ++expected;
+                                }
+                            }
+
+                            const size_t entry =
+                                ((column >> (6 + rank)) << 6) | (column & 63);
+                            ASSERT_LT(entry, counts[s][rank].size());
+                            EXPECT_EQ(expected, counts[s][rank][entry]);
+                        }
+                    }
+                }
+            }
+
+            tokenManager->Shutdown();
+            recycler->Shutdown();
+            background.wait();
+        }
+    }
+}
@@ -21,12 +21,76 @@
 // THE SOFTWARE.
 
 
+#include <cstring>
+
 #include "gtest/gtest.h"
 
+#include "AlignedBuffer.h"
+#include "BitFunnel/Index/Row.h"
+#include "RowTableDescriptor.h"
+
 
 namespace BitFunnel
 {
-    TEST(RowTableDescriptor, Placeholder)
+    namespace RowTableDescriptorTest
     {
+        TEST(RowTableDescriptor, SummaryBlocks)
+        {
+            // Blocks are never smaller than a quadword.
+            EXPECT_EQ(6u, Row::GetSummaryBlockShift(64));
+            EXPECT_EQ(6u, Row::GetSummaryBlockShift(64 * 64));
+            EXPECT_EQ(7u, Row::GetSummaryBlockShift(64 * 64 + 64));
+            EXPECT_EQ(8u, Row::GetSummaryBlockShift(16384));
+
+            EXPECT_EQ(1ull << 3, Row::GetSummaryMask(1000, 6, 8));
+            EXPECT_EQ(0xfull << 4, Row::GetSummaryMask(1024, 10, 8));
+            EXPECT_EQ(~0ull, Row::GetSummaryMask(0, 14, 8));
+        }
+
+
+        TEST(RowTableDescriptor, RowSummary)
+        {
+            const DocIndex c_capacity = 16384;
+            const RowIndex c_rowCount = 3;
+            const Rank c_rank = 1;
+            const Rank c_maxRank = 1;
+
+            const size_t bufferSize =
+                RowTableDescriptor::GetBufferSize(c_capacity, c_rowCount, c_rank, c_maxRank);
+            EXPECT_EQ((Row::BytesInRow(c_capacity, c_rank, c_maxRank) + sizeof(uint64_t))
+                      * c_rowCount,
+                      bufferSize);
+
+            AlignedBuffer buffer(bufferSize,
+                                 RowTableDescriptor::c_rowTableByteAlignment);
+            void* sliceBuffer = buffer.GetBuffer();
+            memset(sliceBuffer, 0, bufferSize);
+
+            RowTableDescriptor rowTable(c_capacity, c_rowCount, c_rank, c_maxRank, 0);
+
+            // Summaries follow the rows.
+            EXPECT_EQ(rowTable.GetRowOffset(c_rowCount),
+                      rowTable.GetRowSummaryOffset(0));
+
+            rowTable.SetBit(sliceBuffer, 1, 1000);
+            EXPECT_EQ(0ull, rowTable.GetRowSummary(sliceBuffer, 0));
+            EXPECT_EQ(1ull << 3, rowTable.GetRowSummary(sliceBuffer, 1));
+            EXPECT_EQ(0ull, rowTable.GetRowSummary(sliceBuffer, 2));
+
+            rowTable.SetBit(sliceBuffer, 1, 1001);
+            rowTable.SetBit(sliceBuffer, 1, c_capacity - 1);
+            EXPECT_EQ((1ull << 3) | (1ull << 63), rowTable.GetRowSummary(sliceBuffer, 1));
+
+            // Summaries don't overlap row data.
+            EXPECT_NE(0ull, rowTable.GetBit(sliceBuffer, 1, c_capacity - 1));
+            for (DocIndex doc = 0; doc < c_capacity; ++doc)
+            {
+                EXPECT_EQ(0ull, rowTable.GetBit(sliceBuffer, 2, doc));
+            }
+
+            // Clearing bits leaves the summary conservatively set.
+            rowTable.ClearBit(sliceBuffer, 1, c_capacity - 1);
+            EXPECT_EQ((1ull << 3) | (1ull << 63), rowTable.GetRowSummary(sliceBuffer, 1));
+        }
     }
 }
@@ -65,7 +65,9 @@ namespace BitFunnel
                         *termTable,
                         docDataSchema,
                         *trackingAllocator,
-                        blockSize);
+                        blockSize,
+                        false,
+                        0);
 
             auto sliceCapacity = shard.GetSliceCapacity();
             ASSERT_GT(sliceCapacity, 0u);
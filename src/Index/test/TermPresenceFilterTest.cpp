@@ -0,0 +1,129 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Term.h"
+#include "TermPresenceFilter.h"
+
+
+namespace BitFunnel
+{
+    namespace TermPresenceFilterTest
+    {
+        TEST(TermPresenceFilter, NoFalseNegatives)
+        {
+            const Term::StreamId stream = 0;
+            const Term::IdfX10 idf = 0;
+            const unsigned c_termCount = 10000;
+
+            TermPresenceFilter filter(0);
+            for (Term::Hash hash = 0; hash < c_termCount; ++hash)
+            {
+                EXPECT_FALSE(filter.MayContain(Term(hash, stream, idf)));
+                filter.Add(Term(hash, stream, idf));
+            }
+
+            for (Term::Hash hash = 0; hash < c_termCount; ++hash)
+            {
+                EXPECT_TRUE(filter.MayContain(Term(hash, stream, idf)));
+            }
+
+            // The same hash in a different stream is a different term.
+            unsigned falsePositives = 0;
+            for (Term::Hash hash = 0; hash < c_termCount; ++hash)
+            {
+                if (filter.MayContain(Term(hash, stream + 1, idf)))
+                {
+                    ++falsePositives;
+                }
+            }
+            EXPECT_LT(falsePositives, c_termCount / 1000);
+            EXPECT_GT(filter.GetLoadFactor(), 0.0);
+            EXPECT_LT(filter.GetLoadFactor(), 0.05);
+        }
+
+
+        TEST(TermPresenceFilter, Sizing)
+        {
+            // At least 12 bits per term, rounded up to a power of two.
+            EXPECT_EQ(1ull << 20,
+                      TermPresenceFilter(0).GetBitCount());
+            EXPECT_EQ(1ull << 20,
+                      TermPresenceFilter(TermPresenceFilter::c_defaultTermCount).GetBitCount());
+            EXPECT_EQ(1ull << 12, TermPresenceFilter(1).GetBitCount());
+            EXPECT_EQ(1ull << 22, TermPresenceFilter(300000).GetBitCount());
+
+            // The false positive rate is below 1% when the filter holds the
+            // expected number of terms.
+            const Term::StreamId stream = 0;
+            const Term::IdfX10 idf = 0;
+            const unsigned c_termCount = 100000;
+
+            TermPresenceFilter filter(c_termCount);
+            for (Term::Hash hash = 0; hash < c_termCount; ++hash)
+            {
+                filter.Add(Term(hash, stream, idf));
+            }
+            EXPECT_TRUE(filter.IsEnabled());
+
+            unsigned falsePositives = 0;
+            for (Term::Hash hash = 0; hash < c_termCount; ++hash)
+            {
+                if (filter.MayContain(Term(hash, stream + 1, idf)))
+                {
+                    ++falsePositives;
+                }
+            }
+            EXPECT_LT(falsePositives, c_termCount / 100);
+        }
+
+
+        // A saturated filter, or one that was disabled, answers "present"
+        // for every term instead of answering with a high false positive
+        // rate.
+        TEST(TermPresenceFilter, Disable)
+        {
+            const Term::StreamId stream = 0;
+            const Term::IdfX10 idf = 0;
+
+            TermPresenceFilter filter(1);
+            EXPECT_TRUE(filter.IsEnabled());
+
+            Term::Hash hash = 0;
+            while (filter.IsEnabled())
+            {
+                filter.Add(Term(hash++, stream, idf));
+                ASSERT_LT(hash, filter.GetBitCount());
+            }
+            EXPECT_GT(filter.GetLoadFactor(), 0.5);
+            EXPECT_TRUE(filter.MayContain(Term(hash + 1000, stream, idf)));
+
+            TermPresenceFilter disabled(1);
+            disabled.Disable();
+            disabled.Add(Term(1, stream, idf));
+            EXPECT_FALSE(disabled.IsEnabled());
+            EXPECT_EQ(0.0, disabled.GetLoadFactor());
+            EXPECT_TRUE(disabled.MayContain(Term(2, stream, idf)));
+        }
+    }
+}
@@ -32,7 +32,9 @@
 
 #include "gtest/gtest.h"
 
+#include "BitFunnel/Index/PackedRowIdSequence.h"
 #include "BitFunnel/Index/RowIdSequence.h"
+#include "CoOccurrenceTable.h"
 #include "DocumentFrequencyTable.h"
 #include "FactSetBase.h"
 #include "TermTable.h"
@@ -342,6 +344,158 @@ private:
             // TODO: Verify facts
             // TODO: Verify row counts.
         }
+
+
+        // Ranks are bin packed on separate threads with separate random
+        // number generators, so builds with random skips must still be
+        // repeatable.
+        TEST(TermTableBuilder, Deterministic)
+        {
+            TestEnvironment environment;
+            DocumentFrequencyTable const & terms =
+                environment.GetDocFrequencyTable();
+            const unsigned c_randomSkipDistance = 3;
+
+            TermTable first;
+            TermTableBuilder firstBuilder(0.1,
+                                          0.0001,
+                                          environment.GetTermTreatment(),
+                                          terms,
+                                          environment.GetFactSet(),
+                                          first,
+                                          c_randomSkipDistance);
+
+            TermTable second;
+            TermTableBuilder secondBuilder(0.1,
+                                           0.0001,
+                                           environment.GetTermTreatment(),
+                                           terms,
+                                           environment.GetFactSet(),
+                                           second,
+                                           c_randomSkipDistance);
+
+            for (auto term : terms)
+            {
+                RowIdSequence expected(term.GetTerm(), first);
+                RowIdSequence observed(term.GetTerm(), second);
+
+                EXPECT_TRUE(std::equal(observed.begin(),
+                                       observed.end(),
+                                       expected.begin()));
+                EXPECT_TRUE(std::equal(expected.begin(),
+                                       expected.end(),
+                                       observed.begin()));
+            }
+
+            for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+            {
+                EXPECT_EQ(first.GetTotalRowCount(rank),
+                          second.GetTotalRowCount(rank));
+            }
+        }
+
+
+        // The fifth term would share the third term's row, as in
+        // GeneralCases, but appears only in documents that contain the third
+        // term, so it moves to the fourth term's row instead.
+        TEST(TermTableBuilder, CorrelatedTerms)
+        {
+            TestEnvironment environment;
+            DocumentFrequencyTable const & terms =
+                environment.GetDocFrequencyTable();
+
+            const double c_documentCount = 1000.0;
+            const Term::Hash c_third = 1002ull;
+            const Term::Hash c_fifth = 1004ull;
+
+            CoOccurrenceTable coOccurrences;
+            CoOccurrenceTable::Sketch third;
+            for (DocId id = 0; id < 70; ++id)
+            {
+                third.Add(CoOccurrenceTable::HashDocument(id));
+            }
+            coOccurrences.AddTerm(c_third, 70 / c_documentCount, third);
+
+            CoOccurrenceTable::Sketch fifth;
+            for (DocId id = 0; id < 20; ++id)
+            {
+                fifth.Add(CoOccurrenceTable::HashDocument(id));
+            }
+            coOccurrences.AddTerm(c_fifth, 20 / c_documentCount, fifth);
+
+            TermTable termTable;
+            TermTableBuilder builder(0.1,
+                                     0.0001,
+                                     environment.GetTermTreatment(),
+                                     terms,
+                                     environment.GetFactSet(),
+                                     termTable,
+                                     0,
+                                     &coOccurrences);
+
+            std::vector<RowId> thirdRows;
+            std::vector<RowId> fifthRows;
+            for (auto term : terms)
+            {
+                RowIdSequence rows(term.GetTerm(), termTable);
+                if (term.GetTerm().GetRawHash() == c_third)
+                {
+                    thirdRows.assign(rows.begin(), rows.end());
+                }
+                else if (term.GetTerm().GetRawHash() == c_fifth)
+                {
+                    fifthRows.assign(rows.begin(), rows.end());
+                }
+            }
+
+            ASSERT_EQ(1u, thirdRows.size());
+            ASSERT_EQ(1u, fifthRows.size());
+            EXPECT_NE(thirdRows[0], fifthRows[0]);
+
+            // Avoiding the correlation did not cost any rows.
+            for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+            {
+                EXPECT_EQ(environment.GetTermTable().GetTotalRowCount(rank),
+                          termTable.GetTotalRowCount(rank));
+            }
+        }
+
+
+        // With an adhoc frequency above every term's frequency, only the
+        // terms in explicitTerms are given explicit rows.
+        TEST(TermTableBuilder, ExplicitTerms)
+        {
+            TestEnvironment environment;
+            DocumentFrequencyTable const & terms =
+                environment.GetDocFrequencyTable();
+
+            const Term::Hash c_fourth = 1003ull;
+            DocumentFrequencyTable explicitTerms;
+            explicitTerms.AddEntry(
+                DocumentFrequencyTable::Entry(Term(c_fourth, 1, 1, 1), 0.5));
+
+            TermTable termTable;
+            TermTableBuilder builder(0.1,
+                                     1.0,
+                                     environment.GetTermTreatment(),
+                                     terms,
+                                     environment.GetFactSet(),
+                                     termTable,
+                                     0,
+                                     nullptr,
+                                     &explicitTerms);
+
+            for (auto term : terms)
+            {
+                const auto expected =
+                    (term.GetTerm().GetRawHash() == c_fourth) ?
+                    PackedRowIdSequence::Type::Explicit :
+                    PackedRowIdSequence::Type::Adhoc;
+                EXPECT_EQ(expected,
+                          termTable.GetRows(term.GetTerm()).GetType())
+                    << term.GetTerm().GetRawHash();
+            }
+        }
     }
 }
 #ifdef _MSC_VER
@@ -0,0 +1,121 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Exceptions.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IDocumentFrequencyTable.h"
+#include "BitFunnel/Index/ITermTreatmentFactory.h"
+#include "BitFunnel/Term.h"
+#include "TreatmentPrivateSharedRank0ToN.h"
+#include "TreatmentQueryAware.h"
+
+
+namespace BitFunnel
+{
+    namespace TermTreatmentQueryAwareTest
+    {
+        static size_t GetRowCount(RowConfiguration configuration)
+        {
+            size_t count = 0;
+            for (auto entry : configuration)
+            {
+                count += entry.GetRowCount();
+            }
+            return count;
+        }
+
+
+        static Rank GetMaxRank(RowConfiguration configuration)
+        {
+            Rank rank = 0;
+            for (auto entry : configuration)
+            {
+                rank = (std::max)(rank, entry.GetRank());
+            }
+            return rank;
+        }
+
+
+        TEST(TreatmentQueryAware, Tiers)
+        {
+            const double density = 0.1;
+            const double snr = 10.0;
+
+            const Term::Hash hot = 123;
+            const Term::Hash warm = 456;
+            const Term::Hash cold = 789;
+
+            auto queryTerms = Factories::CreateDocumentFrequencyTable();
+            queryTerms->AddEntry(
+                IDocumentFrequencyTable::Entry(Term(hot, 0, 0), 0.5));
+            queryTerms->AddEntry(
+                IDocumentFrequencyTable::Entry(Term(warm, 0, 0), 0.001));
+
+            TreatmentQueryAware treatment(density, snr, *queryTerms);
+            TreatmentPrivateSharedRank0ToN baseline(density, snr);
+
+            for (Term::IdfX10 idf = 0; idf <= Term::c_maxIdfX10Value; ++idf)
+            {
+                auto expected = baseline.GetTreatment(Term(0, 0, idf));
+
+                // Adhoc prototypes and warm terms keep the baseline.
+                EXPECT_EQ(expected, treatment.GetTreatment(Term(0, 0, idf)));
+                EXPECT_EQ(expected, treatment.GetTreatment(Term(warm, 0, idf)));
+
+                auto hotConfiguration = treatment.GetTreatment(Term(hot, 0, idf));
+                auto coldConfiguration = treatment.GetTreatment(Term(cold, 0, idf));
+
+                if (Term::IdfX10ToFrequency(idf) >= density)
+                {
+                    // Common terms get a private rank 0 row in every tier.
+                    EXPECT_EQ(1u, GetRowCount(hotConfiguration));
+                    EXPECT_EQ(0u, GetMaxRank(hotConfiguration));
+                    EXPECT_EQ(1u, GetRowCount(coldConfiguration));
+                }
+                else
+                {
+                    EXPECT_GE(GetMaxRank(hotConfiguration), GetMaxRank(expected));
+                    EXPECT_GE(GetRowCount(hotConfiguration), GetRowCount(expected));
+
+                    EXPECT_EQ(0u, GetMaxRank(coldConfiguration));
+                }
+            }
+        }
+
+
+        TEST(TreatmentQueryAware, RequiresQueryTerms)
+        {
+            auto factory = Factories::CreateTreatmentFactory();
+            EXPECT_THROW(factory->CreateTreatment("QueryAware", 0.1, 10.0),
+                         RecoverableError);
+
+            auto queryTerms = Factories::CreateDocumentFrequencyTable();
+            auto treatment =
+                factory->CreateTreatment("QueryAware", 0.1, 10.0, queryTerms.get());
+            EXPECT_NE(nullptr, treatment.get());
+        }
+    }
+}
@@ -197,11 +197,17 @@ namespace BitFunnel
         // of primes less than or equal to maxDocId.
         auto termTableCollection =
             Factories::CreateTermTableCollection();
+        size_t rowCount = 0;
         // TODO: don't create the exact same TermTable for each shard?
         for (unsigned i = 0; i < shardCount; ++i)
         {
             auto termTable =
                 Factories::CreatePrimeFactorsTermTable(maxDocId, streamId);
+            rowCount = 0;
+            for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+            {
+                rowCount += termTable->GetTotalRowCount(rank);
+            }
             termTableCollection->AddTermTable(std::move(termTable));
         }
 
@@ -215,7 +221,11 @@ namespace BitFunnel
         // Right now the hard-coded blocksize yields 13 quadwords at rank 0,
         // but this could change if the TermTable was configured to use higher
         // ranks.
-        size_t blockSize = 20000;
+        //
+        // Each row also has a summary quadword. Space for the summaries is
+        // added to the hard-coded blocksize so that they don't change the
+        // slice capacity.
+        size_t blockSize = 20000 + rowCount * sizeof(uint64_t);
         size_t blockCount = 512;
         auto sliceAllocator =
             Factories::CreateSliceBufferAllocator(blockSize,
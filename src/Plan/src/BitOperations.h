@@ -0,0 +1,65 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>                     // uint64_t parameters.
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // Bit scan and population count helpers shared by the matching engines
+    // (ByteCodeInterpreter, PrecompiledKernel).
+    //
+    //*************************************************************************
+
+    // Returns the index of the least significant set bit in value.
+    // DESIGN NOTE: this is undefined if value is 0. Callers must guarantee
+    // that the input isn't 0.
+    inline uint64_t bsf(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return index;
+#else
+        return static_cast<uint64_t>(__builtin_ctzll(value));
+#endif
+    }
+
+
+    // Returns the number of set bits in value.
+    inline uint64_t popcount(uint64_t value)
+    {
+#ifdef _MSC_VER
+        return __popcnt64(value);
+#else
+        return static_cast<uint64_t>(__builtin_popcountll(value));
+#endif
+    }
+}
@@ -20,19 +20,21 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <algorithm>
 #include <iostream>
-
-#ifdef _MSC_VER
-#include <intrin.h>
-#endif
+#include <emmintrin.h>                          // SSE2 row scan.
+#include <xmmintrin.h>                          // _mm_prefetch().
 
 #include "BitFunnel/Exceptions.h"
 #include "BitFunnel/IDiagnosticStream.h"
 #include "BitFunnel/Index/DocumentHandle.h"
 #include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/Row.h"
 #include "BitFunnel/Plan/QueryInstrumentation.h"
+#include "BitOperations.h"
 #include "ByteCodeInterpreter.h"
 #include "CacheLineRecorder.h"
+#include "CancellationToken.h"
 #include "ResultsBuffer.h"
 
 
@@ -76,11 +78,70 @@ Decide on type of Slices
         m_iterationsPerSlice(iterationsPerSlice),
         m_initialRank(initialRank),
         m_rowOffsets(rowOffsets),
-        m_dedupe(),
+        m_summaryCount(0),
+        m_summaryOffsets(nullptr),
+        m_summaryRanks(nullptr),
+        // Every rank in the plan has a whole number of quadwords in each
+        // slice, so this is the slice capacity.
+        m_summaryBlockShift(
+            Row::GetSummaryBlockShift((iterationsPerSlice << initialRank) << 6)),
+        m_countMode(false),
+        m_matchCount(0),
+        m_cancellation(nullptr),
+        m_maxCallDepth(code.GetMaxCallDepth()),
+        m_maxValueStackDepth(code.GetMaxValueStackDepth()),
+        m_zeroFlag(false),
         m_diagnosticStream(diagnosticStream),
         m_instrumentation(instrumentation),
-        m_cacheLineRecorder(cacheLineRecorder)
+        m_cacheLineRecorder(cacheLineRecorder),
+        m_skipUnsampledSlices(false),
+        m_recordingSlice(false)
+    {
+    }
+
+
+    void ByteCodeInterpreter::EnableRowSummaries(size_t rowCount,
+                                                 ptrdiff_t const * summaryOffsets,
+                                                 Rank const * ranks)
+    {
+        m_summaryCount = rowCount;
+        m_summaryOffsets = summaryOffsets;
+        m_summaryRanks = ranks;
+    }
+
+
+    void ByteCodeInterpreter::EnableCountMode()
+    {
+        m_countMode = true;
+    }
+
+
+    void ByteCodeInterpreter::EnableCancellation(CancellationToken & token)
+    {
+        m_cancellation = &token;
+    }
+
+
+    void ByteCodeInterpreter::SkipUnsampledSlices()
+    {
+        m_skipUnsampledSlices = true;
+    }
+
+
+    size_t ByteCodeInterpreter::GetMatchCount() const
     {
+        return m_matchCount;
+    }
+
+
+    bool ByteCodeInterpreter::IsCancelled()
+    {
+        if (m_cancellation != nullptr && m_cancellation->IsCancelled())
+        {
+            m_cancellation->SetTruncated();
+            return true;
+        }
+        return false;
     }
 
 
@@ -88,6 +149,11 @@ Decide on type of Slices
     {
         for (size_t i = 0; i < m_sliceCount; ++i)
         {
+            if (IsCancelled())
+            {
+                return true;
+            }
+
             bool terminate = ProcessOneSlice(i);
             if (terminate)
             {
@@ -100,20 +166,350 @@ Decide on type of Slices
     }
 
 
+    bool ByteCodeInterpreter::RunInterleaved(size_t laneCount,
+                                             std::vector<Lane> & lanes)
+    {
+        if (laneCount < 2 ||
+            m_cacheLineRecorder != nullptr ||
+            m_diagnosticStream != nullptr)
+        {
+            return Run();
+        }
+
+        if (lanes.size() < laneCount)
+        {
+            lanes.resize(laneCount);
+        }
+
+        size_t nextIteration = 0;
+        uint64_t candidates = 0ull;
+        bool cancelled = false;
+
+        // Prime each lane with its first iteration.
+        size_t activeCount = 0;
+        while (activeCount < laneCount &&
+               FindIteration(nextIteration, candidates, cancelled))
+        {
+            StartIteration(lanes[activeCount++],
+                           m_sliceBuffers[nextIteration / m_iterationsPerSlice],
+                           nextIteration % m_iterationsPerSlice);
+            ++nextIteration;
+        }
+
+        // Round robin over the lanes until every iteration has finished.
+        // A lane that finishes its iteration immediately picks up the next
+        // unstarted iteration. Lanes with no remaining work are retired by
+        // swapping them to the end of the active range. On cancellation,
+        // the iterations in flight are finished, but no iterations from
+        // later slices are started.
+        size_t i = 0;
+        while (activeCount > 0)
+        {
+            Lane & lane = lanes[i];
+            if (Resume<InterleavedPolicy>(lane))
+            {
+                bool terminate = FinishIteration(lane.m_dedupe,
+                                                 lane.m_base,
+                                                 lane.m_sliceBuffer);
+                if (terminate)
+                {
+                    return true;
+                }
+
+                if (!cancelled &&
+                    FindIteration(nextIteration, candidates, cancelled))
+                {
+                    StartIteration(lane,
+                                   m_sliceBuffers[nextIteration / m_iterationsPerSlice],
+                                   nextIteration % m_iterationsPerSlice);
+                    ++nextIteration;
+                }
+                else
+                {
+                    --activeCount;
+                    if (i < activeCount)
+                    {
+                        // Resume the lane that was swapped into this slot.
+                        std::swap(lane, lanes[activeCount]);
+                        continue;
+                    }
+                }
+            }
+
+            if (++i >= activeCount)
+            {
+                i = 0;
+            }
+        }
+
+        // false ==> ran to completion.
+        return cancelled;
+    }
+
+
+    bool ByteCodeInterpreter::FindIteration(size_t & iteration,
+                                            uint64_t & candidates,
+                                            bool & cancelled)
+    {
+        const size_t iterationCount = m_sliceCount * m_iterationsPerSlice;
+        while (iteration < iterationCount)
+        {
+            const size_t offset = iteration % m_iterationsPerSlice;
+            if (offset == 0)
+            {
+                if (IsCancelled())
+                {
+                    cancelled = true;
+                    return false;
+                }
+
+                candidates =
+                    GetCandidateBlocks(m_sliceBuffers[iteration / m_iterationsPerSlice]);
+                if (candidates == 0ull)
+                {
+                    // A row in the top-level conjunction is empty in this
+                    // slice.
+                    iteration += m_iterationsPerSlice;
+                    continue;
+                }
+            }
+
+            if (IsCandidateIteration(candidates, offset))
+            {
+                return true;
+            }
+            ++iteration;
+        }
+
+        return false;
+    }
+
+
+    bool ByteCodeInterpreter::IsCandidateIteration(uint64_t candidates,
+                                                   size_t iteration) const
+    {
+        const unsigned log2IterationSize = 6 + static_cast<unsigned>(m_initialRank);
+        return candidates == ~0ull ||
+            (candidates & Row::GetSummaryMask(iteration << log2IterationSize,
+                                              log2IterationSize,
+                                              m_summaryBlockShift)) != 0;
+    }
+
+
+    bool ByteCodeInterpreter::RunSparse(size_t row, Rank rowRank)
+    {
+        for (size_t i = 0; i < m_sliceCount; ++i)
+        {
+            if (IsCancelled())
+            {
+                return true;
+            }
+
+            bool terminate = ProcessOneSliceSparse(i, row, rowRank);
+            if (terminate)
+            {
+                return true;
+            }
+        }
+
+        // false ==> ran to completion.
+        return false;
+    }
+
+
+    bool ByteCodeInterpreter::ProcessOneSliceSparse(size_t slice,
+                                                    size_t row,
+                                                    Rank rowRank)
+    {
+        // Number of quadwords of the row in each slice.
+        const size_t quadwordCount = (rowRank >= m_initialRank) ?
+            (m_iterationsPerSlice >> (rowRank - m_initialRank)) :
+            (m_iterationsPerSlice << (m_initialRank - rowRank));
+
+        if (quadwordCount == 0)
+        {
+            return ProcessOneSlice(slice);
+        }
+
+        char const * sliceBuffer =
+            reinterpret_cast<char const *>(m_sliceBuffers[slice]);
+        uint64_t const * rowData =
+            reinterpret_cast<uint64_t const *>(sliceBuffer + m_rowOffsets[row]);
+
+        if (!StartSlice(sliceBuffer))
+        {
+            return false;
+        }
+
+        if (m_recordingSlice)
+        {
+            for (size_t q = 0; q < quadwordCount; q += 8)
+            {
+                m_cacheLineRecorder->RecordAccess(rowData + q);
+            }
+        }
+
+        m_instrumentation.IncrementQuadwordCount(quadwordCount);
+
+        size_t nextIteration = 0;
+        bool terminate = false;
+
+        // Test four quadwords at a time and only examine the individual
+        // quadwords of groups that contain a set bit.
+        const __m128i zero = _mm_setzero_si128();
+        size_t q = 0;
+        for (; !terminate && q + 4 <= quadwordCount; q += 4)
+        {
+            const __m128i a =
+                _mm_loadu_si128(reinterpret_cast<__m128i const *>(rowData + q));
+            const __m128i b =
+                _mm_loadu_si128(reinterpret_cast<__m128i const *>(rowData + q + 2));
+            const __m128i any = _mm_or_si128(a, b);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) == 0xffff)
+            {
+                continue;
+            }
+
+            for (size_t i = q; !terminate && i < q + 4; ++i)
+            {
+                if (rowData[i] != 0)
+                {
+                    terminate = RunCandidateIterations(sliceBuffer,
+                                                       i,
+                                                       rowRank,
+                                                       nextIteration);
+                }
+            }
+        }
+
+        for (; !terminate && q < quadwordCount; ++q)
+        {
+            if (rowData[q] != 0)
+            {
+                terminate = RunCandidateIterations(sliceBuffer,
+                                                   q,
+                                                   rowRank,
+                                                   nextIteration);
+            }
+        }
+
+        FinishSlice();
+
+        return terminate;
+    }
+
+
+    bool ByteCodeInterpreter::RunCandidateIterations(void const * sliceBuffer,
+                                                     size_t quadword,
+                                                     Rank rowRank,
+                                                     size_t & nextIteration)
+    {
+        // A quadword above the initial rank spans several iterations. A
+        // quadword below the initial rank shares its iteration with its
+        // neighbors.
+        size_t first;
+        size_t last;
+        if (rowRank >= m_initialRank)
+        {
+            first = quadword << (rowRank - m_initialRank);
+            last = (quadword + 1) << (rowRank - m_initialRank);
+        }
+        else
+        {
+            first = quadword >> (m_initialRank - rowRank);
+            last = first + 1;
+        }
+
+        for (size_t i = (std::max)(first, nextIteration); i < last; ++i)
+        {
+            if (RunOneIteration(sliceBuffer, i))
+            {
+                return true;
+            }
+        }
+        nextIteration = (std::max)(nextIteration, last);
+
+        return false;
+    }
+
+
+    void ByteCodeInterpreter::StartIteration(Lane & lane,
+                                             void const * sliceBuffer,
+                                             size_t iteration) const
+    {
+        lane.m_sliceBuffer = reinterpret_cast<char const *>(sliceBuffer);
+        lane.m_iteration = iteration;
+        lane.m_base = iteration << m_initialRank;
+        lane.m_ip = m_code.data();
+        lane.m_offset = iteration;
+        lane.m_accumulator = 0ull;
+        lane.m_pending = nullptr;
+        lane.m_callDepth = 0;
+        lane.m_valueDepth = 0;
+
+        // Lanes may be reused across queries, so the stacks only grow.
+        if (lane.m_callStack.size() < m_maxCallDepth)
+        {
+            lane.m_callStack.resize(m_maxCallDepth);
+        }
+        if (lane.m_valueStack.size() < m_maxValueStackDepth)
+        {
+            lane.m_valueStack.resize(m_maxValueStackDepth);
+        }
+    }
+
+
+    bool ByteCodeInterpreter::StartSlice(void const * sliceBuffer)
+    {
+        m_recordingSlice =
+            m_cacheLineRecorder != nullptr && m_cacheLineRecorder->SampleSlice();
+
+        if (m_recordingSlice)
+        {
+            m_cacheLineRecorder->StartSlice(sliceBuffer);
+        }
+
+        return m_recordingSlice || !m_skipUnsampledSlices;
+    }
+
+
+    void ByteCodeInterpreter::FinishSlice()
+    {
+        if (m_recordingSlice)
+        {
+            m_instrumentation.IncrementCacheLineCount(
+                m_cacheLineRecorder->FinishSlice());
+            m_recordingSlice = false;
+        }
+    }
+
+
     bool ByteCodeInterpreter::ProcessOneSlice(size_t slice)
     {
         auto sliceBuffer = m_sliceBuffers[slice];
 
-        if (m_cacheLineRecorder != nullptr)
+        if (!StartSlice(sliceBuffer))
+        {
+            return false;
+        }
+
+        const uint64_t candidates = GetCandidateBlocks(sliceBuffer);
+        if (candidates == 0ull)
         {
-            m_cacheLineRecorder->Reset();
-            m_cacheLineRecorder->SetBase(sliceBuffer);
+            // A row in the top-level conjunction is empty in this slice.
+            FinishSlice();
+            return false;
         }
 
         bool terminate = false;
 
         for (size_t i = 0; i < m_iterationsPerSlice; ++i)
         {
+            if (!IsCandidateIteration(candidates, i))
+            {
+                continue;
+            }
+
             terminate = RunOneIteration(sliceBuffer, i);
             if (terminate)
             {
@@ -121,28 +517,56 @@ Decide on type of Slices
             }
         }
 
-        if (m_cacheLineRecorder != nullptr)
-        {
-            m_instrumentation.IncrementCacheLineCount(
-                m_cacheLineRecorder->GetCacheLinesAccessed());
-        }
+        FinishSlice();
 
         // false ==> ran to completion.
         return false;
     }
 
 
-    bool ByteCodeInterpreter::RunOneIteration(
-        void const * voidSliceBuffer,
-        size_t iteration)
+    uint64_t ByteCodeInterpreter::GetCandidateBlocks(void const * sliceBuffer) const
     {
-        const size_t base = iteration << m_initialRank;
-        char const * sliceBuffer =
-            reinterpret_cast<char const *>(voidSliceBuffer);
+        uint64_t candidates = ~0ull;
+        for (size_t i = 0; i < m_summaryCount; ++i)
+        {
+            uint64_t summary = *reinterpret_cast<uint64_t const *>(
+                reinterpret_cast<char const *>(sliceBuffer) + m_summaryOffsets[i]);
+
+            // An iteration reads the quadwords of the row that overlap its
+            // documents. When either the row quadword or the iteration
+            // spans several summary blocks, a bit set in any of those blocks
+            // may affect every one of them.
+            const unsigned log2Span =
+                6 + static_cast<unsigned>((std::max)(m_summaryRanks[i], m_initialRank));
+            if (log2Span > m_summaryBlockShift && summary != 0ull)
+            {
+                const size_t blocksPerSpan = 1ull << (log2Span - m_summaryBlockShift);
+                uint64_t expanded = 0ull;
+                for (size_t block = 0; block < 64; block += blocksPerSpan)
+                {
+                    const uint64_t mask =
+                        Row::GetSummaryMask(block << m_summaryBlockShift,
+                                            log2Span,
+                                            m_summaryBlockShift);
+                    if ((summary & mask) != 0ull)
+                    {
+                        expanded |= mask;
+                    }
+                }
+                summary = expanded;
+            }
+
+            candidates &= summary;
+        }
+
+        return candidates;
+    }
 
-        uint64_t accumulator = 0ull;
-        auto ip = m_code.data();
-        size_t offset = iteration;
+
+    bool ByteCodeInterpreter::RunOneIteration(void const * sliceBuffer,
+                                              size_t iteration)
+    {
+        StartIteration(m_lane, sliceBuffer, iteration);
 
         if (m_diagnosticStream != nullptr &&
             m_diagnosticStream->IsEnabled("bytecode/opcode"))
@@ -152,177 +576,306 @@ Decide on type of Slices
             out << "ByteCode RunOneIteration:" << std::endl;
         }
 
-        while (ip->GetOpcode() != Opcode::End)
+        if (m_diagnosticStream != nullptr || m_recordingSlice)
         {
-            const Opcode opcode = ip->GetOpcode();
-            const unsigned row = ip->GetRow();
-            const unsigned delta = ip->GetDelta();
-            const bool inverted = ip->IsInverted();
+            Resume<DiagnosticPolicy>(m_lane);
+        }
+        else
+        {
+            Resume<ProductionPolicy>(m_lane);
+        }
 
-            if (m_diagnosticStream != nullptr &&
-                m_diagnosticStream->IsEnabled("bytecode/opcode"))
-            {
-                std::ostream& out = m_diagnosticStream->GetStream();
-                out << "IP: " << std::hex << ip << std::dec << std::endl
-                    << "Opcode: " << opcode << std::endl
-                    << "Iteration: " << iteration << std::endl
-                    << "Offset: " << offset << std::endl
-                    << "Row: " << row << std::endl
-                    << "RowOffset: " << std::hex << m_rowOffsets[row] << std::dec << std::endl;
-            }
-            switch (opcode)
-            {
-            case Opcode::AndRow:
-                {
-                    m_instrumentation.IncrementQuadwordCount();
-                    uint64_t const * rowPtr =
-                        reinterpret_cast<uint64_t const *>(
-                            sliceBuffer + m_rowOffsets[row]);
+        return FinishIteration(m_lane.m_dedupe, m_lane.m_base, sliceBuffer);
+    }
 
-                    auto ptr = rowPtr + (offset >> delta);
-                    if (m_cacheLineRecorder != nullptr)
-                    {
-                        m_cacheLineRecorder->RecordAccess(ptr);
-                    }
 
-                    uint64_t value = *ptr;
-                    accumulator &= (inverted ? ~value : value);
-                    m_zeroFlag = (accumulator == 0);
-                    ip++;
+    void ByteCodeInterpreter::TraceInstruction(Instruction const * ip,
+                                               size_t iteration,
+                                               size_t offset) const
+    {
+        if (m_diagnosticStream != nullptr &&
+            m_diagnosticStream->IsEnabled("bytecode/opcode"))
+        {
+            std::ostream& out = m_diagnosticStream->GetStream();
+            out << "IP: " << std::hex << ip << std::dec << std::endl
+                << "Opcode: " << ip->GetOpcode() << std::endl
+                << "Iteration: " << iteration << std::endl
+                << "Offset: " << offset << std::endl
+                << "Row: " << ip->GetRow() << std::endl
+                << "RowOffset: " << std::hex << m_rowOffsets[ip->GetRow()]
+                << std::dec << std::endl;
+        }
+    }
 
-                    if (m_diagnosticStream != nullptr &&
-                        m_diagnosticStream->IsEnabled("bytecode/loadrow"))
-                    {
-                        std::ostream& out = m_diagnosticStream->GetStream();
-                        out << "AndRow: " << std::hex << accumulator
-                            << std::dec << std::endl;
-                    }
-                }
-                break;
-            case Opcode::LoadRow:
-                {
-                    m_instrumentation.IncrementQuadwordCount();
-                    uint64_t const * rowPtr =
-                        reinterpret_cast<uint64_t const *>(
-                            sliceBuffer + m_rowOffsets[row]);
 
-                    auto ptr = rowPtr + (offset >> delta);
-                    if (m_cacheLineRecorder != nullptr)
-                    {
-                        m_cacheLineRecorder->RecordAccess(ptr);
-                    }
+    void ByteCodeInterpreter::TraceRowAccess(char const * opcodeName,
+                                             uint64_t const * ptr,
+                                             uint64_t accumulator) const
+    {
+        if (m_recordingSlice)
+        {
+            m_cacheLineRecorder->RecordAccess(ptr);
+        }
+
+        if (m_diagnosticStream != nullptr &&
+            m_diagnosticStream->IsEnabled("bytecode/loadrow"))
+        {
+            std::ostream& out = m_diagnosticStream->GetStream();
+            out << opcodeName << ": " << std::hex << accumulator
+                << std::dec << std::endl;
+        }
+    }
 
-                    auto value = *ptr;
-                    accumulator = (inverted ? ~value : value);
-                    m_zeroFlag = (accumulator == 0);
-                    ip++;
 
-                    if (m_diagnosticStream != nullptr &&
-                        m_diagnosticStream->IsEnabled("bytecode/loadrow"))
+    // GCC and clang support taking the address of a label, which allows each
+    // handler to jump directly to the next one instead of returning to the
+    // top of a switch statement. Other compilers fall back to a switch.
+#if defined(__GNUC__)
+#define BITFUNNEL_COMPUTED_GOTO
+#endif
+
+#ifdef BITFUNNEL_COMPUTED_GOTO
+#define BEGIN_DISPATCH() NEXT();
+#define NEXT()                                                          \
+    if (POLICY::c_enabled) { TraceInstruction(ip, iteration, offset); } \
+    goto *c_handlers[static_cast<unsigned>(ip->GetOpcode())]
+#define HANDLER(opcode) Handle##opcode:
+#define END_DISPATCH()
+#else
+#define BEGIN_DISPATCH()                                                \
+    for (;;)                                                            \
+    {                                                                   \
+        if (POLICY::c_enabled) { TraceInstruction(ip, iteration, offset); } \
+        switch (ip->GetOpcode())                                        \
+        {
+#define NEXT() continue
+#define HANDLER(opcode) case Opcode::opcode:
+#define END_DISPATCH()                                                  \
+        default:                                                        \
+            throw RecoverableError("ByteCodeInterpreter:: bad opcode."); \
+        }                                                               \
+    }
+#endif
+
+    template <typename POLICY>
+    bool ByteCodeInterpreter::Resume(Lane & lane)
+    {
+#ifdef BITFUNNEL_COMPUTED_GOTO
+        // Handler addresses, indexed by Opcode.
+        static void * const c_handlers[] = {
+            &&HandleAndRow,
+            &&HandleLoadRow,
+            &&HandleLeftShiftOffset,
+            &&HandleRightShiftOffset,
+            &&HandleIncrementOffset,
+            &&HandlePush,
+            &&HandlePop,
+            &&HandleAndStack,
+            &&HandleConstant,
+            &&HandleNot,
+            &&HandleOrStack,
+            &&HandleUpdateFlags,
+            &&HandleReport,
+            &&HandleCall,
+            &&HandleJmp,
+            &&HandleJnz,
+            &&HandleJz,
+            &&HandleReturn,
+            &&HandleEnd
+        };
+        static_assert(sizeof(c_handlers) / sizeof(c_handlers[0]) ==
+                      static_cast<size_t>(Opcode::Last),
+                      "c_handlers must have one entry for each Opcode.");
+#endif
+
+        // The virtual machine registers are kept in locals while the lane
+        // runs, and saved back to the lane when it suspends or completes.
+        char const * const sliceBuffer = lane.m_sliceBuffer;
+        const size_t iteration = lane.m_iteration;
+        const size_t base = lane.m_base;
+        auto ip = lane.m_ip;
+        size_t offset = lane.m_offset;
+        uint64_t accumulator = lane.m_accumulator;
+        uint64_t * valueStack = lane.m_valueStack.data() + lane.m_valueDepth;
+        Instruction const * * callStack =
+            lane.m_callStack.data() + lane.m_callDepth;
+        size_t quadwordCount = 0;
+        bool completed = false;
+
+        BEGIN_DISPATCH()
+
+        HANDLER(AndRow)
+            {
+                auto ptr = reinterpret_cast<uint64_t const *>(
+                    sliceBuffer + m_rowOffsets[ip->GetRow()]) +
+                    (offset >> ip->GetDelta());
+                if (POLICY::c_interleaved)
+                {
+                    if (lane.m_pending != ptr)
                     {
-                        std::ostream& out = m_diagnosticStream->GetStream();
-                        out << "LoadRow: " << std::hex << accumulator
-                            << std::dec << std::endl;
+                        // Start the load and yield to the next lane. The
+                        // lane resumes at this instruction.
+                        _mm_prefetch(reinterpret_cast<char const *>(ptr),
+                                     _MM_HINT_T0);
+                        lane.m_pending = ptr;
+                        goto suspend;
                     }
+                    lane.m_pending = nullptr;
                 }
-                break;
-            case Opcode::LeftShiftOffset:
-                offset <<= row;
-                ip++;
-                break;
-            case Opcode::RightShiftOffset:
-                offset >>= row;
-                ip++;
-                break;
-            case Opcode::IncrementOffset:
-                offset++;
-                ip++;
-                break;
-            case Opcode::Push:
-                m_valueStack.push_back(accumulator);
-                ip++;
-                break;
-            case Opcode::Pop:
-                accumulator = m_valueStack.back();
-                m_valueStack.pop_back();
-                ip++;
-                break;
-            case Opcode::AndStack:
+                ++quadwordCount;
+                const uint64_t value = *ptr;
+                accumulator &= (ip->IsInverted() ? ~value : value);
+                if (POLICY::c_enabled)
                 {
-                    accumulator &= m_valueStack.back();
-                    m_valueStack.pop_back();
-                    ip++;
+                    m_zeroFlag = (accumulator == 0);
+                    TraceRowAccess("AndRow", ptr, accumulator);
                 }
-                break;
-            case Opcode::Constant:
-                throw NotImplemented("Constant opcode not implemented.");
-            case Opcode::Not:
-                accumulator = !accumulator;
                 ip++;
-                break;
-            case Opcode::OrStack:
+            }
+            NEXT();
+
+        HANDLER(LoadRow)
+            {
+                auto ptr = reinterpret_cast<uint64_t const *>(
+                    sliceBuffer + m_rowOffsets[ip->GetRow()]) +
+                    (offset >> ip->GetDelta());
+                if (POLICY::c_interleaved)
                 {
-                    accumulator |= m_valueStack.back();
-                    m_valueStack.pop_back();
-                    ip++;
+                    if (lane.m_pending != ptr)
+                    {
+                        // Start the load and yield to the next lane. The
+                        // lane resumes at this instruction.
+                        _mm_prefetch(reinterpret_cast<char const *>(ptr),
+                                     _MM_HINT_T0);
+                        lane.m_pending = ptr;
+                        goto suspend;
+                    }
+                    lane.m_pending = nullptr;
                 }
-                break;
-            case Opcode::UpdateFlags:
-                m_zeroFlag = (m_valueStack.back() == 0);
-                ip++;
-                break;
-            case Opcode::Report:
-                // TODO: Combine accumulator with value stack.
-                if (accumulator != 0)
+                ++quadwordCount;
+                const uint64_t value = *ptr;
+                accumulator = (ip->IsInverted() ? ~value : value);
+                if (POLICY::c_enabled)
                 {
-                    AddResult(accumulator, offset, base);
+                    m_zeroFlag = (accumulator == 0);
+                    TraceRowAccess("LoadRow", ptr, accumulator);
                 }
                 ip++;
-                break;
-            case Opcode::Call:
-                m_callStack.push_back(ip + 1);
-                ip = m_jumpTable[row];
-                break;
-            case Opcode::Jmp:
-                ip = m_jumpTable[row];
-                break;
-            case Opcode::Jnz:
-                if (accumulator != 0ull)
-                {
-                    ip = m_jumpTable[row];
-                }
-                else
-                {
-                    ip++;
-                }
-                break;
-            case Opcode::Jz:
-                if (accumulator == 0ull)
-                {
-                    ip = m_jumpTable[row];
-                }
-                else
-                {
-                    ip++;
-                }
-                break;
-            case Opcode::Return:
-                ip = m_callStack.back();
-                m_callStack.pop_back();
-                break;
-            default:
-                RecoverableError error("ByteCodeInterpreter:: bad opcode.");
-                throw error;
-            }  // switch
-        }  // while
+            }
+            NEXT();
+
+        HANDLER(LeftShiftOffset)
+            offset <<= ip->GetRow();
+            ip++;
+            NEXT();
+
+        HANDLER(RightShiftOffset)
+            offset >>= ip->GetRow();
+            ip++;
+            NEXT();
+
+        HANDLER(IncrementOffset)
+            offset++;
+            ip++;
+            NEXT();
+
+        HANDLER(Push)
+            *valueStack++ = accumulator;
+            ip++;
+            NEXT();
+
+        HANDLER(Pop)
+            accumulator = *--valueStack;
+            ip++;
+            NEXT();
+
+        HANDLER(AndStack)
+            accumulator &= *--valueStack;
+            ip++;
+            NEXT();
+
+        HANDLER(Constant)
+            throw NotImplemented("Constant opcode not implemented.");
+
+        HANDLER(Not)
+            accumulator = !accumulator;
+            ip++;
+            NEXT();
+
+        HANDLER(OrStack)
+            accumulator |= *--valueStack;
+            ip++;
+            NEXT();
+
+        HANDLER(UpdateFlags)
+            // No opcode reads the zero flag, so it is only maintained for
+            // diagnostics.
+            if (POLICY::c_enabled)
+            {
+                m_zeroFlag = (valueStack[-1] == 0);
+            }
+            ip++;
+            NEXT();
 
+        HANDLER(Report)
+            // TODO: Combine accumulator with value stack.
+            if (accumulator != 0)
+            {
+                AddResult(lane.m_dedupe, accumulator, offset, base);
+            }
+            ip++;
+            NEXT();
 
-        bool terminate = FinishIteration(base, sliceBuffer);
+        HANDLER(Call)
+            *callStack++ = ip + 1;
+            ip = m_jumpTable[ip->GetRow()];
+            NEXT();
 
-        return terminate;
+        HANDLER(Jmp)
+            ip = m_jumpTable[ip->GetRow()];
+            NEXT();
+
+        HANDLER(Jnz)
+            ip = (accumulator != 0ull) ? m_jumpTable[ip->GetRow()] : ip + 1;
+            NEXT();
+
+        HANDLER(Jz)
+            ip = (accumulator == 0ull) ? m_jumpTable[ip->GetRow()] : ip + 1;
+            NEXT();
+
+        HANDLER(Return)
+            ip = *--callStack;
+            NEXT();
+
+        HANDLER(End)
+            completed = true;
+            goto suspend;
+
+        END_DISPATCH()
+
+    suspend:
+        lane.m_ip = ip;
+        lane.m_offset = offset;
+        lane.m_accumulator = accumulator;
+        lane.m_valueDepth =
+            static_cast<size_t>(valueStack - lane.m_valueStack.data());
+        lane.m_callDepth =
+            static_cast<size_t>(callStack - lane.m_callStack.data());
+
+        m_instrumentation.IncrementQuadwordCount(quadwordCount);
+
+        return completed;
     }
 
-    void ByteCodeInterpreter::AddResult(uint64_t accumulator,
+#undef BEGIN_DISPATCH
+#undef NEXT
+#undef HANDLER
+#undef END_DISPATCH
+#undef BITFUNNEL_COMPUTED_GOTO
+
+
+    void ByteCodeInterpreter::AddResult(uint64_t (&dedupe)[65],
+                                        uint64_t accumulator,
                                         size_t offset,
                                         size_t base)
     {
@@ -337,40 +890,32 @@ Decide on type of Slices
             << "Offset out of range.";
 
         // Set bit indicating that we're storing an accululator at offset.
-        m_dedupe[0] |= (1ull << offset);
+        dedupe[0] |= (1ull << offset);
 
         // Or in the accumulator.
-        m_dedupe[offset + 1] |= accumulator;
+        dedupe[offset + 1] |= accumulator;
     }
 
 
-    static uint64_t bsf(uint64_t value)
-    {
-#ifdef _MSC_VER
-        unsigned long index;
-        _BitScanForward64(&index, value);
-        return index;
-#else
-        // DESIGN NOTE: this is undefined if the input operand i 0. We currently
-        // only call lzcnt in one place, where we've prevously gauranteed that
-        // the input isn't 0. This is not safe to use in the general case.
-        return static_cast<uint64_t>(__builtin_ctzll(value));
-#endif
-    }
-
-
-    bool ByteCodeInterpreter::FinishIteration(size_t base,
+    bool ByteCodeInterpreter::FinishIteration(uint64_t (&dedupe)[65],
+                                              size_t base,
                                               void const * sliceBuffer)
     {
         //std::cout
         //    << "FinishIteration: " << base << std::endl;
 
-        uint64_t map = m_dedupe[0];
+        uint64_t map = dedupe[0];
         while (map != 0)
         {
             size_t offset = bsf(map);
 
-            uint64_t accumulator = m_dedupe[offset + 1];
+            uint64_t accumulator = dedupe[offset + 1];
+
+            if (m_countMode)
+            {
+                m_matchCount += popcount(accumulator);
+                accumulator = 0;
+            }
 
             while (accumulator != 0)
             {
@@ -382,29 +927,52 @@ Decide on type of Slices
                 Slice* slice =
                     *reinterpret_cast<Slice**>(const_cast<void*>(sliceBuffer));
                 m_resultsBuffer.push_back(slice, docIndex);
+                ++m_matchCount;
 
                 // Clear the lowest bit set in the accumulator.
                 accumulator &= (accumulator - 1);
             }
-            m_dedupe[offset + 1] = 0;
+            dedupe[offset + 1] = 0;
 
             // Clear the lowest bit set in the map.
             map &= (map - 1);
         }
-        m_dedupe[0] = 0;
+        dedupe[0] = 0;
 
         // TODO: don't always return false.
         return false;
     }
 
 
+    //*************************************************************************
+    //
+    // ByteCodeInterpreter::Lane
+    //
+    //*************************************************************************
+    ByteCodeInterpreter::Lane::Lane()
+      : m_sliceBuffer(nullptr),
+        m_iteration(0),
+        m_base(0),
+        m_ip(nullptr),
+        m_offset(0),
+        m_accumulator(0),
+        m_pending(nullptr),
+        m_callDepth(0),
+        m_valueDepth(0),
+        m_dedupe()
+    {
+    }
+
+
     //*************************************************************************
     //
     // ByteCodeGenerator
     //
     //*************************************************************************
     ByteCodeGenerator::ByteCodeGenerator()
-        : m_sealed(false)
+        : m_sealed(false),
+          m_maxCallDepth(0),
+          m_maxValueStackDepth(0)
     {
     }
 
@@ -429,6 +997,22 @@ Decide on type of Slices
             m_jumpTable.push_back(&m_code[0] + offset);
         }
 
+        // Code generated from a match tree has no recursion, and every value
+        // pushed by a Push instruction is popped before that instruction can
+        // run again. Therefore the number of Call and Push instructions
+        // bound the depths of the call and value stacks.
+        for (auto const & instruction : m_code)
+        {
+            if (instruction.GetOpcode() == ByteCodeInterpreter::Opcode::Call)
+            {
+                ++m_maxCallDepth;
+            }
+            else if (instruction.GetOpcode() == ByteCodeInterpreter::Opcode::Push)
+            {
+                ++m_maxValueStackDepth;
+            }
+        }
+
         m_sealed = true;
     }
 
@@ -449,6 +1033,20 @@ Decide on type of Slices
     }
 
 
+    size_t ByteCodeGenerator::GetMaxCallDepth() const
+    {
+        EnsureSealed(true);
+        return m_maxCallDepth;
+    }
+
+
+    size_t ByteCodeGenerator::GetMaxValueStackDepth() const
+    {
+        EnsureSealed(true);
+        return m_maxValueStackDepth;
+    }
+
+
     void ByteCodeGenerator::AndRow(size_t row, bool inverted, size_t rankDelta)
     {
         EnsureSealed(false);
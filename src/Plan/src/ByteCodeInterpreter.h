@@ -35,6 +35,7 @@ namespace BitFunnel
 {
     class ByteCodeGenerator;
     class CacheLineRecorder;
+    class CancellationToken;
     class IDiagnosticStream;
     class QueryInstrumentation;
     class ResultsBuffer;
@@ -59,6 +60,7 @@ namespace BitFunnel
     {
     public:
         class Instruction;
+        class Lane;
 
         // Constructs a ByteCodeInterpreter for the sequence of instructions
         // in a specific ByteCodeGenerator. This interpreter will run against
@@ -74,12 +76,74 @@ namespace BitFunnel
                             QueryInstrumentation & instrumentation,
                             CacheLineRecorder * cacheLineRecorder);
 
+        // Configures Run() to consult the summary quadwords of the specified
+        // rows, which must be conjuncts of the entire query. Slices where
+        // one of these rows is empty are skipped entirely, as are the
+        // iterations in blocks where one of the rows is empty. The arrays
+        // hold the offset of each row's summary quadword in the slice buffer
+        // and the rank at which each row is stored. They must outlive the
+        // interpreter.
+        void EnableRowSummaries(size_t rowCount,
+                                ptrdiff_t const * summaryOffsets,
+                                Rank const * ranks);
+
+        // Configures the interpreter to count matches instead of appending
+        // them to the ResultsBuffer. Each deduped accumulator contributes
+        // its population count, so individual matches are never visited.
+        void EnableCountMode();
+
+        // Configures Run(), RunInterleaved() and RunSparse() to poll token at
+        // each slice boundary, and to stop with the matches found so far
+        // once it has been cancelled. The token is marked as truncated if
+        // any slices were left unmatched. It must outlive the interpreter.
+        void EnableCancellation(CancellationToken & token);
+
+        // Configures Run() and RunSparse() to skip the slices that the
+        // CacheLineRecorder does not sample. Used to estimate the cache
+        // lines accessed by native code, which cannot record them itself,
+        // by interpreting the same plan for the sampled slices only.
+        void SkipUnsampledSlices();
+
+        // Returns the number of matches found by this interpreter, whether
+        // or not count mode is enabled.
+        size_t GetMatchCount() const;
+
         // Runs the instruction sequence for a specified number of iterations.
         // Each iteration processes a single quadword of row data at the
         // highest rank in the plan.  Returns true to indicate early
         // termination.
         bool Run();
 
+        // Runs the same instruction sequence as Run(), but keeps up to
+        // laneCount iterations in flight at once. Each lane is a stackless
+        // coroutine that prefetches the row quadword needed by its next
+        // AndRow or LoadRow and then yields to the next lane, so that the
+        // memory latency of one iteration overlaps with work on the others.
+        // Lanes draw iterations from all slices, so interleaving is
+        // effective even for shards with a single slice. Slices and blocks
+        // excluded by row summaries are skipped, as in Run().
+        //
+        // The lanes are taken from the lanes parameter, which is grown as
+        // needed and may be reused across interpreters to avoid allocating
+        // on each query.
+        //
+        // Produces the same matches as Run(), although they may be appended
+        // to the ResultsBuffer in a different order. Falls back to Run() when
+        // laneCount is less than two or when cache line recording or
+        // diagnostics are enabled, since both assume a single slice in
+        // flight. Returns true to indicate early termination.
+        bool RunInterleaved(size_t laneCount, std::vector<Lane> & lanes);
+
+        // Runs the same instruction sequence as Run(), but only for the
+        // iterations that overlap a non-zero quadword of the specified row,
+        // which is stored at rank rowRank. The row must be a conjunct of the
+        // entire query, so that iterations where it is zero cannot produce
+        // matches. The row is scanned with SIMD instructions, so the cost of
+        // a query with a sparse row is proportional to the number of
+        // candidate quadwords rather than to the size of the index.
+        // Returns true to indicate early termination.
+        bool RunSparse(size_t row, Rank rowRank);
+
         // Virtual machine opcodes. With the exception of the End opcode,
         // these values have a 1:1 correspondance with the ICodeGenerator
         // methods.
@@ -174,24 +238,156 @@ namespace BitFunnel
             uint32_t m_inverted : 1;
         };
 
+        // Lane holds the complete virtual machine state for one iteration.
+        // Run() and RunSparse() use a single Lane. RunInterleaved() keeps
+        // several Lanes in flight. A non-null m_pending indicates that the
+        // lane is suspended on the AndRow or LoadRow at m_ip, waiting for
+        // the prefetched quadword at m_pending.
+        class Lane
+        {
+        public:
+            Lane();
+
+            char const * m_sliceBuffer;
+            size_t m_iteration;
+            size_t m_base;
+            Instruction const * m_ip;
+            size_t m_offset;
+            uint64_t m_accumulator;
+            uint64_t const * m_pending;
+
+            // Fixed size stacks, sized by ByteCodeGenerator::Seal() so that
+            // they can never overflow, and the number of entries in use.
+            std::vector<Instruction const *> m_callStack;
+            std::vector<uint64_t> m_valueStack;
+            size_t m_callDepth;
+            size_t m_valueDepth;
+
+            // Dedupe buffer. First entry is bitmap indicating which of the
+            // remaining 64 entries correspond to accumulators with matches.
+            uint64_t m_dedupe[65];
+        };
+
     private:
+        // Resets lane to start the specified iteration of the slice. Grows
+        // the lane's stacks if they are too small for the code.
+        void StartIteration(Lane & lane,
+                            void const * sliceBuffer,
+                            size_t iteration) const;
+
+        // Advances iteration, which indexes the sequence of all iterations
+        // across all slices, to the first iteration at or after it that is
+        // not excluded by row summaries. candidates holds the candidate
+        // blocks of the slice containing iteration, and is updated when
+        // iteration enters a new slice. Returns false if no iterations
+        // remain or if the query has been cancelled, in which case
+        // cancelled is set.
+        bool FindIteration(size_t & iteration,
+                           uint64_t & candidates,
+                           bool & cancelled);
+
+        // Returns true if the specified iteration of a slice overlaps one of
+        // the candidate blocks returned by GetCandidateBlocks().
+        bool IsCandidateIteration(uint64_t candidates, size_t iteration) const;
+
+        // Returns true if the cancellation token has been cancelled, in
+        // which case the token is marked as truncated. Called before
+        // starting a slice.
+        bool IsCancelled();
+
+        // Decides whether to record the cache lines accessed in the slice.
+        // Returns false if the slice should be skipped.
+        bool StartSlice(void const * sliceBuffer);
+
+        // Reports the cache lines recorded for the slice, if any.
+        void FinishSlice();
+
         //  Returns true to indicate early termination.
         bool ProcessOneSlice(size_t slice);
 
+        // Returns a bitmap with one bit for each summary block of the slice.
+        // Iterations that do not overlap a set bit cannot produce matches.
+        // Returns all ones if row summaries are not enabled.
+        uint64_t GetCandidateBlocks(void const * sliceBuffer) const;
+
+        // Scans the specified row in one slice and runs the iterations that
+        // overlap its non-zero quadwords. Returns true to indicate early
+        // termination.
+        bool ProcessOneSliceSparse(size_t slice, size_t row, Rank rowRank);
+
+        // Runs the iterations that overlap the specified quadword of a row at
+        // rank rowRank, skipping iterations below nextIteration, which is
+        // then advanced past the last iteration run. Returns true to
+        // indicate early termination.
+        bool RunCandidateIterations(void const * sliceBuffer,
+                                    size_t quadword,
+                                    Rank rowRank,
+                                    size_t & nextIteration);
+
         // Executes the instruction sequence for the specified iteration
-        // number. Returns true to indicate early termination.
+        // number. Returns true to indicate early termination. Uses
+        // DiagnosticPolicy when diagnostics or cache line recording are
+        // enabled, and ProductionPolicy otherwise.
         bool RunOneIteration(void const * sliceBuffer, size_t iteration);
 
+        // Policies for Resume(). DiagnosticPolicy supports the
+        // "bytecode/opcode" and "bytecode/loadrow" diagnostics, cache line
+        // recording and the zero flag. ProductionPolicy and
+        // InterleavedPolicy compile all of these out. InterleavedPolicy
+        // suspends the lane at each row load. All policies report quadword
+        // counts.
+        class DiagnosticPolicy
+        {
+        public:
+            static const bool c_enabled = true;
+            static const bool c_interleaved = false;
+        };
+
+        class ProductionPolicy
+        {
+        public:
+            static const bool c_enabled = false;
+            static const bool c_interleaved = false;
+        };
+
+        class InterleavedPolicy
+        {
+        public:
+            static const bool c_enabled = false;
+            static const bool c_interleaved = true;
+        };
+
+        // Runs lane until it reaches the End opcode, or, with
+        // InterleavedPolicy, until it suspends on a row load. Returns true
+        // if the iteration has run to completion. This is the only
+        // implementation of the opcodes.
+        template <typename POLICY>
+        bool Resume(Lane & lane);
+
+        // Writes the "bytecode/opcode" diagnostic for one instruction.
+        void TraceInstruction(Instruction const * ip,
+                              size_t iteration,
+                              size_t offset) const;
+
+        // Records the cache line for a row access and writes the
+        // "bytecode/loadrow" diagnostic.
+        void TraceRowAccess(char const * opcodeName,
+                            uint64_t const * ptr,
+                            uint64_t accumulator) const;
+
         // The 'base' parameter has the rank0 quadword position for the start
         // of the current iteration. The accumulator corresponds to position
         // 'base + offset'.
-        void AddResult(uint64_t accumulator,
+        void AddResult(uint64_t (&dedupe)[65],
+                       uint64_t accumulator,
                        size_t offset,
                        size_t base);
 
         // The 'base' parameter has the rank0 quadword position for the start
         // of this iteration.
-        bool FinishIteration(size_t base, void const * sliceBuffer);
+        bool FinishIteration(uint64_t (&dedupe)[65],
+                             size_t base,
+                             void const * sliceBuffer);
 
         //
         // Cached constructor parameters.
@@ -209,27 +405,43 @@ namespace BitFunnel
 
         ptrdiff_t const * m_rowOffsets;
 
+        // Row summaries. See EnableRowSummaries().
+        size_t m_summaryCount;
+        ptrdiff_t const * m_summaryOffsets;
+        Rank const * m_summaryRanks;
+        unsigned m_summaryBlockShift;
+
+        // See EnableCountMode().
+        bool m_countMode;
+        size_t m_matchCount;
+
+        // See EnableCancellation().
+        CancellationToken * m_cancellation;
 
         //
         // Virtual machine state.
         //
 
-        // Control flow call stack. Holds return addresses for calls.
-        std::vector<Instruction const *> m_callStack;
+        // Depths of the call and value stacks. See
+        // ByteCodeGenerator::GetMaxCallDepth() and GetMaxValueStackDepth().
+        size_t m_maxCallDepth;
+        size_t m_maxValueStackDepth;
 
-        // 64-bit value stack for Rank0 methods.
-        std::vector<uint64_t> m_valueStack;
+        // Lane used by Run() and RunSparse().
+        Lane m_lane;
 
         // TODO: Formalize definition and usage of zero flag.
         bool m_zeroFlag;
 
-        // Dedupe buffer. First entry is bitmap indicating which of the
-        // remaining 64 entries correspond to accumulators with matches.
-        uint64_t m_dedupe[65];
-
         IDiagnosticStream* m_diagnosticStream;
         QueryInstrumentation& m_instrumentation;
         CacheLineRecorder * m_cacheLineRecorder;
+
+        // See SkipUnsampledSlices().
+        bool m_skipUnsampledSlices;
+
+        // True if the CacheLineRecorder sampled the current slice.
+        bool m_recordingSlice;
     };
 
 
@@ -324,6 +536,12 @@ namespace BitFunnel
         std::vector<ByteCodeInterpreter::Instruction const *> const &
             GetJumpTable() const;
 
+        // Return upper bounds on the depths of the call stack and the value
+        // stack during a single iteration. Class must be sealed before
+        // calling these methods.
+        size_t GetMaxCallDepth() const;
+        size_t GetMaxValueStackDepth() const;
+
         //
         // ICodeGenerator methods
         //
@@ -367,5 +585,7 @@ namespace BitFunnel
         std::vector<ByteCodeInterpreter::Instruction> m_code;
         std::vector<size_t> m_jumpOffsets;
         std::vector<ByteCodeInterpreter::Instruction const *> m_jumpTable;
+        size_t m_maxCallDepth;
+        size_t m_maxValueStackDepth;
     };
 }
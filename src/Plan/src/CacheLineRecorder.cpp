@@ -20,10 +20,12 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <algorithm>    // std::min(), std::max().
 #include <cstring>      // memset().
 
 #include "BitFunnel/BitFunnelTypes.h"
 #include "CacheLineRecorder.h"
+#include "LoggerInterfaces/Check.h"
 #include "Rounding.h"
 
 
@@ -42,10 +44,15 @@ namespace BitFunnel
     };
 
 
-    CacheLineRecorder::CacheLineRecorder(size_t sliceBufferSize)
-        // : m_sliceBufferSize(sliceBufferSize),
-        : m_base(nullptr)
+    CacheLineRecorder::CacheLineRecorder(size_t sliceBufferSize,
+                                         size_t samplePeriod)
+      : m_base(nullptr),
+        m_samplePeriod(samplePeriod),
+        m_sliceCounter(0)
     {
+        CHECK_GT(samplePeriod, 0u)
+            << "Sample period must be at least one slice.";
+
         size_t cacheLineCount =
             RoundUp(sliceBufferSize, c_bytesPerCacheLine) / c_bytesPerCacheLine;
 
@@ -53,6 +60,22 @@ namespace BitFunnel
             RoundUp(cacheLineCount, c_bitsPerByte) / c_bitsPerByte;
 
         m_bitArray.reset(new uint8_t[m_bitArraySize]);
+        memset(m_bitArray.get(), 0, m_bitArraySize);
+        m_firstDirty = m_bitArraySize;
+        m_lastDirty = 0;
+    }
+
+
+    bool CacheLineRecorder::SampleSlice()
+    {
+        return (m_sliceCounter++ % m_samplePeriod) == 0;
+    }
+
+
+    void CacheLineRecorder::StartSlice(void const * sliceBuffer)
+    {
+        Reset();
+        SetBase(sliceBuffer);
     }
 
 
@@ -69,13 +92,16 @@ namespace BitFunnel
         const size_t byteIndex = cacheLineNumber / c_bitsPerByte;
         const uint8_t bitMask = 1ull << (cacheLineNumber % c_bitsPerByte);
         m_bitArray[byteIndex] |= bitMask;
+
+        m_firstDirty = (std::min)(m_firstDirty, byteIndex);
+        m_lastDirty = (std::max)(m_lastDirty, byteIndex);
     }
 
 
     size_t CacheLineRecorder::GetCacheLinesAccessed() const
     {
         size_t count = 0;
-        for (size_t i = 0; i < m_bitArraySize; ++i)
+        for (size_t i = m_firstDirty; i <= m_lastDirty && i < m_bitArraySize; ++i)
         {
             count += g_bitsSetTable256[m_bitArray[i]];
         }
@@ -83,8 +109,27 @@ namespace BitFunnel
     }
 
 
+    size_t CacheLineRecorder::FinishSlice() const
+    {
+        return GetCacheLinesAccessed() * m_samplePeriod;
+    }
+
+
+    size_t CacheLineRecorder::GetSamplePeriod() const
+    {
+        return m_samplePeriod;
+    }
+
+
     void CacheLineRecorder::Reset()
     {
-        memset(m_bitArray.get(), 0ull, m_bitArraySize);
+        if (m_firstDirty <= m_lastDirty)
+        {
+            memset(m_bitArray.get() + m_firstDirty,
+                   0,
+                   m_lastDirty - m_firstDirty + 1);
+        }
+        m_firstDirty = m_bitArraySize;
+        m_lastDirty = 0;
     }
 }
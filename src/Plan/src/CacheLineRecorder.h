@@ -28,22 +28,61 @@
 
 namespace BitFunnel
 {
+    //*************************************************************************
+    //
+    // CacheLineRecorder
+    //
+    // Records the distinct cache lines of a slice that are accessed while
+    // matching it.
+    //
+    // Recording every slice slows matching down considerably, so the
+    // recorder can sample every samplePeriod-th slice instead, counting
+    // slices across shards and queries. FinishSlice() scales the lines
+    // recorded in a sampled slice by the sample period, so the sum of the
+    // estimates is an unbiased estimate of the total, although the
+    // estimate for a single query with few slices may be far off.
+    //
+    //*************************************************************************
     class CacheLineRecorder
     {
     public:
-        CacheLineRecorder(size_t sliceBufferSize);
+        CacheLineRecorder(size_t sliceBufferSize, size_t samplePeriod = 1);
+
+        // Returns true if the next slice should be recorded.
+        bool SampleSlice();
+
+        // Forgets previous accesses and starts recording accesses to the
+        // specified slice.
+        void StartSlice(void const * sliceBuffer);
 
         void SetBase(void const * base);
         void RecordAccess(void const * ptr);
 
+        // Returns the number of distinct cache lines accessed since the
+        // last Reset().
         size_t GetCacheLinesAccessed() const;
 
+        // Returns the estimated number of cache lines accessed in this
+        // slice and the unsampled slices it stands for, i.e.
+        // GetCacheLinesAccessed() scaled by the sample period.
+        size_t FinishSlice() const;
+
+        size_t GetSamplePeriod() const;
+
         void Reset();
 
     private:
-        // size_t m_sliceBufferSize;
         size_t m_bitArraySize;
         std::unique_ptr<uint8_t[]> m_bitArray;
         char const * m_base;
+
+        // Range of m_bitArray modified since the last Reset(). Only this
+        // range is cleared and counted, since queries typically touch a
+        // small fraction of the slice.
+        size_t m_firstDirty;
+        size_t m_lastDirty;
+
+        const size_t m_samplePeriod;
+        size_t m_sliceCounter;
     };
 }
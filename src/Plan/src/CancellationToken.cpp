@@ -0,0 +1,98 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "CancellationToken.h"
+
+
+namespace BitFunnel
+{
+    CancellationToken::CancellationToken()
+      : m_cancelled(0),
+        m_deadline(0.0),
+        m_truncated(false)
+    {
+    }
+
+
+    void CancellationToken::Start(double deadline)
+    {
+        m_stopwatch.Reset();
+        m_deadline = deadline;
+        m_truncated = false;
+    }
+
+
+    void CancellationToken::Cancel()
+    {
+        m_cancelled.store(1);
+    }
+
+
+    bool CancellationToken::IsCancelled()
+    {
+        if (m_cancelled.load(std::memory_order_relaxed) != 0)
+        {
+            return true;
+        }
+
+        if (m_deadline > 0.0 && m_stopwatch.ElapsedTime() > m_deadline)
+        {
+            // Latch the expired deadline so that generated code sees it.
+            Cancel();
+            return true;
+        }
+
+        return false;
+    }
+
+
+    bool CancellationToken::HasDeadline() const
+    {
+        return m_deadline > 0.0;
+    }
+
+
+    void CancellationToken::SetTruncated()
+    {
+        m_truncated = true;
+    }
+
+
+    bool CancellationToken::IsTruncated() const
+    {
+        return m_truncated;
+    }
+
+
+    uint64_t const * CancellationToken::GetFlag() const
+    {
+        return reinterpret_cast<uint64_t const *>(&m_cancelled);
+    }
+
+
+    void CancellationToken::Reset()
+    {
+        m_cancelled.store(0);
+        m_deadline = 0.0;
+        m_truncated = false;
+    }
+}
@@ -0,0 +1,89 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <atomic>                           // std::atomic embedded.
+#include <stdint.h>                         // uint64_t template parameter.
+
+#include "BitFunnel/Utilities/Stopwatch.h"  // Stopwatch embedded.
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // CancellationToken
+    //
+    // Lets a query be stopped before it has matched every slice, either by
+    // a call to Cancel() from another thread or because its deadline has
+    // passed. The matchers poll the token at slice boundaries, so a
+    // cancelled query stops within one slice per shard and reports the
+    // matches found so far.
+    //
+    //*************************************************************************
+    class CancellationToken
+    {
+    public:
+        CancellationToken();
+
+        // Starts the clock for a new query. If deadline is greater than
+        // zero, the query is cancelled once deadline seconds have elapsed.
+        // Clears the truncation flag, but not a pending cancellation.
+        void Start(double deadline);
+
+        // Requests that the current query stop at the next slice boundary.
+        // May be called from any thread.
+        void Cancel();
+
+        // Returns true if Cancel() has been called or the deadline has
+        // passed. Called by the matchers at slice boundaries.
+        bool IsCancelled();
+
+        bool HasDeadline() const;
+
+        // Called by a matcher that stops before its last slice because
+        // the token was cancelled.
+        void SetTruncated();
+
+        // Returns true if any matcher stopped early since Start().
+        bool IsTruncated() const;
+
+        // Returns the address of a quadword that is non-zero once the token
+        // has been cancelled. Generated code polls this quadword directly.
+        // Expired deadlines are only reflected here after a call to
+        // IsCancelled().
+        uint64_t const * GetFlag() const;
+
+        // Clears the cancellation, deadline and truncation flag.
+        void Reset();
+
+    private:
+        std::atomic<uint64_t> m_cancelled;
+        static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+                      "Generated code reads m_cancelled as a uint64_t.");
+
+        Stopwatch m_stopwatch;
+        double m_deadline;
+        bool m_truncated;
+    };
+}
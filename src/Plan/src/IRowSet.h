@@ -73,5 +73,10 @@ namespace BitFunnel
         // shard. The offset specified where in the slice buffer a particular
         // row is stored.
         virtual ptrdiff_t const * GetRowOffsets(ShardId shard) const = 0;
+
+        // Returns the array of offsets for the summary quadwords of the rows
+        // associated with a specified shard. The array is parallel to the
+        // one returned by GetRowOffsets().
+        virtual ptrdiff_t const * GetRowSummaryOffsets(ShardId shard) const = 0;
     };
 }
@@ -20,6 +20,8 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <limits>
+
 #include "LoggerInterfaces/Check.h"
 #include "MachineCodeGenerator.h"
 #include "NativeCodeGenerator.h"
@@ -40,20 +42,38 @@ namespace BitFunnel
     // rbx: accumulator
     // rcx: slice + iteration
     // rdx: slice
-    // rsi: pointer to array of row offsets
+    // rsi: pointer to array of row offsets (unused by rows whose offsets
+    //      are emitted as displacements in shard-specialized code)
     // rdi: pointer to parameters data structure
     // r8-r15: row offset pointers
 
 
     MachineCodeGenerator::MachineCodeGenerator(RegisterAllocator const & registers,
-                                               FunctionBuffer & code)
+                                               FunctionBuffer & code,
+                                               ptrdiff_t const * rowOffsets)
       : m_registers(registers),
         m_code(code),
+        m_rowOffsets(rowOffsets),
         m_pushCount(0)
     {
     }
 
 
+    bool MachineCodeGenerator::TryGetDisplacement(unsigned id,
+                                                  int32_t& displacement) const
+    {
+        if (m_rowOffsets == nullptr
+            || m_rowOffsets[id] < std::numeric_limits<int32_t>::min()
+            || m_rowOffsets[id] > std::numeric_limits<int32_t>::max())
+        {
+            return false;
+        }
+
+        displacement = static_cast<int32_t>(m_rowOffsets[id]);
+        return true;
+    }
+
+
     //
     // ICodeGenerator methods
     //
@@ -93,8 +113,16 @@ namespace BitFunnel
                 else
                 {
                     // Case 2: rankDelta > 0 && !inverted && !IsRegister
-                    m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
-                    m_code.Emit<OpCode::And>(rbx, rax, rdx, SIB::Scale1, 0);
+                    int32_t displacement;
+                    if (TryGetDisplacement(id, displacement))
+                    {
+                        m_code.Emit<OpCode::And>(rbx, rax, rdx, SIB::Scale1, displacement);
+                    }
+                    else
+                    {
+                        m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
+                        m_code.Emit<OpCode::And>(rbx, rax, rdx, SIB::Scale1, 0);
+                    }
                 }
             }
             else
@@ -109,8 +137,16 @@ namespace BitFunnel
                 else
                 {
                     // Case 4: rankDelta > 0 && inverted && !IsRegister
-                    m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
-                    m_code.Emit<OpCode::Mov>(rax, rax, rdx, SIB::Scale1, 0);
+                    int32_t displacement;
+                    if (TryGetDisplacement(id, displacement))
+                    {
+                        m_code.Emit<OpCode::Mov>(rax, rax, rdx, SIB::Scale1, displacement);
+                    }
+                    else
+                    {
+                        m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
+                        m_code.Emit<OpCode::Mov>(rax, rax, rdx, SIB::Scale1, 0);
+                    }
                 }
 
                 // Combine inverted row with accumulator(RBX).
@@ -131,9 +167,17 @@ namespace BitFunnel
                 else
                 {
                     // Case 6: rankDelta == 0 && !inverted && !IsRegister
-                    m_code.Emit<OpCode::Mov>(rax, rcx);
-                    m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
-                    m_code.Emit<OpCode::And>(rbx, rax, 0);
+                    int32_t displacement;
+                    if (TryGetDisplacement(id, displacement))
+                    {
+                        m_code.Emit<OpCode::And>(rbx, rcx, displacement);
+                    }
+                    else
+                    {
+                        m_code.Emit<OpCode::Mov>(rax, rcx);
+                        m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
+                        m_code.Emit<OpCode::And>(rbx, rax, 0);
+                    }
                 }
             }
             else
@@ -148,9 +192,17 @@ namespace BitFunnel
                 else
                 {
                     // Case 8: rankDelta == 0 && inverted && !IsRegister
-                    m_code.Emit<OpCode::Mov>(rax, rcx);
-                    m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
-                    m_code.Emit<OpCode::Mov>(rax, rax, 0);
+                    int32_t displacement;
+                    if (TryGetDisplacement(id, displacement))
+                    {
+                        m_code.Emit<OpCode::Mov>(rax, rcx, displacement);
+                    }
+                    else
+                    {
+                        m_code.Emit<OpCode::Mov>(rax, rcx);
+                        m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
+                        m_code.Emit<OpCode::Mov>(rax, rax, 0);
+                    }
                 }
 
                 // Combine inverted row with accumulator(RBX).
@@ -193,8 +245,16 @@ namespace BitFunnel
             else
             {
                 // Case 2: rankDelta > 0, !IsRegister
-                m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
-                m_code.Emit<OpCode::Mov>(rbx, rax, rdx, SIB::Scale1, 0);
+                int32_t displacement;
+                if (TryGetDisplacement(id, displacement))
+                {
+                    m_code.Emit<OpCode::Mov>(rbx, rax, rdx, SIB::Scale1, displacement);
+                }
+                else
+                {
+                    m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
+                    m_code.Emit<OpCode::Mov>(rbx, rax, rdx, SIB::Scale1, 0);
+                }
             }
         }
         else
@@ -208,9 +268,17 @@ namespace BitFunnel
             else
             {
                 // Case 4: rankDelta == 0, !IsRegister
-                m_code.Emit<OpCode::Mov>(rax, rcx);
-                m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
-                m_code.Emit<OpCode::Mov>(rbx, rax, 0);
+                int32_t displacement;
+                if (TryGetDisplacement(id, displacement))
+                {
+                    m_code.Emit<OpCode::Mov>(rbx, rcx, displacement);
+                }
+                else
+                {
+                    m_code.Emit<OpCode::Mov>(rax, rcx);
+                    m_code.Emit<OpCode::Add>(rax, rsi, id * 8);
+                    m_code.Emit<OpCode::Mov>(rbx, rax, 0);
+                }
             }
         }
 
@@ -22,6 +22,9 @@
 
 #pragma once
 
+#include <stddef.h>                     // ptrdiff_t parameter.
+#include <stdint.h>                     // int32_t parameter.
+
 #include "BitFunnel/NonCopyable.h"      // Base class.
 #include "ICodeGenerator.h"             // Base class.
 
@@ -54,8 +57,14 @@ namespace BitFunnel
         // Constructs a MachineCodeGenerator which generates X64 code using the
         // supplied X64FunctionGenerator. The registers parameter supplies a
         // RegisterAllocator that provides register assignments for some rows.
+        //
+        // If rowOffsets is not nullptr, the generated code is specialized
+        // for a single shard and row offsets that are not held in registers
+        // are emitted as displacements instead of being loaded from
+        // Parameters::m_rowOffsets.
         MachineCodeGenerator(RegisterAllocator const & registers,
-                             FunctionBuffer & code);
+                             FunctionBuffer & code,
+                             ptrdiff_t const * rowOffsets = nullptr);
 
         //
         // ICodeGenerator methods
@@ -112,6 +121,10 @@ namespace BitFunnel
         static unsigned GetSlotCount();
 
     protected:
+        // Returns true if the code is specialized for a shard and the offset
+        // of the specified row fits in a 32-bit displacement.
+        bool TryGetDisplacement(unsigned id, int32_t& displacement) const;
+
         //
         // Constructor parameters
         //
@@ -120,6 +133,8 @@ namespace BitFunnel
 
         FunctionBuffer & m_code;
 
+        ptrdiff_t const * m_rowOffsets;
+
 
         // Records the number of items pushed on the X64 stack since the
         // stack frame setup was completed. Required to satisfy X64 calling
@@ -22,6 +22,8 @@
 
 
 #include "BitFunnel/Utilities/Allocator.h"
+#include "CancellationToken.h"
+#include "LoggerInterfaces/Check.h"
 #include "MatchTreeCompiler.h"
 #include "QueryResources.h"
 
@@ -38,63 +40,207 @@ namespace BitFunnel
     MatchTreeCompiler::MatchTreeCompiler(QueryResources & resources,
                                          CompileNode const & tree,
                                          RegisterAllocator const & registers,
-                                         Rank initialRank)
+                                         Rank initialRank,
+                                         ptrdiff_t const * rowOffsets,
+                                         size_t iterationsPerSlice,
+                                         bool countMode)
+      : m_initialRank(initialRank),
+        m_countMode(countMode)
     {
         NativeCodeGenerator::Prototype expression(resources.GetExpressionTreeAllocator(),
                                                   resources.GetCode());
         // TODO: Remove temporary debugging output.
         //expression.EnableDiagnostics(std::cout);
 
+        NativeCodeGenerator::LoopOptions loopOptions;
+        loopOptions.m_prefetchDistance = resources.GetPrefetchDistance();
+        loopOptions.m_nonTemporalPrefetch = resources.IsNonTemporalPrefetchEnabled();
+
         auto & node =
             expression.PlacementConstruct<NativeCodeGenerator>(expression,
                                                                tree,
                                                                registers,
-                                                               initialRank);
+                                                               initialRank,
+                                                               rowOffsets,
+                                                               iterationsPerSlice,
+                                                               countMode,
+                                                               loopOptions);
         m_function = expression.Compile(node);
     }
 
 
+    // The generated code polls this flag when no CancellationToken is
+    // supplied.
+    static const uint64_t c_notCancelled = 0;
+
+
+    // Returns true if the generated code must be run one slice at a time so
+    // that the token's deadline is checked between slices.
+    static bool HasDeadline(CancellationToken const * cancellation)
+    {
+        return cancellation != nullptr && cancellation->HasDeadline();
+    }
+
+
     size_t MatchTreeCompiler::Run(size_t sliceCount,
                                   void * const * sliceBuffers,
                                   size_t iterationsPerSlice,
                                   ptrdiff_t const * rowOffsets,
-                                  ResultsBuffer & results)
+                                  ResultsBuffer & results,
+                                  ptrdiff_t const * summaryOffsets,
+                                  size_t summaryCount,
+                                  CancellationToken * cancellation)
+    {
+        CHECK_EQ(m_countMode, false)
+            << "Count mode functions must be invoked with Count().";
+
+        size_t matchCount = 0;
+        if (!results.HasConsumer() && !HasDeadline(cancellation))
+        {
+            return RunSlices(sliceCount,
+                             sliceBuffers,
+                             iterationsPerSlice,
+                             rowOffsets,
+                             &results,
+                             matchCount,
+                             summaryOffsets,
+                             summaryCount,
+                             cancellation);
+        }
+
+        // The generated code cannot flush a full buffer or read the clock,
+        // so it is run one slice at a time, flushing whenever the buffer may
+        // not have room for every document in the next slice.
+        const size_t sliceCapacity = (iterationsPerSlice << m_initialRank) << 6;
+        if (results.HasConsumer())
+        {
+            CHECK_GE(results.capacity(), sliceCapacity)
+                << "ResultsBuffer chunk is smaller than a slice.";
+        }
+
+        size_t quadwordCount = 0;
+        for (size_t slice = 0; slice < sliceCount; ++slice)
+        {
+            if (cancellation != nullptr && cancellation->IsCancelled())
+            {
+                cancellation->SetTruncated();
+                break;
+            }
+
+            if (results.HasConsumer() &&
+                results.capacity() - results.size() < sliceCapacity)
+            {
+                results.Flush();
+            }
+
+            quadwordCount += RunSlices(1,
+                                       sliceBuffers + slice,
+                                       iterationsPerSlice,
+                                       rowOffsets,
+                                       &results,
+                                       matchCount,
+                                       summaryOffsets,
+                                       summaryCount,
+                                       cancellation);
+        }
+
+        return quadwordCount;
+    }
+
+
+    size_t MatchTreeCompiler::Count(size_t sliceCount,
+                                    void * const * sliceBuffers,
+                                    size_t iterationsPerSlice,
+                                    ptrdiff_t const * rowOffsets,
+                                    size_t & matchCount,
+                                    ptrdiff_t const * summaryOffsets,
+                                    size_t summaryCount,
+                                    CancellationToken * cancellation)
+    {
+        CHECK_EQ(m_countMode, true)
+            << "Count() requires a function compiled in count mode.";
+
+        if (!HasDeadline(cancellation))
+        {
+            return RunSlices(sliceCount,
+                             sliceBuffers,
+                             iterationsPerSlice,
+                             rowOffsets,
+                             nullptr,
+                             matchCount,
+                             summaryOffsets,
+                             summaryCount,
+                             cancellation);
+        }
+
+        size_t quadwordCount = 0;
+        for (size_t slice = 0; slice < sliceCount; ++slice)
+        {
+            if (cancellation->IsCancelled())
+            {
+                cancellation->SetTruncated();
+                break;
+            }
+
+            quadwordCount += RunSlices(1,
+                                       sliceBuffers + slice,
+                                       iterationsPerSlice,
+                                       rowOffsets,
+                                       nullptr,
+                                       matchCount,
+                                       summaryOffsets,
+                                       summaryCount,
+                                       cancellation);
+        }
+
+        return quadwordCount;
+    }
+
+
+    size_t MatchTreeCompiler::RunSlices(size_t sliceCount,
+                                        void * const * sliceBuffers,
+                                        size_t iterationsPerSlice,
+                                        ptrdiff_t const * rowOffsets,
+                                        ResultsBuffer * results,
+                                        size_t & matchCount,
+                                        ptrdiff_t const * summaryOffsets,
+                                        size_t summaryCount,
+                                        CancellationToken * cancellation)
     {
         NativeCodeGenerator::Parameters parameters = {
             sliceCount,
             sliceBuffers,
             iterationsPerSlice,
             rowOffsets,
+            summaryOffsets,
+            summaryCount,
+            (cancellation != nullptr) ? cancellation->GetFlag() : &c_notCancelled,
             0,
             { 0 },
-            results.m_capacity,
-            results.m_size,
-            results.m_buffer,
+            (results != nullptr) ? results->m_capacity : 0,
+            (results != nullptr) ? results->m_size : 0,
+            (results != nullptr) ? results->m_buffer : nullptr,
             0
         };
 
         // For now ignore return value.
         m_function(&parameters);
 
-        // TODO: Remove temporary debugging output.
-        //std::cout
-        //    << parameters.m_matchCount
-        //    << " matches."
-        //    << std::endl;
-
-        //for (size_t i = 0; i < parameters.m_matchCount; ++i)
-        //{
-        //    auto & match = parameters.m_matches[i];
-        //    std::cout
-        //        << std::hex
-        //        << match.m_buffer
-        //        << std::dec
-        //        << ": "
-        //        << match.m_id
-        //        << std::endl;
-        //}
-
-        results.m_size = parameters.m_matchCount;
+        if (results != nullptr)
+        {
+            results->m_size = parameters.m_matchCount;
+        }
+        else
+        {
+            matchCount += parameters.m_matchCount;
+        }
+
+        // The generated code leaves the count of unmatched slices behind
+        // when it stops early.
+        if (parameters.m_sliceCount != 0 && cancellation != nullptr)
+        {
+            cancellation->SetTruncated();
+        }
 
         return parameters.m_quadwordCount;
     }
@@ -38,6 +38,7 @@ namespace NativeJIT
 
 namespace BitFunnel
 {
+    class CancellationToken;
     class CompileNode;
     class QueryResources;
     class RegisterAllocator;
@@ -51,18 +52,65 @@ namespace BitFunnel
     class MatchTreeCompiler
     {
     public:
+        // Compiles tree into a function that may be run against any shard.
+        // If rowOffsets is not nullptr, the function is instead specialized
+        // for the shard with the specified row offsets and iterations per
+        // slice, and may only be run against that shard. If countMode is
+        // true, the function only counts matches and must be invoked with
+        // Count() instead of Run(). The inner loop is tuned with the
+        // prefetch settings in resources.
         MatchTreeCompiler(QueryResources & resources,
                           CompileNode const & tree,
                           RegisterAllocator const & registers,
-                          Rank initialRank);
+                          Rank initialRank,
+                          ptrdiff_t const * rowOffsets = nullptr,
+                          size_t iterationsPerSlice = 0,
+                          bool countMode = false);
 
+        // Slices where the summary quadword at any of the summaryCount
+        // offsets in summaryOffsets is zero are skipped. These offsets must
+        // belong to rows that are conjuncts of the entire query. If results
+        // has a consumer, it is flushed between slices as needed, and its
+        // capacity must be at least the slice capacity. If cancellation is
+        // not nullptr, it is polled before each slice, and matching stops
+        // once it has been cancelled, marking the token as truncated if any
+        // slices were left unmatched.
         size_t Run(size_t slicecount,
                    void * const * slicebuffers,
                    size_t iterationsperslice,
                    ptrdiff_t const * rowoffsets,
-                   ResultsBuffer & results);
+                   ResultsBuffer & results,
+                   ptrdiff_t const * summaryOffsets = nullptr,
+                   size_t summaryCount = 0,
+                   CancellationToken * cancellation = nullptr);
+
+        // Like Run(), but adds the number of matches to matchCount instead
+        // of storing them in a ResultsBuffer.
+        size_t Count(size_t slicecount,
+                     void * const * slicebuffers,
+                     size_t iterationsperslice,
+                     ptrdiff_t const * rowoffsets,
+                     size_t & matchCount,
+                     ptrdiff_t const * summaryOffsets = nullptr,
+                     size_t summaryCount = 0,
+                     CancellationToken * cancellation = nullptr);
 
     private:
+        // Invokes the generated function once for the specified slices.
+        // Matches are stored in results, or added to matchCount if results
+        // is nullptr.
+        size_t RunSlices(size_t slicecount,
+                         void * const * slicebuffers,
+                         size_t iterationsperslice,
+                         ptrdiff_t const * rowoffsets,
+                         ResultsBuffer * results,
+                         size_t & matchCount,
+                         ptrdiff_t const * summaryOffsets,
+                         size_t summaryCount,
+                         CancellationToken * cancellation);
+
         NativeCodeGenerator::Prototype::FunctionType m_function;
+        Rank m_initialRank;
+        bool m_countMode;
     };
 }
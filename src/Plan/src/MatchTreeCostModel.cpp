@@ -0,0 +1,288 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+
+#include "AbstractRow.h"
+#include "LoggerInterfaces/Logging.h"
+#include "MatchTreeCostModel.h"
+#include "RowMatchNode.h"
+
+
+namespace BitFunnel
+{
+    // Relative cost of a cache line fill compared to reading a quadword
+    // that is already in cache.
+    static const double c_cacheLineWeight = 8.0;
+
+    // Relative cost of the fixed work in each matcher iteration compared to
+    // reading a quadword that is already in cache.
+    static const double c_iterationWeight = 4.0;
+
+    // Density assumed for rows when measured densities are unavailable.
+    static const double c_defaultRowDensity = 0.1;
+
+    static const double c_bitsPerQuadwordDouble = 64.0;
+    static const double c_quadwordsPerCacheLine = 8.0;
+
+
+    // Returns the probability that a quadword with bit density d has at
+    // least one bit set.
+    static double NonZeroProbability(double d, double bits)
+    {
+        return 1.0 - std::pow(1.0 - d, bits);
+    }
+
+
+    //*************************************************************************
+    //
+    // MatchTreeCostModel::Cost
+    //
+    //*************************************************************************
+    MatchTreeCostModel::Cost::Cost()
+      : m_quadwords(0.0),
+        m_cacheLines(0.0),
+        m_iterations(0.0)
+    {
+    }
+
+
+    double MatchTreeCostModel::Cost::GetTotal() const
+    {
+        return m_quadwords
+            + c_cacheLineWeight * m_cacheLines
+            + c_iterationWeight * m_iterations;
+    }
+
+
+    void MatchTreeCostModel::Cost::Print(std::ostream& out) const
+    {
+        out << "quadwords: " << m_quadwords
+            << ", cachelines: " << m_cacheLines
+            << ", iterations: " << m_iterations
+            << ", total: " << GetTotal();
+    }
+
+
+    //*************************************************************************
+    //
+    // MatchTreeCostModel
+    //
+    //*************************************************************************
+    MatchTreeCostModel::MatchTreeCostModel(double const * rowDensities)
+      : m_rowDensities(rowDensities)
+    {
+    }
+
+
+    MatchTreeCostModel::Cost
+        MatchTreeCostModel::Estimate(RowMatchNode const & tree) const
+    {
+        Cost cost;
+        double density = 1.0;
+        Visit(tree, density, cost);
+        cost.m_iterations =
+            std::ldexp(1.0, -static_cast<int>(GetInitialRank(tree)));
+        return cost;
+    }
+
+
+    MatchTreeCostModel::Cost
+        MatchTreeCostModel::EstimateSparse(RowMatchNode const & tree,
+                                           AbstractRow const & driver,
+                                           Rank initialRank) const
+    {
+        const Cost dense = Estimate(tree);
+
+        // An iteration runs if any of the driver bits it covers is set. An
+        // iteration at a rank above the driver's covers several driver
+        // quadwords.
+        const int rank = static_cast<int>(driver.GetRank() + driver.GetRankDelta());
+        const int shift = (std::max)(static_cast<int>(initialRank) - rank, 0);
+        const double fraction =
+            NonZeroProbability(GetDensity(driver.GetId()),
+                               std::ldexp(c_bitsPerQuadwordDouble, shift));
+
+        Cost cost;
+        cost.m_quadwords = fraction * dense.m_quadwords;
+        cost.m_cacheLines = fraction * dense.m_cacheLines
+            + std::ldexp(1.0, -rank) / c_quadwordsPerCacheLine;
+        cost.m_iterations = fraction * std::ldexp(1.0, -static_cast<int>(initialRank));
+        return cost;
+    }
+
+
+    void MatchTreeCostModel::Visit(RowMatchNode const & node,
+                                   double & density,
+                                   Cost & cost) const
+    {
+        switch (node.GetType())
+        {
+        case RowMatchNode::AndMatch:
+            {
+                // The RankDownCompiler evaluates the left child first.
+                RowMatchNode::And const & andNode =
+                    dynamic_cast<RowMatchNode::And const &>(node);
+                Visit(andNode.GetLeft(), density, cost);
+                Visit(andNode.GetRight(), density, cost);
+            }
+            break;
+        case RowMatchNode::OrMatch:
+            {
+                // Both children start from the same accumulator.
+                RowMatchNode::Or const & orNode =
+                    dynamic_cast<RowMatchNode::Or const &>(node);
+                double left = density;
+                double right = density;
+                Visit(orNode.GetLeft(), left, cost);
+                Visit(orNode.GetRight(), right, cost);
+                density = 1.0 - (1.0 - left) * (1.0 - right);
+            }
+            break;
+        case RowMatchNode::RowMatch:
+            {
+                AbstractRow const & row =
+                    dynamic_cast<RowMatchNode::Row const &>(node).GetRow();
+
+                // Fraction of positions, at the row's evaluation rank, where
+                // the accumulator is non-zero and the row must be read.
+                const double reach = NonZeroProbability(density, c_bitsPerQuadwordDouble);
+
+                // A row evaluated at rank r is read once per 2^r rank 0
+                // positions. A row with a non-zero rank delta re-reads each
+                // quadword for 2^delta consecutive positions, so it touches
+                // fewer distinct cache lines.
+                const double positions = std::ldexp(1.0, -static_cast<int>(row.GetRank()));
+                const double quadwordsPerLine =
+                    std::ldexp(c_quadwordsPerCacheLine,
+                               static_cast<int>(row.GetRankDelta()));
+
+                cost.m_quadwords += reach * positions;
+                cost.m_cacheLines +=
+                    NonZeroProbability(reach, quadwordsPerLine)
+                    * positions / quadwordsPerLine;
+
+                const double d = GetDensity(row.GetId());
+                density *= (row.IsInverted() ? 1.0 - d : d);
+            }
+            break;
+        case RowMatchNode::NotMatch:
+        case RowMatchNode::ReportMatch:
+            {
+                const double reach = NonZeroProbability(density, c_bitsPerQuadwordDouble);
+                density *= VisitUnconditional(node, reach, cost);
+            }
+            break;
+        default:
+            LogAbortB("Unsupported node type.");
+        }
+    }
+
+
+    double MatchTreeCostModel::VisitUnconditional(RowMatchNode const & node,
+                                                  double reach,
+                                                  Cost & cost) const
+    {
+        switch (node.GetType())
+        {
+        case RowMatchNode::AndMatch:
+            {
+                RowMatchNode::And const & andNode =
+                    dynamic_cast<RowMatchNode::And const &>(node);
+                return VisitUnconditional(andNode.GetLeft(), reach, cost)
+                    * VisitUnconditional(andNode.GetRight(), reach, cost);
+            }
+        case RowMatchNode::OrMatch:
+            {
+                RowMatchNode::Or const & orNode =
+                    dynamic_cast<RowMatchNode::Or const &>(node);
+                const double left = VisitUnconditional(orNode.GetLeft(), reach, cost);
+                const double right = VisitUnconditional(orNode.GetRight(), reach, cost);
+                return 1.0 - (1.0 - left) * (1.0 - right);
+            }
+        case RowMatchNode::NotMatch:
+            {
+                RowMatchNode::Not const & notNode =
+                    dynamic_cast<RowMatchNode::Not const &>(node);
+                return 1.0 - VisitUnconditional(notNode.GetChild(), reach, cost);
+            }
+        case RowMatchNode::ReportMatch:
+            {
+                RowMatchNode const * child =
+                    dynamic_cast<RowMatchNode::Report const &>(node).GetChild();
+                return (child == nullptr) ?
+                    1.0 : VisitUnconditional(*child, reach, cost);
+            }
+        case RowMatchNode::RowMatch:
+            {
+                // Rows under a Report are evaluated at rank 0.
+                AbstractRow const & row =
+                    dynamic_cast<RowMatchNode::Row const &>(node).GetRow();
+                cost.m_quadwords += reach;
+                cost.m_cacheLines +=
+                    NonZeroProbability(reach, c_quadwordsPerCacheLine)
+                    / c_quadwordsPerCacheLine;
+
+                const double d = GetDensity(row.GetId());
+                return row.IsInverted() ? 1.0 - d : d;
+            }
+        default:
+            LogAbortB("Unsupported node type.");
+            return 1.0;
+        }
+    }
+
+
+    Rank MatchTreeCostModel::GetInitialRank(RowMatchNode const & node)
+    {
+        switch (node.GetType())
+        {
+        case RowMatchNode::AndMatch:
+            {
+                RowMatchNode::And const & andNode =
+                    dynamic_cast<RowMatchNode::And const &>(node);
+                return (std::max)(GetInitialRank(andNode.GetLeft()),
+                                  GetInitialRank(andNode.GetRight()));
+            }
+        case RowMatchNode::OrMatch:
+            {
+                RowMatchNode::Or const & orNode =
+                    dynamic_cast<RowMatchNode::Or const &>(node);
+                return (std::max)(GetInitialRank(orNode.GetLeft()),
+                                  GetInitialRank(orNode.GetRight()));
+            }
+        case RowMatchNode::RowMatch:
+            return dynamic_cast<RowMatchNode::Row const &>(node).GetRow().GetRank();
+        default:
+            return 0;
+        }
+    }
+
+
+    double MatchTreeCostModel::GetDensity(unsigned id) const
+    {
+        return (m_rowDensities == nullptr) ?
+            c_defaultRowDensity : m_rowDensities[id];
+    }
+}
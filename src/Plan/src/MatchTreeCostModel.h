@@ -0,0 +1,113 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <iosfwd>                   // std::ostream parameter.
+
+#include "BitFunnel/BitFunnelTypes.h"   // Rank parameter.
+#include "BitFunnel/NonCopyable.h"      // Base class.
+
+
+namespace BitFunnel
+{
+    class AbstractRow;
+    class RowMatchNode;
+
+    //*************************************************************************
+    //
+    // MatchTreeCostModel estimates the memory traffic of matching a
+    // rewritten RowMatchNode tree with the RankDown algorithm.
+    //
+    // Costs are expressed per rank 0 quadword position, so they can be
+    // compared across plans independent of shard size. The model walks the
+    // tree in evaluation order, tracking the expected density of the
+    // accumulator. A row is only read when the accumulator quadword is
+    // non-zero, so the expected fraction of positions that reach a row is
+    // 1 - (1 - D)^64, where D is the density of the accumulator before the
+    // row. Rows are assumed to be independent.
+    //
+    // Each iteration of the matcher also carries a fixed overhead for loop
+    // control and result processing, so plans that start at a higher rank
+    // are cheaper.
+    //
+    // Row densities come from an optional array indexed by AbstractRow id.
+    // Without it, every row is assumed to have a typical density of 10%.
+    //
+    //*************************************************************************
+    class MatchTreeCostModel : NonCopyable
+    {
+    public:
+        class Cost
+        {
+        public:
+            Cost();
+
+            // Returns a single figure of merit for comparing plans. Cache
+            // line fills and iterations are weighted more heavily than
+            // quadword reads.
+            double GetTotal() const;
+
+            void Print(std::ostream& out) const;
+
+            double m_quadwords;
+            double m_cacheLines;
+            double m_iterations;
+        };
+
+        MatchTreeCostModel(double const * rowDensities);
+
+        Cost Estimate(RowMatchNode const & tree) const;
+
+        // Estimates the cost of matching tree in sparse mode, where the
+        // driver row is scanned sequentially and tree is only evaluated for
+        // iterations at initialRank that overlap a non-zero driver quadword.
+        // The scan is charged for its cache lines but not for its quadwords,
+        // since it runs without the per-quadword work of the matcher.
+        Cost EstimateSparse(RowMatchNode const & tree,
+                            AbstractRow const & driver,
+                            Rank initialRank) const;
+
+    private:
+        // Adds the cost of evaluating node to cost. On entry, density holds
+        // the expected accumulator density. On exit it holds the expected
+        // accumulator density after node.
+        void Visit(RowMatchNode const & node,
+                   double & density,
+                   Cost & cost) const;
+
+        // Adds the cost of evaluating every row in a Report or Not subtree,
+        // which are compiled without short circuits. Returns the density of
+        // the subtree's value.
+        double VisitUnconditional(RowMatchNode const & node,
+                                  double reach,
+                                  Cost & cost) const;
+
+        double GetDensity(unsigned id) const;
+
+        // Returns the highest evaluation rank of any row outside of Report
+        // and Not subtrees. This is the rank at which matching starts.
+        static Rank GetInitialRank(RowMatchNode const & node);
+
+        double const * m_rowDensities;
+    };
+}
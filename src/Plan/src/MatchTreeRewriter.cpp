@@ -20,7 +20,9 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <algorithm>    // std::stable_sort().
 #include <new>          // For placement new.
+#include <vector>       // std::vector used in SortByDensity().
 
 #include "BitFunnel/Allocators/IAllocator.h"
 #include "LoggerInterfaces/Logging.h"
@@ -37,9 +39,10 @@ namespace BitFunnel
     RowMatchNode const & MatchTreeRewriter::Rewrite(RowMatchNode const & root,
                                                     unsigned targetRowCount,
                                                     unsigned targetCrossProductTermCount,
-                                                    IAllocator& allocator)
+                                                    IAllocator& allocator,
+                                                    double const * rowDensities)
     {
-        Partition partition(allocator);
+        Partition partition(allocator, rowDensities);
 
         unsigned currentCrossProductTermCount = 0;
         return BuildCompileTree(partition,
@@ -119,8 +122,10 @@ namespace BitFunnel
 #pragma warning(push)
 #pragma warning(disable:4351)
 #endif
-    MatchTreeRewriter::Partition::Partition(IAllocator& allocator)
+    MatchTreeRewriter::Partition::Partition(IAllocator& allocator,
+                                            double const * rowDensities)
         : m_allocator(allocator),
+          m_rowDensities(rowDensities),
           m_rowCount(0),
           m_parentRank(c_maxRankValue),
           m_minRank(c_maxRankValue),
@@ -141,6 +146,7 @@ namespace BitFunnel
     MatchTreeRewriter::Partition::Partition(Partition const & parent,
                                             RowMatchNode const & node)
         : m_allocator(parent.m_allocator),
+          m_rowDensities(parent.m_rowDensities),
           m_rowCount(parent.m_rowCount),
           m_parentRank(parent.m_minRank),
           m_minRank(parent.m_minRank),
@@ -152,6 +158,14 @@ namespace BitFunnel
     {
         ProcessTree(node);
 
+        if (m_rowDensities != nullptr)
+        {
+            for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+            {
+                SortByDensity(m_rows[rank]);
+            }
+        }
+
         AddNode(m_rank0Tree, m_rows[0]);
 
         for (Rank rank = 1; rank <= c_maxRankValue; ++rank)
@@ -342,6 +356,50 @@ namespace BitFunnel
     }
 
 
+    void MatchTreeRewriter::Partition::SortByDensity(RowMatchNode const * & tree) const
+    {
+        // Flatten the and-expression built by AddNode(). Each And node has a
+        // row on the left and the remainder of the expression on the right.
+        std::vector<RowMatchNode::Row const *> rows;
+        RowMatchNode const * node = tree;
+        while (node != nullptr)
+        {
+            if (node->GetType() == RowMatchNode::AndMatch)
+            {
+                RowMatchNode::And const & andNode = dynamic_cast<RowMatchNode::And const &>(*node);
+                rows.push_back(&dynamic_cast<RowMatchNode::Row const &>(andNode.GetLeft()));
+                node = &andNode.GetRight();
+            }
+            else
+            {
+                rows.push_back(&dynamic_cast<RowMatchNode::Row const &>(*node));
+                node = nullptr;
+            }
+        }
+
+        if (rows.size() < 2)
+        {
+            return;
+        }
+
+        double const * densities = m_rowDensities;
+        std::stable_sort(rows.begin(),
+                         rows.end(),
+                         [densities](RowMatchNode::Row const * a,
+                                     RowMatchNode::Row const * b)
+        {
+            return densities[a->GetRow().GetId()] < densities[b->GetRow().GetId()];
+        });
+
+        // AddNode() prepends, so add the densest row first.
+        tree = nullptr;
+        for (auto it = rows.rbegin(); it != rows.rend(); ++it)
+        {
+            AddNode(tree, *it);
+        }
+    }
+
+
     RowMatchNode const & MatchTreeRewriter::Partition::RankUpToRankZero(RowMatchNode const & node, bool& containsNotNode) const
     {
         switch (node.GetType())
@@ -78,10 +78,18 @@ namespace BitFunnel
         // with a target of 3, the expression (a + b)(c + d)(e + f) would be
         // expanded to four terms, (ac + ad + bc + bd)(e + f), an amount
         // that is one greater than the target.
+        //
+        // rowDensities:
+        // Optional array, indexed by AbstractRow id, of the expected fraction
+        // of bits set in each row. When provided, rows of the same rank in
+        // each and-expression are ordered from sparsest to densest so that
+        // the RankDown matcher can short circuit on a zero accumulator as
+        // early as possible. When nullptr, rows keep their structural order.
         static RowMatchNode const & Rewrite(RowMatchNode const & root,
                                             unsigned targetRowCount,
                                             unsigned targetCrossProductTermCount,
-                                            IAllocator& allocator);
+                                            IAllocator& allocator,
+                                            double const * rowDensities = nullptr);
 
     private:
         // Partition is a helper class that divides the and-expression at the
@@ -90,7 +98,7 @@ namespace BitFunnel
         class Partition : NonCopyable
         {
         public:
-            Partition(IAllocator& allocator);
+            Partition(IAllocator& allocator, double const * rowDensities);
             Partition(Partition const & parent,
                       RowMatchNode const & node);
 
@@ -117,6 +125,11 @@ namespace BitFunnel
 
             void CreateReportNode(RowMatchNode const * & reportNode, RowMatchNode const * node) const;
 
+            // Rebuilds an and-expression of rows so that the sparsest row,
+            // according to m_rowDensities, is evaluated first. Rows with equal
+            // densities keep their relative order.
+            void SortByDensity(RowMatchNode const * & tree) const;
+
             // Given an existing RowMatchTree rooted at RowMatchNode node, create a
             // new RowMatchTree. The new RowMatchTree is exactly the same as the existing
             // RowMatchTree with the exception that all non-rank0 rows in the existing
@@ -131,6 +144,9 @@ namespace BitFunnel
 
             IAllocator& m_allocator;
 
+            // Optional row densities indexed by AbstractRow id. May be nullptr.
+            double const * m_rowDensities;
+
             // Maintains the total number of rows on the path from the match
             // tree root through all parent partitions and all rows in the tio
             // level and-expression of this partition. Used to determine when
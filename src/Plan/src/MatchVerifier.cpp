@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <ostream>
 
+#include "BitFunnel/Index/DocumentHandle.h"
 #include "BitFunnel/Plan/Factories.h"
 #include "MatchVerifier.h"
 
@@ -51,6 +52,16 @@ namespace BitFunnel
     }
 
 
+    void MatchVerifier::Consume(ResultsBuffer::Result const * results,
+                                size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            AddObserved(results[i].GetHandle().GetDocId());
+        }
+    }
+
+
 
     std::string MatchVerifier::GetQuery() const
     {
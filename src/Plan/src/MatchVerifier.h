@@ -27,10 +27,15 @@
 #include <vector>
 
 #include "BitFunnel/Plan/IMatchVerifier.h"  // base class.
+#include "ResultsBuffer.h"                  // base class.
 
 namespace BitFunnel
 {
-    class MatchVerifier : public IMatchVerifier
+    // MatchVerifier is also a ResultsBuffer::IConsumer, so that observed
+    // matches can be streamed from a chunked ResultsBuffer while the query
+    // is being matched.
+    class MatchVerifier : public IMatchVerifier,
+                          public ResultsBuffer::IConsumer
     {
     public:
         MatchVerifier(std::string query);
@@ -38,6 +43,14 @@ namespace BitFunnel
         virtual void AddExpected(DocId) override;
         virtual void AddObserved(DocId) override;
 
+        //
+        // ResultsBuffer::IConsumer methods.
+        //
+
+        // Adds the DocId of each result as an observed match.
+        virtual void Consume(ResultsBuffer::Result const * results,
+                             size_t count) override;
+
         virtual std::string GetQuery() const override;
         virtual std::vector<DocId> GetExpected() const override;
         virtual std::vector<DocId> GetObserved() const override;
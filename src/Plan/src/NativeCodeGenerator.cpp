@@ -20,10 +20,13 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
 #include "BitFunnel/Index/DocumentHandle.h"
 #include "CompileNode.h"
+#include "LoggerInterfaces/Check.h"
 #include "MachineCodeGenerator.h"
 #include "NativeJIT/CodeGen/ExecutionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
@@ -35,6 +38,94 @@
 
 namespace BitFunnel
 {
+    // Each row is prefetched at most this many cache lines per iteration.
+    static const size_t c_maxPrefetchLinesPerRow = 4;
+
+    // Prefetch displacements are 32-bit, which limits the distance.
+    static const size_t c_maxPrefetchDistance = 1024;
+
+
+    // Appends each row in node whose id is not already in rows.
+    static void CollectRows(CompileNode const & node,
+                            std::vector<AbstractRow const *> & rows)
+    {
+        AbstractRow const * row = nullptr;
+        switch (node.GetType())
+        {
+        case CompileNode::opAndRowJz:
+            {
+                auto const & andRow = dynamic_cast<CompileNode::AndRowJz const &>(node);
+                row = &andRow.GetRow();
+                CollectRows(andRow.GetChild(), rows);
+            }
+            break;
+        case CompileNode::opLoadRowJz:
+            {
+                auto const & loadRow = dynamic_cast<CompileNode::LoadRowJz const &>(node);
+                row = &loadRow.GetRow();
+                CollectRows(loadRow.GetChild(), rows);
+            }
+            break;
+        case CompileNode::opLoadRow:
+            row = &dynamic_cast<CompileNode::LoadRow const &>(node).GetRow();
+            break;
+        case CompileNode::opOr:
+        case CompileNode::opAndTree:
+        case CompileNode::opOrTree:
+            {
+                auto const & binary = dynamic_cast<CompileNode::Binary const &>(node);
+                CollectRows(binary.GetLeft(), rows);
+                CollectRows(binary.GetRight(), rows);
+            }
+            break;
+        case CompileNode::opRankDown:
+            CollectRows(dynamic_cast<CompileNode::RankDown const &>(node).GetChild(),
+                        rows);
+            break;
+        case CompileNode::opReport:
+            {
+                CompileNode const * child =
+                    dynamic_cast<CompileNode::Report const &>(node).GetChild();
+                if (child != nullptr)
+                {
+                    CollectRows(*child, rows);
+                }
+            }
+            break;
+        case CompileNode::opNot:
+            CollectRows(dynamic_cast<CompileNode::Not const &>(node).GetChild(),
+                        rows);
+            break;
+        default:
+            break;
+        }
+
+        if (row != nullptr)
+        {
+            for (auto existing : rows)
+            {
+                if (existing->GetId() == row->GetId())
+                {
+                    return;
+                }
+            }
+            rows.push_back(row);
+        }
+    }
+
+
+    //*************************************************************************
+    //
+    // NativeCodeGenerator::LoopOptions
+    //
+    //*************************************************************************
+    NativeCodeGenerator::LoopOptions::LoopOptions()
+      : m_prefetchDistance(0),
+        m_nonTemporalPrefetch(false)
+    {
+    }
+
+
     //*************************************************************************
     //
     // NativeCodeGenerator
@@ -44,12 +135,27 @@ namespace BitFunnel
         Prototype& expression,
         CompileNode const & compileNodeTree,
         RegisterAllocator const & registers,
-        Rank initialRank)
+        Rank initialRank,
+        ptrdiff_t const * rowOffsets,
+        size_t iterationsPerSlice,
+        bool countMode,
+        LoopOptions const & loopOptions)
       : Node(expression),
         m_compileNodeTree(compileNodeTree),
         m_registers(registers),
-        m_initialRank(initialRank)
+        m_initialRank(initialRank),
+        m_shardRowOffsets(rowOffsets),
+        m_shardIterationsPerSlice(iterationsPerSlice),
+        m_countMode(countMode),
+        m_loopOptions(loopOptions)
     {
+        CHECK_LE(loopOptions.m_prefetchDistance, c_maxPrefetchDistance)
+            << "Prefetch distance too large.";
+
+        if (loopOptions.m_prefetchDistance > 0)
+        {
+            CollectRows(compileNodeTree, m_rows);
+        }
     }
 
 
@@ -121,6 +227,16 @@ namespace BitFunnel
         // to use registers that conflict with other matcher registers.
         for (unsigned r = 0; r < m_registers.GetRegistersAllocated(); ++r)
         {
+            if (m_shardRowOffsets != nullptr)
+            {
+                // Shard-specialized code knows the offsets at compile time.
+                const ptrdiff_t offset =
+                    m_shardRowOffsets[m_registers.GetRowIdFromRegister(r)];
+                code.EmitImmediate<OpCode::Mov>(Register<8u, false>(r + 8),
+                                                static_cast<int64_t>(offset));
+                continue;
+            }
+
             code.Emit<OpCode::Mov>(Register<8u, false>(r + 8),
                                    rsi,
                                    m_registers.GetRowIdFromRegister(r) * 8);
@@ -151,7 +267,41 @@ namespace BitFunnel
         code.Emit<OpCode::Or>(rax, rax);
         code.EmitConditionalJump<JccType::JZ>(bottomOfLoop);
 
+        // Stop before this slice if the query has been cancelled.
+        code.Emit<OpCode::Mov>(rax, rdi, m_cancelled);
+        code.Emit<OpCode::Mov>(rax, rax, 0);
+        code.Emit<OpCode::Or>(rax, rax);
+        code.EmitConditionalJump<JccType::JNZ>(bottomOfLoop);
+
+        // Skip the slice if any of the summaries in m_summaryOffsets is
+        // zero. These rows are conjuncts of the query, so the slice cannot
+        // contain a match.
+        //   rdx: slice buffer pointer.
+        //   rcx: pointer to the next summary offset.
+        //   rax: number of summary offsets remaining.
+        auto topOfSummaryLoop = code.AllocateLabel();
+        auto processSlice = code.AllocateLabel();
+        auto skipSlice = code.AllocateLabel();
+
+        code.Emit<OpCode::Mov>(rdx, rdi, m_sliceBuffers);
+        code.Emit<OpCode::Mov>(rdx, rdx, 0);
+        code.Emit<OpCode::Mov>(rcx, rdi, m_summaryOffsets);
+        code.Emit<OpCode::Mov>(rax, rdi, m_summaryCount);
+
+        code.PlaceLabel(topOfSummaryLoop);
+        code.Emit<OpCode::Or>(rax, rax);
+        code.EmitConditionalJump<JccType::JZ>(processSlice);
+        code.Emit<OpCode::Mov>(rbx, rcx, 0);
+        code.Emit<OpCode::Mov>(rbx, rbx, rdx, SIB::Scale1, 0);
+        code.Emit<OpCode::Or>(rbx, rbx);
+        code.EmitConditionalJump<JccType::JZ>(skipSlice);
+        code.EmitImmediate<OpCode::Add>(rcx, 8);
+        code.EmitImmediate<OpCode::Sub>(rax, 1);
+        code.Jmp(topOfSummaryLoop);
+
+        code.PlaceLabel(processSlice);
         EmitInnerLoop(tree);
+        code.PlaceLabel(skipSlice);
 
         // Decrement the slice count by 1.
         code.Emit<OpCode::Dec, 8>(rdi, m_sliceCount);
@@ -182,9 +332,21 @@ namespace BitFunnel
         //   m_innerLoopLimit: slice buffer pointer + bytes in starting row.
         code.Emit<OpCode::Mov>(rdx, rdi, m_sliceBuffers);
         code.Emit<OpCode::Mov>(rdx, rdx, 0);
-        code.Emit<OpCode::Mov>(rax, rdi, m_iterationsPerSlice);
-        code.EmitImmediate<OpCode::Shl>(rax, static_cast<uint8_t>(3));
-        code.Emit<OpCode::Add>(rax, rdx);
+        if (m_shardRowOffsets != nullptr
+            && m_shardIterationsPerSlice <=
+                static_cast<size_t>(std::numeric_limits<int32_t>::max()) / 8)
+        {
+            code.Emit<OpCode::Mov>(rax, rdx);
+            code.EmitImmediate<OpCode::Add>(
+                rax,
+                static_cast<int32_t>(m_shardIterationsPerSlice * 8));
+        }
+        else
+        {
+            code.Emit<OpCode::Mov>(rax, rdi, m_iterationsPerSlice);
+            code.EmitImmediate<OpCode::Shl>(rax, static_cast<uint8_t>(3));
+            code.Emit<OpCode::Add>(rax, rdx);
+        }
         CodeGenHelpers::Emit<OpCode::Mov>(code, m_innerLoopLimit, rax);
         code.Emit<OpCode::Mov>(rcx, rdx);
 
@@ -202,6 +364,27 @@ namespace BitFunnel
         // Body of loop
         //
 
+        EmitPrefetches(tree);
+        EmitIteration(tree);
+
+        //
+        // Bottom of loop
+        //
+        code.PlaceLabel(bottomOfLoop);
+        code.EmitImmediate<OpCode::Add>(rcx, 8);    // Increment current offset.
+        code.Jmp(topOfLoop);
+
+
+        code.PlaceLabel(exitLoop);
+    }
+
+
+    // Emits the match code for the iteration at rcx, followed by the code
+    // that processes its matches.
+    void NativeCodeGenerator::EmitIteration(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
         // TODO: Handle case where there are no rows.
 
         // Store this iteration's base offset in m_base.
@@ -215,21 +398,86 @@ namespace BitFunnel
         code.Emit<OpCode::Pop>(rcx);
 
         {
-            MachineCodeGenerator generator(m_registers, tree.GetCodeGenerator());
+            MachineCodeGenerator generator(m_registers,
+                                           tree.GetCodeGenerator(),
+                                           m_shardRowOffsets);
             m_compileNodeTree.Compile(generator);
         }
 
         EmitFinishIteration(tree);
+    }
 
-        //
-        // Bottom of loop
-        //
-        code.PlaceLabel(bottomOfLoop);
-        code.EmitImmediate<OpCode::Add>(rcx, 8);    // Increment current offset.
-        code.Jmp(topOfLoop);
 
+    // Prefetches, for each row, the cache lines used by the iteration
+    // m_prefetchDistance iterations after the one at rcx. A row with a lower
+    // rank than m_initialRank is accessed at iteration << (m_initialRank -
+    // rank), so both its address and the number of quadwords it spans are
+    // scaled accordingly. Clobbers rax.
+    void NativeCodeGenerator::EmitPrefetches(ExpressionTree& tree)
+    {
+        if (m_loopOptions.m_prefetchDistance == 0)
+        {
+            return;
+        }
 
-        code.PlaceLabel(exitLoop);
+        auto & code = tree.GetCodeGenerator();
+
+        for (auto row : m_rows)
+        {
+            const Rank rank = row->GetRank() + row->GetRankDelta();
+            if (rank > m_initialRank)
+            {
+                continue;
+            }
+            const uint8_t shift = static_cast<uint8_t>(m_initialRank - rank);
+            const unsigned id = row->GetId();
+
+            // rax: address of the row's quadword for the iteration at rcx,
+            // less any row offset that is known at compile time.
+            code.Emit<OpCode::Mov>(rax, rcx);
+            if (shift > 0)
+            {
+                code.Emit<OpCode::Sub>(rax, rdx);
+                code.EmitImmediate<OpCode::Shl>(rax, shift);
+                code.Emit<OpCode::Add>(rax, rdx);
+            }
+
+            int64_t displacement =
+                static_cast<int64_t>((m_loopOptions.m_prefetchDistance << shift) * 8);
+            if (m_registers.IsRegister(id))
+            {
+                code.Emit<OpCode::Add>(rax,
+                                       Register<8u, false>(m_registers.GetRegister(id)));
+            }
+            else if (m_shardRowOffsets != nullptr
+                     && m_shardRowOffsets[id] > std::numeric_limits<int32_t>::min() / 2
+                     && m_shardRowOffsets[id] < std::numeric_limits<int32_t>::max() / 2)
+            {
+                displacement += m_shardRowOffsets[id];
+            }
+            else
+            {
+                code.Emit<OpCode::Add>(rax, rsi, id * 8);
+            }
+
+            const size_t lines =
+                (std::min)(c_maxPrefetchLinesPerRow,
+                           (std::max)(static_cast<size_t>(1),
+                                      ((static_cast<size_t>(1) << shift) + 7) / 8));
+            for (size_t line = 0; line < lines; ++line)
+            {
+                const int32_t offset = static_cast<int32_t>(
+                    displacement + static_cast<int64_t>(line * c_bytesPerCacheLine));
+                if (m_loopOptions.m_nonTemporalPrefetch)
+                {
+                    code.Emit<OpCode::PrefetchNta, 8>(rax, offset);
+                }
+                else
+                {
+                    code.Emit<OpCode::PrefetchT0, 8>(rax, offset);
+                }
+            }
+        }
     }
 
 
@@ -245,6 +493,12 @@ namespace BitFunnel
 
     void NativeCodeGenerator::EmitFinishIteration(ExpressionTree& tree)
     {
+        if (m_countMode)
+        {
+            EmitCountMatches(tree);
+            return;
+        }
+
         auto & code = tree.GetCodeGenerator();
 
         // Check whether there are any matches.
@@ -347,6 +601,77 @@ namespace BitFunnel
     }
 
 
+    // Count mode counterpart of EmitFinishIteration(). Adds the population
+    // count of each deduped accumulator to m_matchCount and clears the
+    // dedupe buffer, without visiting individual matches.
+    void NativeCodeGenerator::EmitCountMatches(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        // Check whether there are any matches.
+        auto noMatches = code.AllocateLabel();
+        code.Emit<OpCode::Mov>(rax, rdi, m_dedupe);
+        code.Emit<OpCode::Or>(rax, rax);
+        code.EmitConditionalJump<JccType::JZ>(noMatches);
+
+        // Save registers.
+        code.Emit<OpCode::Push>(r13);
+        code.Emit<OpCode::Push>(r14);
+        code.Emit<OpCode::Push>(r15);
+
+        // r13 has the running match count.
+        code.Emit<OpCode::Mov>(r13, rdi, m_matchCount);
+
+        auto quadwordLoopTop = code.AllocateLabel();
+        auto quadwordLoopExit = code.AllocateLabel();
+
+        //
+        // Top of quadword loop.
+        //
+
+        // Each bit in rax corresponds to a quadword with a match.
+        code.PlaceLabel(quadwordLoopTop);
+        code.Emit<OpCode::Bsf>(r15, rax);
+        code.EmitConditionalJump<JccType::JZ>(quadwordLoopExit);
+
+        //
+        // Body of quadword loop.
+        //
+
+        code.Emit<OpCode::Mov>(r14, rdi, r15, SIB::Scale8, 8 + m_dedupe);
+        code.Emit<OpCode::Popcnt>(r14, r14);
+        code.Emit<OpCode::Add>(r13, r14);
+
+        code.Emit<OpCode::Xor>(r14, r14);
+        code.Emit<OpCode::Mov>(rdi, r15, SIB::Scale8, 8 + m_dedupe, r14);
+
+        //
+        // Bottom of quadword loop.
+        //
+
+        code.Emit<OpCode::Btr>(rax, r15);
+        code.Jmp(quadwordLoopTop);
+
+        //
+        // Exit quadword loop.
+        //
+
+        code.PlaceLabel(quadwordLoopExit);
+        code.Emit<OpCode::Mov>(rdi, m_matchCount, r13);
+
+        // Write zero'd out rax to m_dedupe in preparation
+        // for next matcher iteration.
+        code.Emit<OpCode::Mov>(rdi, m_dedupe, rax);
+
+        // Restore registers.
+        code.Emit<OpCode::Pop>(r15);
+        code.Emit<OpCode::Pop>(r14);
+        code.Emit<OpCode::Pop>(r13);
+
+        code.PlaceLabel(noMatches);
+    }
+
+
     // If there is space, stores (Slice*, DocIndex) for match in
     //   m_matches[m_matchCount++]
     // Clobbers r10, r11, r12.
@@ -23,6 +23,7 @@
 #pragma once
 
 #include <stddef.h>     // size_t, ptrdiff_t parameters.
+#include <vector>       // std::vector embedded.
 
 #include "BitFunnel/BitFunnelTypes.h"           // Rank parameter.
 #include "NativeJIT/CodeGen/FunctionBuffer.h"   // FunctionBuffer embedded.
@@ -42,6 +43,7 @@ using namespace NativeJIT;
 
 namespace BitFunnel
 {
+    class AbstractRow;
     class CompileNode;
     class DocumentHandle;
     class RegisterAllocator;
@@ -75,6 +77,13 @@ static_cast<int32_t>(reinterpret_cast<uint64_t>(&((static_cast<object*>(nullptr)
             void * const * m_sliceBuffers;
             size_t m_iterationsPerSlice;
             ptrdiff_t const * m_rowOffsets;
+            ptrdiff_t const * m_summaryOffsets;
+            size_t m_summaryCount;
+
+            // Polled before each slice. The generated code returns early if
+            // the quadword is non-zero, leaving m_sliceCount set to the
+            // number of slices that were not matched. Must not be nullptr.
+            uint64_t const * m_cancelled;
 
             // Dedupe buffer
             size_t m_base;
@@ -93,10 +102,37 @@ static_cast<int32_t>(reinterpret_cast<uint64_t>(&((static_cast<object*>(nullptr)
         typedef Function<size_t, Parameters const *> Prototype;
         Prototype::FunctionType m_function;
 
+        // Tuning parameters for the inner loop. The defaults generate a
+        // loop without prefetches.
+        class LoopOptions
+        {
+        public:
+            LoopOptions();
+
+            // Number of iterations ahead of the current one for which each
+            // row is prefetched. Zero disables prefetching.
+            size_t m_prefetchDistance;
+
+            // Selects prefetchnta instead of prefetcht0.
+            bool m_nonTemporalPrefetch;
+        };
+
+        // If rowOffsets is not nullptr, the generated code is specialized
+        // for a single shard. The shard's row offsets and iterationsPerSlice
+        // are emitted as immediates, and the corresponding fields of
+        // Parameters are ignored.
+        //
+        // If countMode is true, the generated code adds the number of bits
+        // set in each deduped accumulator to m_matchCount instead of storing
+        // matches, and m_capacity and m_matches are ignored.
         NativeCodeGenerator(Prototype& expression,
                             CompileNode const & compileNodeTree,
                             RegisterAllocator const & registers,
-                            Rank initialRank);
+                            Rank initialRank,
+                            ptrdiff_t const * rowOffsets = nullptr,
+                            size_t iterationsPerSlice = 0,
+                            bool countMode = false,
+                            LoopOptions const & loopOptions = LoopOptions());
 
         virtual ExpressionTree::Storage<size_t>
             CodeGenValue(ExpressionTree& tree) override;
@@ -107,6 +143,9 @@ static_cast<int32_t>(reinterpret_cast<uint64_t>(&((static_cast<object*>(nullptr)
         static const int32_t m_sliceBuffers = OFFSET_OF(Parameters, m_sliceBuffers);
         static const int32_t m_iterationsPerSlice = OFFSET_OF(Parameters, m_iterationsPerSlice);
         static const int32_t m_rowOffsets = OFFSET_OF(Parameters, m_rowOffsets);
+        static const int32_t m_summaryOffsets = OFFSET_OF(Parameters, m_summaryOffsets);
+        static const int32_t m_summaryCount = OFFSET_OF(Parameters, m_summaryCount);
+        static const int32_t m_cancelled = OFFSET_OF(Parameters, m_cancelled);
         static const int32_t m_base = OFFSET_OF(Parameters, m_base);
         static const int32_t m_dedupe = OFFSET_OF(Parameters, m_dedupe);
         static const int32_t m_capacity = OFFSET_OF(Parameters, m_capacity);
@@ -119,12 +158,22 @@ static_cast<int32_t>(reinterpret_cast<uint64_t>(&((static_cast<object*>(nullptr)
         void EmitRegisterInitialization(ExpressionTree& tree);
         void EmitOuterLoop(ExpressionTree& tree);
         void EmitInnerLoop(ExpressionTree& tree);
+        void EmitIteration(ExpressionTree& tree);
+        void EmitPrefetches(ExpressionTree& tree);
         void EmitFinishIteration(ExpressionTree& tree);
+        void EmitCountMatches(ExpressionTree& tree);
         void EmitStoreMatch(ExpressionTree & tree);
 
         CompileNode const & m_compileNodeTree;
         RegisterAllocator const & m_registers;
         const Rank m_initialRank;
+        ptrdiff_t const * m_shardRowOffsets;
+        const size_t m_shardIterationsPerSlice;
+        const bool m_countMode;
+        const LoopOptions m_loopOptions;
+
+        // Each distinct row in m_compileNodeTree, for prefetching.
+        std::vector<AbstractRow const *> m_rows;
 
         Register<8u, false> m_param1;
         Register<8u, false> m_return;
@@ -0,0 +1,365 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <utility>                      // std::index_sequence.
+
+#include "BitFunnel/Exceptions.h"
+#include "BitOperations.h"
+#include "CancellationToken.h"
+#include "CompileNode.h"
+#include "PrecompiledKernel.h"
+#include "ResultsBuffer.h"
+
+
+namespace BitFunnel
+{
+    namespace
+    {
+        // State shared by the steps of one kernel invocation.
+        class Context
+        {
+        public:
+            PrecompiledKernel::Step const * m_steps;
+            ptrdiff_t const * m_rowOffsets;
+            char const * m_sliceBuffer;
+            Slice * m_slice;
+            ResultsBuffer * m_results;
+            CancellationToken * m_cancellation;
+            size_t m_matchCount;
+            size_t m_quadwordCount;
+        };
+
+
+        // Matches the steps from STEP onwards at the specified offset, which
+        // is measured in quadwords at the current rank from the start of the
+        // slice. The recursion ends at the Report specialization below.
+        template <size_t STEP_COUNT, size_t STEP, bool COUNT_MODE>
+        class Steps
+        {
+        public:
+            static void Match(Context & context,
+                              uint64_t accumulator,
+                              size_t offset)
+            {
+                PrecompiledKernel::Step const & step = context.m_steps[STEP];
+                if (step.m_isRankDown)
+                {
+                    offset <<= step.m_delta;
+                    const size_t end = offset + (1ull << step.m_delta);
+                    for (; offset < end; ++offset)
+                    {
+                        Steps<STEP_COUNT, STEP + 1, COUNT_MODE>::Match(context,
+                                                                       accumulator,
+                                                                       offset);
+                    }
+                }
+                else
+                {
+                    ++context.m_quadwordCount;
+                    const uint64_t value =
+                        *(reinterpret_cast<uint64_t const *>(
+                            context.m_sliceBuffer + context.m_rowOffsets[step.m_row]) +
+                          (offset >> step.m_delta));
+                    accumulator = (accumulator | step.m_load) & (value ^ step.m_invert);
+                    if (accumulator != 0)
+                    {
+                        Steps<STEP_COUNT, STEP + 1, COUNT_MODE>::Match(context,
+                                                                       accumulator,
+                                                                       offset);
+                    }
+                }
+            }
+        };
+
+
+        // Report. Each offset is reported at most once per iteration, so
+        // unlike the other matchers no dedupe buffer is needed.
+        template <size_t STEP_COUNT, bool COUNT_MODE>
+        class Steps<STEP_COUNT, STEP_COUNT, COUNT_MODE>
+        {
+        public:
+            static void Match(Context & context,
+                              uint64_t accumulator,
+                              size_t offset)
+            {
+                if (COUNT_MODE)
+                {
+                    context.m_matchCount += popcount(accumulator);
+                    return;
+                }
+
+                while (accumulator != 0)
+                {
+                    const size_t bitPos = bsf(accumulator);
+                    context.m_results->push_back(context.m_slice,
+                                                 offset * c_bitsPerQuadword + bitPos);
+                    accumulator &= (accumulator - 1);
+                }
+            }
+        };
+
+
+        template <size_t STEP_COUNT, bool COUNT_MODE>
+        void MatchSlices(Context & context,
+                         size_t sliceCount,
+                         void * const * sliceBuffers,
+                         size_t iterationsPerSlice,
+                         ptrdiff_t const * summaryOffsets,
+                         size_t summaryCount)
+        {
+            for (size_t slice = 0; slice < sliceCount; ++slice)
+            {
+                if (context.m_cancellation != nullptr &&
+                    context.m_cancellation->IsCancelled())
+                {
+                    context.m_cancellation->SetTruncated();
+                    return;
+                }
+
+                char const * sliceBuffer =
+                    static_cast<char const *>(sliceBuffers[slice]);
+
+                // Skip the slice if any conjunct has an empty summary.
+                bool empty = false;
+                for (size_t i = 0; i < summaryCount; ++i)
+                {
+                    if (*reinterpret_cast<uint64_t const *>(
+                            sliceBuffer + summaryOffsets[i]) == 0ull)
+                    {
+                        empty = true;
+                        break;
+                    }
+                }
+                if (empty)
+                {
+                    continue;
+                }
+
+                context.m_sliceBuffer = sliceBuffer;
+                context.m_slice = *reinterpret_cast<Slice * const *>(sliceBuffer);
+
+                for (size_t iteration = 0; iteration < iterationsPerSlice; ++iteration)
+                {
+                    Steps<STEP_COUNT, 0, COUNT_MODE>::Match(context, 0, iteration);
+                }
+            }
+        }
+
+
+        typedef void (*Kernel)(Context & context,
+                               size_t sliceCount,
+                               void * const * sliceBuffers,
+                               size_t iterationsPerSlice,
+                               ptrdiff_t const * summaryOffsets,
+                               size_t summaryCount);
+
+
+        // Returns the kernel for the specified step count, which must be
+        // between 1 and the number of STEP_COUNTS.
+        template <bool COUNT_MODE, size_t... STEP_COUNTS>
+        Kernel GetKernel(size_t stepCount, std::index_sequence<STEP_COUNTS...>)
+        {
+            static const Kernel c_kernels[] = {
+                MatchSlices<STEP_COUNTS + 1, COUNT_MODE>...
+            };
+            return c_kernels[stepCount - 1];
+        }
+
+
+        template <bool COUNT_MODE>
+        Kernel GetKernel(size_t stepCount)
+        {
+            return GetKernel<COUNT_MODE>(
+                stepCount,
+                std::make_index_sequence<PrecompiledKernel::c_maxStepCount>());
+        }
+    }
+
+
+    //*************************************************************************
+    //
+    // PrecompiledKernel
+    //
+    //*************************************************************************
+    bool PrecompiledKernel::IsSupported(CompileNode const & tree, Rank initialRank)
+    {
+        Step steps[c_maxStepCount];
+        return Flatten(tree, initialRank, steps) != 0;
+    }
+
+
+    PrecompiledKernel::PrecompiledKernel(CompileNode const & tree, Rank initialRank)
+      : m_stepCount(Flatten(tree, initialRank, m_steps))
+    {
+        if (m_stepCount == 0)
+        {
+            throw RecoverableError("PrecompiledKernel: unsupported CompileNode tree.");
+        }
+    }
+
+
+    size_t PrecompiledKernel::Run(size_t sliceCount,
+                                  void * const * sliceBuffers,
+                                  size_t iterationsPerSlice,
+                                  ptrdiff_t const * rowOffsets,
+                                  ResultsBuffer & results,
+                                  ptrdiff_t const * summaryOffsets,
+                                  size_t summaryCount,
+                                  CancellationToken * cancellation) const
+    {
+        Context context = {
+            m_steps, rowOffsets, nullptr, nullptr, &results, cancellation, 0, 0
+        };
+        Kernel kernel = GetKernel<false>(m_stepCount);
+        kernel(context,
+               sliceCount,
+               sliceBuffers,
+               iterationsPerSlice,
+               summaryOffsets,
+               summaryCount);
+        return context.m_quadwordCount;
+    }
+
+
+    size_t PrecompiledKernel::Count(size_t sliceCount,
+                                    void * const * sliceBuffers,
+                                    size_t iterationsPerSlice,
+                                    ptrdiff_t const * rowOffsets,
+                                    size_t & matchCount,
+                                    ptrdiff_t const * summaryOffsets,
+                                    size_t summaryCount,
+                                    CancellationToken * cancellation) const
+    {
+        Context context = {
+            m_steps, rowOffsets, nullptr, nullptr, nullptr, cancellation, 0, 0
+        };
+        Kernel kernel = GetKernel<true>(m_stepCount);
+        kernel(context,
+               sliceCount,
+               sliceBuffers,
+               iterationsPerSlice,
+               summaryOffsets,
+               summaryCount);
+        matchCount += context.m_matchCount;
+        return context.m_quadwordCount;
+    }
+
+
+    size_t PrecompiledKernel::GetRowCount() const
+    {
+        size_t rowCount = 0;
+        for (size_t i = 0; i < m_stepCount; ++i)
+        {
+            if (!m_steps[i].m_isRankDown)
+            {
+                ++rowCount;
+            }
+        }
+        return rowCount;
+    }
+
+
+    size_t PrecompiledKernel::GetStepCount() const
+    {
+        return m_stepCount;
+    }
+
+
+    size_t PrecompiledKernel::Flatten(CompileNode const & tree,
+                                      Rank initialRank,
+                                      Step (&steps)[c_maxStepCount])
+    {
+        size_t stepCount = 0;
+        size_t rowCount = 0;
+        Rank rank = initialRank;
+        CompileNode const * node = &tree;
+
+        for (;;)
+        {
+            switch (node->GetType())
+            {
+            case CompileNode::opLoadRowJz:
+            case CompileNode::opAndRowJz:
+                {
+                    if (rowCount == c_maxRowCount || stepCount == c_maxStepCount)
+                    {
+                        return 0;
+                    }
+
+                    const bool load = (node->GetType() == CompileNode::opLoadRowJz);
+                    AbstractRow const & row = load ?
+                        dynamic_cast<CompileNode::LoadRowJz const &>(*node).GetRow() :
+                        dynamic_cast<CompileNode::AndRowJz const &>(*node).GetRow();
+
+                    Step & step = steps[stepCount++];
+                    step.m_row = row.GetId();
+                    step.m_delta = row.GetRankDelta();
+                    step.m_isRankDown = false;
+                    step.m_invert = row.IsInverted() ? ~0ull : 0ull;
+                    step.m_load = load ? ~0ull : 0ull;
+                    ++rowCount;
+
+                    node = load ?
+                        &dynamic_cast<CompileNode::LoadRowJz const &>(*node).GetChild() :
+                        &dynamic_cast<CompileNode::AndRowJz const &>(*node).GetChild();
+                }
+                break;
+            case CompileNode::opRankDown:
+                {
+                    CompileNode::RankDown const & rankDown =
+                        dynamic_cast<CompileNode::RankDown const &>(*node);
+                    if (stepCount == c_maxStepCount || rankDown.GetDelta() > rank)
+                    {
+                        return 0;
+                    }
+                    rank -= rankDown.GetDelta();
+
+                    Step & step = steps[stepCount++];
+                    step.m_row = 0;
+                    step.m_delta = rankDown.GetDelta();
+                    step.m_isRankDown = true;
+                    step.m_invert = 0ull;
+                    step.m_load = 0ull;
+
+                    node = &rankDown.GetChild();
+                }
+                break;
+            case CompileNode::opReport:
+                {
+                    // Matches are reported at rank 0. A Report with a child
+                    // combines the accumulator with a subtree, which the
+                    // kernels do not implement.
+                    CompileNode::Report const & report =
+                        dynamic_cast<CompileNode::Report const &>(*node);
+                    if (report.GetChild() != nullptr || rank != 0 || rowCount == 0)
+                    {
+                        return 0;
+                    }
+                    return stepCount;
+                }
+            default:
+                return 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,128 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <stddef.h>                     // size_t, ptrdiff_t parameters.
+#include <stdint.h>                     // uint64_t embedded.
+
+#include "BitFunnel/BitFunnelTypes.h"   // Rank parameter.
+
+
+namespace BitFunnel
+{
+    class CancellationToken;
+    class CompileNode;
+    class ResultsBuffer;
+
+    //*************************************************************************
+    //
+    // PrecompiledKernel
+    //
+    // Matches queries whose CompileNode tree is a single chain of LoadRowJz,
+    // AndRowJz and RankDown nodes that ends in a Report, which is the shape
+    // RankDownCompiler produces for a conjunction of a few terms, each of
+    // which typically contributes several rows. The chain is flattened
+    // into a short list of steps that is walked by C++ templates specialized
+    // on the number of steps and on count mode, so the walk is unrolled when
+    // BitFunnel is built and no code is generated at runtime. Row ids, rank
+    // deltas and inversion flags are loop invariants held in the steps.
+    //
+    // PrecompiledKernel produces the same matches, in the same order, as
+    // MatchTreeCompiler and the ByteCodeInterpreter.
+    //
+    //*************************************************************************
+    class PrecompiledKernel
+    {
+    public:
+        // Maximum number of LoadRowJz and AndRowJz nodes in a supported
+        // tree. Enough for conjunctions of four terms with four rows each.
+        static const size_t c_maxRowCount = 16;
+
+        // The RankDown nodes in a chain descend at most c_maxRankValue ranks
+        // in total, one rank or more at a time.
+        static const size_t c_maxStepCount = c_maxRowCount + c_maxRankValue;
+
+        // One node of the flattened chain.
+        class Step
+        {
+        public:
+            // The AbstractRow id for rows. Unused for RankDown.
+            unsigned m_row;
+
+            // The rank delta of a row, or the number of ranks descended by
+            // a RankDown.
+            Rank m_delta;
+
+            bool m_isRankDown;
+
+            // All ones if the row is inverted, zero otherwise.
+            uint64_t m_invert;
+
+            // All ones for LoadRowJz, which replaces the accumulator instead
+            // of and-ing with it, zero otherwise.
+            uint64_t m_load;
+        };
+
+        // Returns true if tree, compiled for initialRank, has a shape that
+        // PrecompiledKernel can match.
+        static bool IsSupported(CompileNode const & tree, Rank initialRank);
+
+        // Throws if IsSupported(tree, initialRank) is false.
+        PrecompiledKernel(CompileNode const & tree, Rank initialRank);
+
+        // Same contract as MatchTreeCompiler::Run(). A ResultsBuffer with a
+        // consumer is flushed whenever it fills, so its capacity is not
+        // constrained by the slice capacity.
+        size_t Run(size_t sliceCount,
+                   void * const * sliceBuffers,
+                   size_t iterationsPerSlice,
+                   ptrdiff_t const * rowOffsets,
+                   ResultsBuffer & results,
+                   ptrdiff_t const * summaryOffsets = nullptr,
+                   size_t summaryCount = 0,
+                   CancellationToken * cancellation = nullptr) const;
+
+        // Same contract as MatchTreeCompiler::Count().
+        size_t Count(size_t sliceCount,
+                     void * const * sliceBuffers,
+                     size_t iterationsPerSlice,
+                     ptrdiff_t const * rowOffsets,
+                     size_t & matchCount,
+                     ptrdiff_t const * summaryOffsets = nullptr,
+                     size_t summaryCount = 0,
+                     CancellationToken * cancellation = nullptr) const;
+
+        size_t GetRowCount() const;
+        size_t GetStepCount() const;
+
+    private:
+        // Fills steps with the chain at the root of tree and returns the
+        // number of steps, or returns 0 if the tree is not supported.
+        static size_t Flatten(CompileNode const & tree,
+                              Rank initialRank,
+                              Step (&steps)[c_maxStepCount]);
+
+        Step m_steps[c_maxStepCount];
+        size_t m_stepCount;
+    };
+}
@@ -20,37 +20,95 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <string>
+
 #include "BitFunnel/Plan/QueryInstrumentation.h"
 #include "CsvTsv/Csv.h"
 
 
 namespace BitFunnel
 {
+    static char const * const c_phaseNames[QueryInstrumentation::PhaseCount] =
+    {
+        "parse",
+        "plan",
+        "compile",
+        "match"
+    };
+
+
+    void QueryInstrumentation::EnableHardwareCounters(
+        HardwareCounters const & counters)
+    {
+        m_counters = &counters;
+        m_counters->Read(m_lastSample);
+    }
+
+
+    void QueryInstrumentation::RecordCounters(Phase phase)
+    {
+        HardwareCounters::Sample sample;
+        m_counters->Read(sample);
+
+        HardwareCounters::Values counts;
+        HardwareCounters::Difference(m_lastSample, sample, counts);
+        for (unsigned i = 0; i < HardwareCounters::EventCount; ++i)
+        {
+            m_data.m_hardwareCounts[phase][i] += counts[i];
+        }
+        m_lastSample = sample;
+    }
+
+
     // static
     void QueryInstrumentation::Data::FormatHeader(
-        CsvTsv::CsvTableFormatter & formatter)
+        CsvTsv::CsvTableFormatter & formatter,
+        bool hardwareCounts)
     {
         formatter.WriteField("rows");
         formatter.WriteField("matches");
         formatter.WriteField("quadwords");
         formatter.WriteField("cachelines");
+        formatter.WriteField("queue");
         formatter.WriteField("parse");
         formatter.WriteField("plan");
         formatter.WriteField("match");
+        formatter.WriteField("truncated");
+        for (unsigned phase = 0; hardwareCounts && phase < PhaseCount; ++phase)
+        {
+            for (unsigned event = 0; event < HardwareCounters::EventCount; ++event)
+            {
+                std::string name(c_phaseNames[phase]);
+                name.append("_");
+                name.append(HardwareCounters::GetName(
+                    static_cast<HardwareCounters::Event>(event)));
+                formatter.WriteField(name.c_str());
+            }
+        }
         formatter.WriteRowEnd();
     }
 
 
     void QueryInstrumentation::Data::Format(
-        CsvTsv::CsvTableFormatter & formatter) const
+        CsvTsv::CsvTableFormatter & formatter,
+        bool hardwareCounts) const
     {
         formatter.WriteField(m_rowCount);
         formatter.WriteField(m_matchCount);
         formatter.WriteField(m_quadwordCount);
         formatter.WriteField(m_cacheLineCount);
+        formatter.WriteField(m_queueTime);
         formatter.WriteField(m_parsingTime);
         formatter.WriteField(m_planningTime);
         formatter.WriteField(m_matchingTime);
+        formatter.WriteField(m_truncated);
+        for (unsigned phase = 0; hardwareCounts && phase < PhaseCount; ++phase)
+        {
+            for (unsigned event = 0; event < HardwareCounters::EventCount; ++event)
+            {
+                formatter.WriteField(m_hardwareCounts[phase][event]);
+            }
+        }
         formatter.WriteRowEnd();
     }
 }
@@ -20,26 +20,38 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <memory>
+#include <vector>
+
 #include "BitFunnel/Allocators/IAllocator.h"
 #include "BitFunnel/IDiagnosticStream.h"
 #include "BitFunnel/Index/IIngestor.h"
+#include "BitFunnel/Index/IRowDensityTable.h"
 #include "BitFunnel/Index/ISimpleIndex.h"
 #include "BitFunnel/Index/IShard.h"
+#include "BitFunnel/Index/ITermTable.h"
+#include "BitFunnel/Index/RowIdSequence.h"
 #include "BitFunnel/Index/Token.h"
 #include "BitFunnel/Plan/Factories.h"
 #include "BitFunnel/Plan/QueryInstrumentation.h"
 #include "BitFunnel/Plan/TermMatchNode.h"
+#include "BitFunnel/Term.h"
 #include "BitFunnel/Utilities/Factories.h"
 #include "BitFunnel/Utilities/IObjectFormatter.h"
+#include "BitFunnel/Utilities/Stopwatch.h"
 #include "ByteCodeInterpreter.h"
+#include "CancellationToken.h"
 #include "CompileNode.h"
 #include "IPlanRows.h"
 #include "MatchTreeCompiler.h"
+#include "MatchTreeCostModel.h"
 #include "MatchTreeRewriter.h"
+#include "PrecompiledKernel.h"
 #include "QueryPlanner.h"
 #include "QueryResources.h"
 #include "RankDownCompiler.h"
 #include "RegisterAllocator.h"
+#include "RowMatchNode.h"
 #include "RowSet.h"
 #include "TermPlan.h"
 #include "TermPlanConverter.h"
@@ -57,9 +69,7 @@ namespace BitFunnel
                                     ResultsBuffer & resultsBuffer,
                                     bool useNativeCode)
     {
-        const int c_arbitraryRowCount = 500;
         QueryPlanner planner(tree,
-                             c_arbitraryRowCount,
                              index,
                              resources,
                              diagnosticStream,
@@ -69,12 +79,97 @@ namespace BitFunnel
     }
 
 
-    unsigned const c_targetCrossProductTermCount = 180;
+    // Appends the non-inverted rows in the chain of And nodes at the root of
+    // node to rows. Every match must have a bit set in each of these rows.
+    static void GetConjunctRows(RowMatchNode const & node,
+                                std::vector<AbstractRow const *> & rows)
+    {
+        switch (node.GetType())
+        {
+        case RowMatchNode::AndMatch:
+            {
+                RowMatchNode::And const & andNode =
+                    dynamic_cast<RowMatchNode::And const &>(node);
+                GetConjunctRows(andNode.GetLeft(), rows);
+                GetConjunctRows(andNode.GetRight(), rows);
+            }
+            break;
+        case RowMatchNode::RowMatch:
+            {
+                AbstractRow const & row =
+                    dynamic_cast<RowMatchNode::Row const &>(node).GetRow();
+                if (!row.IsInverted())
+                {
+                    rows.push_back(&row);
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+
+    // Fills offsets and ranks with the summary offset and physical rank of
+    // each of the specified rows in a shard.
+    static void GetRowSummaries(std::vector<AbstractRow const *> const & rows,
+                                IPlanRows const & planRows,
+                                RowSet const & rowSet,
+                                ShardId shard,
+                                std::vector<ptrdiff_t> & offsets,
+                                std::vector<Rank> & ranks)
+    {
+        offsets.clear();
+        ranks.clear();
+        for (auto row : rows)
+        {
+            offsets.push_back(rowSet.GetRowSummaryOffsets(shard)[row->GetId()]);
+            ranks.push_back(planRows.PhysicalRow(shard, row->GetId()).GetRank());
+        }
+    }
+
+
+    // Appends the unigram terms in the chain of And nodes at the root of
+    // node to terms. Every match must contain each of these terms.
+    static void GetRequiredTerms(TermMatchNode const & node,
+                                 IConfiguration const & configuration,
+                                 std::vector<Term> & terms)
+    {
+        switch (node.GetType())
+        {
+        case TermMatchNode::AndMatch:
+            {
+                TermMatchNode::And const & andNode =
+                    dynamic_cast<TermMatchNode::And const &>(node);
+                GetRequiredTerms(andNode.GetLeft(), configuration, terms);
+                GetRequiredTerms(andNode.GetRight(), configuration, terms);
+            }
+            break;
+        case TermMatchNode::UnigramMatch:
+            {
+                TermMatchNode::Unigram const & unigram =
+                    dynamic_cast<TermMatchNode::Unigram const &>(node);
+                terms.emplace_back(unigram.GetText(),
+                                   unigram.GetStreamId(),
+                                   configuration);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+
+    // Candidate MatchTreeRewriter parameters explored by the cost model, in
+    // order of increasing rewrite effort. The largest values match the fixed
+    // parameters that were used before the cost model, so the rewritten tree
+    // is never larger than it would have been without the cost model.
+    static const unsigned c_crossProductTermCounts[] = { 1, 4, 16, 64, 180 };
+    static const unsigned c_rowCounts[] = { 4, 16, 500 };
 
     // TODO: this should take a TermPlan instead of a TermMatchNode when we have
     // scoring and query preferences.
     QueryPlanner::QueryPlanner(TermMatchNode const & tree,
-                               unsigned targetRowCount,
                                ISimpleIndex const & index,
                                QueryResources & resources,
                                IDiagnosticStream & diagnosticStream,
@@ -83,6 +178,9 @@ namespace BitFunnel
                                bool useNativeCode)
       : m_resultsBuffer(resultsBuffer)
     {
+        // The deadline covers planning as well as matching.
+        resources.GetCancellationToken().Start(resources.GetDeadline());
+
         if (diagnosticStream.IsEnabled("planning/term"))
         {
             std::ostream& out = diagnosticStream.GetStream();
@@ -138,13 +236,21 @@ namespace BitFunnel
             }
         }
 
+        // When measured row densities are available, the rewriter uses them
+        // to evaluate the sparsest rows first.
+        std::vector<double> rowDensities;
+        IRowDensityTable const * densityTable = index.GetRowDensityTable();
+        if (densityTable != nullptr)
+        {
+            GetRowDensities(*densityTable, rowDensities);
+        }
+
         // Rewrite match tree to optimal form for the RankDownCompiler.
         RowMatchNode const & rewritten =
-            MatchTreeRewriter::Rewrite(rowPlan.GetMatchTree(),
-                                       targetRowCount,
-                                       c_targetCrossProductTermCount,
-                                       resources.GetMatchTreeAllocator());
-
+            Rewrite(rowPlan.GetMatchTree(),
+                    rowDensities.empty() ? nullptr : rowDensities.data(),
+                    resources,
+                    diagnosticStream);
 
         if (diagnosticStream.IsEnabled("planning/rewrite"))
         {
@@ -152,7 +258,6 @@ namespace BitFunnel
             std::unique_ptr<IObjectFormatter>
                 formatter(Factories::CreateObjectFormatter(diagnosticStream.GetStream()));
 
-            out << "--------------------" << std::endl;
             out << "Rewritten Plan:" << std::endl;
             rewritten.Format(*formatter);
             out << std::endl;
@@ -176,8 +281,10 @@ namespace BitFunnel
             out << std::endl;
         }
 
+        SelectShards(tree, index, resources, diagnosticStream);
+
         RowSet rowSet(index, *m_planRows, resources.GetMatchTreeAllocator());
-        rowSet.LoadRows();
+        rowSet.LoadRows(m_shards);
 
         if (diagnosticStream.IsEnabled("planning/rowset"))
         {
@@ -191,23 +298,318 @@ namespace BitFunnel
 
         instrumentation.SetRowCount(rowSet.GetRowCount());
 
-        if (useNativeCode)
+        // Rows whose summaries let the matchers skip slices and blocks.
+        std::vector<AbstractRow const *> summaryRows;
+        if (resources.IsRowSummaryEnabled())
+        {
+            GetConjunctRows(rewritten, summaryRows);
+        }
+
+        if (useNativeCode && resources.IsShardSpecializationEnabled())
+        {
+            RunShardSpecializedNativeCode(index,
+                                          resources,
+                                          instrumentation,
+                                          rewritten,
+                                          rowSet,
+                                          summaryRows,
+                                          diagnosticStream);
+        }
+        else if (useNativeCode)
         {
             RunNativeCode(index,
                           resources,
                           instrumentation,
                           compileTree,
                           initialRank,
-                          rowSet);
+                          rowSet,
+                          summaryRows,
+                          diagnosticStream);
         }
         else
         {
+            AbstractRow const * sparseRow =
+                ChooseSparseRow(rewritten,
+                                rowDensities.empty() ? nullptr : rowDensities.data(),
+                                initialRank,
+                                resources,
+                                diagnosticStream);
+
             RunByteCodeInterpreter(index,
                                    resources,
                                    instrumentation,
                                    compileTree,
                                    initialRank,
-                                   rowSet);
+                                   rowSet,
+                                   sparseRow,
+                                   summaryRows);
+        }
+    }
+
+
+    // Returns true if the tree contains an Or node. MatchTreeRewriter's
+    // parameters only affect the expansion of Or nodes.
+    static bool ContainsOr(RowMatchNode const & node)
+    {
+        switch (node.GetType())
+        {
+        case RowMatchNode::AndMatch:
+            {
+                RowMatchNode::And const & andNode =
+                    dynamic_cast<RowMatchNode::And const &>(node);
+                return ContainsOr(andNode.GetLeft()) || ContainsOr(andNode.GetRight());
+            }
+        case RowMatchNode::NotMatch:
+            return ContainsOr(dynamic_cast<RowMatchNode::Not const &>(node).GetChild());
+        case RowMatchNode::OrMatch:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+
+    RowMatchNode const & QueryPlanner::Rewrite(RowMatchNode const & tree,
+                                               double const * rowDensities,
+                                               QueryResources & resources,
+                                               IDiagnosticStream & diagnosticStream) const
+    {
+        const bool diagnostics = diagnosticStream.IsEnabled("planning/rewrite");
+        if (diagnostics)
+        {
+            diagnosticStream.GetStream() << "--------------------" << std::endl;
+        }
+
+        unsigned bestRowCount = c_rowCounts[0];
+        unsigned bestCrossProductTermCount = c_crossProductTermCounts[0];
+
+        // Without an Or node, every candidate produces the same tree, so
+        // there is nothing to choose.
+        if (ContainsOr(tree))
+        {
+            MatchTreeCostModel costModel(rowDensities);
+            IAllocator & scratch = resources.GetRewriteAllocator();
+            const double budget = resources.GetRewriteBudget();
+            Stopwatch stopwatch;
+            double bestCost = 0.0;
+            bool first = true;
+            bool outOfTime = false;
+
+            for (auto crossProductTermCount : c_crossProductTermCounts)
+            {
+                for (auto rowCount : c_rowCounts)
+                {
+                    // Always evaluate at least one candidate.
+                    if (!first && stopwatch.ElapsedTime() > budget)
+                    {
+                        outOfTime = true;
+                        break;
+                    }
+
+                    scratch.Reset();
+                    RowMatchNode const & candidate =
+                        MatchTreeRewriter::Rewrite(tree,
+                                                   rowCount,
+                                                   crossProductTermCount,
+                                                   scratch,
+                                                   rowDensities);
+                    auto cost = costModel.Estimate(candidate);
+
+                    if (diagnostics)
+                    {
+                        std::ostream& out = diagnosticStream.GetStream();
+                        out << "Candidate rows: " << rowCount
+                            << ", cross products: " << crossProductTermCount
+                            << ", ";
+                        cost.Print(out);
+                        out << std::endl;
+                    }
+
+                    if (first || cost.GetTotal() < bestCost)
+                    {
+                        bestCost = cost.GetTotal();
+                        bestRowCount = rowCount;
+                        bestCrossProductTermCount = crossProductTermCount;
+                        first = false;
+                    }
+                }
+
+                if (outOfTime)
+                {
+                    break;
+                }
+            }
+            scratch.Reset();
+
+            if (diagnostics)
+            {
+                std::ostream& out = diagnosticStream.GetStream();
+                if (outOfTime)
+                {
+                    out << "Planning budget of " << budget
+                        << "s exhausted." << std::endl;
+                }
+                out << "Chosen rows: " << bestRowCount
+                    << ", cross products: " << bestCrossProductTermCount
+                    << std::endl;
+            }
+        }
+
+        return MatchTreeRewriter::Rewrite(tree,
+                                          bestRowCount,
+                                          bestCrossProductTermCount,
+                                          resources.GetMatchTreeAllocator(),
+                                          rowDensities);
+    }
+
+
+    void QueryPlanner::SelectShards(TermMatchNode const & tree,
+                                    ISimpleIndex const & index,
+                                    QueryResources const & resources,
+                                    IDiagnosticStream & diagnosticStream)
+    {
+        std::vector<Term> terms;
+        if (resources.IsShardPruningEnabled())
+        {
+            GetRequiredTerms(tree, index.GetConfiguration(), terms);
+        }
+
+        const bool diagnostics = diagnosticStream.IsEnabled("planning/shards");
+        if (diagnostics)
+        {
+            diagnosticStream.GetStream() << "--------------------" << std::endl;
+        }
+
+        m_shards.clear();
+        const ShardId shardCount = index.GetIngestor().GetShardCount();
+        for (ShardId shardId = 0; shardId < shardCount; ++shardId)
+        {
+            IShard const & shard = index.GetIngestor().GetShard(shardId);
+            bool mayMatch = true;
+            for (auto const & term : terms)
+            {
+                if (!shard.MayContainTerm(term))
+                {
+                    mayMatch = false;
+                    break;
+                }
+            }
+
+            if (mayMatch)
+            {
+                m_shards.push_back(shardId);
+            }
+            else if (diagnostics)
+            {
+                diagnosticStream.GetStream()
+                    << "Shard " << shardId
+                    << " skipped: required term absent." << std::endl;
+            }
+        }
+
+        if (diagnostics)
+        {
+            diagnosticStream.GetStream()
+                << "Shards matched: " << m_shards.size()
+                << " of " << shardCount << std::endl;
+        }
+    }
+
+
+    AbstractRow const * QueryPlanner::ChooseSparseRow(RowMatchNode const & tree,
+                                                      double const * rowDensities,
+                                                      Rank initialRank,
+                                                      QueryResources const & resources,
+                                                      IDiagnosticStream & diagnosticStream) const
+    {
+        const auto strategy = resources.GetMatchingStrategy();
+        if (strategy == QueryResources::MatchingStrategy::Dense ||
+            (strategy == QueryResources::MatchingStrategy::Automatic &&
+             rowDensities == nullptr))
+        {
+            return nullptr;
+        }
+
+        std::vector<AbstractRow const *> candidates;
+        GetConjunctRows(tree, candidates);
+
+        // Pick the driver row with the lowest estimated cost. Without
+        // densities, the cost model favors the row at the highest rank,
+        // which has the fewest quadwords to scan.
+        MatchTreeCostModel costModel(rowDensities);
+        AbstractRow const * sparseRow = nullptr;
+        double sparseCost = 0.0;
+        for (auto row : candidates)
+        {
+            auto cost = costModel.EstimateSparse(tree, *row, initialRank);
+            if (sparseRow == nullptr || cost.GetTotal() < sparseCost)
+            {
+                sparseRow = row;
+                sparseCost = cost.GetTotal();
+            }
+        }
+
+        const bool diagnostics = diagnosticStream.IsEnabled("planning/sparse");
+        if (diagnostics)
+        {
+            diagnosticStream.GetStream() << "--------------------" << std::endl;
+        }
+
+        if (sparseRow != nullptr
+            && strategy == QueryResources::MatchingStrategy::Automatic)
+        {
+            auto dense = costModel.Estimate(tree);
+
+            if (diagnostics)
+            {
+                std::ostream& out = diagnosticStream.GetStream();
+                out << "Dense: ";
+                dense.Print(out);
+                out << std::endl
+                    << "Sparse (row " << sparseRow->GetId() << "): total: "
+                    << sparseCost << std::endl;
+            }
+
+            if (sparseCost >= dense.GetTotal())
+            {
+                sparseRow = nullptr;
+            }
+        }
+
+        if (diagnostics)
+        {
+            std::ostream& out = diagnosticStream.GetStream();
+            if (sparseRow == nullptr)
+            {
+                out << "Matching strategy: dense" << std::endl;
+            }
+            else
+            {
+                out << "Matching strategy: sparse, driven by row "
+                    << sparseRow->GetId() << std::endl;
+            }
+        }
+
+        return sparseRow;
+    }
+
+
+    void QueryPlanner::GetRowDensities(IRowDensityTable const & densityTable,
+                                       std::vector<double> & densities) const
+    {
+        // The match tree is shared by all shards, so each abstract row is
+        // assigned the mean of its physical row densities across shards.
+        const ShardId shardCount = m_planRows->GetShardCount();
+        densities.assign(m_planRows->GetRowCount(), 0.0);
+        for (unsigned id = 0; id < m_planRows->GetRowCount(); ++id)
+        {
+            for (ShardId shard = 0; shard < shardCount; ++shard)
+            {
+                densities[id] +=
+                    densityTable.GetDensity(shard,
+                                            m_planRows->PhysicalRow(shard, id));
+            }
+            densities[id] /= static_cast<double>(shardCount);
         }
     }
 
@@ -217,8 +619,12 @@ namespace BitFunnel
                                               QueryInstrumentation & instrumentation,
                                               CompileNode const & compileTree,
                                               Rank initialRank,
-                                              RowSet const & rowSet)
+                                              RowSet const & rowSet,
+                                              AbstractRow const * sparseRow,
+                                              std::vector<AbstractRow const *> const & summaryRows)
     {
+        instrumentation.StartCompiling();
+
         // TODO: Clear results buffer here?
         compileTree.Compile(m_code);
         m_code.Seal();
@@ -226,11 +632,15 @@ namespace BitFunnel
         instrumentation.FinishPlanning();
         m_resultsBuffer.Reset();
 
+        std::vector<ptrdiff_t> summaryOffsets;
+        std::vector<Rank> summaryRanks;
+        size_t matchCount = 0;
+
         // Get token before we GetSliceBuffers.
         {
             auto token = index.GetIngestor().GetTokenManager().RequestToken();
 
-            for (ShardId shardId = 0; shardId < index.GetIngestor().GetShardCount(); ++shardId)
+            for (auto shardId : m_shards)
             {
                 auto & shard = index.GetIngestor().GetShard(shardId);
                 auto & sliceBuffers = shard.GetSliceBuffers();
@@ -238,6 +648,13 @@ namespace BitFunnel
                 // Iterations per slice calculation.
                 auto iterationsPerSlice = shard.GetSliceCapacity() >> 6 >> initialRank;
 
+                GetRowSummaries(summaryRows,
+                                *m_planRows,
+                                rowSet,
+                                shardId,
+                                summaryOffsets,
+                                summaryRanks);
+
                 ByteCodeInterpreter intepreter(m_code,
                                                m_resultsBuffer,
                                                sliceBuffers.size(),
@@ -248,34 +665,282 @@ namespace BitFunnel
                                                nullptr,
                                                instrumentation,
                                                resources.GetCacheLineRecorder());
+                intepreter.EnableRowSummaries(summaryOffsets.size(),
+                                              summaryOffsets.data(),
+                                              summaryRanks.data());
+                if (resources.IsCountModeEnabled())
+                {
+                    intepreter.EnableCountMode();
+                }
+                intepreter.EnableCancellation(resources.GetCancellationToken());
 
-                intepreter.Run();
+                if (sparseRow != nullptr)
+                {
+                    // The driver row may be stored at a different rank in
+                    // each shard, e.g. when it is padding for a rank the
+                    // term does not use in this shard.
+                    const Rank rank =
+                        m_planRows->PhysicalRow(shardId, sparseRow->GetId()).GetRank();
+                    intepreter.RunSparse(sparseRow->GetId(), rank);
+                }
+                else if (resources.GetInterleaveLaneCount() > 1)
+                {
+                    intepreter.RunInterleaved(resources.GetInterleaveLaneCount(),
+                                              resources.GetInterpreterLanes());
+                }
+                else
+                {
+                    intepreter.Run();
+                }
+
+                matchCount += intepreter.GetMatchCount();
             }
 
+            // Consumers may need the slices, so the last chunk is flushed
+            // before the token is released.
+            m_resultsBuffer.Flush();
+
             instrumentation.FinishMatching();
-            instrumentation.SetMatchCount(m_resultsBuffer.size());
+            instrumentation.SetMatchCount(matchCount);
+            if (resources.GetCancellationToken().IsTruncated())
+            {
+                instrumentation.SetTruncated();
+            }
         } // End of token lifetime.
     }
 
 
+    // Runs a MatchTreeCompiler or PrecompiledKernel against the slices of a
+    // shard and returns the number of quadwords accessed. In count mode,
+    // matches are added to matchCount instead of results. Matching stops
+    // at the next slice boundary once the query has been cancelled.
+    template <typename MATCHER>
+    static size_t RunMatcher(MATCHER & matcher,
+                             bool countMode,
+                             std::vector<void *> const & sliceBuffers,
+                             size_t iterationsPerSlice,
+                             ptrdiff_t const * rowOffsets,
+                             std::vector<ptrdiff_t> const & summaryOffsets,
+                             ResultsBuffer & results,
+                             size_t & matchCount,
+                             CancellationToken & cancellation)
+    {
+        return countMode ?
+            matcher.Count(sliceBuffers.size(),
+                          sliceBuffers.data(),
+                          iterationsPerSlice,
+                          rowOffsets,
+                          matchCount,
+                          summaryOffsets.data(),
+                          summaryOffsets.size(),
+                          &cancellation) :
+            matcher.Run(sliceBuffers.size(),
+                        sliceBuffers.data(),
+                        iterationsPerSlice,
+                        rowOffsets,
+                        results,
+                        summaryOffsets.data(),
+                        summaryOffsets.size(),
+                        &cancellation);
+    }
+
+
+    //*************************************************************************
+    //
+    // CacheLineEstimate
+    //
+    // Native code and precompiled kernels cannot record the cache lines
+    // they access. Instead, the byte code for the same plan is interpreted,
+    // in count mode, for the slices that the CacheLineRecorder samples.
+    // CacheLineEstimate holds what the interpreter needs for one shard, so
+    // that the estimate can run once matching has finished and is not
+    // reported as matching time.
+    //
+    //*************************************************************************
+    class CacheLineEstimate
+    {
+    public:
+        // Estimates a shard matched with code, which must outlive the
+        // CacheLineEstimate.
+        CacheLineEstimate(ShardId shard,
+                          ByteCodeGenerator const & code,
+                          size_t iterationsPerSlice,
+                          Rank initialRank,
+                          std::vector<ptrdiff_t> const & summaryOffsets,
+                          std::vector<Rank> const & summaryRanks)
+          : m_shard(shard),
+            m_code(&code),
+            m_iterationsPerSlice(iterationsPerSlice),
+            m_initialRank(initialRank),
+            m_summaryOffsets(summaryOffsets),
+            m_summaryRanks(summaryRanks)
+        {
+        }
+
+        // Estimates a shard matched with a shard-specialized plan. Takes
+        // ownership of the plan's byte code.
+        CacheLineEstimate(ShardId shard,
+                          std::unique_ptr<ByteCodeGenerator> code,
+                          size_t iterationsPerSlice,
+                          Rank initialRank,
+                          std::vector<ptrdiff_t> const & summaryOffsets,
+                          std::vector<Rank> const & summaryRanks)
+          : CacheLineEstimate(shard,
+                              *code,
+                              iterationsPerSlice,
+                              initialRank,
+                              summaryOffsets,
+                              summaryRanks)
+        {
+            m_ownedCode = std::move(code);
+        }
+
+        // Adds the estimated cache lines for the shard to instrumentation.
+        // Returns false if the estimate stopped early because the query
+        // was cancelled.
+        bool Run(ISimpleIndex const & index,
+                 RowSet const & rowSet,
+                 CacheLineRecorder & recorder,
+                 ResultsBuffer & results,
+                 CancellationToken & cancellation,
+                 QueryInstrumentation & instrumentation) const
+        {
+            // Quadword counts from the interpreter are discarded, since the
+            // matcher has already reported them.
+            QueryInstrumentation scratch;
+
+            auto & sliceBuffers =
+                index.GetIngestor().GetShard(m_shard).GetSliceBuffers();
+
+            ByteCodeInterpreter intepreter(*m_code,
+                                           results,
+                                           sliceBuffers.size(),
+                                           sliceBuffers.data(),
+                                           m_iterationsPerSlice,
+                                           m_initialRank,
+                                           rowSet.GetRowOffsets(m_shard),
+                                           nullptr,
+                                           scratch,
+                                           &recorder);
+            intepreter.EnableRowSummaries(m_summaryOffsets.size(),
+                                          m_summaryOffsets.data(),
+                                          m_summaryRanks.data());
+            intepreter.EnableCountMode();
+            intepreter.EnableCancellation(cancellation);
+            intepreter.SkipUnsampledSlices();
+            const bool stoppedEarly = intepreter.Run();
+
+            instrumentation.IncrementCacheLineCount(
+                scratch.GetData().GetCacheLineCount());
+
+            return !stoppedEarly;
+        }
+
+    private:
+        ShardId m_shard;
+        ByteCodeGenerator const * m_code;
+        std::unique_ptr<ByteCodeGenerator> m_ownedCode;
+        size_t m_iterationsPerSlice;
+        Rank m_initialRank;
+        std::vector<ptrdiff_t> m_summaryOffsets;
+        std::vector<Rank> m_summaryRanks;
+    };
+
+
+    // Runs the estimates collected while matching. Must be called after
+    // QueryInstrumentation::FinishMatching(). No estimate is made for a
+    // truncated query, since it did not match every slice. A query that is
+    // cancelled during the estimate keeps the partial estimate.
+    static void EstimateCacheLines(ISimpleIndex const & index,
+                                   RowSet const & rowSet,
+                                   std::vector<CacheLineEstimate> const & estimates,
+                                   QueryResources & resources,
+                                   ResultsBuffer & results,
+                                   QueryInstrumentation & instrumentation)
+    {
+        CacheLineRecorder * recorder = resources.GetCacheLineRecorder();
+        CancellationToken & cancellation = resources.GetCancellationToken();
+        if (recorder == nullptr || cancellation.IsTruncated())
+        {
+            return;
+        }
+
+        for (auto const & estimate : estimates)
+        {
+            if (!estimate.Run(index,
+                              rowSet,
+                              *recorder,
+                              results,
+                              cancellation,
+                              instrumentation))
+            {
+                break;
+            }
+        }
+
+        instrumentation.FinishEstimatingCacheLines();
+    }
+
+
+    // Writes the kernel chosen for a CompileNode tree to the
+    // "planning/kernel" diagnostic. kernel is nullptr for native code.
+    static void ReportKernel(PrecompiledKernel const * kernel,
+                             IDiagnosticStream & diagnosticStream)
+    {
+        if (diagnosticStream.IsEnabled("planning/kernel"))
+        {
+            std::ostream& out = diagnosticStream.GetStream();
+            if (kernel == nullptr)
+            {
+                out << "Kernel: native code" << std::endl;
+            }
+            else
+            {
+                out << "Kernel: precompiled, "
+                    << kernel->GetRowCount() << " rows, "
+                    << kernel->GetStepCount() << " steps" << std::endl;
+            }
+        }
+    }
+
+
     void QueryPlanner::RunNativeCode(ISimpleIndex const & index,
                                      QueryResources & resources,
                                      QueryInstrumentation & instrumentation,
                                      CompileNode const & compileTree,
                                      Rank initialRank,
-                                     RowSet const & rowSet)
+                                     RowSet const & rowSet,
+                                     std::vector<AbstractRow const *> const & summaryRows,
+                                     IDiagnosticStream & diagnosticStream)
     {
-         // Perform register allocation on the compile tree.
-         RegisterAllocator const registers(compileTree,
-                                           rowSet.GetRowCount(),
-                                           c_registerBase,
-                                           c_registerCount,
-                                           resources.GetMatchTreeAllocator());
+        instrumentation.StartCompiling();
 
-         MatchTreeCompiler compiler(resources,
-                                    compileTree,
-                                    registers,
-                                    initialRank);
+        // Common query shapes are matched without generating code.
+        std::unique_ptr<PrecompiledKernel> kernel;
+        std::unique_ptr<MatchTreeCompiler> compiler;
+        if (resources.IsPrecompiledKernelEnabled() &&
+            PrecompiledKernel::IsSupported(compileTree, initialRank))
+        {
+            kernel.reset(new PrecompiledKernel(compileTree, initialRank));
+        }
+        else
+        {
+            // Perform register allocation on the compile tree.
+            RegisterAllocator const registers(compileTree,
+                                              rowSet.GetRowCount(),
+                                              c_registerBase,
+                                              c_registerCount,
+                                              resources.GetMatchTreeAllocator());
+
+            compiler.reset(new MatchTreeCompiler(resources,
+                                                 compileTree,
+                                                 registers,
+                                                 initialRank,
+                                                 nullptr,
+                                                 0,
+                                                 resources.IsCountModeEnabled()));
+        }
+        ReportKernel(kernel.get(), diagnosticStream);
 
 
          // TODO: Clear results buffer here?
@@ -286,34 +951,322 @@ namespace BitFunnel
 
         m_resultsBuffer.Reset();
 
+        std::vector<ptrdiff_t> summaryOffsets;
+        std::vector<Rank> summaryRanks;
+        std::vector<CacheLineEstimate> estimates;
+        size_t matchCount = 0;
+
+        // Get token before we GetSliceBuffers.
+        {
+            auto token = index.GetIngestor().GetTokenManager().RequestToken();
+
+            for (auto shardId : m_shards)
+            {
+                auto & shard = index.GetIngestor().GetShard(shardId);
+                auto & sliceBuffers = shard.GetSliceBuffers();
+
+                // Iterations per slice calculation.
+                auto iterationsPerSlice = shard.GetSliceCapacity() >> 6 >> initialRank;
+
+                GetRowSummaries(summaryRows,
+                                *m_planRows,
+                                rowSet,
+                                shardId,
+                                summaryOffsets,
+                                summaryRanks);
+
+                size_t quadwordCount = (kernel != nullptr) ?
+                    RunMatcher(*kernel,
+                               resources.IsCountModeEnabled(),
+                               sliceBuffers,
+                               iterationsPerSlice,
+                               rowSet.GetRowOffsets(shardId),
+                               summaryOffsets,
+                               m_resultsBuffer,
+                               matchCount,
+                               resources.GetCancellationToken()) :
+                    RunMatcher(*compiler,
+                               resources.IsCountModeEnabled(),
+                               sliceBuffers,
+                               iterationsPerSlice,
+                               rowSet.GetRowOffsets(shardId),
+                               summaryOffsets,
+                               m_resultsBuffer,
+                               matchCount,
+                               resources.GetCancellationToken());
+
+                instrumentation.IncrementQuadwordCount(quadwordCount);
+
+                if (resources.GetCacheLineRecorder() != nullptr)
+                {
+                    estimates.emplace_back(shardId,
+                                           m_code,
+                                           iterationsPerSlice,
+                                           initialRank,
+                                           summaryOffsets,
+                                           summaryRanks);
+                }
+            }
+
+            m_resultsBuffer.Flush();
+
+            instrumentation.FinishMatching();
+            instrumentation.SetMatchCount(resources.IsCountModeEnabled() ?
+                                          matchCount :
+                                          m_resultsBuffer.GetMatchCount());
+            if (resources.GetCancellationToken().IsTruncated())
+            {
+                instrumentation.SetTruncated();
+            }
+
+            EstimateCacheLines(index,
+                               rowSet,
+                               estimates,
+                               resources,
+                               m_resultsBuffer,
+                               instrumentation);
+        } // End of token lifetime.
+    }
+
+
+    void QueryPlanner::RunShardSpecializedNativeCode(ISimpleIndex const & index,
+                                                     QueryResources & resources,
+                                                     QueryInstrumentation & instrumentation,
+                                                     RowMatchNode const & tree,
+                                                     RowSet const & rowSet,
+                                                     std::vector<AbstractRow const *> const & summaryRows,
+                                                     IDiagnosticStream & diagnosticStream)
+    {
+        // Each shard's function is compiled just before it runs, because
+        // QueryResources holds a single code buffer. As a result, per-shard
+        // compilation time is reported as matching time.
+        instrumentation.FinishPlanning();
+
+        m_resultsBuffer.Reset();
+
+        std::vector<ptrdiff_t> summaryOffsets;
+        std::vector<Rank> summaryRanks;
+        std::vector<CacheLineEstimate> estimates;
+        size_t matchCount = 0;
+
         // Get token before we GetSliceBuffers.
         {
             auto token = index.GetIngestor().GetTokenManager().RequestToken();
 
-            for (ShardId shardId = 0; shardId < index.GetIngestor().GetShardCount(); ++shardId)
+            for (auto shardId : m_shards)
             {
+                // Don't spend time compiling code for a cancelled query.
+                CancellationToken & cancellation = resources.GetCancellationToken();
+                if (cancellation.IsCancelled())
+                {
+                    cancellation.SetTruncated();
+                    break;
+                }
+
                 auto & shard = index.GetIngestor().GetShard(shardId);
                 auto & sliceBuffers = shard.GetSliceBuffers();
 
+                // Trees, compile nodes and expression nodes for this shard
+                // are discarded once its function has been compiled.
+                IAllocator & scratch = resources.GetRewriteAllocator();
+                scratch.Reset();
+                resources.GetExpressionTreeAllocator().Reset();
+
+                RowMatchNode const & shardTree =
+                    SpecializeForShard(tree, shardId, scratch);
+
+                RankDownCompiler rankDown(scratch);
+                rankDown.Compile(shardTree);
+                const Rank initialRank = rankDown.GetMaximumRank();
+                CompileNode const & compileTree = rankDown.CreateTree(initialRank);
+
                 // Iterations per slice calculation.
                 auto iterationsPerSlice = shard.GetSliceCapacity() >> 6 >> initialRank;
 
+                if (diagnosticStream.IsEnabled("planning/shard"))
+                {
+                    std::ostream& out = diagnosticStream.GetStream();
+                    out << "Shard " << shardId
+                        << ": initial rank " << initialRank
+                        << ", iterations per slice " << iterationsPerSlice
+                        << std::endl;
+                }
+
+                // Rows that are conjuncts of the full tree remain conjuncts
+                // of the specialized tree.
+                GetRowSummaries(summaryRows,
+                                *m_planRows,
+                                rowSet,
+                                shardId,
+                                summaryOffsets,
+                                summaryRanks);
+
+                size_t quadwordCount = 0;
+                if (resources.IsPrecompiledKernelEnabled() &&
+                    PrecompiledKernel::IsSupported(compileTree, initialRank))
+                {
+                    PrecompiledKernel kernel(compileTree, initialRank);
+                    ReportKernel(&kernel, diagnosticStream);
 
-                size_t quadwordCount = compiler.Run(sliceBuffers.size(),
-                                                    sliceBuffers.data(),
-                                                    iterationsPerSlice,
-                                                    rowSet.GetRowOffsets(shardId),
-                                                    m_resultsBuffer);
+                    quadwordCount = RunMatcher(kernel,
+                                               resources.IsCountModeEnabled(),
+                                               sliceBuffers,
+                                               iterationsPerSlice,
+                                               rowSet.GetRowOffsets(shardId),
+                                               summaryOffsets,
+                                               m_resultsBuffer,
+                                               matchCount,
+                                               resources.GetCancellationToken());
+                }
+                else
+                {
+                    ReportKernel(nullptr, diagnosticStream);
+
+                    RegisterAllocator const registers(compileTree,
+                                                      rowSet.GetRowCount(),
+                                                      c_registerBase,
+                                                      c_registerCount,
+                                                      scratch);
+
+                    MatchTreeCompiler compiler(resources,
+                                               compileTree,
+                                               registers,
+                                               initialRank,
+                                               rowSet.GetRowOffsets(shardId),
+                                               iterationsPerSlice,
+                                               resources.IsCountModeEnabled());
+
+                    quadwordCount = RunMatcher(compiler,
+                                               resources.IsCountModeEnabled(),
+                                               sliceBuffers,
+                                               iterationsPerSlice,
+                                               rowSet.GetRowOffsets(shardId),
+                                               summaryOffsets,
+                                               m_resultsBuffer,
+                                               matchCount,
+                                               resources.GetCancellationToken());
+                }
 
                 instrumentation.IncrementQuadwordCount(quadwordCount);
+
+                // compileTree is discarded with the scratch allocator, so
+                // the byte code for the estimate is generated now.
+                if (resources.GetCacheLineRecorder() != nullptr)
+                {
+                    std::unique_ptr<ByteCodeGenerator> code(new ByteCodeGenerator());
+                    compileTree.Compile(*code);
+                    code->Seal();
+                    estimates.emplace_back(shardId,
+                                           std::move(code),
+                                           iterationsPerSlice,
+                                           initialRank,
+                                           summaryOffsets,
+                                           summaryRanks);
+                }
             }
 
+            m_resultsBuffer.Flush();
+
             instrumentation.FinishMatching();
-            instrumentation.SetMatchCount(m_resultsBuffer.size());
+            instrumentation.SetMatchCount(resources.IsCountModeEnabled() ?
+                                          matchCount :
+                                          m_resultsBuffer.GetMatchCount());
+            if (resources.GetCancellationToken().IsTruncated())
+            {
+                instrumentation.SetTruncated();
+            }
+
+            EstimateCacheLines(index,
+                               rowSet,
+                               estimates,
+                               resources,
+                               m_resultsBuffer,
+                               instrumentation);
         } // End of token lifetime.
     }
 
 
+    // Removes non-inverted rows that map to matchAllRow from the chain of And
+    // nodes at the root of node. Returns nullptr if node matches everything.
+    // Or, Not and Report nodes are left unchanged.
+    static RowMatchNode const * RemoveMatchAllRows(RowMatchNode const & node,
+                                                   IPlanRows const & planRows,
+                                                   ShardId shard,
+                                                   RowId matchAllRow,
+                                                   IAllocator & allocator)
+    {
+        switch (node.GetType())
+        {
+        case RowMatchNode::AndMatch:
+            {
+                RowMatchNode::And const & andNode =
+                    dynamic_cast<RowMatchNode::And const &>(node);
+                RowMatchNode const * left =
+                    RemoveMatchAllRows(andNode.GetLeft(), planRows, shard, matchAllRow, allocator);
+                RowMatchNode const * right =
+                    RemoveMatchAllRows(andNode.GetRight(), planRows, shard, matchAllRow, allocator);
+
+                if (left == nullptr)
+                {
+                    return right;
+                }
+                else if (right == nullptr)
+                {
+                    return left;
+                }
+                else if (left == &andNode.GetLeft() && right == &andNode.GetRight())
+                {
+                    return &node;
+                }
+                else
+                {
+                    return new (allocator.Allocate(sizeof(RowMatchNode::And)))
+                        RowMatchNode::And(*left, *right);
+                }
+            }
+        case RowMatchNode::RowMatch:
+            {
+                AbstractRow const & row =
+                    dynamic_cast<RowMatchNode::Row const &>(node).GetRow();
+                if (!row.IsInverted()
+                    && planRows.PhysicalRow(shard, row.GetId()) == matchAllRow)
+                {
+                    return nullptr;
+                }
+                return &node;
+            }
+        default:
+            return &node;
+        }
+    }
+
+
+    RowMatchNode const & QueryPlanner::SpecializeForShard(RowMatchNode const & tree,
+                                                          ShardId shard,
+                                                          IAllocator & allocator) const
+    {
+        // AbstractRowEnumerator pads ranks that a term does not use in a
+        // shard with the match-all row. These rows never eliminate a
+        // document, but they force the shard to start at a higher rank.
+        ITermTable const & termTable = m_planRows->GetTermTable(shard);
+        RowIdSequence matchAll(termTable.GetMatchAllTerm(), termTable);
+        const RowId matchAllRow = *matchAll.begin();
+
+        RowMatchNode const * specialized =
+            RemoveMatchAllRows(tree, *m_planRows, shard, matchAllRow, allocator);
+
+        // The compiled code needs at least one row ahead of the Report node
+        // to initialize its accumulator.
+        if (specialized == nullptr
+            || specialized->GetType() == RowMatchNode::ReportMatch)
+        {
+            return tree;
+        }
+
+        return *specialized;
+    }
+
+
     IPlanRows const & QueryPlanner::GetPlanRows() const
     {
         return *m_planRows;
@@ -22,18 +22,24 @@
 
 #pragma once
 
+#include <vector>                         // std::vector parameter.
+
 #include "BitFunnel/NonCopyable.h"        // Inherits from NonCopyable.
 #include "ByteCodeInterpreter.h"
 
 
 namespace BitFunnel
 {
+    class AbstractRow;
+    class IAllocator;
     class IPlanRows;
+    class IRowDensityTable;
     class ISimpleIndex;
     class IThreadResources;
     class QueryInstrumentation;
     class QueryResources;
     class ResultsBuffer;
+    class RowMatchNode;
     class RowSet;
     class TermMatchNode;
 
@@ -42,7 +48,6 @@ namespace BitFunnel
     public:
         // Constructs a QueryPlanner with the specified resources.
         QueryPlanner(TermMatchNode const & tree,
-                     unsigned targetRowCount,
                      ISimpleIndex const & index,
                      // IThreadResources& threadResources,
                      QueryResources & resources,
@@ -54,22 +59,87 @@ namespace BitFunnel
         IPlanRows const & GetPlanRows() const;
 
     private:
+        // Rewrites tree with MatchTreeRewriter, using MatchTreeCostModel to
+        // choose the target row count and cross product term count. Candidate
+        // parameters are evaluated until the budget set by
+        // QueryResources::SetRewriteBudget() is spent. Candidates and the
+        // final choice are reported under the "planning/rewrite" diagnostic.
+        RowMatchNode const & Rewrite(RowMatchNode const & tree,
+                                     double const * rowDensities,
+                                     QueryResources & resources,
+                                     IDiagnosticStream & diagnosticStream) const;
+
+        // Fills densities with the density of each row in m_planRows,
+        // indexed by AbstractRow id.
+        void GetRowDensities(IRowDensityTable const & densityTable,
+                             std::vector<double> & densities) const;
+
+        // Fills m_shards with the shards that may contain a match for tree.
+        // A shard is skipped when IShard::MayContainTerm() rules out one of
+        // the unigrams in the top-level conjunction of tree. Skipped shards
+        // are reported under the "planning/shards" diagnostic.
+        void SelectShards(TermMatchNode const & tree,
+                          ISimpleIndex const & index,
+                          QueryResources const & resources,
+                          IDiagnosticStream & diagnosticStream);
+
+        // Returns the row that drives sparse matching, or nullptr if the
+        // query should be matched densely. Candidates are the non-inverted
+        // rows in the top-level conjunction of tree. The choice is reported
+        // under the "planning/sparse" diagnostic.
+        AbstractRow const * ChooseSparseRow(RowMatchNode const & tree,
+                                            double const * rowDensities,
+                                            Rank initialRank,
+                                            QueryResources const & resources,
+                                            IDiagnosticStream & diagnosticStream) const;
+
+        // If sparseRow is not nullptr, the interpreter only visits
+        // iterations where that row is non-zero. The summaries of
+        // summaryRows, which must be conjuncts of the query, are used to
+        // skip empty slices and blocks.
         void RunByteCodeInterpreter(ISimpleIndex const & index,
                                     QueryResources & resources,
                                     QueryInstrumentation & instrumentation,
                                     CompileNode const & compileTree,
                                     Rank maxRank,
-                                    RowSet const & rowSet);
+                                    RowSet const & rowSet,
+                                    AbstractRow const * sparseRow,
+                                    std::vector<AbstractRow const *> const & summaryRows);
 
+        // Matches with a PrecompiledKernel when compileTree has a supported
+        // shape, falling back to native code generated by MatchTreeCompiler.
+        // The choice is reported under the "planning/kernel" diagnostic.
         void RunNativeCode(ISimpleIndex const & index,
                            QueryResources & resources,
                            QueryInstrumentation & instrumentation,
                            CompileNode const & compileTree,
                            Rank maxRank,
-                           RowSet const & rowSet);
+                           RowSet const & rowSet,
+                           std::vector<AbstractRow const *> const & summaryRows,
+                           IDiagnosticStream & diagnosticStream);
+
+        // Compiles and runs a separate native function for each shard. See
+        // QueryResources::EnableShardSpecialization().
+        void RunShardSpecializedNativeCode(ISimpleIndex const & index,
+                                           QueryResources & resources,
+                                           QueryInstrumentation & instrumentation,
+                                           RowMatchNode const & tree,
+                                           RowSet const & rowSet,
+                                           std::vector<AbstractRow const *> const & summaryRows,
+                                           IDiagnosticStream & diagnosticStream);
+
+        // Returns a copy of tree without the non-inverted rows in its
+        // top-level conjunction that map to the match-all row in the
+        // specified shard. Returns tree if no rows can be removed.
+        RowMatchNode const & SpecializeForShard(RowMatchNode const & tree,
+                                                ShardId shard,
+                                                IAllocator & allocator) const;
 
         IPlanRows const * m_planRows;
 
+        // Shards to be matched, in increasing order. See SelectShards().
+        std::vector<ShardId> m_shards;
+
         // The maximum number of iterations that can be performed before a termination
         // check is mandatory. Details can be found in the MatchTreeCodeGenerator.
         // const unsigned m_maxIterationsScannedBetweenTerminationChecks;
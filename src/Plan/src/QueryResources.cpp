@@ -30,30 +30,117 @@
 
 namespace BitFunnel
 {
+    // Default time that QueryPlanner may spend comparing rewrites of a
+    // single query.
+    static const double c_defaultRewriteBudget = 50e-6;
+
+
     QueryResources::QueryResources(size_t treeAllocatorBytes,
                                    size_t codeAllocatorBytes)
       : m_matchTreeAllocator(new BitFunnel::Allocator(treeAllocatorBytes)),
+        m_rewriteAllocator(new BitFunnel::Allocator(treeAllocatorBytes)),
         m_expressionTreeAllocator(new NativeJIT::Allocator(treeAllocatorBytes)),
-        m_codeAllocator(new NativeJIT::ExecutionBuffer(codeAllocatorBytes))
+        m_codeAllocator(new NativeJIT::ExecutionBuffer(codeAllocatorBytes)),
+        m_interleaveLaneCount(0),
+        m_rewriteBudget(c_defaultRewriteBudget),
+        m_deadline(0.0),
+        m_shardSpecialization(false),
+        m_rowSummaries(true),
+        m_shardPruning(true),
+        m_countMode(false),
+        m_precompiledKernels(true),
+        m_prefetchDistance(0),
+        m_nonTemporalPrefetch(false),
+        m_matchingStrategy(MatchingStrategy::Automatic)
     {
         m_code.reset(new NativeJIT::FunctionBuffer(*m_codeAllocator,
                                                    static_cast<unsigned>(codeAllocatorBytes)));
     }
 
 
-    void QueryResources::EnableCacheLineCounting(ISimpleIndex const & index)
+    void QueryResources::EnableCacheLineCounting(ISimpleIndex const & index,
+                                                 size_t samplePeriod)
     {
         m_cacheLineRecorder.reset(
-            new CacheLineRecorder(index.GetIngestor().GetShard(0).GetSliceBufferSize()));
+            new CacheLineRecorder(index.GetIngestor().GetShard(0).GetSliceBufferSize(),
+                                  samplePeriod));
+    }
+
+
+    void QueryResources::EnableInterleavedMatching(size_t laneCount)
+    {
+        m_interleaveLaneCount = laneCount;
+    }
+
+
+    void QueryResources::EnableShardSpecialization(bool enabled)
+    {
+        m_shardSpecialization = enabled;
+    }
+
+
+    void QueryResources::EnableRowSummaries(bool enabled)
+    {
+        m_rowSummaries = enabled;
+    }
+
+
+    void QueryResources::EnableShardPruning(bool enabled)
+    {
+        m_shardPruning = enabled;
+    }
+
+
+    void QueryResources::EnableCountMode(bool enabled)
+    {
+        m_countMode = enabled;
+    }
+
+
+    void QueryResources::EnablePrecompiledKernels(bool enabled)
+    {
+        m_precompiledKernels = enabled;
+    }
+
+
+    void QueryResources::SetPrefetchDistance(size_t distance)
+    {
+        m_prefetchDistance = distance;
+    }
+
+
+    void QueryResources::EnableNonTemporalPrefetch(bool enabled)
+    {
+        m_nonTemporalPrefetch = enabled;
+    }
+
+
+    void QueryResources::SetMatchingStrategy(MatchingStrategy strategy)
+    {
+        m_matchingStrategy = strategy;
+    }
+
+
+    void QueryResources::SetRewriteBudget(double seconds)
+    {
+        m_rewriteBudget = seconds;
+    }
+
+
+    void QueryResources::SetDeadline(double seconds)
+    {
+        m_deadline = seconds;
     }
 
 
     void QueryResources::Reset()
     {
         m_matchTreeAllocator->Reset();
+        m_rewriteAllocator->Reset();
         m_expressionTreeAllocator->Reset();
         // WARNING: Do not reset m_codeAllocator. It is used to provision m_code.
         m_code->Reset();
+        m_cancellationToken.Reset();
         if (m_cacheLineRecorder != nullptr)
         {
             m_cacheLineRecorder->Reset();
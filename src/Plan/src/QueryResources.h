@@ -23,9 +23,12 @@
 #pragma once
 
 #include <memory>                               // std::unique_ptr embedded.
+#include <vector>                               // std::vector embedded.
 
 #include "BitFunnel/Allocators/IAllocator.h"    // Template parameter.
+#include "ByteCodeInterpreter.h"                // Template parameter.
 #include "CacheLineRecorder.h"                  // Template parameter.
+#include "CancellationToken.h"                  // CancellationToken embedded.
 #include "NativeJIT/CodeGen/ExecutionBuffer.h"  // Template parameter.
 #include "NativeJIT/CodeGen/FunctionBuffer.h"   // Template parameter.
 #include "Temporary/Allocator.h"                // Template parameter.
@@ -38,11 +41,87 @@ namespace BitFunnel
     class QueryResources
     {
     public:
+        // Selects how the ByteCodeInterpreter visits iterations. Dense
+        // visits every iteration. Sparse scans the sparsest row in the
+        // query's top-level conjunction and only visits iterations where it
+        // is non-zero. Automatic lets QueryPlanner choose using
+        // MatchTreeCostModel, and falls back to Dense when row densities
+        // are unavailable.
+        enum class MatchingStrategy
+        {
+            Automatic,
+            Dense,
+            Sparse
+        };
+
         QueryResources(size_t treeAllocatorBytes = 1ull << 16,
                        size_t codeAllocatorBytes = 1ull << 16);
 
-        void EnableCacheLineCounting(ISimpleIndex const & index);
-
+        // Configures the ByteCodeInterpreter to record the cache lines it
+        // accesses in every samplePeriod-th slice, and to report the number
+        // recorded, scaled by samplePeriod, as an estimate of the total.
+        // Native code is estimated by interpreting the sampled slices.
+        void EnableCacheLineCounting(ISimpleIndex const & index,
+                                     size_t samplePeriod = 1);
+
+        // Configures the ByteCodeInterpreter to keep laneCount iterations in
+        // flight, prefetching row data for one while running the others.
+        // A laneCount of 0 or 1 selects the ordinary sequential interpreter.
+        void EnableInterleavedMatching(size_t laneCount);
+
+        // Configures QueryPlanner to compile a separate native function for
+        // each shard, with the shard's row offsets and iterations per slice
+        // emitted as immediates, and with match-all padding rows removed so
+        // that each shard starts at its own maximum rank. Only affects
+        // native code.
+        void EnableShardSpecialization(bool enabled);
+
+        // Configures the matchers to consult the per-row summaries in each
+        // slice, skipping slices, and in the interpreter blocks of
+        // iterations, where a row in the query's top-level conjunction is
+        // empty. Enabled by default.
+        void EnableRowSummaries(bool enabled);
+
+        // Configures QueryPlanner to skip shards whose term presence filter
+        // shows that a term required by the query is absent. Enabled by
+        // default.
+        void EnableShardPruning(bool enabled);
+
+        // Configures the matchers to count matches instead of writing them
+        // to the ResultsBuffer. Only QueryInstrumentation's match count is
+        // reported, so the ResultsBuffer may have zero capacity.
+        void EnableCountMode(bool enabled);
+
+        // Configures QueryPlanner to match conjunctions of a few rows with a
+        // PrecompiledKernel instead of generating native code. Trees of
+        // other shapes still use native code. Only affects native code.
+        // Enabled by default.
+        void EnablePrecompiledKernels(bool enabled);
+
+        // Configures native code to prefetch the rows that an iteration will
+        // use distance iterations ahead of it. Zero, the default, disables
+        // prefetching.
+        void SetPrefetchDistance(size_t distance);
+
+        // Configures native code to prefetch with prefetchnta instead of
+        // prefetcht0, which limits cache pollution from rows that are only
+        // read once.
+        void EnableNonTemporalPrefetch(bool enabled);
+
+        void SetMatchingStrategy(MatchingStrategy strategy);
+
+        // Sets the time, in seconds, that QueryPlanner may spend evaluating
+        // alternative MatchTreeRewriter parameters for a single query.
+        void SetRewriteBudget(double seconds);
+
+        // Sets the time, in seconds, that a query may run before QueryPlanner
+        // stops matching and reports the matches found so far, with
+        // QueryInstrumentation's truncated flag set. The clock starts when
+        // QueryPlanner is constructed. Zero, the default, disables the
+        // deadline.
+        void SetDeadline(double seconds);
+
+        // Clears any cancellation of the previous query.
         virtual void Reset();
 
         IAllocator & GetMatchTreeAllocator() const
@@ -50,6 +129,14 @@ namespace BitFunnel
             return *m_matchTreeAllocator;
         }
 
+        // Scratch allocator for candidate trees that are discarded after
+        // cost estimation and for per-shard trees that are discarded after
+        // the shard is matched.
+        IAllocator & GetRewriteAllocator() const
+        {
+            return *m_rewriteAllocator;
+        }
+
         NativeJIT::Allocator & GetExpressionTreeAllocator() const
         {
             return *m_expressionTreeAllocator;
@@ -70,11 +157,96 @@ namespace BitFunnel
             return m_cacheLineRecorder.get();
         }
 
+        size_t GetInterleaveLaneCount() const
+        {
+            return m_interleaveLaneCount;
+        }
+
+        // Lanes for ByteCodeInterpreter::RunInterleaved(), kept here so
+        // that they are allocated once rather than for each shard of each
+        // query.
+        std::vector<ByteCodeInterpreter::Lane> & GetInterpreterLanes()
+        {
+            return m_interpreterLanes;
+        }
+
+        double GetRewriteBudget() const
+        {
+            return m_rewriteBudget;
+        }
+
+        double GetDeadline() const
+        {
+            return m_deadline;
+        }
+
+        // Token for the query that is using these resources. Another thread
+        // may call Cancel() on it to stop the query at the next slice
+        // boundary.
+        CancellationToken & GetCancellationToken()
+        {
+            return m_cancellationToken;
+        }
+
+        bool IsShardSpecializationEnabled() const
+        {
+            return m_shardSpecialization;
+        }
+
+        bool IsRowSummaryEnabled() const
+        {
+            return m_rowSummaries;
+        }
+
+        bool IsShardPruningEnabled() const
+        {
+            return m_shardPruning;
+        }
+
+        bool IsCountModeEnabled() const
+        {
+            return m_countMode;
+        }
+
+        bool IsPrecompiledKernelEnabled() const
+        {
+            return m_precompiledKernels;
+        }
+
+        size_t GetPrefetchDistance() const
+        {
+            return m_prefetchDistance;
+        }
+
+        bool IsNonTemporalPrefetchEnabled() const
+        {
+            return m_nonTemporalPrefetch;
+        }
+
+        MatchingStrategy GetMatchingStrategy() const
+        {
+            return m_matchingStrategy;
+        }
+
     private:
         std::unique_ptr<IAllocator> m_matchTreeAllocator;
+        std::unique_ptr<IAllocator> m_rewriteAllocator;
         std::unique_ptr<NativeJIT::Allocator> m_expressionTreeAllocator;
         std::unique_ptr<NativeJIT::ExecutionBuffer> m_codeAllocator;
         std::unique_ptr<NativeJIT::FunctionBuffer> m_code;
         std::unique_ptr<CacheLineRecorder> m_cacheLineRecorder;
+        size_t m_interleaveLaneCount;
+        std::vector<ByteCodeInterpreter::Lane> m_interpreterLanes;
+        double m_rewriteBudget;
+        double m_deadline;
+        CancellationToken m_cancellationToken;
+        bool m_shardSpecialization;
+        bool m_rowSummaries;
+        bool m_shardPruning;
+        bool m_countMode;
+        bool m_precompiledKernels;
+        size_t m_prefetchDistance;
+        bool m_nonTemporalPrefetch;
+        MatchingStrategy m_matchingStrategy;
     };
 }
@@ -20,11 +20,16 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
 #include <iostream>             // Used for DiagnosticStream ref; not actually used.
+#include <random>
+#include <thread>
 
 #include "BitFunnel/Configuration/Factories.h"
 #include "BitFunnel/Configuration/IStreamConfiguration.h"
+#include "BitFunnel/Exceptions.h"
 #include "BitFunnel/IDiagnosticStream.h"
 #include "BitFunnel/Index/IIngestor.h"
 #include "BitFunnel/Index/ISimpleIndex.h"
@@ -34,8 +39,11 @@
 #include "BitFunnel/Plan/QueryRunner.h"
 #include "BitFunnel/Utilities/Factories.h"
 #include "BitFunnel/Utilities/Allocator.h"
+#include "BitFunnel/Utilities/HardwareCounters.h"
 #include "CsvTsv/Csv.h"
+#include "LoggerInterfaces/Check.h"
 #include "QueryResources.h"
+#include "QueryScheduler.h"
 #include "ResultsBuffer.h"
 
 
@@ -45,19 +53,25 @@ namespace BitFunnel
         size_t threadCount,
         size_t uniqueQueryCount,
         size_t processedCount,
+        size_t truncatedCount,
         size_t matchCount,
         double elapsedTime,
         double parsingTime,
         double planningTime,
-        double matchingTime)
+        double matchingTime,
+        double queueingTime,
+        LatencyHistogram const & latencies)
       : m_threadCount(threadCount),
         m_uniqueQueryCount(uniqueQueryCount),
         m_processedCount(processedCount),
+        m_truncatedCount(truncatedCount),
         m_matchCount(matchCount),
         m_elapsedTime(elapsedTime),
         m_parsingLatency(parsingTime),
         m_planningLatency(planningTime),
-        m_matchingLatency(matchingTime)
+        m_matchingLatency(matchingTime),
+        m_queueingLatency(queueingTime),
+        m_latencies(latencies)
     {
     }
 
@@ -77,16 +91,26 @@ namespace BitFunnel
             << "Thread count: " << m_threadCount << std::endl
             << "Unique queries: " << m_uniqueQueryCount << std::endl
             << "Queries processed: " << m_processedCount << std::endl
+            << "Queries truncated: " << m_truncatedCount << std::endl
             << "Match count: " << m_matchCount << std::endl
             << "Elapsed time: " << m_elapsedTime << std::endl
             << "Total parsing latency: " << m_parsingLatency << std::endl
             << "Total planning latency: " << m_planningLatency << std::endl
             << "Total matching latency: " << m_matchingLatency << std::endl
+            << "Total queueing latency: " << m_queueingLatency << std::endl
             << "Mean query latency: " << totalLatency / m_processedCount << std::endl
             << "Planning overhead: " << overheadLatency / totalLatency << std::endl
             << "QPS: " << m_processedCount / m_elapsedTime << std::endl
             << "MPS: " << m_matchCount / m_elapsedTime << std::endl
-            << "MPQ: " << static_cast<double>(m_matchCount) / m_processedCount << std::endl;
+            << "MPQ: " << static_cast<double>(m_matchCount) / m_processedCount << std::endl
+            << "Latency samples: " << m_latencies.GetCount() << std::endl
+            << "Queries rejected: " << m_latencies.GetRejectedCount() << std::endl
+            << "Queries shed: " << m_latencies.GetShedCount() << std::endl
+            << "Latency p50: " << m_latencies.GetPercentile(50.0) << std::endl
+            << "Latency p90: " << m_latencies.GetPercentile(90.0) << std::endl
+            << "Latency p99: " << m_latencies.GetPercentile(99.0) << std::endl
+            << "Latency p99.9: " << m_latencies.GetPercentile(99.9) << std::endl
+            << "Latency max: " << m_latencies.GetMax() << std::endl;
     }
 
 
@@ -156,27 +180,44 @@ namespace BitFunnel
     //
     // QueryProcessor
     //
+    // Runs queries from a QueryScheduler on its own thread, with its own
+    // QueryResources, until the scheduler is shut down and empty.
+    //
+    // Records the latency of each query in its own LatencyHistogram. When
+    // queries have scheduled arrival times, latency is measured from the
+    // scheduled arrival rather than from the time the query was enqueued,
+    // so that a submitter that falls behind schedule does not hide queueing
+    // delay (coordinated omission). Closed-loop queries have no arrival
+    // time, so their latency is the time taken to run them.
+    //
     //*************************************************************************
-    class QueryProcessor : public ITaskProcessor
+    class QueryProcessor : public IThreadBase
     {
     public:
         QueryProcessor(ISimpleIndex const & index,
                        IStreamConfiguration const & config,
                        std::vector<std::string> const & queries,
                        std::vector<QueryInstrumentation::Data> & results,
-                       size_t maxResultCount,
                        bool useNativeCode,
-                       bool countCacheLines,
-                       ThreadSynchronizer& synchronizer);
+                       size_t cacheLineSamplePeriod,
+                       bool countHardwareEvents,
+                       double deadline,
+                       QueryScheduler & scheduler,
+                       ThreadSynchronizer& synchronizer,
+                       std::vector<double> const & arrivals,
+                       LatencyHistogram & latencies);
 
         //
-        // ITaskProcessor methods
+        // IThreadBase methods
         //
 
-        virtual void ProcessTask(size_t taskId) override;
-        virtual void Finished() override;
+        virtual void EntryPoint() override;
 
     private:
+        // Runs the query for the specified task and stores its
+        // instrumentation data in m_results[taskId].
+        void ProcessTask(size_t taskId, double queueTime);
+
         //
         // constructor parameters
         //
@@ -185,15 +226,20 @@ namespace BitFunnel
         std::vector<std::string> const & m_queries;
         std::vector<QueryInstrumentation::Data> & m_results;
         bool m_useNativeCode;
+        bool m_countHardwareEvents;
+        QueryScheduler & m_scheduler;
         ThreadSynchronizer& m_synchronizer;
+        std::vector<double> const & m_arrivals;
+        LatencyHistogram & m_latencies;
 
-        std::vector<ResultsBuffer::Result> m_matches;
-
+        // QueryRunner only reports match counts, so queries run in count
+        // mode with an empty ResultsBuffer.
         ResultsBuffer m_resultsBuffer;
 
         QueryResources m_resources;
 
-        size_t m_queriesProcessed;
+        // Opened by EntryPoint(), on the thread that runs the queries.
+        HardwareCounters m_hardwareCounters;
 
         // TODO: Issue #390. Trec 2006 Efficiency Topic 43860 is too bit for
         // c_allocatorSize == 1ull << 17 when using TreatmentClassicBitsliced:
@@ -208,38 +254,68 @@ namespace BitFunnel
                                    IStreamConfiguration const & config,
                                    std::vector<std::string> const & queries,
                                    std::vector<QueryInstrumentation::Data> & results,
-                                   size_t maxResultCount,
                                    bool useNativeCode,
-                                   bool countCacheLines,
-                                   ThreadSynchronizer& synchronizer)
+                                   size_t cacheLineSamplePeriod,
+                                   bool countHardwareEvents,
+                                   double deadline,
+                                   QueryScheduler & scheduler,
+                                   ThreadSynchronizer& synchronizer,
+                                   std::vector<double> const & arrivals,
+                                   LatencyHistogram & latencies)
       : m_index(index),
         m_config(config),
         m_queries(queries),
         m_results(results),
         m_useNativeCode(useNativeCode),
+        m_countHardwareEvents(countHardwareEvents),
+        m_scheduler(scheduler),
         m_synchronizer(synchronizer),
-        m_matches(maxResultCount, {nullptr, 0}),
-        m_resultsBuffer(index.GetIngestor().GetDocumentCount()),
-        m_resources(c_allocatorSize, c_allocatorSize),
-        m_queriesProcessed(0)
+        m_arrivals(arrivals),
+        m_latencies(latencies),
+        m_resultsBuffer(0),
+        m_resources(c_allocatorSize, c_allocatorSize)
     {
-        if (countCacheLines)
+        m_resources.EnableCountMode(true);
+        m_resources.SetDeadline(deadline);
+
+        if (cacheLineSamplePeriod > 0)
         {
-            m_resources.EnableCacheLineCounting(index);
+            m_resources.EnableCacheLineCounting(index, cacheLineSamplePeriod);
         }
     }
 
 
-    void QueryProcessor::ProcessTask(size_t taskId)
+    void QueryProcessor::EntryPoint()
     {
-        // If this is the first query, wait for other threads before continuing.
-        if (m_queriesProcessed == 0)
+        // QueryRunner has checked that counters can be opened. If this
+        // thread's counters still fail to open, its queries report zero
+        // counts so that every row of the results has the same columns.
+        if (m_countHardwareEvents)
+        {
+            m_hardwareCounters.Open();
+        }
+
+        // Wait for other threads before processing the first query.
+        m_synchronizer.Wait();
+
+        size_t taskId;
+        double queueTime;
+        while (m_scheduler.TryDequeue(taskId, queueTime))
         {
-            m_synchronizer.Wait();
+            ProcessTask(taskId, queueTime);
+            m_scheduler.Finish();
         }
-        ++m_queriesProcessed;
+    }
+
 
+    void QueryProcessor::ProcessTask(size_t taskId, double queueTime)
+    {
         QueryInstrumentation instrumentation;
+        if (m_countHardwareEvents)
+        {
+            instrumentation.EnableHardwareCounters(m_hardwareCounters);
+        }
+        instrumentation.SetQueueTime(queueTime);
         m_resources.Reset();
 
         size_t queryId = taskId % m_queries.size();
@@ -263,25 +339,136 @@ namespace BitFunnel
                                        m_useNativeCode);
         }
 
-        m_results[taskId] = instrumentation.GetData();
+        auto data = instrumentation.GetData();
+        if (m_arrivals.empty())
+        {
+            m_latencies.Record(data.GetParsingTime() +
+                               data.GetPlanningTime() +
+                               data.GetMatchingTime());
+        }
+        else
+        {
+            m_latencies.Record(m_synchronizer.GetElapsedTime() -
+                               m_arrivals[taskId]);
+        }
+
+        m_results[taskId] = data;
     }
 
 
-    void QueryProcessor::Finished()
+    // Throws if hardware counters cannot be opened on this machine, rather
+    // than silently reporting zero counts.
+    static void CheckHardwareCounters()
+    {
+        HardwareCounters counters;
+        if (!counters.Open())
+        {
+            RecoverableError error("Hardware counters are unavailable. "
+                                   "Check that perf_event_open() is supported "
+                                   "and allowed by perf_event_paranoid.");
+            throw error;
+        }
+    }
+
+
+    //*************************************************************************
+    //
+    // GetArrivalSchedule
+    //
+    // Returns the time, in seconds after the start of the run, at which
+    // each task arrives. Returns an empty vector if tasks are submitted as
+    // fast as threads become available.
+    //
+    //*************************************************************************
+    static std::vector<double> GetArrivalSchedule(
+        QueryRunner::SchedulerOptions const & options,
+        size_t queryCount,
+        size_t iterations)
     {
+        std::vector<double> arrivals;
+        std::vector<double> const & recorded = options.m_arrivalTimes;
+        const double rate = options.m_arrivalRate;
+
+        if (!recorded.empty())
+        {
+            CHECK_EQ(recorded.size(), queryCount)
+                << "SchedulerOptions must have one arrival time per query.";
+
+            // Average rate of the recording, treating the recording as
+            // covering queryCount intervals so that iterations follow on
+            // at the same rate.
+            const double span = recorded.back() - recorded.front();
+            CHECK_GE(span, 0.0)
+                << "Arrival times must be in nondecreasing order.";
+            const double recordedRate = (queryCount > 1 && span > 0.0) ?
+                (queryCount - 1) / span :
+                rate;
+            CHECK_GT(recordedRate, 0.0)
+                << "Cannot infer an arrival rate from the arrival times.";
+
+            const double scale = (rate > 0.0) ? recordedRate / rate : 1.0;
+            const double period = queryCount / recordedRate;
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                for (double time : recorded)
+                {
+                    arrivals.push_back(
+                        (i * period + time - recorded.front()) * scale);
+                }
+            }
+        }
+        else if (rate > 0.0)
+        {
+            std::mt19937 generator(options.m_seed);
+            std::exponential_distribution<double> interval(rate);
+
+            double time = 0;
+            for (size_t taskId = 0; taskId < queryCount * iterations; ++taskId)
+            {
+                arrivals.push_back(time);
+                time += options.m_poissonArrivals ?
+                    interval(generator) :
+                    1.0 / rate;
+            }
+        }
+        else
+        {
+            CHECK_EQ(options.m_poissonArrivals, false)
+                << "Poisson arrivals require an arrival rate.";
+        }
+
+        return arrivals;
     }
 
+
     //*************************************************************************
     //
     // QueryRunner
     //
     //*************************************************************************
+    QueryRunner::SchedulerOptions::SchedulerOptions()
+      : m_queueCapacity(0),
+        m_targetQueueDelay(0.0),
+        m_deadline(0.0),
+        m_arrivalRate(0.0),
+        m_poissonArrivals(false),
+        m_seed(0)
+    {
+    }
+
+
     QueryInstrumentation::Data QueryRunner::Run(
         char const * query,
         ISimpleIndex const & index,
         bool useNativeCode,
-        bool countCacheLines)
+        size_t cacheLineSamplePeriod,
+        bool countHardwareEvents)
     {
+        if (countHardwareEvents)
+        {
+            CheckHardwareCounters();
+        }
+
         std::vector<std::string> queries;
         queries.push_back(std::string(query));
 
@@ -289,21 +476,30 @@ namespace BitFunnel
 
         auto config = Factories::CreateStreamConfiguration();
 
-        size_t maxResultCount = index.GetIngestor().GetDocumentCount();
+        // The query is run on the calling thread.
+        QueryScheduler scheduler(0, 1, 0.0);
+        scheduler.Enqueue(0, 0);
+        scheduler.Shutdown();
 
         ThreadSynchronizer synchronizer(1);
 
+        std::vector<double> arrivals;
+        LatencyHistogram latencies;
+
         QueryProcessor
             processor(index,
                       *config,
                       queries,
                       results,
-                      maxResultCount,
                       useNativeCode,
-                      countCacheLines,
-                      synchronizer);
-        processor.ProcessTask(0);
-        processor.Finished();
+                      cacheLineSamplePeriod,
+                      countHardwareEvents,
+                      0.0,
+                      scheduler,
+                      synchronizer,
+                      arrivals,
+                      latencies);
+        processor.EntryPoint();
 
         return results[0];
     }
@@ -316,49 +512,123 @@ namespace BitFunnel
         std::vector<std::string> const & queries,
         size_t iterations,
         bool useNativeCode,
-        bool countCacheLines)
+        size_t cacheLineSamplePeriod,
+        bool countHardwareEvents,
+        SchedulerOptions const & options)
     {
-        std::vector<QueryInstrumentation::Data> results(queries.size() * iterations);
+        if (countHardwareEvents)
+        {
+            CheckHardwareCounters();
+        }
+
+        std::vector<unsigned> const & priorities = options.m_priorities;
+        if (!priorities.empty())
+        {
+            CHECK_EQ(priorities.size(), queries.size())
+                << "SchedulerOptions must have one priority per query.";
+        }
+        const unsigned priorityCount = priorities.empty() ?
+            1u :
+            *std::max_element(priorities.begin(), priorities.end()) + 1;
+
+        const size_t taskCount = queries.size() * iterations;
+        std::vector<QueryInstrumentation::Data> results(taskCount);
 
         auto config = Factories::CreateStreamConfiguration();
 
-        size_t maxResultCount = index.GetIngestor().GetDocumentCount();
+        const std::vector<double> arrivals =
+            GetArrivalSchedule(options, queries.size(), iterations);
+
+        // Without an arrival schedule, queries are submitted closed loop:
+        // one per thread is waiting or running, so that queue time is only
+        // the hand-off to a free thread.
+        QueryScheduler scheduler(options.m_queueCapacity,
+                                 priorityCount,
+                                 options.m_targetQueueDelay,
+                                 arrivals.empty() ? threadCount : 0);
 
-        ThreadSynchronizer synchronizer(threadCount);
+        // The calling thread submits queries once every thread has started.
+        ThreadSynchronizer synchronizer(threadCount + 1);
 
-        std::vector<std::unique_ptr<ITaskProcessor>> processors;
+        std::vector<LatencyHistogram> latencies(threadCount);
+        std::vector<std::unique_ptr<IThreadBase>> processors;
         for (size_t i = 0; i < threadCount; ++i) {
             processors.push_back(
-                std::unique_ptr<ITaskProcessor>(
+                std::unique_ptr<IThreadBase>(
                     new QueryProcessor(index,
                                        *config,
                                        queries,
                                        results,
-                                       maxResultCount,
                                        useNativeCode,
-                                       countCacheLines,
-                                       synchronizer)));
+                                       cacheLineSamplePeriod,
+                                       countHardwareEvents,
+                                       options.m_deadline,
+                                       scheduler,
+                                       synchronizer,
+                                       arrivals,
+                                       latencies[i])));
         }
+        auto threadManager = Factories::CreateThreadManager(processors);
 
-        auto distributor =
-            Factories::CreateTaskDistributor(processors,
-                                             queries.size() * iterations);
+        synchronizer.Wait();
+        for (size_t taskId = 0; taskId < taskCount; ++taskId)
+        {
+            const unsigned priority = priorities.empty() ?
+                0u :
+                priorities[taskId % queries.size()];
+
+            if (!arrivals.empty())
+            {
+                // Open loop: queries arrive on schedule, whether or not
+                // there is room for them.
+                const double arrival = arrivals[taskId];
+                const double now = synchronizer.GetElapsedTime();
+                if (arrival > now)
+                {
+                    std::this_thread::sleep_for(
+                        std::chrono::duration<double>(arrival - now));
+                }
+                scheduler.TryEnqueue(taskId, priority);
+            }
+            else
+            {
+                scheduler.Enqueue(taskId, priority);
+            }
+        }
+        scheduler.Shutdown();
 
-        distributor->WaitForCompletion();
+        threadManager->WaitForThreads();
         double elapsedTime = synchronizer.GetElapsedTime();
 
+        // Queries that were rejected or shed never reach a QueryProcessor,
+        // so they are counted in the histogram here rather than dropped.
+        LatencyHistogram latency;
+        for (auto const & histogram : latencies)
+        {
+            latency.Merge(histogram);
+        }
+        latency.RecordRejected(scheduler.GetRejectedCount());
+        latency.RecordShed(scheduler.GetShedCount());
+
+        double totalQueueingTime = 0;
         double totalParsingTime = 0;
         double totalPlanningTime = 0;
         double totalMatchingTime = 0;
 
         size_t queriesProcessed = 0;
+        size_t queriesTruncated = 0;
         size_t matchCount = 0;
         for (auto result : results)
         {
             if (result.GetRowCount() > 0)
             {
                 ++queriesProcessed;
+                if (result.IsTruncated())
+                {
+                    ++queriesTruncated;
+                }
                 matchCount += result.GetMatchCount();
+                totalQueueingTime += result.GetQueueTime();
                 totalParsingTime += result.GetParsingTime();
                 totalPlanningTime += result.GetPlanningTime();
                 totalMatchingTime += result.GetMatchingTime();
@@ -368,11 +638,14 @@ namespace BitFunnel
         auto statistics(QueryRunner::Statistics(threadCount,
                                                 queries.size(),
                                                 queriesProcessed,
+                                                queriesTruncated,
                                                 matchCount,
                                                 elapsedTime,
                                                 totalParsingTime,
                                                 totalPlanningTime,
-                                                totalMatchingTime));
+                                                totalMatchingTime,
+                                                totalQueueingTime,
+                                                latency));
 
         {
             std::cout << "Writing results ..." << std::endl;
@@ -386,14 +659,142 @@ namespace BitFunnel
             CsvTsv::CsvTableFormatter formatter(*out);
 
             formatter.WriteField("query");
-            QueryInstrumentation::Data::FormatHeader(formatter);
+            QueryInstrumentation::Data::FormatHeader(formatter,
+                                                     countHardwareEvents);
             for (size_t i = 0; i < results.size(); ++i)
             {
                 formatter.WriteField(queries[i % queries.size()]);
-                results[i].Format(formatter);
+                results[i].Format(formatter, countHardwareEvents);
             }
         }
 
         return statistics;
     }
+
+
+    //*************************************************************************
+    //
+    // Matcher
+    //
+    // One of the matcher configurations timed by
+    // QueryRunner::CompareMatchers().
+    //
+    //*************************************************************************
+    class Matcher
+    {
+    public:
+        char const * m_name;
+        bool m_useNativeCode;
+        bool m_usePrecompiledKernels;
+        size_t m_prefetchDistance;
+        bool m_nonTemporalPrefetch;
+    };
+
+
+    // Returns the matchers compared by QueryRunner::CompareMatchers().
+    static std::vector<Matcher> GetMatchers(bool sweepLoopOptions)
+    {
+        std::vector<Matcher> matchers;
+        if (!sweepLoopOptions)
+        {
+            matchers.push_back({ "interpreter", false, false, 0, false });
+            matchers.push_back({ "native", true, false, 0, false });
+            matchers.push_back({ "precompiled", true, true, 0, false });
+            return matchers;
+        }
+
+        for (size_t distance : { 0u, 4u, 16u })
+        {
+            for (bool nonTemporal : { false, true })
+            {
+                if (distance == 0 && nonTemporal)
+                {
+                    continue;
+                }
+
+                matchers.push_back(
+                    { "native", true, false, distance, nonTemporal });
+            }
+        }
+        return matchers;
+    }
+
+
+    void QueryRunner::CompareMatchers(ISimpleIndex const & index,
+                                      std::vector<std::string> const & queries,
+                                      size_t repetitions,
+                                      bool sweepLoopOptions,
+                                      std::ostream & out)
+    {
+        CHECK_GT(repetitions, 0u)
+            << "CompareMatchers requires at least one repetition.";
+
+        const std::vector<Matcher> matchers = GetMatchers(sweepLoopOptions);
+
+        const size_t c_allocatorSize = 1ull << 17;
+
+        auto config = Factories::CreateStreamConfiguration();
+        auto diagnosticStream = Factories::CreateDiagnosticStream(std::cout);
+        ResultsBuffer resultsBuffer(0);
+
+        CsvTsv::CsvTableFormatter formatter(out);
+        formatter.WriteField("query");
+        formatter.WriteField("matcher");
+        formatter.WriteField("prefetch");
+        formatter.WriteField("nta");
+        formatter.WriteField("matches");
+        formatter.WriteField("plan");
+        formatter.WriteField("match");
+        formatter.WriteRowEnd();
+
+        for (auto const & query : queries)
+        {
+            for (auto const & matcher : matchers)
+            {
+                QueryResources resources(c_allocatorSize, c_allocatorSize);
+                resources.EnableCountMode(true);
+                resources.EnablePrecompiledKernels(matcher.m_usePrecompiledKernels);
+                resources.SetPrefetchDistance(matcher.m_prefetchDistance);
+                resources.EnableNonTemporalPrefetch(matcher.m_nonTemporalPrefetch);
+
+                size_t matchCount = 0;
+                double planningTime = 0;
+                double matchingTime = 0;
+                for (size_t i = 0; i < repetitions; ++i)
+                {
+                    resources.Reset();
+                    QueryInstrumentation instrumentation;
+                    QueryParser parser(query.c_str(),
+                                       *config,
+                                       resources.GetMatchTreeAllocator());
+                    auto tree = parser.Parse();
+                    instrumentation.FinishParsing();
+                    if (tree != nullptr)
+                    {
+                        Factories::RunQueryPlanner(*tree,
+                                                   index,
+                                                   resources,
+                                                   *diagnosticStream,
+                                                   instrumentation,
+                                                   resultsBuffer,
+                                                   matcher.m_useNativeCode);
+                    }
+
+                    auto data = instrumentation.GetData();
+                    matchCount = data.GetMatchCount();
+                    planningTime += data.GetPlanningTime();
+                    matchingTime += data.GetMatchingTime();
+                }
+
+                formatter.WriteField(query);
+                formatter.WriteField(matcher.m_name);
+                formatter.WriteField(matcher.m_prefetchDistance);
+                formatter.WriteField(matcher.m_nonTemporalPrefetch);
+                formatter.WriteField(matchCount);
+                formatter.WriteField(planningTime / repetitions);
+                formatter.WriteField(matchingTime / repetitions);
+                formatter.WriteRowEnd();
+            }
+        }
+    }
 }
@@ -0,0 +1,193 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "LoggerInterfaces/Check.h"
+#include "QueryScheduler.h"
+
+
+namespace BitFunnel
+{
+    QueryScheduler::QueryScheduler(size_t capacity,
+                                   unsigned priorityCount,
+                                   double targetDelay,
+                                   size_t inFlightLimit)
+      : m_capacity(capacity),
+        m_targetDelay(targetDelay),
+        m_inFlightLimit(inFlightLimit),
+        m_queues(priorityCount),
+        m_size(0),
+        m_running(0),
+        m_shutdown(false),
+        m_rejectedCount(0),
+        m_shedCount(0)
+    {
+        CHECK_GT(priorityCount, 0u)
+            << "QueryScheduler needs at least one priority class.";
+    }
+
+
+    bool QueryScheduler::TryEnqueue(size_t queryId, unsigned priority)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_shutdown || !MakeRoom(priority))
+        {
+            ++m_rejectedCount;
+            return false;
+        }
+        Push(queryId, priority);
+        return true;
+    }
+
+
+    bool QueryScheduler::Enqueue(size_t queryId, unsigned priority)
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (((m_capacity != 0 && m_size >= m_capacity) ||
+                (m_inFlightLimit != 0 && m_size + m_running >= m_inFlightLimit)) &&
+               !m_shutdown)
+        {
+            m_enqueueCond.wait(lock);
+        }
+        if (m_shutdown)
+        {
+            return false;
+        }
+        Push(queryId, priority);
+        return true;
+    }
+
+
+    bool QueryScheduler::TryDequeue(size_t & queryId, double & queueTime)
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        for (;;)
+        {
+            while (m_size == 0 && !m_shutdown)
+            {
+                m_dequeueCond.wait(lock);
+            }
+            if (m_size == 0)
+            {
+                return false;
+            }
+
+            for (unsigned priority = 0; priority < m_queues.size(); ++priority)
+            {
+                auto & queue = m_queues[priority];
+                if (queue.empty())
+                {
+                    continue;
+                }
+
+                const Entry entry = queue.front();
+                queue.pop_front();
+                --m_size;
+                m_enqueueCond.notify_one();
+
+                const double waited = m_stopwatch.ElapsedTime() - entry.m_enqueueTime;
+                if (priority > 0 && m_targetDelay > 0.0 && waited > m_targetDelay)
+                {
+                    // Shed the query and look for another.
+                    ++m_shedCount;
+                    break;
+                }
+
+                queryId = entry.m_queryId;
+                queueTime = waited;
+                ++m_running;
+                return true;
+            }
+        }
+    }
+
+
+    void QueryScheduler::Finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            CHECK_GT(m_running, 0u)
+                << "Finish() called without a matching TryDequeue().";
+            --m_running;
+        }
+        m_enqueueCond.notify_one();
+    }
+
+
+    void QueryScheduler::Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_shutdown = true;
+        }
+        m_dequeueCond.notify_all();
+        m_enqueueCond.notify_all();
+    }
+
+
+    size_t QueryScheduler::GetRejectedCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_rejectedCount;
+    }
+
+
+    size_t QueryScheduler::GetShedCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_shedCount;
+    }
+
+
+    bool QueryScheduler::MakeRoom(unsigned priority)
+    {
+        if (m_capacity == 0 || m_size < m_capacity)
+        {
+            return true;
+        }
+
+        // Displace the newest query from the least important class that is
+        // less important than the new query.
+        for (size_t p = m_queues.size() - 1; p > priority; --p)
+        {
+            if (!m_queues[p].empty())
+            {
+                m_queues[p].pop_back();
+                --m_size;
+                ++m_rejectedCount;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    void QueryScheduler::Push(size_t queryId, unsigned priority)
+    {
+        CHECK_LT(priority, m_queues.size())
+            << "Priority out of range.";
+
+        m_queues[priority].push_back({ queryId, m_stopwatch.ElapsedTime() });
+        ++m_size;
+        m_dequeueCond.notify_one();
+    }
+}
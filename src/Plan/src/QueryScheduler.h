@@ -0,0 +1,139 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <condition_variable>               // std::condition_variable embedded.
+#include <deque>                            // std::deque embedded.
+#include <mutex>                            // std::mutex embedded.
+#include <stddef.h>                         // size_t parameter.
+#include <vector>                           // std::vector embedded.
+
+#include "BitFunnel/NonCopyable.h"          // Base class.
+#include "BitFunnel/Utilities/Stopwatch.h"  // Stopwatch embedded.
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // QueryScheduler
+    //
+    // A threadsafe admission queue for queries, identified by their ids.
+    // Each query belongs to a priority class, with 0 being the highest, and
+    // threads dequeue the oldest query of the highest non-empty class.
+    //
+    // The queue has a fixed capacity. When it is full, a new query displaces
+    // the newest query of the lowest class below its own, and is rejected
+    // if there is no such query. To keep queueing delay bounded under load,
+    // queries outside class 0 that have waited longer than a target delay
+    // are shed when they reach the front of the queue instead of being run.
+    // Queries in class 0 are never shed once admitted.
+    //
+    // A closed-loop submitter can also limit the number of queries in
+    // flight, i.e. waiting or running. Threads report each query they finish
+    // running, and Enqueue() waits for a free thread rather than building a
+    // backlog whose queueing delay would only reflect how long the run has
+    // been going.
+    //
+    //*************************************************************************
+    class QueryScheduler : public NonCopyable
+    {
+    public:
+        // A capacity of zero means that the queue is unbounded. A target
+        // delay of zero disables shedding. An inFlightLimit of zero means
+        // that only the capacity limits Enqueue().
+        QueryScheduler(size_t capacity,
+                       unsigned priorityCount,
+                       double targetDelay,
+                       size_t inFlightLimit = 0);
+
+        // Admits a query without blocking. Returns false if the query was
+        // rejected because the queue is full or has been shut down.
+        bool TryEnqueue(size_t queryId, unsigned priority);
+
+        // Blocks the caller while the queue is full, or while the in-flight
+        // limit is reached. Returns false if the queue was shut down before
+        // the query could be admitted.
+        bool Enqueue(size_t queryId, unsigned priority);
+
+        // Blocks the caller until a query is available or the queue has been
+        // shut down and is empty. On success, returns true and sets
+        // queueTime to the number of seconds the query spent in the queue.
+        // The caller must call Finish() once it has run the query.
+        bool TryDequeue(size_t & queryId, double & queueTime);
+
+        // Reports that a query returned by TryDequeue() has finished
+        // running.
+        void Finish();
+
+        // Stops admitting queries. Queries already in the queue are still
+        // dequeued.
+        void Shutdown();
+
+        // Number of queries refused by TryEnqueue() or displaced by higher
+        // priority queries.
+        size_t GetRejectedCount() const;
+
+        // Number of queries dropped because they waited longer than the
+        // target delay.
+        size_t GetShedCount() const;
+
+    private:
+        class Entry
+        {
+        public:
+            size_t m_queryId;
+            double m_enqueueTime;
+        };
+
+        // Makes room for a query of the specified priority. Returns false
+        // if the queue is full of queries that are at least as important.
+        // Must be called with m_lock held.
+        bool MakeRoom(unsigned priority);
+
+        // Must be called with m_lock held.
+        void Push(size_t queryId, unsigned priority);
+
+        const size_t m_capacity;
+        const double m_targetDelay;
+        const size_t m_inFlightLimit;
+
+        mutable std::mutex m_lock;
+        std::condition_variable m_enqueueCond;
+        std::condition_variable m_dequeueCond;
+
+        // One queue per priority class.
+        std::vector<std::deque<Entry>> m_queues;
+        size_t m_size;
+
+        // Number of queries dequeued that have not yet been finished.
+        size_t m_running;
+
+        bool m_shutdown;
+
+        size_t m_rejectedCount;
+        size_t m_shedCount;
+
+        Stopwatch m_stopwatch;
+    };
+}
@@ -0,0 +1,193 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+
+#include "BitFunnel/Allocators/IAllocator.h"
+#include "BitFunnel/Configuration/Factories.h"
+#include "BitFunnel/Configuration/IStreamConfiguration.h"
+#include "BitFunnel/Exceptions.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IDocumentFrequencyTable.h"
+#include "BitFunnel/Plan/Factories.h"
+#include "BitFunnel/Plan/QueryParser.h"
+#include "BitFunnel/Utilities/Factories.h"
+#include "QueryTermFrequencyTableBuilder.h"
+#include "StringVector.h"
+
+
+namespace BitFunnel
+{
+    std::unique_ptr<IDocumentFrequencyTable>
+        Factories::CreateQueryTermFrequencyTable(
+            IConfiguration const & configuration,
+            std::vector<std::string> const & queries)
+    {
+        QueryTermFrequencyTableBuilder builder(configuration);
+        for (auto const & query : queries)
+        {
+            builder.AddQuery(query.c_str());
+        }
+        return builder.CreateTable();
+    }
+
+
+    QueryTermFrequencyTableBuilder::QueryTermFrequencyTableBuilder(
+        IConfiguration const & configuration)
+      : m_configuration(configuration),
+        m_streamConfiguration(Factories::CreateStreamConfiguration()),
+        m_allocator(Factories::CreateAllocator(1ull << 16)),
+        m_queryCount(0)
+    {
+    }
+
+
+    void QueryTermFrequencyTableBuilder::AddQuery(char const * query)
+    {
+        m_allocator->Reset();
+        m_queryTerms.clear();
+
+        QueryParser parser(query, *m_streamConfiguration, *m_allocator);
+        auto tree = parser.Parse();
+        if (tree != nullptr)
+        {
+            CollectTerms(*tree);
+        }
+
+        ++m_queryCount;
+    }
+
+
+    std::unique_ptr<IDocumentFrequencyTable>
+        QueryTermFrequencyTableBuilder::CreateTable() const
+    {
+        auto table = Factories::CreateDocumentFrequencyTable();
+        for (size_t i = 0; i < m_terms.size(); ++i)
+        {
+            table->AddEntry(
+                IDocumentFrequencyTable::Entry(
+                    m_terms[i],
+                    static_cast<double>(m_counts[i]) / m_queryCount));
+        }
+        return table;
+    }
+
+
+    void QueryTermFrequencyTableBuilder::CollectTerms(TermMatchNode const & node)
+    {
+        switch (node.GetType())
+        {
+        case TermMatchNode::AndMatch:
+            {
+                auto const & andNode =
+                    dynamic_cast<TermMatchNode::And const &>(node);
+                CollectTerms(andNode.GetLeft());
+                CollectTerms(andNode.GetRight());
+            }
+            break;
+        case TermMatchNode::NotMatch:
+            // The rows of negated terms are scanned too.
+            CollectTerms(
+                dynamic_cast<TermMatchNode::Not const &>(node).GetChild());
+            break;
+        case TermMatchNode::OrMatch:
+            {
+                auto const & orNode =
+                    dynamic_cast<TermMatchNode::Or const &>(node);
+                CollectTerms(orNode.GetLeft());
+                CollectTerms(orNode.GetRight());
+            }
+            break;
+        case TermMatchNode::PhraseMatch:
+            CollectTerms(dynamic_cast<TermMatchNode::Phrase const &>(node));
+            break;
+        case TermMatchNode::UnigramMatch:
+            {
+                auto const & unigram =
+                    dynamic_cast<TermMatchNode::Unigram const &>(node);
+                CollectTerm(Term(unigram.GetText(),
+                                 unigram.GetStreamId(),
+                                 m_configuration));
+            }
+            break;
+        case TermMatchNode::FactMatch:
+            // Facts have dedicated rows that no treatment configures.
+            break;
+        default:
+            FatalError error("QueryTermFrequencyTableBuilder: invalid node type.");
+            throw error;
+        }
+    }
+
+
+    // Mirrors TermMatchTreeConverter::BuildMatchTree(Phrase), which looks up
+    // every n-gram of up to Term::c_maxGramSize consecutive words.
+    void QueryTermFrequencyTableBuilder::CollectTerms(
+        TermMatchNode::Phrase const & node)
+    {
+        std::vector<Term> grams;
+        StringVector const & strings = node.GetGrams();
+        for (unsigned i = 0; i < strings.GetSize(); ++i)
+        {
+            grams.push_back(Term(strings[i],
+                                 node.GetStreamId(),
+                                 m_configuration));
+        }
+
+        for (size_t start = 0; start < grams.size(); ++start)
+        {
+            const size_t end =
+                (std::min)(grams.size(), start + Term::c_maxGramSize);
+
+            Term term(grams[start]);
+            CollectTerm(term);
+            for (size_t n = start + 1; n < end; ++n)
+            {
+                term.AddTerm(grams[n], m_configuration);
+                CollectTerm(term);
+            }
+        }
+    }
+
+
+    void QueryTermFrequencyTableBuilder::CollectTerm(Term const & term)
+    {
+        const Term::Hash hash = term.GetRawHash();
+        if (!m_queryTerms.insert(hash).second)
+        {
+            // This query already counted the term.
+            return;
+        }
+
+        auto it = m_termIndexes.find(hash);
+        if (it == m_termIndexes.end())
+        {
+            m_termIndexes.insert(std::make_pair(hash, m_terms.size()));
+            m_terms.push_back(term);
+            m_counts.push_back(1);
+        }
+        else
+        {
+            ++m_counts[it->second];
+        }
+    }
+}
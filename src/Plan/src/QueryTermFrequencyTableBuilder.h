@@ -0,0 +1,85 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <memory>                           // std::unique_ptr member.
+#include <unordered_map>                    // std::unordered_map member.
+#include <unordered_set>                    // std::unordered_set member.
+#include <vector>                           // std::vector member.
+
+#include "BitFunnel/NonCopyable.h"          // Base class.
+#include "BitFunnel/Plan/TermMatchNode.h"   // TermMatchNode::Phrase parameter.
+#include "BitFunnel/Term.h"                 // Term member.
+
+
+namespace BitFunnel
+{
+    class IAllocator;
+    class IConfiguration;
+    class IDocumentFrequencyTable;
+    class IStreamConfiguration;
+
+    //*************************************************************************
+    //
+    // QueryTermFrequencyTableBuilder
+    //
+    // Counts, for each term, the number of queries that would look up the
+    // term's rows. Terms are formed the same way TermMatchTreeConverter forms
+    // them, so phrases contribute each of their n-grams. The resulting table
+    // has the format of an IDocumentFrequencyTable, but its frequencies are
+    // fractions of queries rather than of documents.
+    //
+    //*************************************************************************
+    class QueryTermFrequencyTableBuilder : NonCopyable
+    {
+    public:
+        QueryTermFrequencyTableBuilder(IConfiguration const & configuration);
+
+        // Parses the query and counts each distinct term it contains.
+        // Throws QueryParser::ParseError if the query cannot be parsed.
+        void AddQuery(char const * query);
+
+        std::unique_ptr<IDocumentFrequencyTable> CreateTable() const;
+
+    private:
+        void CollectTerms(TermMatchNode const & node);
+        void CollectTerms(TermMatchNode::Phrase const & node);
+        void CollectTerm(Term const & term);
+
+        IConfiguration const & m_configuration;
+
+        std::unique_ptr<IStreamConfiguration> m_streamConfiguration;
+        std::unique_ptr<IAllocator> m_allocator;
+
+        size_t m_queryCount;
+
+        // Terms seen in the current query, so that each query counts a term
+        // at most once.
+        std::unordered_set<Term::Hash> m_queryTerms;
+
+        // The terms seen so far, and the number of queries containing each.
+        std::vector<Term> m_terms;
+        std::unordered_map<Term::Hash, size_t> m_termIndexes;
+        std::vector<size_t> m_counts;
+    };
+}
@@ -0,0 +1,55 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>                        // std::max().
+
+#include "BitFunnel/Index/IIngestor.h"
+#include "BitFunnel/Index/IShard.h"
+#include "BitFunnel/Index/ISimpleIndex.h"
+#include "ResultsBuffer.h"
+
+
+namespace BitFunnel
+{
+    size_t ResultsBuffer::GetMinimumChunkCapacity(ISimpleIndex const & index)
+    {
+        size_t capacity = 0;
+        auto & ingestor = index.GetIngestor();
+        for (ShardId shard = 0; shard < ingestor.GetShardCount(); ++shard)
+        {
+            capacity = (std::max)(capacity,
+                                  static_cast<size_t>(ingestor.GetShard(shard).GetSliceCapacity()));
+        }
+        return capacity;
+    }
+
+
+    void ResultsBuffer::Flush()
+    {
+        if (m_consumer != nullptr && m_size > 0)
+        {
+            m_consumer->Consume(m_buffer, m_size);
+            m_flushedCount += m_size;
+            m_size = 0;
+        }
+    }
+}
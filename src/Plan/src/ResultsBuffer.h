@@ -33,8 +33,21 @@
 
 namespace BitFunnel
 {
+    class ISimpleIndex;
     class Slice;
 
+    //*************************************************************************
+    //
+    // ResultsBuffer
+    //
+    // Holds the matches produced by the ByteCodeInterpreter and by native
+    // code. A ResultsBuffer constructed with an IConsumer is a bounded,
+    // reusable chunk. When it fills, its contents are handed to the consumer
+    // and the buffer is emptied, so that memory use does not depend on the
+    // number of matches and downstream processing can overlap with matching.
+    // Without a consumer, matches beyond the capacity are dropped.
+    //
+    //*************************************************************************
     class ResultsBuffer
     {
     public:
@@ -66,27 +79,82 @@ namespace BitFunnel
         static_assert(std::is_trivially_copyable<Result>::value,
                       "Generated code requires that Result be trivially copyable.");
 
+        // Receives the contents of a chunked ResultsBuffer each time it
+        // fills, and once more when matching completes. The results are
+        // only valid for the duration of the call.
+        class IConsumer
+        {
+        public:
+            virtual ~IConsumer() {};
+
+            virtual void Consume(Result const * results, size_t count) = 0;
+        };
+
         ResultsBuffer(size_t capacity)
           : m_bufferOwner(new Result[capacity]),
             m_capacity(capacity),
-            m_size(0)
+            m_size(0),
+            m_consumer(nullptr),
+            m_flushedCount(0)
+        {
+            m_buffer = m_bufferOwner.get();
+        }
+
+        ResultsBuffer(size_t capacity, IConsumer & consumer)
+          : m_bufferOwner(new Result[capacity]),
+            m_capacity(capacity),
+            m_size(0),
+            m_consumer(&consumer),
+            m_flushedCount(0)
         {
             m_buffer = m_bufferOwner.get();
         }
 
+        // Returns the smallest chunk capacity that can be used with native
+        // code for the specified index. Native code cannot flush a full
+        // buffer, so it is flushed between slices, and each chunk must hold
+        // every document in a slice.
+        static size_t GetMinimumChunkCapacity(ISimpleIndex const & index);
+
         void Reset()
         {
             m_size = 0;
+            m_flushedCount = 0;
         }
 
         void push_back(Slice* slice, size_t index)
         {
-            // TODO: add overflow check
+            if (m_size == m_capacity)
+            {
+                Flush();
+                if (m_size == m_capacity)
+                {
+                    // No consumer. Drop the match.
+                    return;
+                }
+            }
+
             m_buffer[m_size].m_slice = slice;
             m_buffer[m_size].m_index = index;
             m_size++;
         }
 
+        // Hands the buffered results to the consumer and empties the buffer.
+        // Does nothing if there is no consumer.
+        void Flush();
+
+        bool HasConsumer() const
+        {
+            return m_consumer != nullptr;
+        }
+
+        // Returns the number of results added since the last Reset(),
+        // including those that have been flushed.
+        size_t GetMatchCount() const
+        {
+            return m_flushedCount + m_size;
+        }
+
         class const_iterator
             : public std::iterator<std::input_iterator_tag, Result>
         {
@@ -131,10 +199,17 @@ namespace BitFunnel
             return m_size;
         }
 
+        size_t capacity() const
+        {
+            return m_capacity;
+        }
+
         std::unique_ptr<Result[]> m_bufferOwner;
         size_t m_capacity;
         size_t m_size;
         Result * m_buffer;
+        IConsumer * m_consumer;
+        size_t m_flushedCount;
     };
     static_assert(std::is_standard_layout<ResultsBuffer>::value,
                   "Generated code requires standard layout for ResultsBuffer.");
@@ -66,11 +66,15 @@ namespace BitFunnel
         // Allocate one entry for each shard.
         m_rows = new (allocator.Allocate(sizeof(ptrdiff_t) * m_planRows.GetShardCount()))
                       ptrdiff_t*;
+        m_summaries = new (allocator.Allocate(sizeof(ptrdiff_t) * m_planRows.GetShardCount()))
+                           ptrdiff_t*;
         // For each shard, allocate an array of Row.
         for (ShardId shard = 0; shard < m_planRows.GetShardCount(); ++shard)
         {
             m_rows[shard] = reinterpret_cast<ptrdiff_t*>(allocator.Allocate(sizeof(ptrdiff_t)
                                                                             * m_planRows.GetRowCount()));
+            m_summaries[shard] = reinterpret_cast<ptrdiff_t*>(allocator.Allocate(sizeof(ptrdiff_t)
+                                                                                 * m_planRows.GetRowCount()));
 
         }
     }
@@ -78,14 +82,25 @@ namespace BitFunnel
 
     void RowSet::LoadRows()
     {
-        // For each shard, allocate an array of Row.
+        std::vector<ShardId> shards;
         for (ShardId shardId = 0; shardId < m_planRows.GetShardCount(); ++shardId)
+        {
+            shards.push_back(shardId);
+        }
+        LoadRows(shards);
+    }
+
+
+    void RowSet::LoadRows(std::vector<ShardId> const & shards)
+    {
+        for (auto shardId : shards)
         {
             IShard const & shard = m_index.GetIngestor().GetShard(shardId);
             for (unsigned i = 0; i < m_planRows.GetRowCount(); ++i)
             {
                 const RowId rowId = m_planRows.PhysicalRow(shardId, i);
                 m_rows[shardId][i] = shard.GetRowOffset(rowId);
+                m_summaries[shardId][i] = shard.GetRowSummaryOffset(rowId);
             }
         }
     }
@@ -107,4 +122,10 @@ namespace BitFunnel
     {
         return m_rows[shard];
     }
+
+
+    ptrdiff_t const * RowSet::GetRowSummaryOffsets(ShardId shard) const
+    {
+        return m_summaries[shard];
+    }
 }
@@ -23,6 +23,8 @@
 
 #pragma once
 
+#include <vector>                   // std::vector parameter.
+
 #include "BitFunnel/NonCopyable.h"  // Base class.
 #include "IRowSet.h"                // Base class.
 
@@ -45,9 +47,14 @@ namespace BitFunnel
         //
         // In the current implementation, non-DDR rows are not supported
         virtual void LoadRows() override;
+
+        // Loads the rows for the specified shards only. Row offsets for the
+        // other shards are left uninitialized.
+        void LoadRows(std::vector<ShardId> const & shards);
         virtual ShardId GetShardCount() const override;
         virtual unsigned GetRowCount() const override;
         virtual ptrdiff_t const * GetRowOffsets(ShardId shard) const override;
+        virtual ptrdiff_t const * GetRowSummaryOffsets(ShardId shard) const override;
 
     private:
         //
@@ -59,5 +66,6 @@ namespace BitFunnel
         // IAllocator& m_allocator;
 
         ptrdiff_t ** m_rows;
+        ptrdiff_t ** m_summaries;
     };
 }
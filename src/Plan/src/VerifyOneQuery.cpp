@@ -57,7 +57,7 @@ namespace BitFunnel
         auto tree = parser.Parse();
 
         // TODO: Can MatchVerifier take a char const *? Does it need a copy?
-        std::unique_ptr<IMatchVerifier> verifier(new MatchVerifier(query));
+        std::unique_ptr<MatchVerifier> verifier(new MatchVerifier(query));
 
         if (tree == nullptr)
         {
@@ -98,7 +98,9 @@ namespace BitFunnel
 
             QueryInstrumentation instrumentation;
 
-            ResultsBuffer results(index.GetIngestor().GetDocumentCount());
+            // Observed matches are streamed to the verifier in chunks.
+            ResultsBuffer results(ResultsBuffer::GetMinimumChunkCapacity(index),
+                                  *verifier);
 
             Factories::RunQueryPlanner(*tree,
                                        index,
@@ -108,12 +110,6 @@ namespace BitFunnel
                                        results,
                                        compilerMode);
 
-            for (auto result : results)
-            {
-                DocumentHandle handle = Factories::CreateDocumentHandle(result.m_slice, result.m_index);
-                verifier->AddObserved(handle.GetDocId());
-            }
-
             verifier->Verify();
             //verifier->Print(std::cout);
         }
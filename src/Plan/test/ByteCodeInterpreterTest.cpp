@@ -22,6 +22,7 @@
 
 #include <iomanip>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -743,4 +744,242 @@ namespace BitFunnel
 
         verifier.Verify(text);
     }
+
+
+    //*************************************************************************
+    //
+    // Interleaved test cases
+    //
+    //*************************************************************************
+    TEST(ByteCodeInterpreter, InterleavedAndRowJzDelta1)
+    {
+        ShardId c_numShards = 1;
+
+        char const * text =
+            "RankDown {"
+            "  Delta: 1,"
+            "  Child: LoadRowJz {"
+            "    Row: Row(0, 0, 0, false),"
+            "    Child: AndRowJz {"
+            "      Row: Row(1, 0, 1, true),"
+            "      Child: Report {"
+            "        Child: "
+            "      }"
+            "    }"
+            "  }"
+            "}";
+
+        const Rank initialRank = 1;
+
+        // Try lane counts smaller than, equal to, and larger than the
+        // number of iterations.
+        for (size_t laneCount = 2; laneCount <= 32; laneCount *= 2)
+        {
+            ByteCodeVerifier verifier(GetIndex(c_numShards),
+                                      initialRank,
+                                      laneCount);
+
+            verifier.DeclareRow("3");
+            verifier.DeclareRow("5");
+
+            for (auto iteration : verifier.GetIterations())
+            {
+                const size_t slice = verifier.GetSliceNumber(iteration);
+                const size_t offset = verifier.GetOffset(iteration);
+
+                for (size_t i = 0; i < 2; ++i)
+                {
+                    const uint64_t row0 = verifier.GetRowData(0, offset * 2 + i, slice);
+                    const uint64_t row1 = verifier.GetRowData(1, offset, slice);
+                    verifier.ExpectResult(row0 & ~row1, offset * 2 + i, slice);
+                }
+            }
+
+            verifier.Verify(text);
+        }
+    }
+
+
+    TEST(ByteCodeInterpreter, InterleavedOrMatches)
+    {
+        ShardId c_numShards = 1;
+
+        char const * text =
+            "Or {"
+            "  Children: ["
+            "    LoadRowJz {"
+            "      Row: Row(0, 0, 0, false),"
+            "      Child: Report {"
+            "        Child: "
+            "      }"
+            "    },"
+            "    LoadRowJz {"
+            "      Row: Row(1, 0, 0, false),"
+            "      Child: Report {"
+            "        Child: "
+            "      }"
+            "    }"
+            "  ]"
+            "}";
+
+        const Rank initialRank = 0;
+        const size_t laneCount = 4;
+        ByteCodeVerifier verifier(GetIndex(c_numShards), initialRank, laneCount);
+
+        verifier.DeclareRow("3");
+        verifier.DeclareRow("5");
+
+        for (auto iteration : verifier.GetIterations())
+        {
+            const size_t slice = verifier.GetSliceNumber(iteration);
+            const size_t offset = verifier.GetOffset(iteration);
+
+            const uint64_t row0 = verifier.GetRowData(0, offset, slice);
+            const uint64_t row1 = verifier.GetRowData(1, offset, slice);
+            verifier.ExpectResult(row0, offset, slice);
+            verifier.ExpectResult(row1, offset, slice);
+        }
+
+        verifier.Verify(text);
+    }
+
+
+    // The diagnostic policy must find the same matches as the production
+    // policy used by the other tests.
+    TEST(ByteCodeInterpreter, DiagnosticOrMatches)
+    {
+        ShardId c_numShards = 1;
+
+        char const * text =
+            "Or {"
+            "  Children: ["
+            "    LoadRowJz {"
+            "      Row: Row(0, 0, 0, false),"
+            "      Child: Report {"
+            "        Child: "
+            "      }"
+            "    },"
+            "    LoadRowJz {"
+            "      Row: Row(1, 0, 0, false),"
+            "      Child: Report {"
+            "        Child: "
+            "      }"
+            "    }"
+            "  ]"
+            "}";
+
+        const Rank initialRank = 0;
+        ByteCodeVerifier verifier(GetIndex(c_numShards), initialRank);
+        verifier.EnableDiagnostics();
+
+        verifier.DeclareRow("3");
+        verifier.DeclareRow("5");
+
+        for (auto iteration : verifier.GetIterations())
+        {
+            const size_t slice = verifier.GetSliceNumber(iteration);
+            const size_t offset = verifier.GetOffset(iteration);
+
+            const uint64_t row0 = verifier.GetRowData(0, offset, slice);
+            const uint64_t row1 = verifier.GetRowData(1, offset, slice);
+            verifier.ExpectResult(row0, offset, slice);
+            verifier.ExpectResult(row1, offset, slice);
+        }
+
+        verifier.Verify(text);
+
+        EXPECT_NE(std::string::npos,
+                  verifier.GetDiagnostics().find("Opcode: LoadRow"));
+    }
+
+
+    //*************************************************************************
+    //
+    // Sparse test cases
+    //
+    //*************************************************************************
+    TEST(ByteCodeInterpreter, SparseAndRowJzDelta0)
+    {
+        ShardId c_numShards = 1;
+
+        char const * text =
+            "LoadRowJz {"
+            "  Row: Row(0, 0, 0, false),"
+            "  Child: AndRowJz {"
+            "    Row: Row(1, 0, 0, false),"
+            "    Child: Report {"
+            "      Child: "
+            "    }"
+            "  }"
+            "}";
+
+        const Rank initialRank = 0;
+
+        // Drive from either row.
+        for (size_t driver = 0; driver < 2; ++driver)
+        {
+            ByteCodeVerifier verifier(GetIndex(c_numShards), initialRank);
+
+            verifier.DeclareRow("31");
+            verifier.DeclareRow("2");
+            verifier.EnableSparseMatching(driver, 0);
+
+            for (auto iteration : verifier.GetIterations())
+            {
+                const size_t slice = verifier.GetSliceNumber(iteration);
+                const size_t offset = verifier.GetOffset(iteration);
+
+                const uint64_t row0 = verifier.GetRowData(0, offset, slice);
+                const uint64_t row1 = verifier.GetRowData(1, offset, slice);
+                verifier.ExpectResult(row0 & row1, offset, slice);
+            }
+
+            verifier.Verify(text);
+        }
+    }
+
+
+    TEST(ByteCodeInterpreter, SparseBelowInitialRank)
+    {
+        ShardId c_numShards = 1;
+
+        char const * text =
+            "RankDown {"
+            "  Delta: 1,"
+            "  Child: LoadRowJz {"
+            "    Row: Row(0, 0, 0, false),"
+            "    Child: AndRowJz {"
+            "      Row: Row(1, 0, 1, true),"
+            "      Child: Report {"
+            "        Child: "
+            "      }"
+            "    }"
+            "  }"
+            "}";
+
+        const Rank initialRank = 1;
+        ByteCodeVerifier verifier(GetIndex(c_numShards), initialRank);
+
+        verifier.DeclareRow("3");
+        verifier.DeclareRow("5");
+
+        // Row 0 is stored at rank 0, below the initial rank, so each of its
+        // non-zero quadwords shares an iteration with its neighbor.
+        verifier.EnableSparseMatching(0, 0);
+
+        for (auto iteration : verifier.GetIterations())
+        {
+            const size_t slice = verifier.GetSliceNumber(iteration);
+            const size_t offset = verifier.GetOffset(iteration);
+
+            for (size_t i = 0; i < 2; ++i)
+            {
+                const uint64_t row0 = verifier.GetRowData(0, offset * 2 + i, slice);
+                const uint64_t row1 = verifier.GetRowData(1, offset, slice);
+                verifier.ExpectResult(row0 & ~row1, offset * 2 + i, slice);
+            }
+        }
+
+        verifier.Verify(text);
+    }
 }
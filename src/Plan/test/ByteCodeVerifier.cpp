@@ -45,12 +45,38 @@ namespace BitFunnel
 
 
     ByteCodeVerifier::ByteCodeVerifier(ISimpleIndex const & index,
-                                       Rank initialRank)
-      : CodeVerifierBase(index, initialRank)
+                                       Rank initialRank,
+                                       size_t laneCount)
+      : CodeVerifierBase(index, initialRank),
+        m_diagnostics(false),
+        m_laneCount(laneCount),
+        m_sparse(false),
+        m_sparseRow(0),
+        m_sparseRowRank(0)
     {
     }
 
 
+    void ByteCodeVerifier::EnableSparseMatching(size_t row, Rank rowRank)
+    {
+        m_sparse = true;
+        m_sparseRow = row;
+        m_sparseRowRank = rowRank;
+    }
+
+
+    void ByteCodeVerifier::EnableDiagnostics()
+    {
+        m_diagnostics = true;
+    }
+
+
+    std::string ByteCodeVerifier::GetDiagnostics() const
+    {
+        return m_diagnosticOutput.str();
+    }
+
+
     void ByteCodeVerifier::Verify(char const * codeText)
     {
         Allocator allocator(c_allocatorBufferSize);
@@ -66,6 +92,9 @@ namespace BitFunnel
 
         QueryInstrumentation instrumentation;
 
+        auto diagnosticStream = Factories::CreateDiagnosticStream(m_diagnosticOutput);
+        diagnosticStream->Enable("bytecode/opcode");
+
         ResultsBuffer results(m_index.GetIngestor().GetDocumentCount());
         ByteCodeInterpreter interpreter(
             code,
@@ -75,11 +104,23 @@ namespace BitFunnel
             GetIterationsPerSlice(),
             m_initialRank,
             m_rowOffsets.data(),
-            nullptr,
+            m_diagnostics ? diagnosticStream.get() : nullptr,
             instrumentation,
             nullptr);
 
-        interpreter.Run();
+        if (m_sparse)
+        {
+            interpreter.RunSparse(m_sparseRow, m_sparseRowRank);
+        }
+        else if (m_laneCount > 1)
+        {
+            std::vector<ByteCodeInterpreter::Lane> lanes;
+            interpreter.RunInterleaved(m_laneCount, lanes);
+        }
+        else
+        {
+            interpreter.Run();
+        }
 
         CheckResults(results);
     }
@@ -22,6 +22,9 @@
 
 #pragma once
 
+#include <sstream>                              // std::stringstream embedded.
+#include <string>                               // std::string return value.
+
 #include "BitFunnel/BitFunnelTypes.h"           // Rank parameter.
 #include "CodeVerifierBase.h"                   // Base class.
 
@@ -42,8 +45,32 @@ namespace BitFunnel
     class ByteCodeVerifier : public CodeVerifierBase
     {
     public:
-        ByteCodeVerifier(ISimpleIndex const & index, Rank initialRank);
+        // When laneCount is greater than one, Verify() runs the interpreter
+        // in interleaved mode with that many iterations in flight.
+        ByteCodeVerifier(ISimpleIndex const & index,
+                         Rank initialRank,
+                         size_t laneCount = 1);
+
+        // Configures Verify() to run the interpreter in sparse mode, driven
+        // by the declared row with the specified index. The row must be a
+        // conjunct of the entire plan.
+        void EnableSparseMatching(size_t row, Rank rowRank);
+
+        // Configures Verify() to enable the "bytecode/opcode" diagnostic,
+        // which runs the interpreter with its DiagnosticPolicy. The output
+        // is available from GetDiagnostics().
+        void EnableDiagnostics();
+
+        std::string GetDiagnostics() const;
 
         virtual void Verify(char const * codeText) override;
+
+    private:
+        bool m_diagnostics;
+        std::stringstream m_diagnosticOutput;
+        size_t m_laneCount;
+        bool m_sparse;
+        size_t m_sparseRow;
+        Rank m_sparseRowRank;
     };
 }
@@ -57,4 +57,39 @@ namespace BitFunnel
             }
         }
     }
+
+
+    TEST(CacheLineRecorder, Sampling)
+    {
+        const size_t c_samplePeriod = 4;
+        std::vector<uint64_t> slice(1024);
+
+        CacheLineRecorder recorder(slice.size() * sizeof(uint64_t),
+                                   c_samplePeriod);
+        EXPECT_EQ(c_samplePeriod, recorder.GetSamplePeriod());
+
+        size_t sampled = 0;
+        size_t estimate = 0;
+        for (size_t i = 0; i < 100; ++i)
+        {
+            if (recorder.SampleSlice())
+            {
+                ++sampled;
+                recorder.StartSlice(slice.data());
+                EXPECT_EQ(0u, recorder.GetCacheLinesAccessed());
+
+                // Touch three distinct cache lines, one of them twice.
+                recorder.RecordAccess(&slice[8]);
+                recorder.RecordAccess(&slice[9]);
+                recorder.RecordAccess(&slice[100]);
+                recorder.RecordAccess(&slice[1023]);
+                EXPECT_EQ(3u, recorder.GetCacheLinesAccessed());
+
+                estimate += recorder.FinishSlice();
+            }
+        }
+
+        EXPECT_EQ(100u / c_samplePeriod, sampled);
+        EXPECT_EQ(3u * 100u, estimate);
+    }
 }
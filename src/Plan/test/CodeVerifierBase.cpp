@@ -213,6 +213,8 @@ namespace BitFunnel
 
     void CodeVerifierBase::CheckResults(ResultsBuffer const & results)
     {
+        m_observed.clear();
+
         for (auto result : results)
         {
             DocumentHandle handle =
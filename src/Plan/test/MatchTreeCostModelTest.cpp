@@ -0,0 +1,174 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Utilities/Allocator.h"
+#include "MatchTreeCostModel.h"
+#include "RowMatchNode.h"
+#include "TextObjectParser.h"
+
+
+namespace BitFunnel
+{
+    namespace MatchTreeCostModelTest
+    {
+        static MatchTreeCostModel::Cost Estimate(char const * text,
+                                                 double const * densities)
+        {
+            std::stringstream input(text);
+            Allocator allocator(1024 * 4);
+            TextObjectParser parser(input, allocator, &RowPlanBase::GetType);
+            RowMatchNode const & root = RowMatchNode::Parse(parser);
+
+            MatchTreeCostModel model(densities);
+            return model.Estimate(root);
+        }
+
+
+        // A single rank 0 row is read at every position.
+        TEST(MatchTreeCostModel, SingleRow)
+        {
+            const double densities[] = { 0.5 };
+            auto cost = Estimate(
+                "And {"
+                "  Children: ["
+                "    Row(0, 0, 0, false),"
+                "    Report {"
+                "      Child:"
+                "    }"
+                "  ]"
+                "}",
+                densities);
+
+            EXPECT_DOUBLE_EQ(cost.m_quadwords, 1.0);
+            EXPECT_DOUBLE_EQ(cost.m_cacheLines, 1.0 / 8);
+            EXPECT_DOUBLE_EQ(cost.m_iterations, 1.0);
+        }
+
+
+        // Evaluating a sparse row first avoids reading the second row at
+        // positions where the first row is zero.
+        TEST(MatchTreeCostModel, SparseRowFirst)
+        {
+            const double densities[] = { 0.001, 0.5 };
+            auto sparseFirst = Estimate(
+                "And {"
+                "  Children: ["
+                "    Row(0, 0, 0, false),"
+                "    Row(1, 0, 0, false),"
+                "    Report {"
+                "      Child:"
+                "    }"
+                "  ]"
+                "}",
+                densities);
+
+            auto denseFirst = Estimate(
+                "And {"
+                "  Children: ["
+                "    Row(1, 0, 0, false),"
+                "    Row(0, 0, 0, false),"
+                "    Report {"
+                "      Child:"
+                "    }"
+                "  ]"
+                "}",
+                densities);
+
+            EXPECT_LT(sparseFirst.m_quadwords, denseFirst.m_quadwords);
+            EXPECT_LT(sparseFirst.GetTotal(), denseFirst.GetTotal());
+        }
+
+
+        // A row evaluated at a higher rank covers more documents per
+        // quadword.
+        TEST(MatchTreeCostModel, HigherRank)
+        {
+            auto rank0 = Estimate(
+                "And {"
+                "  Children: ["
+                "    Row(0, 0, 0, false),"
+                "    Report {"
+                "      Child:"
+                "    }"
+                "  ]"
+                "}",
+                nullptr);
+
+            auto rank3 = Estimate(
+                "And {"
+                "  Children: ["
+                "    Row(0, 3, 0, false),"
+                "    Report {"
+                "      Child:"
+                "    }"
+                "  ]"
+                "}",
+                nullptr);
+
+            EXPECT_DOUBLE_EQ(rank3.m_quadwords, rank0.m_quadwords / 8);
+        }
+
+
+        // Sparse matching pays off when the driver row is rare, but not when
+        // most of its quadwords are non-zero.
+        TEST(MatchTreeCostModel, Sparse)
+        {
+            char const * text =
+                "And {"
+                "  Children: ["
+                "    Row(0, 0, 0, false),"
+                "    Row(1, 0, 0, false),"
+                "    Report {"
+                "      Child:"
+                "    }"
+                "  ]"
+                "}";
+
+            const double densities[] = { 0.0001, 0.5 };
+
+            std::stringstream input(text);
+            Allocator allocator(1024 * 4);
+            TextObjectParser parser(input, allocator, &RowPlanBase::GetType);
+            RowMatchNode const & root = RowMatchNode::Parse(parser);
+            RowMatchNode::And const & andNode =
+                dynamic_cast<RowMatchNode::And const &>(root);
+            AbstractRow const & rare =
+                dynamic_cast<RowMatchNode::Row const &>(andNode.GetLeft()).GetRow();
+            RowMatchNode::And const & rest =
+                dynamic_cast<RowMatchNode::And const &>(andNode.GetRight());
+            AbstractRow const & common =
+                dynamic_cast<RowMatchNode::Row const &>(rest.GetLeft()).GetRow();
+
+            MatchTreeCostModel model(densities);
+            auto dense = model.Estimate(root);
+
+            EXPECT_LT(model.EstimateSparse(root, rare, 0).GetTotal(),
+                      dense.GetTotal());
+            EXPECT_GT(model.EstimateSparse(root, common, 0).GetTotal(),
+                      dense.GetTotal());
+        }
+    }
+}
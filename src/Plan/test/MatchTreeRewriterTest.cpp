@@ -1012,5 +1012,54 @@ namespace BitFunnel
                 VerifyCase(c_rewriteCases[i]);
             }
         }
+
+
+        // Rows of the same rank should be ordered from sparsest to densest
+        // when row densities are supplied. Without densities, rows of the
+        // same rank appear in the reverse of their input order.
+        TEST(MatchTreeRewriter, DensityOrder)
+        {
+            char const * inputText =
+                "And {"
+                "  Children: ["
+                "    Row(0, 0, 0, false),"
+                "    Row(1, 0, 0, false),"
+                "    Row(2, 3, 0, false),"
+                "    Row(3, 3, 0, false)"
+                "  ]"
+                "}";
+
+            char const * expected =
+                "And {"
+                "  Children: ["
+                "    Row(2, 3, 0, false),"
+                "    Row(3, 3, 0, false),"
+                "    Row(0, 0, 0, false),"
+                "    Row(1, 0, 0, false),"
+                "    Report {"
+                "      Child:"
+                "    }"
+                "  ]"
+                "}";
+
+            const double densities[] = { 0.1, 0.5, 0.05, 0.4 };
+
+            std::stringstream input(inputText);
+            Allocator allocator(1024*4);
+            TextObjectParser parser(input, allocator, &RowPlanBase::GetType);
+            RowMatchNode const & root = RowMatchNode::Parse(parser);
+
+            RowMatchNode const & converted = MatchTreeRewriter::Rewrite(root,
+                                                                        4,
+                                                                        0,
+                                                                        allocator,
+                                                                        densities);
+
+            std::stringstream output;
+            TextObjectFormatter formatter(output);
+            converted.Format(formatter);
+
+            EXPECT_TRUE(SameExceptForWhitespace(output.str().c_str(), expected));
+        }
     }
 }
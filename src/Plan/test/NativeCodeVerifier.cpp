@@ -70,12 +70,43 @@ namespace BitFunnel
                                     7,
                                     allocator);
 
+        // Rows that are not held in registers are only exercised when no
+        // registers are available.
+        RegisterAllocator noRegisters(compileNodeTree,
+                                      8,
+                                      8,
+                                      0,
+                                      allocator);
+
+        // Verify the generic code, and code specialized for the shard's row
+        // offsets, both with and without rows held in registers.
+        Verify(compileNodeTree, registers, false);
+        Verify(compileNodeTree, registers, true);
+        Verify(compileNodeTree, noRegisters, true);
+
+        // Verify both kinds of prefetch.
+        Verify(compileNodeTree, registers, false, 1, false);
+        Verify(compileNodeTree, registers, true, 4, true);
+        Verify(compileNodeTree, noRegisters, false, 2, true);
+    }
+
+
+    void NativeCodeVerifier::Verify(CompileNode const & compileNodeTree,
+                                    RegisterAllocator const & registers,
+                                    bool specializeForShard,
+                                    size_t prefetchDistance,
+                                    bool nonTemporalPrefetch)
+    {
         QueryResources resources;
+        resources.SetPrefetchDistance(prefetchDistance);
+        resources.EnableNonTemporalPrefetch(nonTemporalPrefetch);
 
         MatchTreeCompiler compiler(resources,
                                    compileNodeTree,
                                    registers,
-                                   m_initialRank);
+                                   m_initialRank,
+                                   specializeForShard ? m_rowOffsets.data() : nullptr,
+                                   GetIterationsPerSlice());
 
         ResultsBuffer results(m_index.GetIngestor().GetDocumentCount());
 
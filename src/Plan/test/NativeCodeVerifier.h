@@ -28,8 +28,10 @@
 
 namespace BitFunnel
 {
+    class CompileNode;
     class IShard;
     class ISimpleIndex;
+    class RegisterAllocator;
 
     //*************************************************************************
     //
@@ -44,5 +46,14 @@ namespace BitFunnel
         NativeCodeVerifier(ISimpleIndex const & index, Rank initialRank);
 
         virtual void Verify(char const * codeText) override;
+
+    private:
+        // The loop tuning parameters correspond to the QueryResources
+        // methods of the same names.
+        void Verify(CompileNode const & compileNodeTree,
+                    RegisterAllocator const & registers,
+                    bool specializeForShard,
+                    size_t prefetchDistance = 0,
+                    bool nonTemporalPrefetch = false);
     };
 }
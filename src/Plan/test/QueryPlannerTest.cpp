@@ -0,0 +1,804 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Configuration/Factories.h"
+#include "BitFunnel/Configuration/IFileSystem.h"
+#include "BitFunnel/Configuration/IStreamConfiguration.h"
+#include "BitFunnel/IDiagnosticStream.h"
+#include "BitFunnel/Index/DocumentHandle.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IIngestor.h"
+#include "BitFunnel/Index/IRowDensityTable.h"
+#include "BitFunnel/Index/IShard.h"
+#include "BitFunnel/Index/ISimpleIndex.h"
+#include "BitFunnel/Mocks/Factories.h"
+#include "BitFunnel/Plan/Factories.h"
+#include "BitFunnel/Plan/QueryInstrumentation.h"
+#include "BitFunnel/Plan/QueryParser.h"
+#include "BitFunnel/Utilities/Factories.h"
+#include "QueryResources.h"
+#include "ResultsBuffer.h"
+
+
+namespace BitFunnel
+{
+    namespace QueryPlannerTest
+    {
+        static const Term::StreamId c_streamId = 0;
+        static const DocId c_maxDocId = 1664;
+
+
+        // Runs a query with the specified resources and returns its
+        // instrumentation data. The bytecode interpreter is used unless
+        // useNativeCode is true. If diagnostic is not nullptr, it is
+        // enabled and written to diagnostics.
+        static QueryInstrumentation::Data RunQuery(ISimpleIndex const & index,
+                                                   char const * query,
+                                                   QueryResources & resources,
+                                                   bool useNativeCode = false,
+                                                   std::ostream & diagnostics = std::cout,
+                                                   char const * diagnostic = nullptr)
+        {
+            resources.Reset();
+            auto streamConfiguration = Factories::CreateStreamConfiguration();
+            QueryParser parser(query,
+                               *streamConfiguration,
+                               resources.GetMatchTreeAllocator());
+            auto tree = parser.Parse();
+
+            auto diagnosticStream = Factories::CreateDiagnosticStream(diagnostics);
+            if (diagnostic != nullptr)
+            {
+                diagnosticStream->Enable(diagnostic);
+            }
+            QueryInstrumentation instrumentation;
+
+            // Count mode must never write to the ResultsBuffer.
+            ResultsBuffer results(resources.IsCountModeEnabled() ?
+                                  0 :
+                                  index.GetIngestor().GetDocumentCount());
+
+            Factories::RunQueryPlanner(*tree,
+                                       index,
+                                       resources,
+                                       *diagnosticStream,
+                                       instrumentation,
+                                       results,
+                                       useNativeCode);
+
+            return instrumentation.GetData();
+        }
+
+
+        // Records the DocIds of the results it consumes, and the number of
+        // times it was called.
+        class DocIdConsumer : public ResultsBuffer::IConsumer
+        {
+        public:
+            DocIdConsumer()
+              : m_callCount(0)
+            {
+            }
+
+            virtual void Consume(ResultsBuffer::Result const * results,
+                                 size_t count) override
+            {
+                ++m_callCount;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    m_ids.push_back(results[i].GetHandle().GetDocId());
+                }
+            }
+
+            std::vector<DocId> m_ids;
+            size_t m_callCount;
+        };
+
+
+        // Runs a query, streaming its results through a ResultsBuffer with
+        // the specified capacity, and returns the sorted DocIds.
+        static std::vector<DocId> RunChunkedQuery(ISimpleIndex const & index,
+                                                  char const * query,
+                                                  size_t capacity,
+                                                  bool useNativeCode,
+                                                  size_t & callCount)
+        {
+            QueryResources resources;
+            auto streamConfiguration = Factories::CreateStreamConfiguration();
+            QueryParser parser(query,
+                               *streamConfiguration,
+                               resources.GetMatchTreeAllocator());
+            auto tree = parser.Parse();
+
+            auto diagnosticStream = Factories::CreateDiagnosticStream(std::cout);
+            QueryInstrumentation instrumentation;
+
+            DocIdConsumer consumer;
+            ResultsBuffer results(capacity, consumer);
+
+            Factories::RunQueryPlanner(*tree,
+                                       index,
+                                       resources,
+                                       *diagnosticStream,
+                                       instrumentation,
+                                       results,
+                                       useNativeCode);
+
+            EXPECT_EQ(0u, results.size());
+            EXPECT_EQ(instrumentation.GetData().GetMatchCount(),
+                      consumer.m_ids.size());
+
+            callCount = consumer.m_callCount;
+            std::sort(consumer.m_ids.begin(), consumer.m_ids.end());
+            return consumer.m_ids;
+        }
+
+
+        // With row densities available, the planner should evaluate the row
+        // for "997" before the row for "2", regardless of the order of terms
+        // in the query, and should scan fewer quadwords than at least one of
+        // the structural orderings.
+        TEST(QueryPlanner, DensityOrdering)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            1);
+
+            // Sparse matching would scan the row for "997" instead, and row
+            // summaries would skip the slices where it is empty.
+            QueryResources resources;
+            resources.SetMatchingStrategy(QueryResources::MatchingStrategy::Dense);
+            resources.EnableRowSummaries(false);
+
+            auto before1 = RunQuery(*index, "997 2", resources);
+            auto before2 = RunQuery(*index, "2 997", resources);
+
+            index->SetRowDensityTable(Factories::CreateRowDensityTable(*index));
+
+            auto after1 = RunQuery(*index, "997 2", resources);
+            auto after2 = RunQuery(*index, "2 997", resources);
+
+            // Reordering must not change the results.
+            EXPECT_EQ(before1.GetMatchCount(), after1.GetMatchCount());
+            EXPECT_EQ(before2.GetMatchCount(), after2.GetMatchCount());
+
+            EXPECT_EQ(after1.GetQuadwordCount(), after2.GetQuadwordCount());
+            EXPECT_LE(after1.GetQuadwordCount(), before1.GetQuadwordCount());
+            EXPECT_LE(after2.GetQuadwordCount(), before2.GetQuadwordCount());
+            EXPECT_LT(after1.GetQuadwordCount(),
+                      (std::max)(before1.GetQuadwordCount(),
+                                 before2.GetQuadwordCount()));
+        }
+
+
+        // Code compiled separately for each shard must find the same matches
+        // as code compiled once for all shards, without reading more rows.
+        TEST(QueryPlanner, ShardSpecialization)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "3 5 7",
+                "2 -3",
+                "5 (7|11)",
+                "(2|3) (5|7)"
+            };
+
+            QueryResources genericResources;
+            QueryResources specializedResources;
+            specializedResources.EnableShardSpecialization(true);
+
+            for (auto query : queries)
+            {
+                auto generic = RunQuery(*index, query, genericResources, true);
+                auto specialized = RunQuery(*index, query, specializedResources, true);
+
+                EXPECT_EQ(generic.GetMatchCount(), specialized.GetMatchCount())
+                    << query;
+                EXPECT_LE(specialized.GetQuadwordCount(),
+                          generic.GetQuadwordCount())
+                    << query;
+            }
+        }
+
+
+        // Sparse matching must find the same matches as dense matching. The
+        // planner should only choose it when the query has a rare row.
+        TEST(QueryPlanner, SparseMatching)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+            index->SetRowDensityTable(Factories::CreateRowDensityTable(*index));
+
+            QueryResources dense;
+            dense.SetMatchingStrategy(QueryResources::MatchingStrategy::Dense);
+            QueryResources sparse;
+            sparse.SetMatchingStrategy(QueryResources::MatchingStrategy::Sparse);
+            QueryResources automatic;
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "997 2",
+                "2 997",
+                "997 -2",
+                "3 (5|7)",
+                "(2|3) (5|7)"
+            };
+
+            for (auto query : queries)
+            {
+                auto denseData = RunQuery(*index, query, dense);
+                auto sparseData = RunQuery(*index, query, sparse);
+
+                EXPECT_EQ(denseData.GetMatchCount(), sparseData.GetMatchCount())
+                    << query;
+            }
+
+            // A rare term is matched sparsely, touching fewer quadwords than
+            // dense matching with the rare row first.
+            auto rare = RunQuery(*index, "997 2", automatic);
+            EXPECT_EQ(rare.GetQuadwordCount(),
+                      RunQuery(*index, "997 2", sparse).GetQuadwordCount());
+
+            // A common term is matched densely.
+            auto common = RunQuery(*index, "2 3", automatic);
+            EXPECT_EQ(common.GetQuadwordCount(),
+                      RunQuery(*index, "2 3", dense).GetQuadwordCount());
+        }
+
+
+        // Skipping slices and blocks with empty row summaries must not
+        // change the matches, and should reduce the work for a rare term.
+        TEST(QueryPlanner, RowSummaries)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+
+            QueryResources withSummaries;
+            withSummaries.SetMatchingStrategy(QueryResources::MatchingStrategy::Dense);
+            QueryResources withoutSummaries;
+            withoutSummaries.SetMatchingStrategy(QueryResources::MatchingStrategy::Dense);
+            withoutSummaries.EnableRowSummaries(false);
+            QueryResources interleaved;
+            interleaved.SetMatchingStrategy(QueryResources::MatchingStrategy::Dense);
+            interleaved.EnableInterleavedMatching(4);
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "997 2",
+                "1 -2",
+                "3 (5|7)",
+                "(2|3) (5|7)"
+            };
+
+            for (auto useNativeCode : { false, true })
+            {
+                for (auto query : queries)
+                {
+                    auto skipped = RunQuery(*index, query, withSummaries, useNativeCode);
+                    auto full = RunQuery(*index, query, withoutSummaries, useNativeCode);
+
+                    EXPECT_EQ(full.GetMatchCount(), skipped.GetMatchCount())
+                        << query;
+                    EXPECT_LE(skipped.GetQuadwordCount(), full.GetQuadwordCount())
+                        << query;
+                }
+            }
+
+            // Interleaved lanes skip the same iterations as Run().
+            for (auto query : queries)
+            {
+                auto sequential = RunQuery(*index, query, withSummaries);
+                auto lanes = RunQuery(*index, query, interleaved);
+
+                EXPECT_EQ(sequential.GetMatchCount(), lanes.GetMatchCount())
+                    << query;
+                EXPECT_EQ(sequential.GetQuadwordCount(), lanes.GetQuadwordCount())
+                    << query;
+            }
+
+            EXPECT_LT(RunQuery(*index, "997 2", withSummaries).GetQuadwordCount(),
+                      RunQuery(*index, "997 2", withoutSummaries).GetQuadwordCount());
+        }
+
+
+        // Shards that have no document containing a required term are
+        // skipped without changing the matches. All PrimeFactors documents
+        // are short, so the second shard is empty.
+        TEST(QueryPlanner, ShardPruning)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+
+            QueryResources pruned;
+            QueryResources unpruned;
+            unpruned.EnableShardPruning(false);
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "997 -2",
+                "5 (7|11)",
+                "(2|3) (5|7)"
+            };
+
+            for (auto useNativeCode : { false, true })
+            {
+                for (auto query : queries)
+                {
+                    EXPECT_EQ(RunQuery(*index, query, unpruned, useNativeCode).GetMatchCount(),
+                              RunQuery(*index, query, pruned, useNativeCode).GetMatchCount())
+                        << query;
+                }
+            }
+
+            {
+                std::stringstream diagnostics;
+                RunQuery(*index, "2 3", pruned, false, diagnostics, "planning/shards");
+                EXPECT_NE(std::string::npos,
+                          diagnostics.str().find("Shards matched: 1 of 2"));
+            }
+
+            {
+                // Without a required unigram, every shard is matched.
+                std::stringstream diagnostics;
+                RunQuery(*index, "2|3", pruned, false, diagnostics, "planning/shards");
+                EXPECT_NE(std::string::npos,
+                          diagnostics.str().find("Shards matched: 2 of 2"));
+            }
+        }
+
+
+        // Counting matches must agree with materializing them, for every
+        // way the planner can run a query.
+        TEST(QueryPlanner, CountMode)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+            index->SetRowDensityTable(Factories::CreateRowDensityTable(*index));
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "997 2",
+                "997 -2",
+                "5 (7|11)",
+                "(2|3) (5|7)"
+            };
+
+            QueryResources materialized;
+            QueryResources counted;
+            counted.EnableCountMode(true);
+
+            QueryResources sparse;
+            sparse.SetMatchingStrategy(QueryResources::MatchingStrategy::Sparse);
+            sparse.EnableCountMode(true);
+
+            QueryResources interleaved;
+            interleaved.SetMatchingStrategy(QueryResources::MatchingStrategy::Dense);
+            interleaved.EnableInterleavedMatching(4);
+            interleaved.EnableCountMode(true);
+
+            QueryResources specialized;
+            specialized.EnableShardSpecialization(true);
+            specialized.EnableCountMode(true);
+
+            for (auto query : queries)
+            {
+                auto expected = RunQuery(*index, query, materialized).GetMatchCount();
+
+                EXPECT_EQ(expected,
+                          RunQuery(*index, query, counted).GetMatchCount())
+                    << query;
+                EXPECT_EQ(expected,
+                          RunQuery(*index, query, sparse).GetMatchCount())
+                    << query;
+                EXPECT_EQ(expected,
+                          RunQuery(*index, query, interleaved).GetMatchCount())
+                    << query;
+                EXPECT_EQ(RunQuery(*index, query, materialized, true).GetMatchCount(),
+                          RunQuery(*index, query, counted, true).GetMatchCount())
+                    << query;
+                EXPECT_EQ(RunQuery(*index, query, materialized, true).GetMatchCount(),
+                          RunQuery(*index, query, specialized, true).GetMatchCount())
+                    << query;
+            }
+
+            EXPECT_EQ(c_maxDocId / 2,
+                      RunQuery(*index, "2", counted, true).GetMatchCount());
+        }
+
+
+        // Queries matched by a PrecompiledKernel must find the same matches
+        // as native code, and trees of other shapes must fall back to it.
+        TEST(QueryPlanner, PrecompiledKernels)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "997 -2",
+                "2 3 5 7",
+                "-2 -3 -5",
+                "2 3 5 7 11",
+                "5 (7|11)",
+                "(2|3) (5|7)"
+            };
+
+            QueryResources jit;
+            jit.EnablePrecompiledKernels(false);
+            QueryResources jitCounted;
+            jitCounted.EnablePrecompiledKernels(false);
+            jitCounted.EnableCountMode(true);
+
+            QueryResources kernels;
+            QueryResources counted;
+            counted.EnableCountMode(true);
+            QueryResources specialized;
+            specialized.EnableShardSpecialization(true);
+
+            for (auto query : queries)
+            {
+                auto expected = RunQuery(*index, query, jit, true).GetMatchCount();
+
+                EXPECT_EQ(expected,
+                          RunQuery(*index, query, kernels, true).GetMatchCount())
+                    << query;
+                EXPECT_EQ(expected,
+                          RunQuery(*index, query, counted, true).GetMatchCount())
+                    << query;
+                EXPECT_EQ(expected,
+                          RunQuery(*index, query, specialized, true).GetMatchCount())
+                    << query;
+                EXPECT_EQ(expected,
+                          RunQuery(*index, query, jitCounted, true).GetMatchCount())
+                    << query;
+            }
+
+            {
+                std::stringstream diagnostics;
+                RunQuery(*index, "2 3", kernels, true, diagnostics, "planning/kernel");
+                EXPECT_NE(std::string::npos,
+                          diagnostics.str().find("Kernel: precompiled, 7 rows"));
+            }
+
+            {
+                std::stringstream diagnostics;
+                RunQuery(*index, "(2|3) (5|7)", kernels, true, diagnostics, "planning/kernel");
+                EXPECT_NE(std::string::npos,
+                          diagnostics.str().find("Kernel: native code"));
+            }
+
+            {
+                std::stringstream diagnostics;
+                RunQuery(*index, "2 3", jit, true, diagnostics, "planning/kernel");
+                EXPECT_NE(std::string::npos,
+                          diagnostics.str().find("Kernel: native code"));
+            }
+        }
+
+
+        // Runs a query whose CancellationToken was cancelled before the
+        // QueryPlanner was constructed, and returns its instrumentation data.
+        static QueryInstrumentation::Data RunCancelledQuery(ISimpleIndex const & index,
+                                                            char const * query,
+                                                            QueryResources & resources,
+                                                            bool useNativeCode)
+        {
+            resources.Reset();
+            resources.GetCancellationToken().Cancel();
+
+            auto streamConfiguration = Factories::CreateStreamConfiguration();
+            QueryParser parser(query,
+                               *streamConfiguration,
+                               resources.GetMatchTreeAllocator());
+            auto tree = parser.Parse();
+
+            auto diagnosticStream = Factories::CreateDiagnosticStream(std::cout);
+            QueryInstrumentation instrumentation;
+            ResultsBuffer results(index.GetIngestor().GetDocumentCount());
+
+            Factories::RunQueryPlanner(*tree,
+                                       index,
+                                       resources,
+                                       *diagnosticStream,
+                                       instrumentation,
+                                       results,
+                                       useNativeCode);
+
+            return instrumentation.GetData();
+        }
+
+
+        // A query that runs past its deadline or is cancelled must stop
+        // before matching any slices and report that it was truncated. A
+        // query that finishes within its deadline must not.
+        TEST(QueryPlanner, Cancellation)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "(2|3) (5|7)"
+            };
+
+            std::vector<std::unique_ptr<QueryResources>> configurations;
+            for (size_t i = 0; i < 6; ++i)
+            {
+                configurations.emplace_back(new QueryResources());
+            }
+            configurations[1]->EnablePrecompiledKernels(false);
+            configurations[2]->EnableCountMode(true);
+            configurations[3]->EnableShardSpecialization(true);
+            configurations[4]->EnableInterleavedMatching(4);
+            configurations[5]->SetMatchingStrategy(
+                QueryResources::MatchingStrategy::Sparse);
+
+            for (auto query : queries)
+            {
+                QueryResources baseline;
+                auto expected = RunQuery(*index, query, baseline).GetMatchCount();
+                ASSERT_GT(expected, 0u) << query;
+
+                for (auto & resources : configurations)
+                {
+                    for (auto useNativeCode : { false, true })
+                    {
+                        resources->SetDeadline(60.0);
+                        auto data = RunQuery(*index, query, *resources, useNativeCode);
+                        EXPECT_EQ(expected, data.GetMatchCount()) << query;
+                        EXPECT_FALSE(data.IsTruncated()) << query;
+
+                        // The deadline passes during planning.
+                        resources->SetDeadline(1e-12);
+                        data = RunQuery(*index, query, *resources, useNativeCode);
+                        EXPECT_EQ(0u, data.GetMatchCount()) << query;
+                        EXPECT_TRUE(data.IsTruncated()) << query;
+
+                        // Without a deadline, native code polls the token's
+                        // flag directly.
+                        resources->SetDeadline(0.0);
+                        data = RunCancelledQuery(*index, query, *resources, useNativeCode);
+                        EXPECT_EQ(0u, data.GetMatchCount()) << query;
+                        EXPECT_TRUE(data.IsTruncated()) << query;
+
+                        // Reset() clears the cancellation.
+                        data = RunQuery(*index, query, *resources, useNativeCode);
+                        EXPECT_EQ(expected, data.GetMatchCount()) << query;
+                        EXPECT_FALSE(data.IsTruncated()) << query;
+                    }
+                }
+            }
+        }
+
+
+        // Sampling every slice must match the interpreter's exact count, for
+        // native code and shard-specialized native code alike. With a prime
+        // sample period larger than the number of slices, P consecutive runs
+        // sample each slice exactly once, so their estimates must sum to P
+        // times the exact count. A truncated query makes no estimate.
+        TEST(QueryPlanner, SampledCacheLines)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+
+            const size_t samplePeriod = 101;
+            size_t sliceCount = 0;
+            for (ShardId shard = 0;
+                 shard < index->GetIngestor().GetShardCount();
+                 ++shard)
+            {
+                sliceCount +=
+                    index->GetIngestor().GetShard(shard).GetSliceBuffers().size();
+            }
+            ASSERT_GT(samplePeriod, sliceCount);
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "(2|3) (5|7)"
+            };
+
+            for (auto query : queries)
+            {
+                QueryResources interpreter;
+                interpreter.EnableCacheLineCounting(*index, 1);
+                const size_t exact =
+                    RunQuery(*index, query, interpreter).GetCacheLineCount();
+                ASSERT_GT(exact, 0u) << query;
+
+                for (auto specialize : { false, true })
+                {
+                    QueryResources every;
+                    every.EnableShardSpecialization(specialize);
+                    every.EnableCacheLineCounting(*index, 1);
+                    EXPECT_EQ(exact,
+                              RunQuery(*index, query, every, true).GetCacheLineCount())
+                        << query << (specialize ? ", specialized" : "");
+
+                    QueryResources sampled;
+                    sampled.EnableShardSpecialization(specialize);
+                    sampled.EnableCacheLineCounting(*index, samplePeriod);
+                    size_t total = 0;
+                    for (size_t i = 0; i < samplePeriod; ++i)
+                    {
+                        total += RunQuery(*index, query, sampled, true).GetCacheLineCount();
+                    }
+                    EXPECT_EQ(samplePeriod * exact, total)
+                        << query << (specialize ? ", specialized" : "");
+
+                    sampled.SetDeadline(1e-12);
+                    auto truncated = RunQuery(*index, query, sampled, true);
+                    EXPECT_TRUE(truncated.IsTruncated()) << query;
+                    EXPECT_EQ(0u, truncated.GetCacheLineCount()) << query;
+                }
+            }
+        }
+
+
+        // Every combination of prefetch distance and prefetch hint must
+        // produce the same matches as the default inner loop. This only
+        // checks correctness. Use the REPL's "query loops" command to time
+        // them.
+        TEST(QueryPlanner, LoopOptions)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "997 -2",
+                "(2|3) (5|7)"
+            };
+
+            for (auto query : queries)
+            {
+                QueryResources baseline;
+                baseline.EnablePrecompiledKernels(false);
+                auto expected =
+                    RunQuery(*index, query, baseline, true).GetMatchCount();
+
+                for (auto distance : { 0u, 16u })
+                {
+                    for (auto nonTemporal : { false, true })
+                    {
+                        if (distance == 0 && nonTemporal)
+                        {
+                            continue;
+                        }
+
+                        QueryResources resources;
+                        resources.EnablePrecompiledKernels(false);
+                        resources.SetPrefetchDistance(distance);
+                        resources.EnableNonTemporalPrefetch(nonTemporal);
+
+                        EXPECT_EQ(expected,
+                                  RunQuery(*index, query, resources, true).GetMatchCount())
+                            << query
+                            << ", distance " << distance
+                            << (nonTemporal ? ", nta" : ", t0");
+                    }
+                }
+            }
+        }
+
+
+        // Streaming results through a small chunked buffer must produce the
+        // same matches as a buffer large enough for every document.
+        TEST(QueryPlanner, ChunkedResults)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            c_maxDocId,
+                                                            c_streamId,
+                                                            2);
+
+            const size_t chunkCapacity =
+                ResultsBuffer::GetMinimumChunkCapacity(*index);
+            const size_t documentCount = index->GetIngestor().GetDocumentCount();
+            ASSERT_LT(chunkCapacity, documentCount);
+
+            char const * queries[] = {
+                "2",
+                "2 3",
+                "997 -2",
+                "(2|3) (5|7)"
+            };
+
+            for (auto useNativeCode : { false, true })
+            {
+                for (auto query : queries)
+                {
+                    size_t chunkedCalls = 0;
+                    size_t fullCalls = 0;
+                    auto chunked = RunChunkedQuery(*index,
+                                                   query,
+                                                   chunkCapacity,
+                                                   useNativeCode,
+                                                   chunkedCalls);
+                    auto full = RunChunkedQuery(*index,
+                                                query,
+                                                documentCount,
+                                                useNativeCode,
+                                                fullCalls);
+
+                    EXPECT_EQ(full, chunked) << query;
+                    EXPECT_LE(fullCalls, 1u) << query;
+                }
+            }
+
+            // Half of the documents match "2", which takes several chunks.
+            size_t callCount = 0;
+            RunChunkedQuery(*index, "2", chunkCapacity, true, callCount);
+            EXPECT_GT(callCount, 1u);
+            RunChunkedQuery(*index, "2", chunkCapacity, false, callCount);
+            EXPECT_GT(callCount, 1u);
+        }
+    }
+}
@@ -0,0 +1,323 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Configuration/Factories.h"
+#include "BitFunnel/Configuration/IFileSystem.h"
+#include "BitFunnel/Exceptions.h"
+#include "BitFunnel/IFileManager.h"
+#include "BitFunnel/Index/ISimpleIndex.h"
+#include "BitFunnel/Mocks/Factories.h"
+#include "BitFunnel/Plan/QueryInstrumentation.h"
+#include "BitFunnel/Plan/QueryRunner.h"
+#include "BitFunnel/Utilities/HardwareCounters.h"
+#include "CsvTsv/Csv.h"
+
+
+namespace BitFunnel
+{
+    namespace QueryRunnerTest
+    {
+        // Returns the named column of the QueryPipelineStatistics file that
+        // QueryRunner::Run() wrote to the root of fileSystem.
+        static std::vector<std::string> ReadColumn(IFileSystem & fileSystem,
+                                                   char const * name)
+        {
+            auto fileManager =
+                Factories::CreateFileManager("", "", "", fileSystem);
+            auto input = fileManager->QueryPipelineStatistics().OpenForRead();
+
+            std::vector<std::vector<std::string>> rows;
+            std::string line;
+            while (std::getline(*input, line))
+            {
+                std::stringstream fields(line);
+                std::vector<std::string> row;
+                std::string field;
+                while (std::getline(fields, field, ','))
+                {
+                    row.push_back(field);
+                }
+                rows.push_back(row);
+            }
+
+            std::vector<std::string> column;
+            if (rows.empty())
+            {
+                return column;
+            }
+
+            auto const & header = rows[0];
+            const size_t index =
+                std::find(header.begin(), header.end(), name) - header.begin();
+            EXPECT_LT(index, header.size()) << name;
+            for (size_t i = 1; i < rows.size() && index < header.size(); ++i)
+            {
+                column.push_back(rows[i][index]);
+            }
+            return column;
+        }
+
+
+        // Runs queries through the QueryScheduler on several threads and
+        // checks that every admitted query is processed exactly once.
+        TEST(QueryRunner, Scheduler)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            1664,
+                                                            0,
+                                                            2);
+
+            std::vector<std::string> queries = { "2", "2 3", "5 (7|11)" };
+            const size_t iterations = 10;
+
+            QueryRunner::SchedulerOptions options;
+            options.m_queueCapacity = 2;
+            options.m_priorities = { 0, 1, 1 };
+
+            for (auto useNativeCode : { false, true })
+            {
+                auto statistics = QueryRunner::Run(*index,
+                                                   "",
+                                                   3,
+                                                   queries,
+                                                   iterations,
+                                                   useNativeCode,
+                                                   0,
+                                                   false,
+                                                   options);
+
+                std::stringstream output;
+                statistics.Print(output);
+                EXPECT_NE(std::string::npos,
+                          output.str().find("Queries processed: 30\n"))
+                    << output.str();
+                EXPECT_NE(std::string::npos,
+                          output.str().find("Queries rejected: 0\n"));
+                EXPECT_NE(std::string::npos,
+                          output.str().find("Queries shed: 0\n"));
+            }
+
+            auto data = QueryRunner::Run("2 3", *index, true, 0);
+            EXPECT_GT(data.GetMatchCount(), 0u);
+
+            // Hardware counters, if available, must not change the results.
+            // If they are unavailable, asking for them must fail.
+            HardwareCounters counters;
+            if (counters.Open())
+            {
+                auto counted = QueryRunner::Run("2 3", *index, true, 0, true);
+                EXPECT_EQ(data.GetMatchCount(), counted.GetMatchCount());
+            }
+            else
+            {
+                EXPECT_THROW(QueryRunner::Run("2 3", *index, true, 0, true),
+                             RecoverableError);
+            }
+        }
+
+
+        // Without an arrival schedule, each query is submitted when a thread
+        // is free to run it, so no query waits behind a backlog of queries
+        // submitted before it. Were every query submitted at the start, the
+        // last one would wait for all of the others to run.
+        TEST(QueryRunner, ClosedLoopQueueTime)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            1664,
+                                                            0,
+                                                            2);
+
+            std::vector<std::string> queries = { "2", "2 3", "5 (7|11)" };
+            const size_t iterations = 1000;
+
+            QueryRunner::Run(*index, "", 1, queries, iterations, false, 0);
+
+            auto queue = ReadColumn(*fileSystem, "queue");
+            auto parse = ReadColumn(*fileSystem, "parse");
+            auto plan = ReadColumn(*fileSystem, "plan");
+            auto match = ReadColumn(*fileSystem, "match");
+            ASSERT_EQ(queries.size() * iterations, queue.size());
+
+            double maxQueueTime = 0;
+            double totalRunTime = 0;
+            for (size_t i = 0; i < queue.size(); ++i)
+            {
+                maxQueueTime = (std::max)(maxQueueTime, std::stod(queue[i]));
+                totalRunTime += std::stod(parse[i]) +
+                                std::stod(plan[i]) +
+                                std::stod(match[i]);
+            }
+            EXPECT_LT(maxQueueTime, totalRunTime / 2);
+        }
+
+
+        // A query that runs past the deadline in SchedulerOptions is cut off
+        // and reported as truncated, in both the statistics and the
+        // per-query rows.
+        TEST(QueryRunner, Deadline)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            1664,
+                                                            0,
+                                                            2);
+
+            std::vector<std::string> queries = { "2", "2 3", "5 (7|11)" };
+            const size_t iterations = 10;
+
+            for (auto useNativeCode : { false, true })
+            {
+                // The short deadline passes during planning.
+                for (auto deadline : { 1e-12, 60.0 })
+                {
+                    const bool truncated = (deadline < 1.0);
+
+                    QueryRunner::SchedulerOptions options;
+                    options.m_deadline = deadline;
+                    auto statistics = QueryRunner::Run(*index,
+                                                       "",
+                                                       2,
+                                                       queries,
+                                                       iterations,
+                                                       useNativeCode,
+                                                       0,
+                                                       false,
+                                                       options);
+
+                    std::stringstream output;
+                    statistics.Print(output);
+                    EXPECT_NE(std::string::npos,
+                              output.str().find(truncated ?
+                                                "Queries truncated: 30\n" :
+                                                "Queries truncated: 0\n"))
+                        << output.str();
+                    EXPECT_EQ(truncated,
+                              output.str().find("Match count: 0\n") != std::string::npos);
+                    EXPECT_EQ(std::vector<std::string>(30, truncated ? "TRUE" : "FALSE"),
+                              ReadColumn(*fileSystem, "truncated"));
+                }
+            }
+        }
+
+
+        // The scripts in src/Scripts expect exactly these columns unless
+        // hardware counters are enabled.
+        TEST(QueryRunner, PipelineStatisticsColumns)
+        {
+            std::stringstream plain;
+            {
+                CsvTsv::CsvTableFormatter formatter(plain);
+                QueryInstrumentation::Data::FormatHeader(formatter);
+            }
+            EXPECT_EQ("rows,matches,quadwords,cachelines,queue,parse,plan,match,truncated\n",
+                      plain.str());
+
+            std::stringstream counted;
+            {
+                CsvTsv::CsvTableFormatter formatter(counted);
+                QueryInstrumentation::Data::FormatHeader(formatter, true);
+            }
+            EXPECT_EQ(0u, counted.str().find(plain.str().substr(0, plain.str().size() - 1)));
+            EXPECT_NE(std::string::npos,
+                      counted.str().find(",match_llcmisses,match_dtlbmisses\n"));
+        }
+
+
+        // Native code estimates cache lines by interpreting the sampled
+        // slices, so with every slice sampled it should agree with the
+        // interpreter.
+        TEST(QueryRunner, CacheLines)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            1664,
+                                                            0,
+                                                            2);
+
+            auto interpreted = QueryRunner::Run("2 3 5", *index, false, 1);
+            auto native = QueryRunner::Run("2 3 5", *index, true, 1);
+            EXPECT_GT(interpreted.GetCacheLineCount(), 0u);
+            EXPECT_EQ(interpreted.GetCacheLineCount(),
+                      native.GetCacheLineCount());
+            EXPECT_EQ(interpreted.GetMatchCount(), native.GetMatchCount());
+
+            auto uncounted = QueryRunner::Run("2 3 5", *index, true, 0);
+            EXPECT_EQ(0u, uncounted.GetCacheLineCount());
+        }
+
+
+        // Submits queries on an open-loop schedule, both from a Poisson
+        // process and from recorded arrival times, and checks that every
+        // query is reflected in the latency percentiles.
+        TEST(QueryRunner, OpenLoop)
+        {
+            auto fileSystem = Factories::CreateRAMFileSystem();
+            auto index = Factories::CreatePrimeFactorsIndex(*fileSystem,
+                                                            1664,
+                                                            0,
+                                                            2);
+
+            std::vector<std::string> queries = { "2", "2 3", "5 (7|11)" };
+            const size_t iterations = 10;
+
+            QueryRunner::SchedulerOptions poisson;
+            poisson.m_arrivalRate = 10000.0;
+            poisson.m_poissonArrivals = true;
+            poisson.m_seed = 1234;
+
+            QueryRunner::SchedulerOptions recorded;
+            recorded.m_arrivalTimes = { 10.0, 10.001, 10.001 };
+
+            for (auto const & options : { poisson, recorded })
+            {
+                auto statistics = QueryRunner::Run(*index,
+                                                   "",
+                                                   2,
+                                                   queries,
+                                                   iterations,
+                                                   false,
+                                                   0,
+                                                   false,
+                                                   options);
+
+                std::stringstream output;
+                statistics.Print(output);
+                EXPECT_NE(std::string::npos,
+                          output.str().find("Queries processed: 30\n"))
+                    << output.str();
+                EXPECT_NE(std::string::npos,
+                          output.str().find("Latency p99.9: "));
+                EXPECT_EQ(std::string::npos,
+                          output.str().find("Latency p50: 0\n"));
+            }
+        }
+    }
+}
@@ -0,0 +1,189 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "QueryScheduler.h"
+
+
+namespace BitFunnel
+{
+    namespace QuerySchedulerTest
+    {
+        // Dequeues every query from a scheduler that has been shut down.
+        static std::vector<size_t> Drain(QueryScheduler & scheduler)
+        {
+            std::vector<size_t> ids;
+            size_t id;
+            double queueTime;
+            while (scheduler.TryDequeue(id, queueTime))
+            {
+                EXPECT_GE(queueTime, 0.0);
+                ids.push_back(id);
+            }
+            return ids;
+        }
+
+
+        TEST(QueryScheduler, PriorityOrder)
+        {
+            QueryScheduler scheduler(0, 3, 0.0);
+            EXPECT_TRUE(scheduler.TryEnqueue(0, 2));
+            EXPECT_TRUE(scheduler.TryEnqueue(1, 0));
+            EXPECT_TRUE(scheduler.TryEnqueue(2, 1));
+            EXPECT_TRUE(scheduler.TryEnqueue(3, 0));
+            EXPECT_TRUE(scheduler.TryEnqueue(4, 2));
+            scheduler.Shutdown();
+
+            // Highest priority first, and first in first out within a class.
+            std::vector<size_t> expected = { 1, 3, 2, 0, 4 };
+            EXPECT_EQ(expected, Drain(scheduler));
+            EXPECT_EQ(0u, scheduler.GetRejectedCount());
+            EXPECT_EQ(0u, scheduler.GetShedCount());
+
+            EXPECT_FALSE(scheduler.TryEnqueue(5, 0));
+            EXPECT_EQ(1u, scheduler.GetRejectedCount());
+        }
+
+
+        TEST(QueryScheduler, Admission)
+        {
+            QueryScheduler scheduler(2, 2, 0.0);
+            EXPECT_TRUE(scheduler.TryEnqueue(0, 1));
+            EXPECT_TRUE(scheduler.TryEnqueue(1, 1));
+
+            // The queue is full of queries that are at least as important.
+            EXPECT_FALSE(scheduler.TryEnqueue(2, 1));
+
+            // A more important query displaces the newest less important one.
+            EXPECT_TRUE(scheduler.TryEnqueue(3, 0));
+            EXPECT_TRUE(scheduler.TryEnqueue(4, 0));
+            EXPECT_FALSE(scheduler.TryEnqueue(5, 0));
+            scheduler.Shutdown();
+
+            std::vector<size_t> expected = { 3, 4 };
+            EXPECT_EQ(expected, Drain(scheduler));
+            EXPECT_EQ(4u, scheduler.GetRejectedCount());
+        }
+
+
+        TEST(QueryScheduler, Shedding)
+        {
+            const double targetDelay = 0.001;
+            QueryScheduler scheduler(0, 2, targetDelay);
+            EXPECT_TRUE(scheduler.TryEnqueue(0, 1));
+            EXPECT_TRUE(scheduler.TryEnqueue(1, 0));
+            EXPECT_TRUE(scheduler.TryEnqueue(2, 1));
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+            // Query 3 has not exceeded the target.
+            EXPECT_TRUE(scheduler.TryEnqueue(3, 1));
+            scheduler.Shutdown();
+
+            size_t id;
+            double queueTime;
+            ASSERT_TRUE(scheduler.TryDequeue(id, queueTime));
+            EXPECT_EQ(1u, id);
+            EXPECT_GT(queueTime, targetDelay);
+
+            // Queries 0 and 2 waited too long.
+            ASSERT_TRUE(scheduler.TryDequeue(id, queueTime));
+            EXPECT_EQ(3u, id);
+            EXPECT_FALSE(scheduler.TryDequeue(id, queueTime));
+            EXPECT_EQ(2u, scheduler.GetShedCount());
+        }
+
+
+        TEST(QueryScheduler, InFlightLimit)
+        {
+            QueryScheduler scheduler(0, 1, 0.0, 1);
+            EXPECT_TRUE(scheduler.Enqueue(0, 0));
+
+            size_t id;
+            double queueTime;
+            ASSERT_TRUE(scheduler.TryDequeue(id, queueTime));
+            EXPECT_EQ(0u, id);
+
+            // Query 0 is still running, so Enqueue() waits for Finish().
+            std::atomic<bool> finished(false);
+            std::thread thread([&scheduler, &finished]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                finished = true;
+                scheduler.Finish();
+            });
+            EXPECT_TRUE(scheduler.Enqueue(1, 0));
+            EXPECT_TRUE(finished);
+            thread.join();
+
+            ASSERT_TRUE(scheduler.TryDequeue(id, queueTime));
+            EXPECT_EQ(1u, id);
+            scheduler.Finish();
+            scheduler.Shutdown();
+            EXPECT_FALSE(scheduler.TryDequeue(id, queueTime));
+        }
+
+
+        TEST(QueryScheduler, Threads)
+        {
+            const size_t queryCount = 1000;
+            const size_t threadCount = 4;
+
+            QueryScheduler scheduler(8, 2, 0.0);
+            std::vector<std::vector<size_t>> ids(threadCount);
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < threadCount; ++i)
+            {
+                threads.emplace_back([&scheduler, &ids, i]() {
+                    ids[i] = Drain(scheduler);
+                });
+            }
+
+            // Enqueue() blocks while the queue is full, so nothing is lost.
+            for (size_t id = 0; id < queryCount; ++id)
+            {
+                EXPECT_TRUE(scheduler.Enqueue(id, id % 2));
+            }
+            scheduler.Shutdown();
+            for (auto & thread : threads)
+            {
+                thread.join();
+            }
+
+            std::vector<bool> seen(queryCount, false);
+            for (auto const & threadIds : ids)
+            {
+                for (auto id : threadIds)
+                {
+                    EXPECT_FALSE(seen[id]);
+                    seen[id] = true;
+                }
+            }
+            EXPECT_EQ(std::vector<bool>(queryCount, true), seen);
+            EXPECT_EQ(0u, scheduler.GetRejectedCount());
+        }
+    }
+}
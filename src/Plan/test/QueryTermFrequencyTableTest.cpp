@@ -0,0 +1,83 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "BitFunnel/Configuration/IStreamConfiguration.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IConfiguration.h"
+#include "BitFunnel/Index/IDocumentFrequencyTable.h"
+#include "BitFunnel/Index/IFactSet.h"
+#include "BitFunnel/Index/IIndexedIdfTable.h"
+#include "BitFunnel/Plan/Factories.h"
+#include "BitFunnel/Plan/QueryParser.h"
+
+
+namespace BitFunnel
+{
+    TEST(QueryTermFrequencyTable, Basic)
+    {
+        auto idfTable = Factories::CreateIndexedIdfTable();
+        auto facts = Factories::CreateFactSet();
+        auto configuration =
+            Factories::CreateConfiguration(2, false, *idfTable, *facts);
+
+        std::vector<std::string> queries = {
+            "a b",
+            "a a",
+            "\"a b\"",
+            "-c"
+        };
+
+        auto table =
+            Factories::CreateQueryTermFrequencyTable(*configuration, queries);
+
+        std::unordered_map<Term::Hash, double> frequencies;
+        for (auto const & entry : *table)
+        {
+            frequencies[entry.GetTerm().GetRawHash()] = entry.GetFrequency();
+        }
+
+        Term a("a", 0, *configuration);
+        Term b("b", 0, *configuration);
+        Term c("c", 0, *configuration);
+        Term ab(a);
+        ab.AddTerm(b, *configuration);
+
+        // Repeated terms count once per query, phrases contribute their
+        // words and their bigram, and negated terms are counted.
+        EXPECT_EQ(4u, frequencies.size());
+        EXPECT_EQ(0.75, frequencies[a.GetRawHash()]);
+        EXPECT_EQ(0.5, frequencies[b.GetRawHash()]);
+        EXPECT_EQ(0.25, frequencies[ab.GetRawHash()]);
+        EXPECT_EQ(0.25, frequencies[c.GetRawHash()]);
+
+        std::vector<std::string> invalid = { "(a" };
+        EXPECT_THROW(
+            Factories::CreateQueryTermFrequencyTable(*configuration, invalid),
+            QueryParser::ParseError);
+    }
+}
@@ -38,9 +38,11 @@ with open(querypipeline_filename) as f:
                          'matches',
                          'quadwords',
                          'cachelines',
+                         'queue',
                          'parse',
                          'plan',
-                         'match']
+                         'match',
+                         'truncated']
     outf = open(output_filename, 'w', newline='')
     writer = csv.writer(outf)
     writer.writerow(['Query',
@@ -11,16 +11,19 @@ with open("/tmp/QueryPipelineStatistics.csv") as f:
                       'matches',
                       'quadwords',
                       'cachelines',
+                      'queue',
                       'parse',
                       'plan',
-                      'match']
+                      'match',
+                      'truncated']
+    column = header.index('match')
     normal_sum  = 0
     phrase_sum = 0
     for row in reader:
         if row[0][0] == '"':
-            phrase_sum += float(row[7])
+            phrase_sum += float(row[column])
         else:
-            normal_sum += float(row[7])
+            normal_sum += float(row[column])
 
     print("normal query time", normal_sum)
     print("phrase query time", phrase_sum)
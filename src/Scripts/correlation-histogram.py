@@ -13,16 +13,31 @@ def bf_correlate_to_dicts(term_term_correlation,
     filename = basepath + "-" + treatment + ".csv"
     with open(filename) as f:
         reader = csv.reader(f)
-        for row in reader:
-            term_all = 0
-            pos = 0
-            for item in row:
-                if pos > 0 and pos % 2 == 0:
-                    correlation = int(item)
-                    term_all += correlation
-                    term_term_correlation[treatment][correlation] += 1
-                pos += 1
-            term_all_correlation[treatment][term_all] += 1
+        rows = list(reader)
+    if len(rows) > 0 and rows[0] == ["term", "partner", "rows"]:
+        # Output of "correlate <terms> top <count>": one pair per line.
+        # Per-term totals only cover the pairs that made the top list.
+        term_all = defaultdict(int)
+        for term, partner, item in rows[1:]:
+            correlation = int(item)
+            term_term_correlation[treatment][correlation] += 1
+            term_all[term] += correlation
+            term_all[partner] += correlation
+        for total in term_all.values():
+            term_all_correlation[treatment][total] += 1
+        return
+    # One line per term: the term, then partner,rows for each partner that
+    # shares more than one row. Pairs sharing a single row are not listed.
+    for row in rows:
+        term_all = 0
+        pos = 0
+        for item in row:
+            if pos > 0 and pos % 2 == 0:
+                correlation = int(item)
+                term_all += correlation
+                term_term_correlation[treatment][correlation] += 1
+            pos += 1
+        term_all_correlation[treatment][term_all] += 1
 
 def dict_to_csv(dd, filename):
     with open(filename, 'w') as f:
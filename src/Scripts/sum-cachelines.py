@@ -8,10 +8,13 @@ with open("/tmp/int/QueryPipelineStatistics.csv") as f:
                       'matches',
                       'quadwords',
                       'cachelines',
+                      'queue',
                       'parse',
                       'plan',
-                      'match']
+                      'match',
+                      'truncated']
+    column = header.index('cachelines')
     sum = 0
     for row in reader:
-        sum += int(row[3])
+        sum += int(row[column])
     print(sum)
@@ -1,8 +1,20 @@
-# Note that this is not a valid measurement of tail latency. This uses the execution times we measure because they're convenient, but this does not include queueing time inside BitFunnel nor does it include head-of-line blocking queue waiting time on the queue into BitFunnel.
+# Note that this is not a valid measurement of tail latency. This uses the execution times we measure because they're convenient, but this does not include head-of-line blocking queue waiting time on the queue into BitFunnel.
+#
+# Time spent in QueryRunner's admission queue is only meaningful when queries
+# arrived open loop (the rate or arrivals options of "query log"), so it is
+# only included when the --open-loop flag is given. Closed-loop runs submit
+# each query when a thread is free, and their queue times are just the
+# hand-off to that thread.
+#
+# Usage: tail-latency.py [--open-loop] [QueryPipelineStatistics.csv]
 
 import csv
+import sys
 
-filename = "/tmp/QueryPipelineStatistics.csv"
+args = sys.argv[1:]
+open_loop = "--open-loop" in args
+args = [arg for arg in args if arg != "--open-loop"]
+filename = args[0] if args else "/tmp/QueryPipelineStatistics.csv"
 
 times = []
 
@@ -14,11 +26,17 @@ with open(filename) as f:
                       'matches',
                       'quadwords',
                       'cachelines',
+                      'queue',
                       'parse',
                       'plan',
-                      'match']
+                      'match',
+                      'truncated']
+    names = ['parse', 'plan', 'match']
+    if open_loop:
+        names.append('queue')
+    columns = [header.index(name) for name in names]
     for row in reader:
-        total_time = float(row[-1]) + float(row[-2]) + float(row[-3])
+        total_time = sum(float(row[column]) for column in columns)
         times.append(total_time)
 
 times.sort(reverse=True)
@@ -51,7 +51,8 @@ namespace BitFunnel
             << "output directory";
 
         Factories::AnalyzeRowTables(GetEnvironment().GetSimpleIndex(),
-                                    GetEnvironment().GetOutputDir().c_str());
+                                    GetEnvironment().GetOutputDir().c_str(),
+                                    GetEnvironment().GetThreadCount());
     }
 
 
@@ -32,6 +32,7 @@
 #include "ShardBuilder.h"
 #include "StatisticsBuilder.h"
 #include "TermTableBuilderTool.h"
+#include "TreatmentTuner.h"
 
 
 namespace BitFunnel
@@ -113,6 +114,10 @@ namespace BitFunnel
         {
             executable.reset(new TermTableBuilderTool(m_fileSystem));
         }
+        else if (strcmp(name, "tune") == 0)
+        {
+            executable.reset(new TreatmentTuner(m_fileSystem));
+        }
 
         return executable;
     }
@@ -151,6 +156,7 @@ namespace BitFunnel
             << "   shard          Compute shard definition based on histogram." << std::endl
             << "   statistics     Generate corpus statistics used to configure the index." << std::endl
             << "   termtable      Construct a term table based on generated corpus statistics." << std::endl
+            << "   tune           Choose term table configurations by measuring query cost." << std::endl
             << "   repl           Run interative read-eval-print console." << std::endl
             << std::endl
             << "See 'bitfunnel <command> -help' to read about a specific command." << std::endl
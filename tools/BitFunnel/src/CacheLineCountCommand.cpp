@@ -22,8 +22,10 @@
 
 #include <iostream>
 
+#include "BitFunnel/Exceptions.h"
 #include "CacheLineCountCommand.h"
 #include "Environment.h"
+#include "TaskFactory.h"
 
 
 namespace BitFunnel
@@ -35,21 +37,48 @@ namespace BitFunnel
     //*************************************************************************
     CacheLineCountCommand::CacheLineCountCommand(Environment & environment,
                                                  Id id,
-                                                 char const * /*parameters*/)
-        : TaskBase(environment, id, Type::Synchronous)
+                                                 char const * parameters)
+        : TaskBase(environment, id, Type::Synchronous),
+          m_samplePeriod(0)
     {
+        auto token = TaskFactory::GetNextToken(parameters);
+        if (token.size() > 0)
+        {
+            m_samplePeriod = stoull(token);
+            if (m_samplePeriod == 0)
+            {
+                RecoverableError error("cachelines: sample period must be at least 1.");
+                throw error;
+            }
+        }
     }
 
 
     void CacheLineCountCommand::Execute()
     {
         auto & env = GetEnvironment();
-        env.SetCacheLineCountMode(!env.GetCacheLineCountMode());
+        if (m_samplePeriod > 0)
+        {
+            env.SetCacheLineSamplePeriod(m_samplePeriod);
+            env.SetCacheLineCountMode(true);
+        }
+        else
+        {
+            env.SetCacheLineCountMode(!env.GetCacheLineCountMode());
+        }
 
         if (env.GetCacheLineCountMode())
         {
             std::cout
-                << "Counting cache lines.";
+                << "Counting cache lines";
+            if (env.GetCacheLineSamplePeriod() > 1)
+            {
+                std::cout
+                    << " in one of every "
+                    << env.GetCacheLineSamplePeriod()
+                    << " slices";
+            }
+            std::cout << ".";
         }
         else
         {
@@ -67,8 +96,11 @@ namespace BitFunnel
         return Documentation(
             "cachelines",
             "Toggles counting of row cachelines accessed.",
-            "cachelines\n"
-            "  Toggles counting of row cachelines accessed during query processing."
+            "cachelines [period]\n"
+            "  Toggles counting of row cachelines accessed during query processing.\n"
+            "  With a period, enables counting in one of every period slices,\n"
+            "  scaled up to estimate the total, which is much cheaper than\n"
+            "  counting every slice."
         );
     }
 }
@@ -38,5 +38,8 @@ namespace BitFunnel
         static ICommand::Documentation GetDocumentation();
 
     private:
+        // Zero if the command toggles cache line counting without changing
+        // the sample period.
+        size_t m_samplePeriod;
     };
 }
@@ -24,6 +24,7 @@
 
 #include "BitFunnel/Configuration/Factories.h"
 #include "BitFunnel/Configuration/IFileSystem.h"
+#include "BitFunnel/Exceptions.h"
 #include "BitFunnel/Index/Factories.h"
 #include "BitFunnel/Utilities/ReadLines.h"
 #include "CorrelateCommand.h"
@@ -41,9 +42,31 @@ namespace BitFunnel
     Correlate::Correlate(Environment & environment,
                      Id id,
                      char const * parameters)
-        : TaskBase(environment, id, Type::Synchronous)
+        : TaskBase(environment, id, Type::Synchronous),
+          m_topPairCount(0)
     {
         std::string termsFilename = TaskFactory::GetNextToken(parameters);
+
+        auto token = TaskFactory::GetNextToken(parameters);
+        if (token.compare("top") == 0)
+        {
+            token = TaskFactory::GetNextToken(parameters);
+            if (token.size() > 0)
+            {
+                m_topPairCount = stoull(token);
+            }
+            if (m_topPairCount == 0)
+            {
+                RecoverableError error("correlate: top requires a pair count of at least 1.");
+                throw error;
+            }
+        }
+        else if (token.size() > 0)
+        {
+            RecoverableError error("correlate: expected \"top\" after the terms file.");
+            throw error;
+        }
+
         auto fileSystem = Factories::CreateFileSystem();  // TODO: Use environment file system
         m_terms = ReadLines(*fileSystem, termsFilename.c_str());
     }
@@ -59,7 +82,9 @@ namespace BitFunnel
 
         Factories::CreateCorrelate(GetEnvironment().GetSimpleIndex(),
                                    GetEnvironment().GetOutputDir().c_str(),
-                                   m_terms);
+                                   m_terms,
+                                   GetEnvironment().GetThreadCount(),
+                                   m_topPairCount);
     }
 
 
@@ -68,8 +93,13 @@ namespace BitFunnel
         return Documentation(
             "correlate",
             "Calculate RowTable correlations.",
-            "correlate\n"
-            "  Calculate RowTable correlations.\n"
+            "correlate <terms file> [top <count>]\n"
+            "  Writes, for each term in the file, the other terms that share\n"
+            "  more than one of its rows in each shard, in the order of the\n"
+            "  terms file. With top, writes a term,partner,rows header and then\n"
+            "  the <count> pairs that share the most rows in each shard.\n"
+            "  Shards are processed in parallel on 'threads' threads. The\n"
+            "  output does not depend on the number of threads.\n"
         );
     }
 
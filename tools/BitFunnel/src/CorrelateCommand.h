@@ -39,5 +39,8 @@ namespace BitFunnel
 
     private:
         std::vector<std::string> m_terms;
+
+        // When non-zero, only this many pairs are written per shard.
+        size_t m_topPairCount;
     };
 }
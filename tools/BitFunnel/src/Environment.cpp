@@ -30,6 +30,7 @@
 #include "Environment.h"
 #include "ExitCommand.h"
 #include "FailOnExceptionCommand.h"
+#include "HardwareCountersCommand.h"
 #include "HelpCommand.h"
 #include "IngestCommands.h"
 #include "InterpreterCommand.h"
@@ -60,8 +61,10 @@ namespace BitFunnel
         m_taskPool(new TaskPool(threadCount + 1)),
         m_index(Factories::CreateSimpleIndex(fileSystem)),
         m_cacheLineCountMode(false),
+        m_cacheLineSamplePeriod(1),
         m_compilerMode(true),
         m_failOnException(false),
+        m_hardwareCounterMode(false),
         m_threadCount(threadCount),
         m_memory(memory),
         m_directory(directory),
@@ -82,6 +85,7 @@ namespace BitFunnel
         m_taskFactory->RegisterCommand<Correlate>();
         m_taskFactory->RegisterCommand<Exit>();
         m_taskFactory->RegisterCommand<FailOnException>();
+        m_taskFactory->RegisterCommand<HardwareCountersCommand>();
         m_taskFactory->RegisterCommand<Help>();
         m_taskFactory->RegisterCommand<InterpreterCommand>();
         m_taskFactory->RegisterCommand<Load>();
@@ -127,6 +131,30 @@ namespace BitFunnel
     }
 
 
+    size_t Environment::GetCacheLineSamplePeriod() const
+    {
+        return m_cacheLineSamplePeriod;
+    }
+
+
+    void Environment::SetCacheLineSamplePeriod(size_t period)
+    {
+        m_cacheLineSamplePeriod = period;
+    }
+
+
+    bool Environment::GetHardwareCounterMode() const
+    {
+        return m_hardwareCounterMode;
+    }
+
+
+    void Environment::SetHardwareCounterMode(bool mode)
+    {
+        m_hardwareCounterMode = mode;
+    }
+
+
     bool Environment::GetFailOnException() const
     {
         return m_failOnException;
@@ -57,12 +57,18 @@ namespace BitFunnel
         bool GetCacheLineCountMode() const;
         void SetCacheLineCountMode(bool mode);
 
+        size_t GetCacheLineSamplePeriod() const;
+        void SetCacheLineSamplePeriod(size_t period);
+
         bool GetCompilerMode() const;
         void SetCompilerMode(bool mode);
 
         bool GetFailOnException() const;
         void SetFailOnException(bool mode);
 
+        bool GetHardwareCounterMode() const;
+        void SetHardwareCounterMode(bool mode);
+
         std::string const & GetOutputDir() const;
         void SetOutputDir(std::string dir);
 
@@ -90,8 +96,10 @@ namespace BitFunnel
         std::unique_ptr<ISimpleIndex> m_index;
 
         bool m_cacheLineCountMode;
+        size_t m_cacheLineSamplePeriod;
         bool m_compilerMode;
         bool m_failOnException;
+        bool m_hardwareCounterMode;
         size_t m_threadCount;
         size_t m_memory;
         std::string m_directory;
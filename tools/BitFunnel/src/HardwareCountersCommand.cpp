@@ -0,0 +1,90 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <iostream>
+
+#include "BitFunnel/Exceptions.h"
+#include "BitFunnel/Utilities/HardwareCounters.h"
+#include "Environment.h"
+#include "HardwareCountersCommand.h"
+
+
+namespace BitFunnel
+{
+    //*************************************************************************
+    //
+    // HardwareCountersCommand
+    //
+    //*************************************************************************
+    HardwareCountersCommand::HardwareCountersCommand(Environment & environment,
+                                                     Id id,
+                                                     char const * /*parameters*/)
+        : TaskBase(environment, id, Type::Synchronous)
+    {
+    }
+
+
+    void HardwareCountersCommand::Execute()
+    {
+        auto & env = GetEnvironment();
+        if (!env.GetHardwareCounterMode())
+        {
+            HardwareCounters counters;
+            if (!counters.Open())
+            {
+                RecoverableError error("counters: hardware counters are unavailable. "
+                                       "Check perf_event_paranoid.");
+                throw error;
+            }
+        }
+        env.SetHardwareCounterMode(!env.GetHardwareCounterMode());
+
+        if (env.GetHardwareCounterMode())
+        {
+            std::cout
+                << "Counting hardware events.";
+        }
+        else
+        {
+            std::cout
+                << "Hardware event counting disabled.";
+        }
+        std::cout
+            << std::endl
+            << std::endl;
+    }
+
+
+    ICommand::Documentation HardwareCountersCommand::GetDocumentation()
+    {
+        return Documentation(
+            "counters",
+            "Toggles counting of hardware events.",
+            "counters\n"
+            "  Toggles counting of instructions, cycles, branch misses,\n"
+            "  last level cache misses and dTLB misses in each phase of\n"
+            "  query processing, as extra columns of the query results.\n"
+            "  Requires Linux perf_event support; fails if no event is\n"
+            "  available, and reports individual unavailable events as zero."
+        );
+    }
+}
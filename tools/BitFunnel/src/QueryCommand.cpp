@@ -21,6 +21,7 @@
 // THE SOFTWARE.
 
 #include <iostream>
+#include <sstream>
 
 #include "BitFunnel/Configuration/Factories.h"
 #include "BitFunnel/Configuration/IFileSystem.h"
@@ -44,7 +45,10 @@ namespace BitFunnel
     Query::Query(Environment & environment,
                  Id id,
                  char const * parameters)
-        : TaskBase(environment, id, Type::Synchronous)
+        : TaskBase(environment, id, Type::Synchronous),
+          m_isComparison(false),
+          m_sweepLoopOptions(false),
+          m_repetitions(c_defaultRepetitions)
     {
         auto command = TaskFactory::GetNextToken(parameters);
         if (command.compare("one") == 0)
@@ -52,15 +56,99 @@ namespace BitFunnel
             m_isSingleQuery = true;
             m_query = parameters;
         }
+        else if (command.compare("compare") == 0 ||
+                 command.compare("loops") == 0)
+        {
+            m_isSingleQuery = false;
+            m_isComparison = true;
+            m_sweepLoopOptions = (command.compare("loops") == 0);
+            m_query = TaskFactory::GetNextToken(parameters);
+            auto repetitions = TaskFactory::GetNextToken(parameters);
+            if (repetitions.size() > 0)
+            {
+                m_repetitions = stoull(repetitions);
+                if (m_repetitions == 0)
+                {
+                    RecoverableError error("query: repetitions must be at least 1.");
+                    throw error;
+                }
+            }
+        }
         else
         {
             m_isSingleQuery = false;
             if (command.compare("log") != 0)
             {
-                std::cout << "expected log or one" << std::endl;
+                std::cout << "expected log, one, compare, or loops" << std::endl;
                 throw RecoverableError();
             }
             m_query = TaskFactory::GetNextToken(parameters);
+            ParseSchedulerOptions(parameters);
+        }
+    }
+
+
+    void Query::ParseSchedulerOptions(char const * parameters)
+    {
+        for (auto option = TaskFactory::GetNextToken(parameters);
+             option.size() > 0;
+             option = TaskFactory::GetNextToken(parameters))
+        {
+            auto value = TaskFactory::GetNextToken(parameters);
+            if (value.size() == 0)
+            {
+                std::stringstream message;
+                message << "query log: option \"" << option << "\" expects a value.";
+                RecoverableError error(message.str().c_str());
+                throw error;
+            }
+
+            if (option.compare("queue") == 0)
+            {
+                m_schedulerOptions.m_queueCapacity = stoull(value);
+            }
+            else if (option.compare("delay") == 0)
+            {
+                m_schedulerOptions.m_targetQueueDelay = stod(value);
+            }
+            else if (option.compare("deadline") == 0)
+            {
+                m_schedulerOptions.m_deadline = stod(value);
+            }
+            else if (option.compare("priorities") == 0)
+            {
+                m_priorityFile = value;
+            }
+            else if (option.compare("rate") == 0)
+            {
+                m_schedulerOptions.m_arrivalRate = stod(value);
+            }
+            else if (option.compare("arrivals") == 0)
+            {
+                if (value.compare("fixed") == 0)
+                {
+                    m_schedulerOptions.m_poissonArrivals = false;
+                }
+                else if (value.compare("poisson") == 0)
+                {
+                    m_schedulerOptions.m_poissonArrivals = true;
+                }
+                else
+                {
+                    m_arrivalFile = value;
+                }
+            }
+            else if (option.compare("seed") == 0)
+            {
+                m_schedulerOptions.m_seed = static_cast<unsigned>(stoul(value));
+            }
+            else
+            {
+                std::stringstream message;
+                message << "query log: unknown option \"" << option << "\".";
+                RecoverableError error(message.str().c_str());
+                throw error;
+            }
         }
     }
 
@@ -79,12 +167,33 @@ namespace BitFunnel
                 QueryRunner::Run(m_query.c_str(),
                                  GetEnvironment().GetSimpleIndex(),
                                  GetEnvironment().GetCompilerMode(),
-                                 GetEnvironment().GetCacheLineCountMode());
+                                 GetEnvironment().GetCacheLineCountMode() ?
+                                     GetEnvironment().GetCacheLineSamplePeriod() :
+                                     0,
+                                 GetEnvironment().GetHardwareCounterMode());
 
             output << "Results:" << std::endl;
             CsvTsv::CsvTableFormatter formatter(output);
-            QueryInstrumentation::Data::FormatHeader(formatter);
-            instrumentation.Format(formatter);
+            QueryInstrumentation::Data::FormatHeader(
+                formatter,
+                GetEnvironment().GetHardwareCounterMode());
+            instrumentation.Format(formatter,
+                                   GetEnvironment().GetHardwareCounterMode());
+        }
+        else if (m_isComparison)
+        {
+            output
+                << "Comparing matchers on queries from \""
+                << m_query
+                << "\"" << std::endl;
+
+            auto fileSystem = Factories::CreateFileSystem();  // TODO: Use environment file system
+            auto queries = ReadLines(*fileSystem, m_query.c_str());
+            QueryRunner::CompareMatchers(GetEnvironment().GetSimpleIndex(),
+                                         queries,
+                                         m_repetitions,
+                                         m_sweepLoopOptions,
+                                         output);
         }
         else
         {
@@ -101,6 +210,24 @@ namespace BitFunnel
             std::string const & filename = m_query;
             auto fileSystem = Factories::CreateFileSystem();  // TODO: Use environment file system
             auto queries = ReadLines(*fileSystem, filename.c_str());
+
+            QueryRunner::SchedulerOptions options = m_schedulerOptions;
+            if (!m_priorityFile.empty())
+            {
+                for (auto const & line : ReadLines(*fileSystem, m_priorityFile.c_str()))
+                {
+                    options.m_priorities.push_back(
+                        static_cast<unsigned>(stoul(line)));
+                }
+            }
+            if (!m_arrivalFile.empty())
+            {
+                for (auto const & line : ReadLines(*fileSystem, m_arrivalFile.c_str()))
+                {
+                    options.m_arrivalTimes.push_back(stod(line));
+                }
+            }
+
             const size_t c_threadCount = GetEnvironment().GetThreadCount();
             const size_t c_iterations = 1;
             auto statistics =
@@ -110,7 +237,11 @@ namespace BitFunnel
                                  queries,
                                  c_iterations,
                                  GetEnvironment().GetCompilerMode(),
-                                 GetEnvironment().GetCacheLineCountMode());
+                                 GetEnvironment().GetCacheLineCountMode() ?
+                                     GetEnvironment().GetCacheLineSamplePeriod() :
+                                     0,
+                                 GetEnvironment().GetHardwareCounterMode(),
+                                 options);
             output << "Results:" << std::endl;
             statistics.Print(output);
 
@@ -133,9 +264,33 @@ namespace BitFunnel
         return Documentation(
             "query",
             "Process a single query or list of queries.",
-            "query (one <expression>) | (log <file>)\n"
+            "query (one <expression>) | (log <file>) |\n"
+            "      ((compare | loops) <file> [repetitions])\n"
             "  Processes a single query or a list of queries\n"
             "  specified by a file.\n"
+            "  log accepts scheduler options after the file:\n"
+            "    queue <n>           admit at most n waiting queries\n"
+            "                        when arrivals are open loop\n"
+            "    delay <seconds>     shed queries outside priority 0\n"
+            "                        that wait longer than this\n"
+            "    deadline <seconds>  stop matching each query after\n"
+            "                        this long and report it truncated\n"
+            "    priorities <file>   priority class of each query,\n"
+            "                        one per line, 0 is highest\n"
+            "    rate <qps>          submit queries open loop at\n"
+            "                        this average rate\n"
+            "    arrivals fixed | poisson | <file>\n"
+            "                        fixed or exponential intervals\n"
+            "                        at the rate, or replay the arrival\n"
+            "                        times in seconds, one per query,\n"
+            "                        scaled to the rate if one is given\n"
+            "    seed <n>            seed for poisson arrivals\n"
+            "  compare runs each query in the file repetitions\n"
+            "  times with the interpreter, native code, and\n"
+            "  precompiled kernels, and prints the mean planning\n"
+            "  and matching time of each.\n"
+            "  loops does the same for native code with each\n"
+            "  combination of prefetch distance and prefetch hint.\n"
         );
     }
 }
@@ -22,9 +22,10 @@
 
 #pragma once
 
-#include <string>       // std::string embedded.
+#include <string>                       // std::string embedded.
 
-#include "TaskBase.h"   // TaskBase base class.
+#include "BitFunnel/Plan/QueryRunner.h" // QueryRunner::SchedulerOptions embedded.
+#include "TaskBase.h"                   // TaskBase base class.
 
 
 namespace BitFunnel
@@ -40,7 +41,18 @@ namespace BitFunnel
         static ICommand::Documentation GetDocumentation();
 
     private:
+        // Parses the options that follow "query log <file>".
+        void ParseSchedulerOptions(char const * parameters);
+
+        static const size_t c_defaultRepetitions = 10;
+
         bool m_isSingleQuery;
+        bool m_isComparison;
+        bool m_sweepLoopOptions;
+        size_t m_repetitions;
         std::string m_query;
+        QueryRunner::SchedulerOptions m_schedulerOptions;
+        std::string m_priorityFile;
+        std::string m_arrivalFile;
     };
 }
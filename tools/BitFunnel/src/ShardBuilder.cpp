@@ -22,15 +22,21 @@
 
 
 #include <iostream>
+#include <limits>
 
 #include "BitFunnel/Configuration/Factories.h"
+#include "BitFunnel/Configuration/IShardDefinition.h"
 #include "BitFunnel/Exceptions.h"
 #include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/IDocumentFrequencyTable.h"
 #include "BitFunnel/Index/IDocumentHistogram.h"
+#include "BitFunnel/Index/IQueryShardCostFunction.h"
 #include "BitFunnel/Index/IShardCostFunction.h"
 #include "BitFunnel/Index/ShardDefinitionBuilder.h"
+#include "BitFunnel/Utilities/ReadLines.h"
 #include "CmdLineParser/CmdLineParser.h"
 #include "ShardBuilder.h"
+#include "TermTableBuilderTool.h"
 
 
 namespace BitFunnel
@@ -77,11 +83,40 @@ namespace BitFunnel
             3u,
             CmdLine::GreaterThan(0));
 
+        CmdLine::OptionalParameter<char const *> queryLog(
+            "querylog",
+            "File with one query per line. When set, the shards minimize "
+            "the bits these queries are expected to scan, estimated from "
+            "the DocFreqTable for shard 0.",
+            nullptr);
+
+        CmdLine::OptionalParameter<double> budget(
+            "budget",
+            "Set the maximum bytes of row tables when using -querylog.",
+            std::numeric_limits<double>::infinity(),
+            CmdLine::GreaterThan(0.0));
+
+        CmdLine::OptionalParameter<double> density(
+            "density",
+            "Set the target row density used to estimate rows per term.",
+            0.15,
+            CmdLine::GreaterThan(0.0));
+
+        CmdLine::OptionalParameter<double> snr(
+            "snr",
+            "Set the signal-to-noise ratio used to estimate rows per term.",
+            10.0,
+            CmdLine::GreaterThan(0.0));
+
         parser.AddParameter(path);
         parser.AddParameter(maxShardCount);
         parser.AddParameter(overhead);
         parser.AddParameter(minCapacity);
         parser.AddParameter(maxRankInUse);
+        parser.AddParameter(queryLog);
+        parser.AddParameter(budget);
+        parser.AddParameter(density);
+        parser.AddParameter(snr);
 
         int returnCode = 1;
 
@@ -93,7 +128,11 @@ namespace BitFunnel
                    static_cast<size_t>(maxShardCount),
                    overhead,
                    static_cast<size_t>(minCapacity),
-                   static_cast<size_t>(maxRankInUse));
+                   static_cast<Rank>(maxRankInUse),
+                   queryLog,
+                   budget,
+                   density,
+                   snr);
 
                 returnCode = 0;
             }
@@ -115,13 +154,12 @@ namespace BitFunnel
                           size_t maxShardCount,
                           double shardOverhead,
                           size_t minShardCapacity,
-                          Rank maxRankInUse) const
+                          Rank maxRankInUse,
+                          char const * queryLog,
+                          double memoryBudget,
+                          double density,
+                          double snr) const
     {
-        //size_t maxShardCount = 10;
-        //double shardOverhead = 1.0;
-        //size_t minShardCapacity = 1;
-        //Rank maxRankInUse = 3;
-
         std::cout
             << "Optimal Shard Builder" << std::endl
             << "  maxShards: " << maxShardCount << std::endl
@@ -149,15 +187,48 @@ namespace BitFunnel
             << std::endl
             << std::endl;
 
-        auto costFunction =
-            Factories::CreateShardCostFunction(*histogram,
-                                               1.0,
-                                               1,
-                                               3);
-
-        auto shardDefinition =
-            ShardDefinitionBuilder::CreateShardDefinition(*costFunction,
-                                                          maxShardCount);
+        std::unique_ptr<IShardDefinition const> shardDefinition;
+        if (queryLog == nullptr)
+        {
+            auto costFunction =
+                Factories::CreateShardCostFunction(*histogram,
+                                                   shardOverhead,
+                                                   minShardCapacity,
+                                                   maxRankInUse);
+
+            shardDefinition =
+                ShardDefinitionBuilder::CreateShardDefinition(*costFunction,
+                                                              maxShardCount);
+        }
+        else
+        {
+            std::cout
+                << "Replaying " << queryLog
+                << " against " << fileManager->DocFreqTable(0).GetName()
+                << std::endl
+                << std::endl;
+
+            auto terms = Factories::CreateDocumentFrequencyTable(
+                *fileManager->DocFreqTable(0).OpenForRead());
+            auto queryTerms =
+                TermTableBuilderTool::CreateQueryTermFrequencyTable(
+                    ReadLines(m_fileSystem, queryLog));
+
+            auto costFunction =
+                Factories::CreateQueryShardCostFunction(*histogram,
+                                                        *terms,
+                                                        *queryTerms,
+                                                        density,
+                                                        snr,
+                                                        shardOverhead,
+                                                        minShardCapacity,
+                                                        maxRankInUse);
+
+            shardDefinition =
+                ShardDefinitionBuilder::CreateShardDefinition(*costFunction,
+                                                              maxShardCount,
+                                                              memoryBudget);
+        }
 
         std::cout
             << "Writing to "
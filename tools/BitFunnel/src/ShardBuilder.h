@@ -42,11 +42,19 @@ namespace BitFunnel
                          char const *argv[]) override;
 
     private:
+        // If queryLog is not nullptr, the shards minimize the expected bits
+        // scanned by the queries in the log, within memoryBudget bytes of
+        // row tables. Otherwise they minimize row table memory plus
+        // shardOverhead per shard.
         void Go(char const * path,
                 size_t maxShardCount,
                 double shardOverhead,
                 size_t minShardCapacity,
-                Rank maxRankInUse) const;
+                Rank maxRankInUse,
+                char const * queryLog,
+                double memoryBudget,
+                double density,
+                double snr) const;
 
         //
         // Constructor parameters.
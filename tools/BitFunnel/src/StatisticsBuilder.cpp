@@ -78,10 +78,26 @@ namespace BitFunnel
             1u,
             CmdLine::GreaterThan(0));
 
+        CmdLine::OptionalParameter<double> sampleFraction(
+            "sample",
+            "Ingest only this fraction of the documents, chosen by DocId. "
+            "Document counts are extrapolated to the whole corpus and "
+            "confidence bounds are written for term frequencies.",
+            1.0,
+            CmdLine::Range(CmdLine::GreaterThan(0.0),
+                           CmdLine::LessThanOrEqual(1.0)));
+
+        CmdLine::OptionalParameterList coOccurrences(
+            "cooccurrence",
+            "Gather term co-occurrence sketches, which 'termtable' uses to "
+            "avoid packing correlated terms into the same shared row.");
+
         parser.AddParameter(manifestFileName);
         parser.AddParameter(outputPath);
         parser.AddParameter(termToText);
         parser.AddParameter(gramSize);
+        parser.AddParameter(sampleFraction);
+        parser.AddParameter(coOccurrences);
 
         int returnCode = 1;
 
@@ -94,7 +110,9 @@ namespace BitFunnel
                                        manifestFileName,
                                        gramSize,
                                        true,
-                                       termToText.IsActivated());
+                                       termToText.IsActivated(),
+                                       sampleFraction,
+                                       coOccurrences.IsActivated());
                 returnCode = 0;
             }
             catch (RecoverableError e)
@@ -118,13 +136,17 @@ namespace BitFunnel
         // TODO: gramSize should be unsigned once CmdLineParser supports unsigned.
         int gramSize,
         bool generateStatistics,
-        bool generateTermToText) const
+        bool generateTermToText,
+        double sampleFraction,
+        bool collectCoOccurrences) const
     {
         // TODO: cast of gramSize can be removed when it's fixed to be unsigned.
         auto index = Factories::CreateSimpleIndex(m_fileSystem);
         index->ConfigureForStatistics(intermediateDirectory,
                                       static_cast<size_t>(gramSize),
-                                      generateTermToText);
+                                      generateTermToText,
+                                      sampleFraction,
+                                      collectCoOccurrences);
         index->StartIndex();
 
 
@@ -137,6 +159,12 @@ namespace BitFunnel
 
         output << "Reading " << filePaths.size() << " files\n";
 
+        if (sampleFraction < 1.0)
+        {
+            output << "Sampling " << sampleFraction
+                   << " of the documents" << std::endl;
+        }
+
         IConfiguration const & configuration = index->GetConfiguration();
         IIngestor & ingestor = index->GetIngestor();
 
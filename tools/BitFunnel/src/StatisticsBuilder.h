@@ -48,7 +48,9 @@ namespace BitFunnel
             char const * chunkListFileName,
             int gramSize,
             bool generateStatistics,
-            bool generateTermToText) const;
+            bool generateTermToText,
+            double sampleFraction,
+            bool collectCoOccurrences) const;
 
         IFileSystem& m_fileSystem;
     };
@@ -21,23 +21,87 @@
 // THE SOFTWARE.
 
 
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
 #include "BitFunnel/BitFunnelTypes.h"
 #include "BitFunnel/Configuration/Factories.h"
 #include "BitFunnel/Configuration/IFileSystem.h"
 #include "BitFunnel/Exceptions.h"
 #include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/ICoOccurrenceTable.h"
+#include "BitFunnel/Index/IConfiguration.h"
 #include "BitFunnel/Index/IDocumentFrequencyTable.h"
+#include "BitFunnel/Index/IFactSet.h"
+#include "BitFunnel/Index/IIndexedIdfTable.h"
 #include "BitFunnel/Index/ITermTable.h"
 #include "BitFunnel/Index/ITermTableBuilder.h"
 #include "BitFunnel/Index/ITermTreatmentFactory.h"
+#include "BitFunnel/Plan/Factories.h"
+#include "BitFunnel/Term.h"
+#include "BitFunnel/Utilities/Factories.h"
+#include "BitFunnel/Utilities/ITaskProcessor.h"
+#include "BitFunnel/Utilities/ReadLines.h"
+#include "BitFunnel/Utilities/Stopwatch.h"
 #include "CmdLineParser/CmdLineParser.h"
 #include "TermTableBuilderTool.h"
 
 
 namespace BitFunnel
 {
+    //*************************************************************************
+    //
+    // ShardProcessor
+    //
+    // Builds the TermTable for the shard with the same number as the task.
+    // Output for each shard is buffered, so that it can be printed in shard
+    // order, and errors are held until every shard has finished.
+    //
+    //*************************************************************************
+    class ShardProcessor : public ITaskProcessor
+    {
+    public:
+        typedef std::function<void(std::ostream&, ShardId)> Builder;
+
+        ShardProcessor(Builder const & builder,
+                       std::vector<std::stringstream> & outputs,
+                       std::vector<std::exception_ptr> & errors)
+          : m_builder(builder),
+            m_outputs(outputs),
+            m_errors(errors)
+        {
+        }
+
+        //
+        // ITaskProcessor methods
+        //
+
+        virtual void ProcessTask(size_t taskId) override
+        {
+            try
+            {
+                m_builder(m_outputs[taskId], static_cast<ShardId>(taskId));
+            }
+            catch (...)
+            {
+                m_errors[taskId] = std::current_exception();
+            }
+        }
+
+        virtual void Finished() override
+        {
+        }
+
+    private:
+        Builder const & m_builder;
+        std::vector<std::stringstream> & m_outputs;
+        std::vector<std::exception_ptr> & m_errors;
+    };
+
+
     TermTableBuilderTool::TermTableBuilderTool(IFileSystem& fileSystem)
       : m_fileSystem(fileSystem)
     {
@@ -72,11 +136,34 @@ namespace BitFunnel
             10.0,
             CmdLine::GreaterThan(0.0));
 
+        CmdLine::OptionalParameter<char const *> queryLog(
+            "querylog",
+            "File with one query per line, used by treatments that take "
+            "query term frequencies into account.",
+            nullptr);
+
+        CmdLine::OptionalParameterList uncorrelated(
+            "uncorrelated",
+            "Ignore the co-occurrence sketches written by "
+            "'statistics -cooccurrence' and pack shared rows without regard "
+            "to term correlation.");
+
+        // TODO: This parameter should be unsigned, but it doesn't seem to work
+        // with CmdLineParser.
+        CmdLine::OptionalParameter<int> threadCount(
+            "threads",
+            "Set the number of shards built at once.",
+            (std::max)(1u, std::thread::hardware_concurrency()),
+            CmdLine::GreaterThan(0));
+
 
         parser.AddParameter(config);
         parser.AddParameter(density);
         parser.AddParameter(treatment);
         parser.AddParameter(snr);
+        parser.AddParameter(queryLog);
+        parser.AddParameter(uncorrelated);
+        parser.AddParameter(threadCount);
 
         int returnCode = 1;
 
@@ -101,37 +188,68 @@ namespace BitFunnel
 
             try
             {
-                double adhocFrequency = density;
-
-                // Check if treatmentName starts with Classic. This is a bit of
-                // a hack and we should probably just take adhocFrequency
-                // directly.
-                std::string treatmentName(treatment);
-                std::string classic("Classic");
-                if (treatmentName.compare(0, classic.length(), classic) == 0)
+                const double adhocFrequency =
+                    GetAdhocFrequency(treatment, density);
+
+                std::unique_ptr<IDocumentFrequencyTable> queryTerms;
+                if (queryLog != nullptr)
                 {
-                    adhocFrequency = 1.0;
+                    queryTerms = CreateQueryTermFrequencyTable(
+                        ReadLines(m_fileSystem, queryLog));
                 }
 
-                std::string optimal("Optimal");
-                if (treatmentName.compare(0, optimal.length(), optimal) == 0)
+                Stopwatch stopwatch;
+
+                // Shards are independent, so they are built concurrently.
+                ShardProcessor::Builder builder =
+                    [&](std::ostream& shardOutput, ShardId shard)
+                    {
+                        BuildTermTable(shardOutput,
+                                       *fileManager,
+                                       treatment,
+                                       shard,
+                                       density,
+                                       snr,
+                                       adhocFrequency,
+                                       queryTerms.get(),
+                                       !uncorrelated.IsActivated());
+                    };
+
+                std::vector<std::stringstream> outputs(shardCount);
+                std::vector<std::exception_ptr> errors(shardCount);
                 {
-                    adhocFrequency = 0.01;
+                    const size_t threads =
+                        (std::min)(static_cast<size_t>(threadCount),
+                                   static_cast<size_t>(shardCount));
+                    std::vector<std::unique_ptr<ITaskProcessor>> processors;
+                    for (size_t i = 0; i < threads; ++i)
+                    {
+                        processors.push_back(
+                            std::unique_ptr<ITaskProcessor>(
+                                new ShardProcessor(builder, outputs, errors)));
+                    }
+
+                    auto distributor =
+                        Factories::CreateTaskDistributor(processors,
+                                                         shardCount);
+                    distributor->WaitForCompletion();
                 }
 
-
                 for (ShardId shard = 0; shard < shardCount; ++shard)
                 {
-
-                    BuildTermTable(output,
-                                   *fileManager,
-                                   treatment,
-                                   shard,
-                                   density,
-                                   snr,
-                                   adhocFrequency);
+                    output << outputs[shard].str();
+                }
+                for (auto const & error : errors)
+                {
+                    if (error != nullptr)
+                    {
+                        std::rethrow_exception(error);
+                    }
                 }
 
+                output << "Built " << shardCount << " TermTables in "
+                       << stopwatch.ElapsedTime() << " seconds." << std::endl;
+
                 returnCode = 0;
             }
             catch (RecoverableError e)
@@ -160,6 +278,85 @@ namespace BitFunnel
     }
 
 
+    double TermTableBuilderTool::GetAdhocFrequency(char const * treatmentName,
+                                                   double density)
+    {
+        double adhocFrequency = density;
+
+        // Check if treatmentName starts with Classic. This is a bit of
+        // a hack and we should probably just take adhocFrequency
+        // directly.
+        std::string name(treatmentName);
+        std::string classic("Classic");
+        if (name.compare(0, classic.length(), classic) == 0)
+        {
+            adhocFrequency = 1.0;
+        }
+
+        std::string optimal("Optimal");
+        if (name.compare(0, optimal.length(), optimal) == 0)
+        {
+            adhocFrequency = 0.01;
+        }
+
+        return adhocFrequency;
+    }
+
+
+    IDocumentFrequencyTable const *
+        TermTableBuilderTool::GetExplicitTerms(
+            char const * treatmentName,
+            IDocumentFrequencyTable const * queryTerms)
+    {
+        // QueryAware configures queried terms by their query frequency,
+        // which adhoc rows cannot express, so queried terms must be
+        // explicit. Other terms keep the usual adhoc threshold.
+        std::string name(treatmentName);
+        std::string queryAware("QueryAware");
+        if (name.compare(0, queryAware.length(), queryAware) == 0)
+        {
+            return queryTerms;
+        }
+
+        return nullptr;
+    }
+
+
+    std::unique_ptr<IDocumentFrequencyTable>
+        TermTableBuilderTool::CreateQueryTermFrequencyTable(
+            std::vector<std::string> const & queries)
+    {
+        // Term hashes do not depend on the IDF table, so an empty one will
+        // do.
+        auto idfTable = Factories::CreateIndexedIdfTable();
+        auto facts = Factories::CreateFactSet();
+        auto configuration =
+            Factories::CreateConfiguration(Term::c_maxGramSize,
+                                           false,
+                                           *idfTable,
+                                           *facts);
+
+        return Factories::CreateQueryTermFrequencyTable(*configuration,
+                                                        queries);
+    }
+
+
+    std::unique_ptr<ICoOccurrenceTable>
+        TermTableBuilderTool::LoadCoOccurrenceTable(IFileManager& fileManager,
+                                                    ShardId shard)
+    {
+        // Statistics gathered without -cooccurrence have no
+        // CoOccurrenceTable.
+        if (!fileManager.CoOccurrenceTable(shard).Exists())
+        {
+            return nullptr;
+        }
+
+        return Factories::CreateCoOccurrenceTable(
+            *fileManager.CoOccurrenceTable(shard).OpenForRead());
+    }
+
+
     void TermTableBuilderTool::BuildTermTable(
         std::ostream& output,
         IFileManager& fileManager,
@@ -167,7 +364,9 @@ namespace BitFunnel
         ShardId shard,
         double density,
         double snr,
-        double adhocFrequency) const
+        double adhocFrequency,
+        IDocumentFrequencyTable const * queryTerms,
+        bool isCorrelationAware) const
     {
         output << "Loading files for TermTable build: "
                << shard << std::endl;
@@ -176,12 +375,21 @@ namespace BitFunnel
             *fileManager.DocFreqTable(shard).OpenForRead()));
 
         auto treatments = Factories::CreateTreatmentFactory();
-        auto treatment(treatments->CreateTreatment(treatmentName, density, snr));
+        auto treatment(treatments->CreateTreatment(treatmentName,
+                                                   density,
+                                                   snr,
+                                                   queryTerms));
 
         auto facts(Factories::CreateFactSet());
 
         auto termTable(Factories::CreateTermTable());
 
+        std::unique_ptr<ICoOccurrenceTable> coOccurrences;
+        if (isCorrelationAware)
+        {
+            coOccurrences = LoadCoOccurrenceTable(fileManager, shard);
+        }
+
         output << "Starting TermTable build." << std::endl;
 
         auto termTableBuilderTool(
@@ -190,7 +398,10 @@ namespace BitFunnel
                                               *treatment,
                                               *terms,
                                               *facts,
-                                              *termTable));
+                                              *termTable,
+                                              coOccurrences.get(),
+                                              GetExplicitTerms(treatmentName,
+                                                               queryTerms)));
 
         termTableBuilderTool->Print(output);
         termTableBuilderTool->Print(*fileManager.TermTableStatistics(shard).OpenForWrite());
@@ -20,12 +20,19 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <memory>                       // std::unique_ptr return value.
+#include <string>                       // std::string parameter.
+#include <vector>                       // std::vector parameter.
+
 #include "BitFunnel/BitFunnelTypes.h"   // ShardId parameter.
 #include "BitFunnel/IExecutable.h"      // Base class.
 
 
 namespace BitFunnel
 {
+    class ICoOccurrenceTable;
+    class IDocumentFrequencyTable;
+    class IFileManager;
     class IFileSystem;
 
     class TermTableBuilderTool : public IExecutable
@@ -41,6 +48,30 @@ namespace BitFunnel
                          int argc,
                          char const *argv[]) override;
 
+        // Returns the frequency below which terms are given adhoc rows by
+        // the named treatment. Classic treatments put every term in adhoc
+        // rows, and Optimal uses a fixed threshold.
+        static double GetAdhocFrequency(char const * treatmentName,
+                                        double density);
+
+        // Returns the terms that the named treatment needs in explicit rows
+        // even when they are rarer than the adhoc frequency, or nullptr if
+        // there are none. QueryAware needs the terms in queryTerms.
+        static IDocumentFrequencyTable const *
+            GetExplicitTerms(char const * treatmentName,
+                             IDocumentFrequencyTable const * queryTerms);
+
+        // Returns the fraction of the queries that look up each term, for
+        // treatments that take query frequencies into account.
+        static std::unique_ptr<IDocumentFrequencyTable>
+            CreateQueryTermFrequencyTable(
+                std::vector<std::string> const & queries);
+
+        // Returns the co-occurrence sketches written for a shard by the
+        // 'statistics' command, or nullptr if there are none.
+        static std::unique_ptr<ICoOccurrenceTable>
+            LoadCoOccurrenceTable(IFileManager& fileManager, ShardId shard);
+
     private:
         void BuildTermTable(
             std::ostream& output,
@@ -49,7 +80,9 @@ namespace BitFunnel
             ShardId shard,
             double density,
             double snr,
-            double adhocFrequency) const;
+            double adhocFrequency,
+            IDocumentFrequencyTable const * queryTerms,
+            bool isCorrelationAware) const;
 
         //
         // Constructor parameters.
@@ -0,0 +1,637 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "BitFunnel/Chunks/DocumentFilters.h"
+#include "BitFunnel/Chunks/Factories.h"
+#include "BitFunnel/Chunks/IChunkManifestIngestor.h"
+#include "BitFunnel/Configuration/Factories.h"
+#include "BitFunnel/Configuration/IFileSystem.h"
+#include "BitFunnel/Configuration/IShardDefinition.h"
+#include "BitFunnel/Exceptions.h"
+#include "BitFunnel/Index/Factories.h"
+#include "BitFunnel/Index/ICoOccurrenceTable.h"
+#include "BitFunnel/Index/IDocumentFrequencyTable.h"
+#include "BitFunnel/Index/IFactSet.h"
+#include "BitFunnel/Index/IngestChunks.h"
+#include "BitFunnel/Index/ISimpleIndex.h"
+#include "BitFunnel/Index/ITermTable.h"
+#include "BitFunnel/Index/ITermTableBuilder.h"
+#include "BitFunnel/Index/ITermTableCollection.h"
+#include "BitFunnel/Index/ITermTreatmentFactory.h"
+#include "BitFunnel/Plan/IMatchVerifier.h"
+#include "BitFunnel/Plan/QueryInstrumentation.h"
+#include "BitFunnel/Plan/QueryRunner.h"
+#include "BitFunnel/Plan/VerifyOneQuery.h"
+#include "BitFunnel/Utilities/ReadLines.h"
+#include "BitFunnel/Utilities/Stopwatch.h"
+#include "CmdLineParser/CmdLineParser.h"
+#include "TermTableBuilderTool.h"
+#include "TreatmentTuner.h"
+
+
+namespace BitFunnel
+{
+    TreatmentTuner::TreatmentTuner(IFileSystem& fileSystem)
+      : m_fileSystem(fileSystem)
+    {
+    }
+
+
+    int TreatmentTuner::Main(std::istream& /*input*/,
+                             std::ostream& output,
+                             int argc,
+                             char const *argv[])
+    {
+        CmdLine::CmdLineParser parser(
+            "TreatmentTuner",
+            "Choose the term treatment, density, and signal-to-noise ratio "
+            "for each shard by measuring query cost on a sample of the "
+            "corpus.");
+
+        CmdLine::RequiredParameter<char const *> config(
+            "config",
+            "Path to configuration directory containing files generated "
+            "by the 'BitFunnel statistics'.command.");
+
+        CmdLine::RequiredParameter<char const *> manifestFileName(
+            "manifestFile",
+            "Path to a file listing the chunk files of the corpus sample. "
+            "One chunk file per line.");
+
+        CmdLine::RequiredParameter<char const *> queryLogFileName(
+            "queryLog",
+            "Path to a file with one query per line.");
+
+        CmdLine::OptionalParameter<char const *> treatments(
+            "treatments",
+            "Comma separated list of term treatments to try.",
+            "PrivateSharedRank0ToN,Optimal,ClassicBitsliced,QueryAware");
+
+        CmdLine::OptionalParameter<char const *> densities(
+            "densities",
+            "Comma separated list of target bit densities to try.",
+            "0.1,0.15,0.2,0.25");
+
+        CmdLine::OptionalParameter<char const *> snrs(
+            "snrs",
+            "Comma separated list of signal-to-noise ratios to try.",
+            "10");
+
+        CmdLine::OptionalParameter<double> memoryWeight(
+            "memoryweight",
+            "Weight of memory, between 0 and 1, relative to cache lines "
+            "when choosing among Pareto optimal configurations.",
+            0.5,
+            CmdLine::Range(CmdLine::GreaterThanOrEqual(0.0),
+                           CmdLine::LessThanOrEqual(1.0)));
+
+        CmdLine::OptionalParameter<double> maxFalsePositiveRate(
+            "maxfp",
+            "Largest acceptable fraction of matches that are false positives.",
+            1.0,
+            CmdLine::Range(CmdLine::GreaterThanOrEqual(0.0),
+                           CmdLine::LessThanOrEqual(1.0)));
+
+        CmdLine::OptionalParameter<char const *> csvFileName(
+            "csv",
+            "File to receive every measurement in CSV format.",
+            nullptr);
+
+        CmdLine::OptionalParameterList write(
+            "write",
+            "Write the TermTable chosen for each shard to the configuration "
+            "directory.");
+
+        // TODO: These parameters should be unsigned, but it doesn't seem to
+        // work with CmdLineParser.
+        CmdLine::OptionalParameter<int> gramSize(
+            "gramsize",
+            "Set the maximum ngram size for phrases.",
+            1u,
+            CmdLine::GreaterThan(0));
+
+        CmdLine::OptionalParameter<int> threadCount(
+            "threads",
+            "Set the thread count for ingestion.",
+            (std::max)(1u, std::thread::hardware_concurrency()),
+            CmdLine::GreaterThan(0));
+
+        CmdLine::OptionalParameter<int> memory(
+            "memory",
+            "Specify the amount of memory (in KiB) to use for Slice buffers.",
+            1000000u,
+            CmdLine::GreaterThan(0));
+
+        parser.AddParameter(config);
+        parser.AddParameter(manifestFileName);
+        parser.AddParameter(queryLogFileName);
+        parser.AddParameter(treatments);
+        parser.AddParameter(densities);
+        parser.AddParameter(snrs);
+        parser.AddParameter(memoryWeight);
+        parser.AddParameter(maxFalsePositiveRate);
+        parser.AddParameter(csvFileName);
+        parser.AddParameter(write);
+        parser.AddParameter(gramSize);
+        parser.AddParameter(threadCount);
+        parser.AddParameter(memory);
+
+        int returnCode = 1;
+
+        if (parser.TryParse(output, argc, argv))
+        {
+            try
+            {
+                Stopwatch stopwatch;
+
+                std::vector<Candidate> candidates;
+                for (auto const & treatment : SplitList(treatments))
+                {
+                    for (auto const & density : SplitList(densities))
+                    {
+                        for (auto const & snr : SplitList(snrs))
+                        {
+                            Candidate candidate;
+                            candidate.m_treatment = treatment;
+                            candidate.m_density = ParseNumber(density);
+                            candidate.m_snr = ParseNumber(snr);
+                            candidates.push_back(candidate);
+                        }
+                    }
+                }
+                if (candidates.empty())
+                {
+                    throw RecoverableError("No candidate configurations.");
+                }
+
+                auto fileManager = Factories::CreateFileManager(config,
+                                                                config,
+                                                                config,
+                                                                m_fileSystem);
+
+                ShardId shardCount = 0;
+                {
+                    auto input = fileManager->ShardDefinition().OpenForRead();
+                    auto shardDefinition =
+                        Factories::CreateShardDefinition(*input);
+                    shardCount = shardDefinition->GetShardCount();
+                }
+
+                auto chunkPaths = ReadLines(m_fileSystem, manifestFileName);
+                auto queries = ReadLines(m_fileSystem, queryLogFileName);
+                if (queries.empty())
+                {
+                    throw RecoverableError("Query log is empty.");
+                }
+
+                output << "Building " << candidates.size() * shardCount
+                       << " TermTables." << std::endl;
+
+                auto queryTerms =
+                    TermTableBuilderTool::CreateQueryTermFrequencyTable(queries);
+
+                TermTables termTables;
+                BuildTermTables(output,
+                                config,
+                                candidates,
+                                *queryTerms,
+                                shardCount,
+                                termTables);
+
+                // The configuration where every shard uses the first
+                // candidate is shared by all shards, so it is measured once.
+                std::vector<std::vector<Measurement>>
+                    measurements(shardCount,
+                                 std::vector<Measurement>(candidates.size()));
+                Measurement baseline;
+                for (ShardId shard = 0; shard < shardCount; ++shard)
+                {
+                    for (size_t c = 0; c < candidates.size(); ++c)
+                    {
+                        output << "Measuring shard " << shard << ": "
+                               << candidates[c].m_treatment
+                               << ", density " << candidates[c].m_density
+                               << ", snr " << candidates[c].m_snr
+                               << std::endl;
+
+                        Measurement measurement;
+                        if (c == 0 && shard > 0)
+                        {
+                            measurement = baseline;
+                        }
+                        else
+                        {
+                            std::vector<size_t> assignment(shardCount, 0);
+                            assignment[shard] = c;
+                            measurement = Measure(config,
+                                                  termTables,
+                                                  assignment,
+                                                  chunkPaths,
+                                                  queries,
+                                                  static_cast<size_t>(gramSize),
+                                                  static_cast<size_t>(threadCount),
+                                                  static_cast<size_t>(memory) * 1024ull);
+                            if (c == 0)
+                            {
+                                baseline = measurement;
+                            }
+                        }
+                        measurement.m_bytesPerDocument =
+                            termTables.m_bytesPerDocument[shard][c];
+                        measurements[shard][c] = measurement;
+                    }
+                }
+
+                std::unique_ptr<std::ostream> csv;
+                if (csvFileName != nullptr)
+                {
+                    csv = m_fileSystem.OpenForWrite(csvFileName);
+                    *csv << "shard,treatment,density,snr,bytesPerDocument,"
+                         << "quadwords,cacheLines,falsePositiveRate,"
+                         << "falseNegatives,pareto,selected" << std::endl;
+                }
+
+                for (ShardId shard = 0; shard < shardCount; ++shard)
+                {
+                    auto const & shardMeasurements = measurements[shard];
+
+                    std::vector<bool> front(candidates.size(), true);
+                    for (size_t c = 0; c < candidates.size(); ++c)
+                    {
+                        for (size_t other = 0; other < candidates.size(); ++other)
+                        {
+                            if (shardMeasurements[other].Dominates(
+                                    shardMeasurements[c]))
+                            {
+                                front[c] = false;
+                                break;
+                            }
+                        }
+                    }
+
+                    const size_t selected = Select(shardMeasurements,
+                                                   front,
+                                                   memoryWeight,
+                                                   maxFalsePositiveRate);
+
+                    output << std::endl
+                           << "Shard " << shard
+                           << " (* Pareto optimal, > selected):" << std::endl
+                           << "    treatment                 density    snr"
+                           << "    bytes/doc   quadwords  cachelines"
+                           << "  false+ rate" << std::endl;
+
+                    for (size_t c = 0; c < candidates.size(); ++c)
+                    {
+                        Candidate const & candidate = candidates[c];
+                        Measurement const & m = shardMeasurements[c];
+
+                        output << (c == selected ? '>' : ' ')
+                               << (front[c] ? '*' : ' ')
+                               << "  " << std::left << std::setw(24)
+                               << candidate.m_treatment << std::right
+                               << std::setw(9) << candidate.m_density
+                               << std::setw(7) << candidate.m_snr
+                               << std::setw(13) << m.m_bytesPerDocument
+                               << std::setw(12) << m.m_quadwords
+                               << std::setw(12) << m.m_cacheLines
+                               << std::setw(13) << m.m_falsePositiveRate
+                               << std::endl;
+
+                        if (m.m_falseNegatives > 0)
+                        {
+                            output << "    Warning: " << m.m_falseNegatives
+                                   << " false negatives." << std::endl;
+                        }
+
+                        if (csv.get() != nullptr)
+                        {
+                            *csv << shard << ","
+                                 << candidate.m_treatment << ","
+                                 << candidate.m_density << ","
+                                 << candidate.m_snr << ","
+                                 << m.m_bytesPerDocument << ","
+                                 << m.m_quadwords << ","
+                                 << m.m_cacheLines << ","
+                                 << m.m_falsePositiveRate << ","
+                                 << m.m_falseNegatives << ","
+                                 << (front[c] ? 1 : 0) << ","
+                                 << (c == selected ? 1 : 0) << std::endl;
+                        }
+                    }
+
+                    if (write.IsActivated())
+                    {
+                        *fileManager->TermTable(shard).OpenForWrite()
+                            << termTables.m_tables[shard][selected];
+                        *fileManager->TermTableStatistics(shard).OpenForWrite()
+                            << termTables.m_statistics[shard][selected];
+                    }
+                }
+
+                output << std::endl;
+                if (write.IsActivated())
+                {
+                    output << "Wrote " << shardCount << " TermTables. ";
+                }
+                output << "Tuning took " << stopwatch.ElapsedTime()
+                       << " seconds." << std::endl;
+
+                returnCode = 0;
+            }
+            catch (RecoverableError e)
+            {
+                output << "Error: " << e.what() << std::endl;
+            }
+            catch (...)
+            {
+                output << "Unexpected error." << std::endl;
+            }
+        }
+
+        return returnCode;
+    }
+
+
+    void TreatmentTuner::BuildTermTables(
+        std::ostream& output,
+        char const * config,
+        std::vector<Candidate> const & candidates,
+        IDocumentFrequencyTable const & queryTerms,
+        ShardId shardCount,
+        TermTables & termTables) const
+    {
+        auto fileManager = Factories::CreateFileManager(config,
+                                                        config,
+                                                        config,
+                                                        m_fileSystem);
+        auto treatments = Factories::CreateTreatmentFactory();
+
+        termTables.m_tables.resize(shardCount);
+        termTables.m_statistics.resize(shardCount);
+        termTables.m_bytesPerDocument.resize(shardCount);
+
+        for (ShardId shard = 0; shard < shardCount; ++shard)
+        {
+            auto terms(Factories::CreateDocumentFrequencyTable(
+                *fileManager->DocFreqTable(shard).OpenForRead()));
+            auto coOccurrences(
+                TermTableBuilderTool::LoadCoOccurrenceTable(*fileManager,
+                                                            shard));
+
+            for (auto const & candidate : candidates)
+            {
+                auto treatment(
+                    treatments->CreateTreatment(candidate.m_treatment.c_str(),
+                                                candidate.m_density,
+                                                candidate.m_snr,
+                                                &queryTerms));
+                auto facts(Factories::CreateFactSet());
+                auto termTable(Factories::CreateTermTable());
+
+                const double adhocFrequency =
+                    TermTableBuilderTool::GetAdhocFrequency(
+                        candidate.m_treatment.c_str(),
+                        candidate.m_density);
+
+                auto builder(
+                    Factories::CreateTermTableBuilder(candidate.m_density,
+                                                      adhocFrequency,
+                                                      *treatment,
+                                                      *terms,
+                                                      *facts,
+                                                      *termTable,
+                                                      coOccurrences.get(),
+                                                      TermTableBuilderTool::GetExplicitTerms(
+                                                          candidate.m_treatment.c_str(),
+                                                          &queryTerms)));
+
+                std::stringstream statistics;
+                builder->Print(statistics);
+
+                std::stringstream table;
+                termTable->Write(table);
+
+                double bytesPerDocument = 0.0;
+                for (Rank rank = 0; rank <= c_maxRankValue; ++rank)
+                {
+                    bytesPerDocument += termTable->GetBytesPerDocument(rank);
+                }
+
+                termTables.m_tables[shard].push_back(table.str());
+                termTables.m_statistics[shard].push_back(statistics.str());
+                termTables.m_bytesPerDocument[shard].push_back(bytesPerDocument);
+            }
+
+            output << "Built TermTables for shard " << shard << "." << std::endl;
+        }
+    }
+
+
+    TreatmentTuner::Measurement TreatmentTuner::Measure(
+        char const * config,
+        TermTables const & termTables,
+        std::vector<size_t> const & assignment,
+        std::vector<std::string> const & chunkPaths,
+        std::vector<std::string> const & queries,
+        size_t gramSize,
+        size_t threadCount,
+        size_t memory) const
+    {
+        auto collection = Factories::CreateTermTableCollection();
+        for (size_t shard = 0; shard < assignment.size(); ++shard)
+        {
+            std::stringstream input(termTables.m_tables[shard][assignment[shard]]);
+            collection->AddTermTable(Factories::CreateTermTable(input));
+        }
+
+        auto index = Factories::CreateSimpleIndex(m_fileSystem);
+        index->SetTermTableCollection(std::move(collection));
+        index->SetBlockAllocatorBufferSize(memory);
+        index->ConfigureForServing(config, gramSize, false);
+        index->StartIndex();
+
+        // Documents are cached so that VerifyOneQuery() can find the true
+        // matches.
+        NopFilter filter;
+        auto manifest = Factories::CreateChunkManifestIngestor(
+            m_fileSystem,
+            nullptr,
+            chunkPaths,
+            index->GetConfiguration(),
+            index->GetIngestor(),
+            filter,
+            true);
+        IngestChunks(*manifest, threadCount);
+
+        size_t quadwords = 0;
+        size_t cacheLines = 0;
+        size_t observed = 0;
+        size_t falsePositives = 0;
+        size_t falseNegatives = 0;
+
+        for (auto const & query : queries)
+        {
+            auto data = QueryRunner::Run(query.c_str(), *index, false, 1);
+            quadwords += data.GetQuadwordCount();
+            cacheLines += data.GetCacheLineCount();
+
+            auto verifier = VerifyOneQuery(*index, query, false);
+            observed += verifier->GetObservedCount();
+            falsePositives += verifier->GetFalsePositiveCount();
+            falseNegatives += verifier->GetFalseNegativeCount();
+        }
+
+        Measurement measurement;
+        measurement.m_quadwords =
+            static_cast<double>(quadwords) / queries.size();
+        measurement.m_cacheLines =
+            static_cast<double>(cacheLines) / queries.size();
+        measurement.m_falsePositiveRate =
+            (observed == 0) ?
+            0.0 :
+            static_cast<double>(falsePositives) / observed;
+        measurement.m_falseNegatives = falseNegatives;
+
+        return measurement;
+    }
+
+
+    size_t TreatmentTuner::Select(std::vector<Measurement> const & measurements,
+                                  std::vector<bool> const & front,
+                                  double memoryWeight,
+                                  double maxFalsePositiveRate)
+    {
+        bool anyAcceptable = false;
+        for (size_t c = 0; c < measurements.size(); ++c)
+        {
+            if (front[c] &&
+                measurements[c].m_falsePositiveRate <= maxFalsePositiveRate)
+            {
+                anyAcceptable = true;
+            }
+        }
+
+        std::vector<size_t> considered;
+        double maxBytes = 0.0;
+        double maxCacheLines = 0.0;
+        for (size_t c = 0; c < measurements.size(); ++c)
+        {
+            if (front[c] &&
+                (!anyAcceptable ||
+                 measurements[c].m_falsePositiveRate <= maxFalsePositiveRate))
+            {
+                considered.push_back(c);
+                maxBytes = (std::max)(maxBytes,
+                                      measurements[c].m_bytesPerDocument);
+                maxCacheLines = (std::max)(maxCacheLines,
+                                           measurements[c].m_cacheLines);
+            }
+        }
+
+        size_t selected = considered.front();
+        double bestScore = 0.0;
+        for (auto c : considered)
+        {
+            Measurement const & m = measurements[c];
+            const double memoryCost =
+                (maxBytes > 0.0) ? m.m_bytesPerDocument / maxBytes : 0.0;
+            const double cacheLineCost =
+                (maxCacheLines > 0.0) ? m.m_cacheLines / maxCacheLines : 0.0;
+            const double score =
+                memoryWeight * memoryCost + (1.0 - memoryWeight) * cacheLineCost;
+
+            if (c == considered.front() || score < bestScore)
+            {
+                selected = c;
+                bestScore = score;
+            }
+        }
+
+        return selected;
+    }
+
+
+    std::vector<std::string> TreatmentTuner::SplitList(char const * list)
+    {
+        std::vector<std::string> items;
+        std::stringstream input(list);
+        std::string item;
+        while (std::getline(input, item, ','))
+        {
+            if (!item.empty())
+            {
+                items.push_back(item);
+            }
+        }
+        return items;
+    }
+
+
+    double TreatmentTuner::ParseNumber(std::string const & text)
+    {
+        std::stringstream input(text);
+        double value = 0.0;
+        input >> value;
+        if (input.fail() || !input.eof())
+        {
+            throw RecoverableError("Expected a number, found '" + text + "'.");
+        }
+        return value;
+    }
+
+
+    //*************************************************************************
+    //
+    // TreatmentTuner::Measurement
+    //
+    //*************************************************************************
+    TreatmentTuner::Measurement::Measurement()
+      : m_bytesPerDocument(0.0),
+        m_quadwords(0.0),
+        m_cacheLines(0.0),
+        m_falsePositiveRate(0.0),
+        m_falseNegatives(0)
+    {
+    }
+
+
+    bool TreatmentTuner::Measurement::Dominates(Measurement const & other) const
+    {
+        const bool noWorse =
+            m_bytesPerDocument <= other.m_bytesPerDocument &&
+            m_quadwords <= other.m_quadwords &&
+            m_cacheLines <= other.m_cacheLines &&
+            m_falsePositiveRate <= other.m_falsePositiveRate;
+        const bool better =
+            m_bytesPerDocument < other.m_bytesPerDocument ||
+            m_quadwords < other.m_quadwords ||
+            m_cacheLines < other.m_cacheLines ||
+            m_falsePositiveRate < other.m_falsePositiveRate;
+        return noWorse && better;
+    }
+}
@@ -0,0 +1,141 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <iosfwd>                       // std::ostream parameter.
+#include <string>                       // std::string member.
+#include <vector>                       // std::vector member.
+
+#include "BitFunnel/BitFunnelTypes.h"   // ShardId parameter.
+#include "BitFunnel/IExecutable.h"      // Base class.
+
+
+namespace BitFunnel
+{
+    class IDocumentFrequencyTable;
+    class IFileSystem;
+
+    //*************************************************************************
+    //
+    // TreatmentTuner
+    //
+    // Searches a grid of term treatments, densities, and signal-to-noise
+    // ratios for the term table configuration of each shard that best trades
+    // memory against query cost. Each candidate is measured by ingesting a
+    // sample of the corpus into an index held in RAM and replaying a query
+    // log against it, counting quadwords, cache lines, and false positives.
+    //
+    // Shards are tuned independently. Since query costs add across shards,
+    // a candidate is measured on one shard while the other shards keep the
+    // first candidate in the grid, and the differences between candidates
+    // are attributed to that shard.
+    //
+    //*************************************************************************
+    class TreatmentTuner : public IExecutable
+    {
+    public:
+        TreatmentTuner(IFileSystem& fileSystem);
+
+        //
+        // IExecutable methods
+        //
+        virtual int Main(std::istream& input,
+                         std::ostream& output,
+                         int argc,
+                         char const *argv[]) override;
+
+    private:
+        class Candidate
+        {
+        public:
+            std::string m_treatment;
+            double m_density;
+            double m_snr;
+        };
+
+        class Measurement
+        {
+        public:
+            Measurement();
+
+            // Returns true if this measurement is no worse than other in
+            // every cost, and better in at least one.
+            bool Dominates(Measurement const & other) const;
+
+            double m_bytesPerDocument;
+            double m_quadwords;
+            double m_cacheLines;
+            double m_falsePositiveRate;
+            size_t m_falseNegatives;
+        };
+
+        // Serialized term tables and their builder statistics, indexed by
+        // shard and then by candidate.
+        class TermTables
+        {
+        public:
+            std::vector<std::vector<std::string>> m_tables;
+            std::vector<std::vector<std::string>> m_statistics;
+            std::vector<std::vector<double>> m_bytesPerDocument;
+        };
+
+        void BuildTermTables(std::ostream& output,
+                             char const * config,
+                             std::vector<Candidate> const & candidates,
+                             IDocumentFrequencyTable const & queryTerms,
+                             ShardId shardCount,
+                             TermTables & termTables) const;
+
+        // Ingests the corpus sample into an index whose shard s uses the
+        // term table built for candidate assignment[s], then replays the
+        // queries. The returned measurement reports query costs averaged
+        // over the queries, and leaves m_bytesPerDocument at zero.
+        Measurement Measure(char const * config,
+                            TermTables const & termTables,
+                            std::vector<size_t> const & assignment,
+                            std::vector<std::string> const & chunkPaths,
+                            std::vector<std::string> const & queries,
+                            size_t gramSize,
+                            size_t threadCount,
+                            size_t memory) const;
+
+        // Returns the index of the candidate on the Pareto front with the
+        // lowest weighted sum of memory and cache lines, each normalized by
+        // its minimum over the front. Candidates whose false positive rate
+        // exceeds maxFalsePositiveRate are only considered when no candidate
+        // meets it.
+        static size_t Select(std::vector<Measurement> const & measurements,
+                             std::vector<bool> const & front,
+                             double memoryWeight,
+                             double maxFalsePositiveRate);
+
+        static std::vector<std::string> SplitList(char const * list);
+        static double ParseNumber(std::string const & text);
+
+        //
+        // Constructor parameters.
+        //
+
+        IFileSystem& m_fileSystem;
+    };
+}
@@ -22,6 +22,7 @@
 
 #include <limits>
 #include <sstream>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -29,6 +30,7 @@
 #include "BitFunnel/Configuration/Factories.h"
 #include "BitFunnel/Configuration/IFileSystem.h"
 #include "BitFunnel/Data/SyntheticChunks.h"
+#include "BitFunnel/IFileManager.h"
 #include "BitFunnelTool.h"
 
 
@@ -161,4 +163,110 @@ namespace BitFunnel
                       argv.data());
         }
     }
+
+
+    TEST(BitFunnelTool, TreatmentTuner)
+    {
+        auto fileSystem = BitFunnel::Factories::CreateRAMFileSystem();
+        auto fileManager =
+            BitFunnel::Factories::CreateFileManager(
+                "config",
+                "config",
+                "config",
+                *fileSystem);
+
+        {
+            auto shardDefinition = Factories::CreateShardDefinition();
+            const double defaultDensity = 0.15;
+            shardDefinition->AddShard(0, defaultDensity);
+            shardDefinition->AddShard(32, defaultDensity);
+
+            {
+                auto out = fileManager->ShardDefinition().OpenForWrite();
+                shardDefinition->Write(*out);
+            }
+
+            SyntheticChunks chunks(*shardDefinition, 100, 5);
+
+            auto manifest = fileSystem->OpenForWrite("manifest.txt");
+            for (size_t i = 0; i < chunks.GetChunkCount(); ++i)
+            {
+                *manifest << chunks.GetChunkName(i) << std::endl;
+
+                auto out = fileSystem->OpenForWrite(chunks.GetChunkName(i).c_str());
+                chunks.WriteChunk(*out, i);
+            }
+
+            auto queries = fileSystem->OpenForWrite("queries.txt");
+            *queries << "1" << std::endl
+                     << "7" << std::endl
+                     << "32" << std::endl
+                     << "64" << std::endl;
+        }
+
+        BitFunnel::BitFunnelTool tool(*fileSystem);
+
+        {
+            std::vector<char const *> argv = {
+                "BitFunnel",
+                "statistics",
+                "manifest.txt",
+                "config",
+                "-cooccurrence"
+            };
+
+            ASSERT_EQ(0, tool.Main(std::cin,
+                                   std::cout,
+                                   static_cast<int>(argv.size()),
+                                   argv.data()));
+        }
+
+        // Sketches are only written when requested.
+        EXPECT_TRUE(fileManager->CoOccurrenceTable(0).Exists());
+
+        {
+            std::vector<char const *> argv = {
+                "BitFunnel",
+                "tune",
+                "config",
+                "manifest.txt",
+                "queries.txt",
+                "-treatments",
+                "PrivateSharedRank0,ClassicBitsliced,QueryAware",
+                "-densities",
+                "0.1",
+                "-csv",
+                "tuning.csv",
+                "-write",
+                "-threads",
+                "1"
+            };
+
+            ASSERT_EQ(0, tool.Main(std::cin,
+                                   std::cout,
+                                   static_cast<int>(argv.size()),
+                                   argv.data()));
+        }
+
+        // One header line, then one line per shard and candidate, exactly
+        // one of which is selected for each shard.
+        auto csv = fileSystem->OpenForRead("tuning.csv");
+        std::string line;
+        std::getline(*csv, line);
+        size_t rows = 0;
+        size_t selected = 0;
+        while (std::getline(*csv, line))
+        {
+            ++rows;
+            if (line.back() == '1')
+            {
+                ++selected;
+            }
+        }
+        EXPECT_EQ(6u, rows);
+        EXPECT_EQ(2u, selected);
+
+        EXPECT_TRUE(fileManager->TermTable(0).Exists());
+        EXPECT_TRUE(fileManager->TermTable(1).Exists());
+    }
 }